@@ -2,12 +2,18 @@
 
 #pragma once
 
+#include "Async/ParallelFor.h"
+#include "HAL/CriticalSection.h"
 #include "HAL/Platform.h"
+#include "HAL/ThreadSafeBool.h"
+#include "HAL/ThreadSafeCounter64.h"
 #include "Math/NumericLimits.h"
 #include "Math/UnrealMathUtility.h"
 #include "Math/Vector.h"
 #include "Math/Vector2D.h"
+#include "Math/VectorRegister.h"
 #include "Misc/AssertionMacros.h"
+#include "Misc/ScopeLock.h"
 #include "Templates/Function.h"
 #include "Templates/TypeHash.h"
 #include "Templates/UnrealTemplate.h"
@@ -66,6 +72,30 @@ namespace TreeHelper
 		return FVector{V.X, V.Y, Val};
 	}
 
+	/** spread the low bits of Value so that every Dim-th bit is used, Dim = 2: 16 bits, Dim = 3: 10 bits */
+	template<uint32 Dim>
+	static FORCEINLINE uint32 MortonSpreadBits(uint32 Value)
+	{
+		if constexpr (Dim == 2)
+		{
+			Value &= 0x0000ffff;
+			Value = (Value ^ (Value << 8)) & 0x00ff00ff;
+			Value = (Value ^ (Value << 4)) & 0x0f0f0f0f;
+			Value = (Value ^ (Value << 2)) & 0x33333333;
+			Value = (Value ^ (Value << 1)) & 0x55555555;
+		}
+		else
+		{
+			static_assert(Dim == 3, "MortonSpreadBits: Dim error");
+			Value &= 0x000003ff;
+			Value = (Value ^ (Value << 16)) & 0xff0000ff;
+			Value = (Value ^ (Value << 8)) & 0x0300f00f;
+			Value = (Value ^ (Value << 4)) & 0x030c30c3;
+			Value = (Value ^ (Value << 2)) & 0x09249249;
+		}
+		return Value;
+	}
+
 	static FORCEINLINE FBox2D ToBox2D(const FBox& InBox)
 	{
 		return FBox2D(FVector2D(InBox.Min[0], InBox.Min[1]), FVector2D(InBox.Max[0], InBox.Max[1]));
@@ -246,7 +276,7 @@ public:
 	{
 		for (int32 i = 0; i < VSpace::GetInt32; ++i)
 		{
-			if (min[i] >= BoxMax[i] && BoxMin[i] > max[i])
+			if (min[i] > BoxMax[i] || BoxMin[i] > max[i])
 			{
 				return false;
 			}
@@ -267,21 +297,27 @@ public:
 
 	FORCEINLINE operator PointType() const { return GetCenter(); }
 
-	FORCEINLINE bool SphereAABBIntersection(const PointType& SphereCenter, const Real Radius) const
+	/** 0 inside the box */
+	FORCEINLINE Real DistSquaredToPoint(const PointType& Point) const
 	{
-		Real Dist = 0.0;
+		Real DistSquared = 0.0;
 		for (int32 i = 0; i < VSpace::GetInt32; ++i)
 		{
-			if (SphereCenter[i] < min[i])
+			if (Point[i] < min[i])
 			{
-				Dist += SphereCenter[i] - min[i];
+				DistSquared += FMath::Square(Point[i] - min[i]);
 			}
-			else if (SphereCenter[i] > max[i])
+			else if (Point[i] > max[i])
 			{
-				Dist += SphereCenter[i] - max[i];
+				DistSquared += FMath::Square(Point[i] - max[i]);
 			}
 		}
-		return Dist <= Radius;
+		return DistSquared;
+	}
+
+	FORCEINLINE bool SphereAABBIntersection(const PointType& SphereCenter, const Real Radius) const
+	{
+		return DistSquaredToPoint(SphereCenter) <= FMath::Square(Radius);
 	}
 
 	FORCEINLINE operator FBox2D() const
@@ -319,6 +355,38 @@ public:
 };
 
 
+/** vertical extent of the elements of a 2D tree, Min > Max is empty, the limits are float so that the float trees can hold them */
+struct FTreeZRange
+{
+	using Real = FVector::FReal;
+	static constexpr Real Limit = TNumericLimits<float>::Max();
+
+	FTreeZRange() = default;
+	FTreeZRange(const Real InMin, const Real InMax) : Min(InMin), Max(InMax) {}
+	explicit FTreeZRange(const FBox& Box) : Min(Box.Min.Z), Max(Box.Max.Z) {}
+
+	/** default of the elements and queries that give no Z, they are never pruned by it */
+	static FTreeZRange Unbounded() { return FTreeZRange(-Limit, Limit); }
+
+	FORCEINLINE bool operator==(const FTreeZRange& Other) const { return Min == Other.Min && Max == Other.Max; }
+	FORCEINLINE bool IsIntersect(const FTreeZRange& Other) const { return Min <= Other.Max && Other.Min <= Max; }
+	FORCEINLINE bool IsInside(const FTreeZRange& Other) const { return Min <= Other.Min && Other.Max <= Max; }
+	FORCEINLINE void Add(const FTreeZRange& Other)
+	{
+		Min = FMath::Min(Min, Other.Min);
+		Max = FMath::Max(Max, Other.Max);
+	}
+
+	Real Min = Limit;
+	Real Max = -Limit;
+};
+
+/** 3D nodes split on Z, they keep no range */
+struct FTreeNoZRange
+{
+};
+
+
 /**	Tree Node */
 template<
 	typename TreeElementIdxType, // Element Idx in Element pool
@@ -362,6 +430,11 @@ public:
 		Self_ID = Other.Self_ID;
 		Parent = Other.Parent;
 		ContainsCount = Other.ContainsCount;
+		ChannelMask = Other.ChannelMask;
+		bCollapseQueued = Other.bCollapseQueued;
+		Stamp = Other.Stamp;
+		ElementsStamp = Other.ElementsStamp;
+		ZRange = Other.ZRange;
 		TreeBox = Other.TreeBox;
 		Nodes = Other.Nodes;
 		return *this;
@@ -372,6 +445,16 @@ public:
 	IndexQtType Parent = MaxIndexQt;
 
 	int32 ContainsCount = 0;
+	/** OR of the element masks in the node and its subtree, queries skip the subtree when it misses their mask */
+	uint64 ChannelMask = 0;
+	/** in TTree_Base::CollapseQueue */
+	bool bCollapseQueued = false;
+	/** TTree_Base::ModStamp of the last insert, remove or element change in the node and its subtree */
+	uint64 Stamp = 0;
+	/** as Stamp for the elements in the node, a collapsed node takes the Stamp of its children */
+	uint64 ElementsStamp = 0;
+	/** 2D node: Z range of the elements in the node and its subtree, queries skip the subtree when it misses theirs */
+	typename TChooseClass<VectorSpace == 2U, FTreeZRange, FTreeNoZRange>::Result ZRange;
 	BoxType TreeBox;
 	TArray<ElementNodeType, TInlineAllocator<InlineNodeNum>> Nodes; // 16 + InlineAllocator aligned
 
@@ -485,6 +568,41 @@ public:
 };
 
 
+/** restructure counters are written under the tree write lock, query counters by the concurrent readers */
+struct FTreeCounters
+{
+	uint64 Splits = 0;
+	uint64 Collapses = 0;
+	uint64 Reinserts = 0;
+	FThreadSafeCounter64 Queries;
+	FThreadSafeCounter64 VisitedNodes;
+	FThreadSafeCounter64 VisitedElements;
+
+	/** the query counters are three shared atomic adds per query, counted only while read, set per tree by USenseManager each tick */
+	FThreadSafeBool bCountQueries = false;
+
+	FORCEINLINE void AddQuery(const int32 NodeNum, const int32 ElementNum)
+	{
+		if (bCountQueries)
+		{
+			Queries.Increment();
+			VisitedNodes.Add(NodeNum);
+			VisitedElements.Add(ElementNum);
+		}
+	}
+
+	void Reset()
+	{
+		Splits = 0;
+		Collapses = 0;
+		Reinserts = 0;
+		Queries.Reset();
+		VisitedNodes.Reset();
+		VisitedElements.Reset();
+	}
+};
+
+
 /** Tree Base */
 template<
 	typename ElementType,			   //
@@ -516,6 +634,9 @@ public:
 
 	static constexpr int32 SubNodesNum = VSpace::SubTravelNum();
 
+	/** BulkInsert and UpdateBatch with fewer elements stay on the calling thread */
+	static constexpr int32 ParallelBatchMinNum = 2048;
+
 private:
 	/** Tree Data */
 	struct TreeIdxBox
@@ -530,33 +651,83 @@ private:
 	using VectorOrBox = typename TChooseClass<bElementVector, PointType, BoxType>::Result;
 	using TreeData = typename TChooseClass<bElementVector, IndexQtType, TreeIdxBox>::Result;
 
+	/** 2D box trees keep the element Z range as a third ElementBounds axis and a Z range per node */
+	static constexpr bool bTrackZ = VSpace::Size == 2 && !bElementVector;
+	static constexpr int32 BoundsAxes = bTrackZ ? 3 : VSpace::Size;
+	static constexpr int32 ZAxis = 2;
+
 
 public:
 	explicit TTree_Base(
 		const Real InMinimumQuadSize = 100.f,
 		const int32 InNodeCantSplit = SubNodesNum,
 		const int32 TreePoolSize = 256,
-		const int32 CompPoolSize = 256)
+		const int32 CompPoolSize = 256,
+		const Real InLooseFactor = 1.f)
 		: Root(MaxIndexQt)
 		, MinimumQuadSize(InMinimumQuadSize)
 		, SplitTolerance(InMinimumQuadSize * 1.5f)
 		, NodeCantSplit(InNodeCantSplit)
+		, LooseFactor(FMath::Max<Real>(InLooseFactor, 1.f))
+		, bLooseTree(!bElementVector && LooseFactor > 1.f)
 	{
 		Pool.Reserve(TreePoolSize);
 		ElementPool.Reserve(CompPoolSize);
 		Data.Reserve(CompPoolSize);
+		IF_CONSTEXPR(!bElementVector)
+		{
+			ElementBounds.Reserve(CompPoolSize);
+			ElementMasks.Reserve(CompPoolSize);
+		}
 	}
 
 protected:
 	IndexQtType Root = MaxIndexQt;
-	const Real MinimumQuadSize;
-	const Real SplitTolerance;
-	const int32 NodeCantSplit;
+	/** set by the constructor and Rebuild */
+	Real MinimumQuadSize;
+	Real SplitTolerance;
+	int32 NodeCantSplit;
+
+	/** loose tree: node accepts elements inside TreeBox scaled by LooseFactor around its center, 1 = strict tree */
+	const Real LooseFactor;
+	const bool bLooseTree;
 
 	TSparseArray<TreeNodeType> Pool;
 	TSparseArray<TreeData> Data;
 	TSparseArray<ElementType> ElementPool;
 
+	/** copy of the Data boxes indexed by ObjID, read by the vectorized leaf test, 2D trees add the element Z range */
+	struct FElementBounds
+	{
+		Real Min[BoundsAxes];
+		Real Max[BoundsAxes];
+	};
+	TArray<FElementBounds> ElementBounds;
+	/** per element mask indexed by ObjID, set by Insert and SetElementMask */
+	TArray<uint64> ElementMasks;
+
+	/** nodes that fell to NodeCantSplit or below, collapsed by CollapseQueued */
+	TArray<IndexQtType> CollapseQueue;
+	/** root may have a single filled child after a remove or a root extend */
+	bool bRootCollapseDirty = false;
+
+	mutable FTreeCounters Counters;
+
+	/** advanced by every change of the elements, never reset, see IsChangedSince */
+	uint64 ModStamp = 0;
+	/** changes no node keeps: Clear, Compact and the nodes dropped by CollapseRoot, every region changed since it */
+	uint64 DropStamp = 0;
+
+	/** node allocation of the BulkInsert sub tree tasks */
+	struct FParallelBulk
+	{
+		FCriticalSection NodeLock;
+		/** leaves that found no reserved node slot, split after the tasks */
+		TArray<IndexQtType> Unsplit;
+	};
+	/** set while the BulkInsert sub trees run in ParallelFor */
+	FParallelBulk* ParallelBulk = nullptr;
+
 public:
 	FORCEINLINE bool IsValidTreeIdx(IndexQtType TreeIdx) const { return TreeIdx != MaxIndexQt; }
 	FORCEINLINE const BoxType& GetTreeBox(IndexQtType TreeIdx) const { return Pool[static_cast<int32>(TreeIdx)].GetTreeBox(); }
@@ -568,9 +739,116 @@ public:
 	FORCEINLINE const BoxType& GetRootBox() const { return GetTreeBox(GetRoot()); }
 	FORCEINLINE BoxType GetRootBox() { return GetTreeBox(GetRoot()); }
 
+	FORCEINLINE bool IsLooseTree() const { return bLooseTree; }
+	FORCEINLINE Real GetLooseFactor() const { return LooseFactor; }
+
+	FORCEINLINE BoxType GetLooseTreeBox(const TreeNodeType& Node) const
+	{
+		const BoxType& Box = Node.GetTreeBox();
+		return BoxType::BuildAABB(Box.GetCenter(), Box.GetExtent() * LooseFactor);
+	}
+
+	/** node acceptance region: TreeBox for the strict tree, inflated TreeBox for the loose one */
+	FORCEINLINE bool IsInsideNode(const TreeNodeType& Node, const VectorOrBox& InBox) const
+	{
+		return bLooseTree ? GetLooseTreeBox(Node).IsInside(InBox) : Node.IsInside(InBox);
+	}
+	FORCEINLINE bool IsIntersectNode(const TreeNodeType& Node, const BoxType& InBox) const
+	{
+		return bLooseTree ? GetLooseTreeBox(Node).IsIntersect(InBox) : Node.IsIntersect(InBox);
+	}
+
 	FORCEINLINE TSparseArray<ElementType>& GetElementPool() { return ElementPool; }
 	FORCEINLINE const TSparseArray<ElementType>& GetElementPool() const { return ElementPool; }
 	FORCEINLINE int32 NumElements() { return ElementPool.Num(); }
+	FORCEINLINE int32 NumElements() const { return ElementPool.Num(); }
+
+	FORCEINLINE const FTreeCounters& GetCounters() const { return Counters; }
+	FORCEINLINE void ResetCounters() { Counters.Reset(); }
+	FORCEINLINE void SetQueryCounting(const bool bCount) { Counters.bCountQueries = bCount; }
+
+	/** stamp of the last element change, kept by the caller with a query result for IsChangedSince */
+	FORCEINLINE uint64 GetModStamp() const { return ModStamp; }
+
+	/**
+	 * true if an element that can touch Box was inserted, removed, moved or got a new mask or Z range after Stamp,
+	 * a query result taken at Stamp is still valid when false. Walks only the nodes changed since Stamp.
+	 */
+	bool IsChangedSince(const BoxType& Box, const uint64 Stamp) const
+	{
+		if (DropStamp > Stamp)
+		{
+			return true;
+		}
+		if (!IsValidRoot() || Pool[Root].Stamp <= Stamp)
+		{
+			return false;
+		}
+		TArray<IndexQtType, TInlineAllocator<64>> Stack;
+		Stack.Add(Root);
+		while (Stack.Num())
+		{
+			const TreeNodeType& SelfNode = Pool[static_cast<int32>(Stack.Pop(false))];
+			if (SelfNode.Stamp <= Stamp || !IsIntersectNode(SelfNode, Box))
+			{
+				continue;
+			}
+			if (SelfNode.ElementsStamp > Stamp)
+			{
+				return true;
+			}
+			for (const IndexQtType SubNode : SelfNode.SubNodes)
+			{
+				if (SubNode != MaxIndexQt)
+				{
+					Stack.Add(SubNode);
+				}
+			}
+		}
+		return false;
+	}
+
+	/** node pool with the element lists that outgrew the node inline allocation */
+	SIZE_T GetPoolAllocatedSize() const
+	{
+		SIZE_T Out = Pool.GetAllocatedSize();
+		for (const TreeNodeType& Node : Pool)
+		{
+			Out += Node.Nodes.GetAllocatedSize();
+		}
+		return Out;
+	}
+	/** tree ID and box per element with the copies read by the leaf test */
+	FORCEINLINE SIZE_T GetDataAllocatedSize() const { return Data.GetAllocatedSize() + ElementBounds.GetAllocatedSize() + ElementMasks.GetAllocatedSize(); }
+	FORCEINLINE SIZE_T GetElementPoolAllocatedSize() const { return ElementPool.GetAllocatedSize(); }
+
+	/** NodeLambda(const TreeNodeType& Node, int32 Depth) for the nodes under the root, parents first */
+	template<typename NodeLambdaType>
+	void ForEachNode(NodeLambdaType NodeLambda) const
+	{
+		if (!IsValidRoot())
+		{
+			return;
+		}
+		TArray<TPair<IndexQtType, int32>, TInlineAllocator<64>> Stack;
+		Stack.Add(TPair<IndexQtType, int32>(Root, 0));
+		while (Stack.Num())
+		{
+			const TPair<IndexQtType, int32> It = Stack.Pop(false);
+			const TreeNodeType& SelfNode = Pool[static_cast<int32>(It.Key)];
+			NodeLambda(SelfNode, It.Value);
+			if (!SelfNode.IsLeaf())
+			{
+				for (const IndexQtType SubNode : SelfNode.SubNodes)
+				{
+					if (SubNode != MaxIndexQt)
+					{
+						Stack.Add(TPair<IndexQtType, int32>(SubNode, It.Value + 1));
+					}
+				}
+			}
+		}
+	}
 
 	FORCEINLINE const ElementType& GetElement(const TreeElementIdxType ObjID) const { return GetElementPool()[static_cast<int32>(ObjID)]; }
 	FORCEINLINE ElementType& GetElement(const TreeElementIdxType ObjID) { return GetElementPool()[static_cast<int32>(ObjID)]; }
@@ -619,18 +897,124 @@ public:
 	{
 		return Data[static_cast<int32>(ObjID)].TreeID;
 	}
+
+	/** mask tested against FElementQuery::Mask, the caller keeps it in sync with the element, node masks above it are refreshed */
+	template<typename T = ElementType>
+	std::enable_if_t<!std::is_same_v<T, PointType>, void> SetElementMask(const TreeElementIdxType ObjID, const uint64 Mask)
+	{
+		uint64& ElemMask = ElementMasks[static_cast<int32>(ObjID)];
+		if (ElemMask != Mask)
+		{
+			ElemMask = Mask;
+			++ModStamp;
+			StampNode(GetElementTreeID(ObjID));
+			RefreshNodeFilter_Up(GetElementTreeID(ObjID));
+		}
+	}
+	template<typename T = ElementType>
+	FORCEINLINE std::enable_if_t<!std::is_same_v<T, PointType>, uint64> GetElementMask(const TreeElementIdxType ObjID) const
+	{
+		return ElementMasks[static_cast<int32>(ObjID)];
+	}
+
+	/**
+	 * Z range of a 2D tree element, Insert and BulkInsert take the first one.
+	 * Nodes above it grow to hold a wider range, a range that left the edge of its node recomputes the nodes up.
+	 */
+	template<typename T = ElementType>
+	std::enable_if_t<!std::is_same_v<T, PointType>, void> SetElementZ(const TreeElementIdxType ObjID, const FTreeZRange& Z)
+	{
+		static_assert(bTrackZ, "SetElementZ: the 3D tree splits on Z");
+
+		FElementBounds& Bounds = ElementBounds[static_cast<int32>(ObjID)];
+		const FTreeZRange Old(Bounds.Min[ZAxis], Bounds.Max[ZAxis]);
+		Bounds.Min[ZAxis] = static_cast<Real>(Z.Min);
+		Bounds.Max[ZAxis] = static_cast<Real>(Z.Max);
+		const FTreeZRange New(Bounds.Min[ZAxis], Bounds.Max[ZAxis]);
+		if (Old == New)
+		{
+			return;
+		}
+
+		IndexQtType Self_ID = GetElementTreeID(ObjID);
+		++ModStamp;
+		StampNode(Self_ID);
+		const FTreeZRange& NodeZ = Pool[Self_ID].ZRange;
+		if (Old.Min <= NodeZ.Min || Old.Max >= NodeZ.Max)
+		{
+			RefreshNodeFilter_Up(Self_ID);
+			return;
+		}
+		// parents hold the ranges of their children, the first node that holds Z ends the walk
+		while (Self_ID != MaxIndexQt && !Pool[Self_ID].ZRange.IsInside(New))
+		{
+			Pool[Self_ID].ZRange.Add(New);
+			Self_ID = Pool[Self_ID].Parent;
+		}
+	}
 	// end element
 
 private:
 	template<typename T = ElementType>
-	FORCEINLINE std::enable_if_t<std::is_same_v<T, PointType>, void> InsertNewData(const TreeElementIdxType ObjID, const PointType&)
+	FORCEINLINE std::enable_if_t<std::is_same_v<T, PointType>, void> InsertNewData(const TreeElementIdxType ObjID, const PointType&, uint64, const FTreeZRange&)
 	{
 		Data.Insert(static_cast<int32>(ObjID), MaxIndexQt);
 	}
 	template<typename T = ElementType>
-	FORCEINLINE std::enable_if_t<!std::is_same_v<T, PointType>, void> InsertNewData(const TreeElementIdxType ObjID, const BoxType& InBox)
+	FORCEINLINE std::enable_if_t<!std::is_same_v<T, PointType>, void> InsertNewData(const TreeElementIdxType ObjID, const BoxType& InBox, const uint64 Mask, const FTreeZRange& Z)
 	{
 		Data.Insert(static_cast<int32>(ObjID), TreeData(MaxIndexQt, InBox));
+
+		if (ElementBounds.Num() <= static_cast<int32>(ObjID))
+		{
+			const int32 NewNum = FMath::Max(ElementPool.GetMaxIndex(), static_cast<int32>(ObjID) + 1);
+			ElementBounds.SetNumUninitialized(NewNum);
+			ElementMasks.SetNumUninitialized(NewNum);
+		}
+		SetElementBounds(ObjID, InBox);
+		IF_CONSTEXPR(bTrackZ)
+		{
+			ElementBounds[static_cast<int32>(ObjID)].Min[ZAxis] = static_cast<Real>(Z.Min);
+			ElementBounds[static_cast<int32>(ObjID)].Max[ZAxis] = static_cast<Real>(Z.Max);
+		}
+		ElementMasks[static_cast<int32>(ObjID)] = Mask;
+	}
+
+	/** unbounded for the trees that keep no element Z */
+	FORCEINLINE FTreeZRange GetElementZ(const TreeElementIdxType ObjID) const
+	{
+		IF_CONSTEXPR(bTrackZ)
+		{
+			const FElementBounds& Bounds = ElementBounds[static_cast<int32>(ObjID)];
+			return FTreeZRange(Bounds.Min[ZAxis], Bounds.Max[ZAxis]);
+		}
+		else
+		{
+			return FTreeZRange::Unbounded();
+		}
+	}
+
+	/** element vector trees have no masks, every node matches */
+	FORCEINLINE uint64 GetElementChannelMask(const TreeElementIdxType ObjID) const
+	{
+		IF_CONSTEXPR(bElementVector)
+		{
+			return MAX_uint64;
+		}
+		else
+		{
+			return ElementMasks[static_cast<int32>(ObjID)];
+		}
+	}
+
+	FORCEINLINE void SetElementBounds(const TreeElementIdxType ObjID, const BoxType& InBox)
+	{
+		FElementBounds& Bounds = ElementBounds[static_cast<int32>(ObjID)];
+		for (int32 i = 0; i < VSpace::GetInt32; ++i)
+		{
+			Bounds.Min[i] = InBox.min[i];
+			Bounds.Max[i] = InBox.max[i];
+		}
 	}
 
 	template<typename T = ElementType>
@@ -670,11 +1054,12 @@ public:
 	}
 	*/
 
-	TreeElementIdxType Insert(const ElementType& Element, VectorOrBox InBox)
+	/** Z - vertical extent of a 2D tree element, see SetElementZ */
+	TreeElementIdxType Insert(const ElementType& Element, VectorOrBox InBox, const uint64 Mask = MAX_uint64, const FTreeZRange& Z = FTreeZRange::Unbounded())
 	{
 		const int32 ResIdx = ElementPool.Add(Element);
 		const TreeElementIdxType ObjID = ResIdx;
-		InsertNewData(ObjID, InBox);
+		InsertNewData(ObjID, InBox, Mask, Z);
 
 		checkSlow(GetElement(ObjID) == Element);
 
@@ -685,21 +1070,23 @@ public:
 		}
 
 		bool bNewRoot = false;
-		if (!GetRootBox().IsInside(InBox))
+		if (!IsInsideNode(Pool[Root], InBox))
 		{
 			Root = ExtendToParent(Root, InBox);
 			bNewRoot = true;
 		}
 
-		checkSlow(GetRootBox().IsInside(InBox));
+		checkSlow(IsInsideNode(Pool[Root], InBox));
 
 		const IndexQtType NewOtID = Insert_Internal(Root, ObjID, InBox);
 		IndexQtType& QtID_Ref = GetElementTreeID(ObjID);
 		QtID_Ref = NewOtID; //update current
+		++ModStamp;
+		StampNode(NewOtID);
 
 		if (bNewRoot)
 		{
-			CollapseQt(true);
+			bRootCollapseDirty = true;
 		}
 
 #if WITH_EDITOR
@@ -708,11 +1095,11 @@ public:
 
 		return ObjID;
 	}
-	TreeElementIdxType Insert(ElementType&& Element, VectorOrBox InBox)
+	TreeElementIdxType Insert(ElementType&& Element, VectorOrBox InBox, const uint64 Mask = MAX_uint64, const FTreeZRange& Z = FTreeZRange::Unbounded())
 	{
 		const int32 ResIdx = ElementPool.Add(MoveTemp(Element));
 		const TreeElementIdxType ObjID = ResIdx;
-		InsertNewData(ObjID, InBox);
+		InsertNewData(ObjID, InBox, Mask, Z);
 
 		if (!IsValidRoot())
 		{
@@ -721,21 +1108,23 @@ public:
 		}
 
 		bool bNewRoot = false;
-		if (!GetRootBox().IsInside(InBox))
+		if (!IsInsideNode(Pool[Root], InBox))
 		{
 			Root = ExtendToParent(Root, InBox);
 			bNewRoot = true;
 		}
 
-		checkSlow(GetRootBox().IsInside(InBox));
+		checkSlow(IsInsideNode(Pool[Root], InBox));
 
 		const IndexQtType NewOtID = Insert_Internal(Root, ObjID, InBox);
 		IndexQtType& QtID_Ref = GetElementTreeID(ObjID);
 		QtID_Ref = NewOtID; //update current
+		++ModStamp;
+		StampNode(NewOtID);
 
 		if (bNewRoot)
 		{
-			CollapseQt(true);
+			bRootCollapseDirty = true;
 		}
 
 #if WITH_EDITOR
@@ -745,6 +1134,178 @@ public:
 		return ObjID;
 	}
 
+	/**
+	 * Insert many elements in one pass, OutIDs[i] is the ObjID of Elements[i].
+	 * Elements are added in Morton order of their centers and distributed down the tree level by level,
+	 * each node is split once for the whole batch instead of once per NodeCantSplit inserts.
+	 * From ParallelBatchMinNum elements the sub trees of the root children are filled in ParallelFor.
+	 * InMasks[i] is the mask of Elements[i], all MAX_uint64 when null, InZ[i] its Z range in a 2D tree, unbounded when null.
+	 */
+	void BulkInsert(
+		TArray<ElementType>&& Elements,
+		const TArray<VectorOrBox>& InBoxes,
+		TArray<TreeElementIdxType>& OutIDs,
+		const uint64* InMasks = nullptr,
+		const FTreeZRange* InZ = nullptr)
+	{
+		check(Elements.Num() == InBoxes.Num());
+
+		const int32 Count = InBoxes.Num();
+		OutIDs.SetNumUninitialized(Count);
+		if (Count == 0)
+		{
+			return;
+		}
+
+		BoxType Bounds = BoxType(InBoxes[0]);
+		{
+			Real* const RESTRICT Mi = reinterpret_cast<Real*>(&Bounds.min);
+			Real* const RESTRICT Ma = reinterpret_cast<Real*>(&Bounds.max);
+			for (int32 i = 1; i < Count; ++i)
+			{
+				const BoxType Box = BoxType(InBoxes[i]);
+				for (int32 j = 0; j < VSpace::GetInt32; ++j)
+				{
+					Mi[j] = FMath::Min(Mi[j], Box.min[j]);
+					Ma[j] = FMath::Max(Ma[j], Box.max[j]);
+				}
+			}
+			Bounds.Center = (Bounds.min + Bounds.max) / 2;
+		}
+
+		struct FMortonIdx
+		{
+			uint32 Code;
+			int32 Idx;
+		};
+		TArray<FMortonIdx> Order;
+		Order.SetNumUninitialized(Count);
+		{
+			constexpr uint32 AxisBits = 32 / VSpace::Size;
+			constexpr Real AxisCells = static_cast<Real>((1U << AxisBits) - 1U);
+			const PointType Size = Bounds.GetSize();
+			ParallelFor(
+				Count,
+				[&](const int32 i)
+				{
+					const PointType Center = PointType(InBoxes[i]);
+					uint32 Code = 0;
+					for (int32 j = 0; j < VSpace::GetInt32; ++j)
+					{
+						const Real Cell = Size[j] > 0.f ? (Center[j] - Bounds.min[j]) / Size[j] * AxisCells : 0.f;
+						Code |= MortonSpreadBits<VSpace::Size>(static_cast<uint32>(FMath::Clamp<Real>(Cell, 0.f, AxisCells))) << j;
+					}
+					Order[i] = FMortonIdx{Code, i};
+				},
+				Count < ParallelBatchMinNum);
+			Order.Sort([](const FMortonIdx& A, const FMortonIdx& B) { return A.Code < B.Code; });
+		}
+
+		TArray<TreeElementIdxType> IDs;
+		IDs.SetNumUninitialized(Count);
+		ElementPool.Reserve(ElementPool.Num() + Count);
+		Data.Reserve(Data.Num() + Count);
+		for (int32 i = 0; i < Count; ++i)
+		{
+			const int32 SrcIdx = Order[i].Idx;
+			const TreeElementIdxType ObjID = ElementPool.Add(MoveTemp(Elements[SrcIdx]));
+			InsertNewData(ObjID, InBoxes[SrcIdx], InMasks ? InMasks[SrcIdx] : MAX_uint64, InZ ? InZ[SrcIdx] : FTreeZRange::Unbounded());
+			IDs[i] = ObjID;
+			OutIDs[SrcIdx] = ObjID;
+		}
+		Elements.Reset();
+
+		BulkInsertIDs_Internal(IDs, Bounds);
+	}
+
+	/**
+	 * New split parameters for the elements in the tree, the nodes are built again by the BulkInsert pass.
+	 * ObjIDs, boxes and masks stay as they are, every region counts as changed for IsChangedSince.
+	 */
+	void Rebuild(const Real InMinimumQuadSize, const int32 InNodeCantSplit)
+	{
+		MinimumQuadSize = InMinimumQuadSize;
+		SplitTolerance = InMinimumQuadSize * 1.5f;
+		NodeCantSplit = InNodeCantSplit;
+
+		Pool.Empty();
+		Root = MaxIndexQt;
+		CollapseQueue.Empty();
+		bRootCollapseDirty = false;
+		DropStamp = ++ModStamp;
+
+		// Data and not ElementPool, a CopyForRebuild copy has no elements
+		const int32 Count = Data.Num();
+		if (Count == 0)
+		{
+			return;
+		}
+		TArray<TreeElementIdxType> IDs;
+		IDs.Reserve(Count);
+		BoxType Bounds;
+		for (auto It = Data.CreateConstIterator(); It; ++It)
+		{
+			const TreeElementIdxType ObjID = static_cast<TreeElementIdxType>(It.GetIndex());
+			const BoxType Box = BoxType(GetElementBox(ObjID));
+			if (IDs.Num() == 0)
+			{
+				Bounds = Box;
+			}
+			else
+			{
+				for (int32 j = 0; j < VSpace::GetInt32; ++j)
+				{
+					Bounds.min[j] = FMath::Min(Bounds.min[j], Box.min[j]);
+					Bounds.max[j] = FMath::Max(Bounds.max[j], Box.max[j]);
+				}
+			}
+			IDs.Add(ObjID);
+		}
+		Bounds.Center = (Bounds.min + Bounds.max) / 2;
+
+		BulkInsertIDs_Internal(IDs, Bounds);
+	}
+
+	/**
+	 * Boxes, masks and stamps of Other without its elements and nodes, Rebuild on the copy runs without Other's lock.
+	 * The tree must be made with Other's LooseFactor, TakeRebuiltNodes moves the result back.
+	 */
+	void CopyForRebuild(const TTree_Base& Other)
+	{
+		check(LooseFactor == Other.LooseFactor);
+		Clear();
+		Data = Other.Data;
+		ElementBounds = Other.ElementBounds;
+		ElementMasks = Other.ElementMasks;
+		ModStamp = Other.ModStamp;
+		DropStamp = Other.DropStamp;
+	}
+
+	/** nodes and split parameters of a rebuilt CopyForRebuild copy, false and nothing moved if the elements changed since the copy */
+	bool TakeRebuiltNodes(TTree_Base&& Built)
+	{
+		// Rebuild advances the stamp of the copy once for the drop
+		if (Built.DropStamp != ModStamp + 1)
+		{
+			return false;
+		}
+		MinimumQuadSize = Built.MinimumQuadSize;
+		SplitTolerance = Built.SplitTolerance;
+		NodeCantSplit = Built.NodeCantSplit;
+		Pool = MoveTemp(Built.Pool);
+		Data = MoveTemp(Built.Data);
+		Root = Built.Root;
+		CollapseQueue = MoveTemp(Built.CollapseQueue);
+		bRootCollapseDirty = Built.bRootCollapseDirty;
+		ModStamp = Built.ModStamp;
+		DropStamp = Built.DropStamp;
+		Built.Clear();
+		return true;
+	}
+
+	FORCEINLINE Real GetMinimumQuadSize() const { return MinimumQuadSize; }
+	FORCEINLINE int32 GetNodeCantSplit() const { return NodeCantSplit; }
+
 
 	void Update(const TreeElementIdxType ObjID, const VectorOrBox New)
 	{
@@ -761,47 +1322,127 @@ public:
 			check(QtID != MaxIndexQt);
 #endif
 			check(Pool[QtID].Num());
+			++ModStamp;
+			StampNode(QtID);
 
-			const auto& TreeCell = Pool[QtID];
-			if (!TreeCell.IsInside(New) || (!TreeCell.IsLeaf() && TreeCell.GetByQuadName(TreeCell.GetQuad(New)) != MaxIndexQt))
+			if (IsLeavingNode(Pool[QtID], New))
 			{
-				check(GetRootBox().IsInside(Old));
+				check(IsInsideNode(Pool[Root], Old));
 
-				if (!Pool[Root].IsInside(New))
+				if (!IsInsideNode(Pool[Root], New))
 				{
 					Root = ExtendToParent(Root, New);
 					checkSlow(IsValidRoot());
-					checkSlow(GetRootBox().IsInside(New));
+					checkSlow(IsInsideNode(Pool[Root], New));
 					checkSlow(GetElementBox(QtID).IsInside(GetElement(ObjID)));
 				}
 
 				const IndexQtType NewQtID = UpdateFromDown_Internal(QtID, ObjID, New, Old);
 				IndexQtType& QtID_Ref = GetElementTreeID(ObjID);
 				QtID_Ref = NewQtID; //update current
+				++Counters.Reinserts;
 			}
 			GetElementBox(ObjID) = New;
+			IF_CONSTEXPR(!bElementVector)
+			{
+				SetElementBounds(ObjID, New);
+			}
+			StampNode(GetElementTreeID(ObjID));
 
 #if WITH_EDITOR
 			const IndexQtType CheckQtID = GetElementTreeID(ObjID);
 			const auto& Check = GetElementBox(ObjID);
 			check(CheckQtID != MaxIndexQt);
 			check(Check == New);
-			check(GetTreeBox(CheckQtID).IsInside(Check));
+			check(IsInsideNode(Pool[CheckQtID], Check));
 			check(CheckNum(Root));
 #endif
 		}
 	}
 
+	/**
+	 * Update for many elements, the last box of an ObjID wins.
+	 * From ParallelBatchMinNum elements the moves that stay in their node are written in ParallelFor,
+	 * the ones that leave it are reinserted by Update on the calling thread.
+	 */
+	void UpdateBatch(const TreeElementIdxType* ObjIDs, const VectorOrBox* NewBoxes, const int32 Num)
+	{
+		if (Num < ParallelBatchMinNum)
+		{
+			for (int32 i = 0; i < Num; ++i)
+			{
+				Update(ObjIDs[i], NewBoxes[i]);
+			}
+			return;
+		}
+		check(IsValidRoot());
+
+		// the tasks write the element data of their item only, an ObjID is kept once
+		TBitArray<> Seen(false, ElementPool.GetMaxIndex());
+		TArray<int32> Items;
+		Items.Reserve(Num);
+		for (int32 i = Num - 1; i >= 0; --i)
+		{
+			const int32 ObjID = static_cast<int32>(ObjIDs[i]);
+			if (!Seen[ObjID])
+			{
+				Seen[ObjID] = true;
+				Items.Add(i);
+			}
+		}
+
+		// 1 - leaves its node, 2 - moved inside it
+		TArray<uint8> Leaving;
+		Leaving.SetNumZeroed(Items.Num());
+		ParallelFor(
+			Items.Num(),
+			[&](const int32 k)
+			{
+				const TreeElementIdxType ObjID = ObjIDs[Items[k]];
+				const VectorOrBox& New = NewBoxes[Items[k]];
+				if (GetElementBox(ObjID) == New)
+				{
+					return;
+				}
+				if (IsLeavingNode(Pool[GetElementTreeID(ObjID)], New))
+				{
+					Leaving[k] = 1;
+					return;
+				}
+				GetElementBox(ObjID) = New;
+				IF_CONSTEXPR(!bElementVector)
+				{
+					SetElementBounds(ObjID, New);
+				}
+				Leaving[k] = 2;
+			});
+
+		++ModStamp;
+		for (int32 k = Items.Num() - 1; k >= 0; --k)
+		{
+			if (Leaving[k] == 1)
+			{
+				Update(ObjIDs[Items[k]], NewBoxes[Items[k]]);
+			}
+			else if (Leaving[k] == 2)
+			{
+				StampNode(GetElementTreeID(ObjIDs[Items[k]]));
+			}
+		}
+	}
+
 	void Remove(const TreeElementIdxType ObjID)
 	{
 		check(IsValidRoot());
 		check(ObjID != TNumericLimits<TreeElementIdxType>::Max());
 
 #if WITH_EDITOR
-		check(GetRootBox().IsInside(GetElementBox(ObjID)));
+		check(IsInsideNode(Pool[Root], GetElementBox(ObjID)));
 #endif
 
 		const IndexQtType QtID = GetElementTreeID(ObjID);
+		++ModStamp;
+		StampNode(QtID);
 		Remove_Internal(QtID, ObjID);
 
 		Data.RemoveAt(static_cast<int32>(ObjID));
@@ -817,20 +1458,19 @@ public:
 		ElementPool.Empty();
 		Data.Empty();
 		Pool.Empty();
+		ElementBounds.Empty();
+		ElementMasks.Empty();
+		CollapseQueue.Empty();
+		bRootCollapseDirty = false;
+		Root = MaxIndexQt;
+		DropStamp = ++ModStamp;
 	}
 
 	void CollapseQt(const bool bWithSubTree = true)
 	{
 		if (Root != MaxIndexQt)
 		{
-			const IndexQtType NewRootQuadTree = CheckCollapseParentDown_Recursive(Root);
-			if (NewRootQuadTree != Root)
-			{
-				DetachFromParent(NewRootQuadTree);
-				Empty(Root);
-				Pool.RemoveAt(Root);
-				Root = NewRootQuadTree;
-			}
+			CollapseRoot();
 
 			if (bWithSubTree)
 			{
@@ -843,21 +1483,196 @@ public:
 		}
 	}
 
-	int32 NumElements_Recursive(const IndexQtType Self_ID) const
+	/**
+	 * Collapse up to Budget queued nodes, the cost follows the removes since the last call instead of the tree size.
+	 * Returns the number of queue entries taken, 0 on a tree without removes.
+	 */
+	int32 CollapseQueued(const int32 Budget)
 	{
-		int32 Out = 0;
-		NumElements_Recursive(Self_ID, Out);
-		return Out;
-	}
+		if (bRootCollapseDirty)
+		{
+			bRootCollapseDirty = false;
+			CollapseRoot();
+		}
 
-	IndexQtType GetMaxIntersect(const BoxType Box) const
-	{
-		if (IsValidRoot() && GetRootBox().IsIntersect(Box))
+		const int32 Num = FMath::Min(Budget, CollapseQueue.Num());
+		for (int32 i = 0; i < Num; ++i)
 		{
-			const IndexQtType MaxIntersect = GetMaxIntersectTree_Internal(Root, Box);
-			if (MaxIntersect != TNumericLimits<IndexQtType>::Max())
+			const IndexQtType Self_ID = CollapseQueue.Pop(false);
+			// the node may be gone or reused since it was queued, only the current state is collapsed
+			if (!Pool.IsValidIndex(Self_ID))
 			{
-				return MaxIntersect;
+				continue;
+			}
+			Pool[Self_ID].bCollapseQueued = false;
+			if (!Pool[Self_ID].IsLeaf() && Pool[Self_ID].Num() <= NodeCantSplit)
+			{
+				CollectChildTreesToSelf_Recursive(Self_ID);
+			}
+		}
+		if (CollapseQueue.Num() == 0 && CollapseQueue.Max() > 64)
+		{
+			CollapseQueue.Empty(64);
+		}
+
+#if WITH_EDITOR
+		checkSlow(!IsValidRoot() || CheckNum(Root));
+#endif
+		return Num;
+	}
+
+	FORCEINLINE bool IsCollapseQueued() const { return bRootCollapseDirty || CollapseQueue.Num() != 0; }
+
+	/**
+	 * Repack the node and element pools without free slots, nodes are renumbered in preorder
+	 * and elements in the order of their nodes, so a leaf reads its elements from one run of the pool.
+	 * OutRemap[OldObjID] is the new ObjID, Max for a free slot.
+	 */
+	void Compact(TArray<TreeElementIdxType>& OutRemap)
+	{
+		constexpr TreeElementIdxType MaxElementIdx = TNumericLimits<TreeElementIdxType>::Max();
+		OutRemap.Init(MaxElementIdx, ElementPool.GetMaxIndex());
+
+		TArray<IndexQtType> NodeRemap;
+		NodeRemap.Init(MaxIndexQt, Pool.GetMaxIndex());
+		TArray<IndexQtType> NodeOrder;
+		NodeOrder.Reserve(Pool.Num());
+		TArray<int32> ElementOrder;
+		ElementOrder.Reserve(ElementPool.Num());
+
+		if (IsValidRoot())
+		{
+			TArray<IndexQtType, TInlineAllocator<64>> Stack;
+			Stack.Add(Root);
+			while (Stack.Num())
+			{
+				const IndexQtType Self_ID = Stack.Pop(false);
+				NodeRemap[static_cast<int32>(Self_ID)] = static_cast<IndexQtType>(NodeOrder.Add(Self_ID));
+
+				const TreeNodeType& SelfNode = Pool[static_cast<int32>(Self_ID)];
+				for (const TreeElementIdxType ObjID : SelfNode.Nodes)
+				{
+					OutRemap[static_cast<int32>(ObjID)] = static_cast<TreeElementIdxType>(ElementOrder.Add(static_cast<int32>(ObjID)));
+				}
+				for (int32 i = SubNodesNum - 1; i >= 0; --i)
+				{
+					if (SelfNode.SubNodes[i] != MaxIndexQt)
+					{
+						Stack.Add(SelfNode.SubNodes[i]);
+					}
+				}
+			}
+		}
+		checkSlow(NodeOrder.Num() == Pool.Num());
+
+		// every element is in a node, kept at the end if not
+		if (ElementOrder.Num() != ElementPool.Num())
+		{
+			for (auto It = ElementPool.CreateConstIterator(); It; ++It)
+			{
+				if (OutRemap[It.GetIndex()] == MaxElementIdx)
+				{
+					OutRemap[It.GetIndex()] = static_cast<TreeElementIdxType>(ElementOrder.Add(It.GetIndex()));
+				}
+			}
+		}
+
+		{
+			TSparseArray<ElementType> NewElementPool;
+			TSparseArray<TreeData> NewData;
+			NewElementPool.Reserve(ElementOrder.Num());
+			NewData.Reserve(ElementOrder.Num());
+			for (const int32 OldID : ElementOrder)
+			{
+				NewElementPool.Add(MoveTemp(ElementPool[OldID]));
+				NewData.Add(MoveTemp(Data[OldID]));
+			}
+			ElementPool = MoveTemp(NewElementPool);
+			Data = MoveTemp(NewData);
+		}
+		IF_CONSTEXPR(!bElementVector)
+		{
+			TArray<FElementBounds> NewBounds;
+			TArray<uint64> NewMasks;
+			NewBounds.SetNumUninitialized(ElementOrder.Num());
+			NewMasks.SetNumUninitialized(ElementOrder.Num());
+			for (int32 i = 0; i < ElementOrder.Num(); ++i)
+			{
+				NewBounds[i] = ElementBounds[ElementOrder[i]];
+				NewMasks[i] = ElementMasks[ElementOrder[i]];
+			}
+			ElementBounds = MoveTemp(NewBounds);
+			ElementMasks = MoveTemp(NewMasks);
+		}
+		for (int32 i = 0; i < ElementOrder.Num(); ++i)
+		{
+			IndexQtType& TreeID = GetElementTreeID(static_cast<TreeElementIdxType>(i));
+			TreeID = NodeRemap[static_cast<int32>(TreeID)];
+		}
+
+		TSparseArray<TreeNodeType> NewPool;
+		NewPool.Reserve(NodeOrder.Num());
+		for (const IndexQtType OldID : NodeOrder)
+		{
+			TreeNodeType& SelfNode = Pool[static_cast<int32>(OldID)];
+			SelfNode.Self_ID = NodeRemap[static_cast<int32>(OldID)];
+			if (SelfNode.Parent != MaxIndexQt)
+			{
+				SelfNode.Parent = NodeRemap[static_cast<int32>(SelfNode.Parent)];
+			}
+			for (int32 i = 0; i < SubNodesNum; ++i)
+			{
+				if (SelfNode.SubNodes[i] != MaxIndexQt)
+				{
+					SelfNode.SubNodes[i] = NodeRemap[static_cast<int32>(SelfNode.SubNodes[i])];
+				}
+			}
+			for (TreeElementIdxType& ObjID : SelfNode.Nodes)
+			{
+				ObjID = OutRemap[static_cast<int32>(ObjID)];
+			}
+			NewPool.Add(MoveTemp(SelfNode));
+		}
+		Pool = MoveTemp(NewPool);
+		if (IsValidRoot())
+		{
+			Root = NodeRemap[static_cast<int32>(Root)];
+		}
+
+		// entries of freed nodes are dropped, the others follow their node
+		int32 QueueNum = 0;
+		for (const IndexQtType OldID : CollapseQueue)
+		{
+			if (NodeRemap.IsValidIndex(static_cast<int32>(OldID)) && NodeRemap[static_cast<int32>(OldID)] != MaxIndexQt)
+			{
+				CollapseQueue[QueueNum++] = NodeRemap[static_cast<int32>(OldID)];
+			}
+		}
+		CollapseQueue.SetNum(QueueNum, false);
+
+		// results taken before hold the old ObjIDs
+		DropStamp = ++ModStamp;
+
+#if WITH_EDITOR
+		checkSlow(!IsValidRoot() || CheckNum(Root));
+#endif
+	}
+
+	int32 NumElements_Recursive(const IndexQtType Self_ID) const
+	{
+		int32 Out = 0;
+		NumElements_Recursive(Self_ID, Out);
+		return Out;
+	}
+
+	IndexQtType GetMaxIntersect(const BoxType Box) const
+	{
+		if (IsValidRoot() && IsIntersectNode(Pool[Root], Box))
+		{
+			const IndexQtType MaxIntersect = GetMaxIntersectTree_Internal(Root, Box);
+			if (MaxIntersect != TNumericLimits<IndexQtType>::Max())
+			{
+				return MaxIntersect;
 			}
 		}
 		return TNumericLimits<IndexQtType>::Max();
@@ -895,10 +1710,319 @@ public:
 		return MinIdx;
 	}
 
+	/**
+	 * Best first walk, Out gets up to K elements nearest to Center within MaxRadius, nearest first.
+	 * Distance is measured to the element bounds, nodes are visited in order of their distance and the walk stops
+	 * once the nearest unvisited node is farther than the K-th element found.
+	 */
+	template<typename IdxContainer, typename T = ElementType>
+	std::enable_if_t<!std::is_same_v<T, PointType>, void> GetKNearestIDs(
+		const PointType& Center,
+		const int32 K,
+		const Real MaxRadius,
+		const uint64 Mask,
+		IdxContainer& Out) const
+	{
+		Out.Reset();
+		if (!IsValidRoot() || K <= 0 || Pool[Root].Num() == 0 || (Pool[Root].ChannelMask & Mask) == 0)
+		{
+			Counters.AddQuery(0, 0);
+			return;
+		}
+
+		struct FNodeDist
+		{
+			Real DistSquared;
+			IndexQtType Node;
+			FORCEINLINE bool operator<(const FNodeDist& Other) const { return DistSquared < Other.DistSquared; }
+		};
+		struct FElemDist
+		{
+			Real DistSquared;
+			TreeElementIdxType ObjID;
+			// max heap, the worst kept element on top
+			FORCEINLINE bool operator<(const FElemDist& Other) const { return DistSquared > Other.DistSquared; }
+		};
+
+		const Real MaxDistSquared = FMath::Square(MaxRadius);
+		TArray<FNodeDist, TInlineAllocator<64>> Nodes;
+		TArray<FElemDist, TInlineAllocator<16>> Best;
+		Best.Reserve(K + 1);
+
+		auto NodeDistSquared = [this, &Center](const TreeNodeType& Node)
+		{
+			return (bLooseTree ? GetLooseTreeBox(Node) : Node.GetTreeBox()).DistSquaredToPoint(Center);
+		};
+
+		int32 VisitedNodes = 0;
+		int32 VisitedElements = 0;
+		Nodes.HeapPush(FNodeDist{NodeDistSquared(Pool[Root]), Root});
+		while (Nodes.Num())
+		{
+			FNodeDist Top;
+			Nodes.HeapPop(Top, false);
+			const Real Bound = Best.Num() == K ? FMath::Min(Best.HeapTop().DistSquared, MaxDistSquared) : MaxDistSquared;
+			if (Top.DistSquared > Bound)
+			{
+				break;
+			}
+
+			const TreeNodeType& SelfNode = Pool[Top.Node];
+			++VisitedNodes;
+			VisitedElements += SelfNode.Nodes.Num();
+			for (const TreeElementIdxType ObjID : SelfNode.Nodes)
+			{
+				if (ElementMasks[ObjID] & Mask)
+				{
+					const FElementBounds& EB = ElementBounds[ObjID];
+					Real DistSquared = 0.0;
+					for (int32 j = 0; j < VSpace::GetInt32; ++j)
+					{
+						const Real Delta = Center[j] - FMath::Clamp(Center[j], EB.Min[j], EB.Max[j]);
+						DistSquared += Delta * Delta;
+					}
+					if (DistSquared <= MaxDistSquared && (Best.Num() < K || DistSquared < Best.HeapTop().DistSquared))
+					{
+						if (Best.Num() == K)
+						{
+							Best.HeapPopDiscard(false);
+						}
+						Best.HeapPush(FElemDist{DistSquared, ObjID});
+					}
+				}
+			}
+
+			if (!SelfNode.IsLeaf())
+			{
+				for (const IndexQtType It : SelfNode.SubNodes)
+				{
+					if (Pool[It].Num() && (Pool[It].ChannelMask & Mask))
+					{
+						const Real DistSquared = NodeDistSquared(Pool[It]);
+						if (DistSquared <= MaxDistSquared)
+						{
+							Nodes.HeapPush(FNodeDist{DistSquared, It});
+						}
+					}
+				}
+			}
+		}
+
+		Counters.AddQuery(VisitedNodes, VisitedElements);
+
+		Best.Sort([](const FElemDist& A, const FElemDist& B) { return A.DistSquared < B.DistSquared; });
+		Out.Reserve(Best.Num());
+		for (const FElemDist& It : Best)
+		{
+			Out.Add(It.ObjID);
+		}
+	}
+
+	/**
+	 * Slab walk along a segment, HitLambda(Real Entry, TreeElementIdxType ObjID) for every element whose bounds the segment enters,
+	 * in node order. SegmentType::ClipSlab(Axis, Min, Max, T0, T1) narrows [T0, T1] to the part of the segment inside one slab,
+	 * a node is skipped once a slab of its (loose) box misses, 2D trees clip the node and element Z ranges as the third slab.
+	 */
+	template<typename SegmentType, typename HitLambdaType, typename T = ElementType>
+	std::enable_if_t<!std::is_same_v<T, PointType>, void> ForEachAlongSegment(const SegmentType& Segment, const uint64 Mask, HitLambdaType HitLambda) const
+	{
+		int32 VisitedNodes = 0;
+		int32 VisitedElements = 0;
+		if (IsValidRoot())
+		{
+			TArray<IndexQtType, TInlineAllocator<64>> Stack;
+			Stack.Add(Root);
+			while (Stack.Num())
+			{
+				const TreeNodeType& SelfNode = Pool[static_cast<int32>(Stack.Pop(false))];
+				++VisitedNodes;
+				if (SelfNode.Num() == 0 || (SelfNode.ChannelMask & Mask) == 0)
+				{
+					continue;
+				}
+				const BoxType NodeBox = bLooseTree ? GetLooseTreeBox(SelfNode) : SelfNode.GetTreeBox();
+				Real T0 = 0.f;
+				Real T1 = 1.f;
+				bool bHit = true;
+				for (int32 j = 0; j < VSpace::GetInt32 && bHit; ++j)
+				{
+					bHit = Segment.ClipSlab(j, NodeBox.min[j], NodeBox.max[j], T0, T1);
+				}
+				IF_CONSTEXPR(bTrackZ)
+				{
+					bHit = bHit && Segment.ClipSlab(ZAxis, SelfNode.ZRange.Min, SelfNode.ZRange.Max, T0, T1);
+				}
+				if (!bHit)
+				{
+					continue;
+				}
+
+				VisitedElements += SelfNode.Nodes.Num();
+				for (const TreeElementIdxType ObjID : SelfNode.Nodes)
+				{
+					if (ElementMasks[ObjID] & Mask)
+					{
+						const FElementBounds& EB = ElementBounds[ObjID];
+						Real Entry = 0.f;
+						Real Exit = 1.f;
+						bool bElemHit = true;
+						for (int32 j = 0; j < BoundsAxes && bElemHit; ++j)
+						{
+							bElemHit = Segment.ClipSlab(j, EB.Min[j], EB.Max[j], Entry, Exit);
+						}
+						if (bElemHit)
+						{
+							HitLambda(Entry, ObjID);
+						}
+					}
+				}
+				if (!SelfNode.IsLeaf())
+				{
+					for (const IndexQtType SubNode : SelfNode.SubNodes)
+					{
+						if (SubNode != MaxIndexQt)
+						{
+							Stack.Add(SubNode);
+						}
+					}
+				}
+			}
+		}
+		Counters.AddQuery(VisitedNodes, VisitedElements);
+	}
+
+	/** ForEachAlongSegment into Out, nearest entry first */
+	template<typename IdxContainer, typename SegmentType, typename T = ElementType>
+	std::enable_if_t<!std::is_same_v<T, PointType>, void> GetAlongSegmentIDs(const SegmentType& Segment, const uint64 Mask, IdxContainer& Out) const
+	{
+		struct FSegmentHit
+		{
+			Real Entry;
+			TreeElementIdxType ObjID;
+			FORCEINLINE bool operator<(const FSegmentHit& Other) const { return Entry < Other.Entry; }
+		};
+		TArray<FSegmentHit, TInlineAllocator<16>> Hits;
+		ForEachAlongSegment(Segment, Mask, [&Hits](const Real Entry, const TreeElementIdxType ObjID) { Hits.Add(FSegmentHit{Entry, ObjID}); });
+		Hits.Sort();
+
+		Out.Reset();
+		Out.Reserve(Hits.Num());
+		for (const FSegmentHit& Hit : Hits)
+		{
+			Out.Add(Hit.ObjID);
+		}
+	}
+
+	/** box test, optional sphere test and element mask test, 2D trees also test ZRange */
+	struct FElementQuery
+	{
+		FElementQuery(const BoxType& InBox, const uint64 InMask = MAX_uint64) //
+			: Box(InBox)
+			, Center(InBox.GetCenter())
+			, Radius(-1.f)
+			, Mask(InMask)
+		{}
+		FElementQuery(const BoxType& InBox, const PointType& InCenter, const Real InRadius, const uint64 InMask = MAX_uint64)
+			: Box(InBox)
+			, Center(InCenter)
+			, Radius(InRadius)
+			, Mask(InMask)
+		{}
+
+		FORCEINLINE bool IsSphere() const { return Radius >= 0.f; }
+
+		BoxType Box;
+		PointType Center;
+		Real Radius;
+		uint64 Mask;
+		/** 2D tree: nodes and elements whose Z range misses it are skipped */
+		FTreeZRange ZRange = FTreeZRange::Unbounded();
+
+		/** walk counts of the last query, added to the tree counters once it ends */
+		mutable int32 VisitedNodes = 0;
+		mutable int32 VisitedElements = 0;
+	};
+
+	/** same result as a predicate query, the element lists of the visited nodes are tested four at a time from ElementBounds */
+	template<typename IdxContainer, typename T = ElementType>
+	std::enable_if_t<!std::is_same_v<T, PointType>, void> GetElementsIDs(const FElementQuery& Query, IdxContainer& Out) const
+	{
+		Query.VisitedNodes = 0;
+		Query.VisitedElements = 0;
+		if (IsValidRoot() && IsIntersectNode(Pool[Root], Query.Box))
+		{
+			const IndexQtType MaxIntersect = GetMaxIntersectTree_Internal(GetRoot(), Query.Box);
+			if (MaxIntersect != MaxIndexQt)
+			{
+				Out.Reserve(Pool[MaxIntersect].Num());
+				if (Query.IsSphere())
+				{
+					GetElemIDQuery_Recursive<true>(MaxIntersect, Query, Out);
+				}
+				else
+				{
+					GetElemIDQuery_Recursive<false>(MaxIntersect, Query, Out);
+				}
+				Out.Shrink();
+			}
+		}
+		Counters.AddQuery(Query.VisitedNodes, Query.VisitedElements);
+	}
+
+	/** Num queries in one walk from the root, a node is skipped only when no query overlaps it, Out[i] holds the IDs of Queries[i] */
+	template<typename IdxContainer, typename T = ElementType>
+	std::enable_if_t<!std::is_same_v<T, PointType>, void> GetElementsIDsBatch(const FElementQuery* Queries, const int32 Num, TArray<IdxContainer>& Out) const
+	{
+		Out.SetNum(Num);
+		for (int32 i = 0; i < Num; ++i)
+		{
+			Queries[i].VisitedNodes = 0;
+			Queries[i].VisitedElements = 0;
+		}
+		if (IsValidRoot() && Num > 0)
+		{
+			FBatchIndices Active;
+			Active.Reserve(Num);
+			for (int32 i = 0; i < Num; ++i)
+			{
+				Active.Add(i);
+			}
+			GetElemIDQueryBatch_Recursive(GetRoot(), Queries, Active, Out);
+		}
+		for (int32 i = 0; i < Num; ++i)
+		{
+			Counters.AddQuery(Queries[i].VisitedNodes, Queries[i].VisitedElements);
+		}
+	}
+
+	/**
+	 * box query narrowed by a volume, NodeTest(const BoxType&) skips the (loose) node boxes outside the volume,
+	 * ElemTest(const FElementBounds&) filters the elements that pass the box and mask test
+	 */
+	template<typename IdxContainer, typename NodeTestType, typename ElemTestType, typename T = ElementType>
+	std::enable_if_t<!std::is_same_v<T, PointType>, void> GetElementsIDsInVolume(
+		const FElementQuery& Query,
+		NodeTestType NodeTest,
+		ElemTestType ElemTest,
+		IdxContainer& Out) const
+	{
+		Query.VisitedNodes = 0;
+		Query.VisitedElements = 0;
+		if (IsValidRoot() && IsIntersectNode(Pool[Root], Query.Box))
+		{
+			const IndexQtType MaxIntersect = GetMaxIntersectTree_Internal(GetRoot(), Query.Box);
+			if (MaxIntersect != MaxIndexQt)
+			{
+				GetElemIDVolume_Recursive(MaxIntersect, Query, NodeTest, ElemTest, Out);
+			}
+		}
+		Counters.AddQuery(Query.VisitedNodes, Query.VisitedElements);
+	}
+
 	template<typename Predicate>
 	void GetElementsIDs(const BoxType& Box, Predicate FilterPredicate, TArray<TreeElementIdxType>& Out) const
 	{
-		if (IsValidRoot() && GetRootBox().IsIntersect(Box))
+		if (IsValidRoot() && IsIntersectNode(Pool[Root], Box))
 		{
 			const IndexQtType MaxIntersect = GetMaxIntersectTree_Internal(GetRoot(), Box);
 			if (MaxIntersect == MaxIndexQt)
@@ -913,7 +2037,7 @@ public:
 	template<typename Predicate>
 	void GetElementsIDs(const BoxType& Box, Predicate FilterPredicate, TSet<TreeElementIdxType>& Out) const
 	{
-		if (IsValidRoot() && GetRootBox().IsIntersect(Box))
+		if (IsValidRoot() && IsIntersectNode(Pool[Root], Box))
 		{
 			const IndexQtType MaxIntersect = GetMaxIntersectTree_Internal(GetRoot(), Box);
 			if (MaxIntersect == MaxIndexQt)
@@ -929,7 +2053,7 @@ public:
 	template<typename ElemLambda = TFunctionRef<void(const PointType&)>>
 	void CallLambdaElement(const BoxType& Box, ElemLambda CallLambda) const
 	{
-		if (IsValidRoot() && GetRootBox().IsIntersect(Box))
+		if (IsValidRoot() && IsIntersectNode(Pool[Root], Box))
 		{
 			const IndexQtType MaxIntersect = GetMaxIntersectTree_Internal(GetRoot(), Box);
 			if (MaxIntersect == MaxIndexQt)
@@ -943,7 +2067,7 @@ public:
 	template<typename ElemLambda = TFunctionRef<void(PointType&)>>
 	void CallLambdaElement(const BoxType& Box, ElemLambda CallLambda)
 	{
-		if (IsValidRoot() && GetRootBox().IsIntersect(Box))
+		if (IsValidRoot() && IsIntersectNode(Pool[Root], Box))
 		{
 			const IndexQtType MaxIntersect = GetMaxIntersectTree_Internal(GetRoot(), Box);
 			if (MaxIntersect == MaxIndexQt)
@@ -958,7 +2082,7 @@ public:
 	template<typename Predicate>
 	void GetElements(const BoxType& Box, Predicate FilterPredicate, TArray<ElementType>& Out) const
 	{
-		if (IsValidRoot() && GetRootBox().IsIntersect(Box))
+		if (IsValidRoot() && IsIntersectNode(Pool[Root], Box))
 		{
 			const IndexQtType MaxIntersect = GetMaxIntersectTree_Internal(GetRoot(), Box);
 			if (MaxIntersect == MaxIndexQt)
@@ -974,7 +2098,7 @@ public:
 	template<typename T, typename Predicate, typename TConvLambda>
 	void GetElements(const BoxType& Box, Predicate FilterPredicate, TConvLambda ConvLambda, TArray<T>& Out)
 	{
-		if (IsValidRoot() && GetRootBox().IsIntersect(Box))
+		if (IsValidRoot() && IsIntersectNode(Pool[Root], Box))
 		{
 			const IndexQtType MaxIntersect = GetMaxIntersectTree_Internal(GetRoot(), Box);
 			if (MaxIntersect == MaxIndexQt)
@@ -1033,23 +2157,64 @@ public:
 	// clang-format on
 
 private:
-	bool IsCanSplitTree(const TreeNodeType& SelfNode) const
+	bool IsCanSplitTree(const TreeNodeType& SelfNode, const int32 AddNum = 1) const
+	{
+		return SelfNode.IsLeaf() && SelfNode.Num() + AddNum > NodeCantSplit && (SelfNode.GetTreeBox().GetSize()[0] - SplitTolerance) > 0.f &&
+			HasNodeCapacity(SubNodesNum);
+	}
+
+	/** loose node keeps the element while it stays inside the inflated bounds, no re-insert for small moves */
+	FORCEINLINE bool IsLeavingNode(const TreeNodeType& TreeCell, const VectorOrBox& New) const
 	{
-		return SelfNode.IsLeaf() && SelfNode.Num() >= NodeCantSplit && (SelfNode.GetTreeBox().GetSize()[0] - SplitTolerance) > 0.f;
+		return !IsInsideNode(TreeCell, New) || (!bLooseTree && !TreeCell.IsLeaf() && TreeCell.GetByQuadName(TreeCell.GetQuad(New)) != MaxIndexQt);
+	}
+
+	/** a full 16 bit node pool stops splitting, the elements stay in the leaf */
+	FORCEINLINE bool HasNodeCapacity(const int32 AddNum) const
+	{
+		return static_cast<int64>(Pool.GetMaxIndex()) + AddNum < static_cast<int64>(MaxIndexQt);
 	}
 
 	bool IsCanCollapse(const TreeNodeType& SelfNode) const { return (SelfNode.Parent != MaxIndexQt) && Pool[SelfNode.Parent].Num() <= NodeCantSplit; }
 
+	/** SubNodes slot that takes InBox: strict - the only quad overlapped by InBox, loose - the quad of InBox center if its inflated bounds hold InBox */
+	int32 GetInsertSubNodeSlot(const TreeNodeType& SelfNode, const VectorOrBox& InBox) const
+	{
+		const uint8 Q = (bLooseTree || bElementVector) ? SelfNode.GetQuad(PointType(InBox)) : SelfNode.GetQuads(InBox);
+		if (Q == 0 || (Q & (Q - 1)) != 0)
+		{
+			return INDEX_NONE;
+		}
+		const int32 Slot = static_cast<int32>(FMath::FloorLog2(Q));
+		if (bLooseTree && (SelfNode.SubNodes[Slot] == MaxIndexQt || !IsInsideNode(Pool[SelfNode.SubNodes[Slot]], InBox)))
+		{
+			return INDEX_NONE;
+		}
+		return Slot;
+	}
+
+	FORCEINLINE IndexQtType GetInsertSubNode(const TreeNodeType& SelfNode, const VectorOrBox& InBox) const
+	{
+		const int32 Slot = GetInsertSubNodeSlot(SelfNode, InBox);
+		return Slot != INDEX_NONE ? SelfNode.SubNodes[Slot] : MaxIndexQt;
+	}
+
 
 	IndexQtType Insert_Internal(IndexQtType Self_ID, TreeElementIdxType ObjID, const VectorOrBox& InBox)
 	{
+		const uint64 Mask = GetElementChannelMask(ObjID);
+		const FTreeZRange Z = GetElementZ(ObjID);
 		while (true)
 		{
 			TreeNodeType& SelfNode = Pool[Self_ID];
+			SelfNode.ChannelMask |= Mask;
+			IF_CONSTEXPR(bTrackZ)
+			{
+				SelfNode.ZRange.Add(Z);
+			}
 			if (!SelfNode.IsLeaf())
 			{
-				const auto Q = bElementVector ? SelfNode.GetQuad(InBox) : SelfNode.GetQuads(InBox);
-				const IndexQtType TreeId = SelfNode.GetByQuadName(Q);
+				const IndexQtType TreeId = GetInsertSubNode(SelfNode, InBox);
 				check(!bElementVector || (bElementVector && TreeId != MaxIndexQt)) if (bElementVector || TreeId != MaxIndexQt)
 				{
 					SelfNode.ContainsCount++;
@@ -1057,9 +2222,8 @@ private:
 					continue;
 				}
 			}
-			else if (IsCanSplitTree(SelfNode))
+			else if (IsCanSplitTree(SelfNode) && Split(Self_ID))
 			{
-				Split(Self_ID);
 				continue; // next loop
 			}
 
@@ -1073,6 +2237,214 @@ private:
 		return Self_ID;
 	}
 
+	/** IDs of the elements already in the pools but in no node, Bounds - their bounding box */
+	void BulkInsertIDs_Internal(TArray<TreeElementIdxType>& IDs, const BoxType& Bounds)
+	{
+		const int32 Count = IDs.Num();
+
+		if (!IsValidRoot())
+		{
+			Root = Pool.Add(TreeNodeType(MaxIndexQt, BoxType(Bounds.GetCenter(), MinimumQuadSize)));
+			Pool[Root].Self_ID = Root;
+		}
+
+		bool bNewRoot = false;
+		IF_CONSTEXPR(bElementVector)
+		{
+			for (const PointType& Corner : {Bounds.min, Bounds.max})
+			{
+				if (!IsInsideNode(Pool[Root], Corner))
+				{
+					Root = ExtendToParent(Root, Corner);
+					bNewRoot = true;
+				}
+			}
+		}
+		else
+		{
+			if (!IsInsideNode(Pool[Root], Bounds))
+			{
+				Root = ExtendToParent(Root, Bounds);
+				bNewRoot = true;
+			}
+		}
+
+		// BulkInsertNode stamps the nodes on the way down
+		++ModStamp;
+		TArray<TreeElementIdxType> Scratch;
+		TArray<uint8> Slots;
+		Scratch.SetNumUninitialized(Count);
+		Slots.SetNumUninitialized(Count);
+		if (Count >= ParallelBatchMinNum)
+		{
+			BulkInsertParallel_Internal(IDs.GetData(), Count, Scratch.GetData(), Slots.GetData());
+		}
+		else
+		{
+			BulkInsert_Internal(Root, IDs.GetData(), Count, Scratch.GetData(), Slots.GetData());
+		}
+
+		if (bNewRoot)
+		{
+			bRootCollapseDirty = true;
+		}
+
+#if WITH_EDITOR
+		checkSlow(CheckNum(Root));
+#endif
+	}
+
+	/**
+	 * Adds IDs to the node or partitions them in place by SubNodes slot, Scratch and Slots hold at least Num items.
+	 * SlotStart[Slot], SlotCount[Slot] - the IDs range of a sub node, false when all of them stay in the node.
+	 */
+	bool BulkInsertNode(
+		const IndexQtType Self_ID,
+		TreeElementIdxType* RESTRICT IDs,
+		const int32 Num,
+		TreeElementIdxType* RESTRICT Scratch,
+		uint8* RESTRICT Slots,
+		int32 (&SlotStart)[SubNodesNum + 1],
+		int32 (&SlotCount)[SubNodesNum + 1])
+	{
+		if (IsCanSplitTree(Pool[Self_ID], Num))
+		{
+			Split(Self_ID);
+		}
+
+		TreeNodeType& SelfNode = Pool[Self_ID];
+		SelfNode.ContainsCount += Num;
+		SelfNode.Stamp = ModStamp;
+		for (int32 i = 0; i < Num; ++i)
+		{
+			SelfNode.ChannelMask |= GetElementChannelMask(IDs[i]);
+			IF_CONSTEXPR(bTrackZ)
+			{
+				SelfNode.ZRange.Add(GetElementZ(IDs[i]));
+			}
+		}
+
+		constexpr uint8 SelfSlot = static_cast<uint8>(SubNodesNum);
+		FMemory::Memzero(SlotCount, sizeof(SlotCount));
+		if (SelfNode.IsLeaf())
+		{
+			SlotCount[SelfSlot] = Num;
+			FMemory::Memset(Slots, SelfSlot, Num);
+		}
+		else
+		{
+			for (int32 i = 0; i < Num; ++i)
+			{
+				const int32 Slot = GetInsertSubNodeSlot(SelfNode, GetElementBox(IDs[i]));
+				Slots[i] = Slot == INDEX_NONE ? SelfSlot : static_cast<uint8>(Slot);
+				SlotCount[Slots[i]]++;
+			}
+		}
+
+		SelfNode.Nodes.Reserve(SelfNode.Nodes.Num() + SlotCount[SelfSlot]);
+		for (int32 i = 0; i < Num; ++i)
+		{
+			if (Slots[i] == SelfSlot)
+			{
+				SelfNode.Nodes.Add(IDs[i]);
+				GetElementTreeID(IDs[i]) = Self_ID;
+			}
+		}
+		if (SlotCount[SelfSlot])
+		{
+			SelfNode.ElementsStamp = ModStamp;
+		}
+		if (SlotCount[SelfSlot] == Num)
+		{
+			return false;
+		}
+
+		SlotStart[0] = 0;
+		for (int32 Slot = 1; Slot <= SubNodesNum; ++Slot)
+		{
+			SlotStart[Slot] = SlotStart[Slot - 1] + SlotCount[Slot - 1];
+		}
+		{
+			int32 SlotEnd[SubNodesNum + 1];
+			FMemory::Memcpy(SlotEnd, SlotStart, sizeof(SlotStart));
+			for (int32 i = 0; i < Num; ++i)
+			{
+				Scratch[SlotEnd[Slots[i]]++] = IDs[i];
+			}
+			FMemory::Memcpy(IDs, Scratch, sizeof(TreeElementIdxType) * Num);
+		}
+		return true;
+	}
+
+	/** Scratch and Slots are reused down the recursion */
+	void BulkInsert_Internal(const IndexQtType Self_ID, TreeElementIdxType* RESTRICT IDs, const int32 Num, TreeElementIdxType* RESTRICT Scratch, uint8* RESTRICT Slots)
+	{
+		int32 SlotStart[SubNodesNum + 1];
+		int32 SlotCount[SubNodesNum + 1];
+		if (!BulkInsertNode(Self_ID, IDs, Num, Scratch, Slots, SlotStart, SlotCount))
+		{
+			return;
+		}
+		for (int32 Slot = 0; Slot < SubNodesNum; ++Slot)
+		{
+			if (SlotCount[Slot])
+			{
+				const IndexQtType SubNode = Pool[Self_ID].SubNodes[Slot];
+				BulkInsert_Internal(SubNode, IDs + SlotStart[Slot], SlotCount[Slot], Scratch, Slots);
+			}
+		}
+	}
+
+	/**
+	 * BulkInsert_Internal with the root on the calling thread and a task per filled root child.
+	 * The tasks own disjoint sub trees and IDs ranges, the Scratch and Slots at the same offsets.
+	 * New nodes come from the free pool slots reserved here, the pool is never reallocated under the tasks.
+	 */
+	void BulkInsertParallel_Internal(TreeElementIdxType* RESTRICT IDs, const int32 Num, TreeElementIdxType* RESTRICT Scratch, uint8* RESTRICT Slots)
+	{
+		// about one split per NodeCantSplit elements, a 16 bit pool is not reserved past its last index
+		const int64 ReserveNum = Pool.Num() + static_cast<int64>(SubNodesNum) * (Num / FMath::Max(NodeCantSplit, 1) + 1);
+		Pool.Reserve(static_cast<int32>(FMath::Min<int64>(ReserveNum, static_cast<int64>(MaxIndexQt) - SubNodesNum - 1)));
+
+		int32 SlotStart[SubNodesNum + 1];
+		int32 SlotCount[SubNodesNum + 1];
+		if (!BulkInsertNode(Root, IDs, Num, Scratch, Slots, SlotStart, SlotCount))
+		{
+			return;
+		}
+
+		int32 TaskSlots[SubNodesNum];
+		int32 TaskNum = 0;
+		for (int32 Slot = 0; Slot < SubNodesNum; ++Slot)
+		{
+			if (SlotCount[Slot])
+			{
+				TaskSlots[TaskNum++] = Slot;
+			}
+		}
+
+		FParallelBulk Bulk;
+		ParallelBulk = &Bulk;
+		ParallelFor(
+			TaskNum,
+			[&](const int32 TaskIdx)
+			{
+				const int32 Slot = TaskSlots[TaskIdx];
+				const int32 Start = SlotStart[Slot];
+				BulkInsert_Internal(Pool[Root].SubNodes[Slot], IDs + Start, SlotCount[Slot], Scratch + Start, Slots + Start);
+			},
+			TaskNum < 2);
+		ParallelBulk = nullptr;
+
+		for (const IndexQtType Self_ID : Bulk.Unsplit)
+		{
+			if (IsCanSplitTree(Pool[Self_ID], 0))
+			{
+				Split(Self_ID);
+			}
+		}
+	}
+
 	bool Remove_Internal(IndexQtType Self_ID, const TreeElementIdxType ObjID)
 	{
 #if WITH_EDITOR
@@ -1082,18 +2454,19 @@ private:
 		RemoveNodeForElement(Self_ID, ObjID);
 #endif
 
+		bool bFilterChanged = true;
 		while (true)
 		{
 			TreeNodeType& SelfNode = Pool[Self_ID];
 			SelfNode.ContainsCount--;
-
-			if (SelfNode.Num() == 0)
+			if (bFilterChanged)
 			{
-				Empty(Self_ID);
+				bFilterChanged = RefreshNodeFilter(SelfNode);
 			}
-			else if (SelfNode.Num() <= NodeCantSplit && !SelfNode.IsLeaf())
+
+			if (SelfNode.Num() <= NodeCantSplit && !SelfNode.IsLeaf())
 			{
-				CollectChildTreesToSelf(Self_ID);
+				QueueCollapse(SelfNode);
 			}
 
 			if (SelfNode.Parent != MaxIndexQt)
@@ -1103,6 +2476,7 @@ private:
 			}
 			break;
 		}
+		bRootCollapseDirty = true;
 		return true;
 	}
 
@@ -1111,6 +2485,12 @@ private:
 	{
 		//checkNoRecursion();
 
+		if (bLooseTree)
+		{
+			// inflated bounds of the sibling nodes overlap, the query can't be narrowed down to a single sub node
+			return (Pool[Self_ID].Num() > 0 && IsIntersectNode(Pool[Self_ID], Box)) ? Self_ID : MaxIndexQt;
+		}
+
 		Real* const RESTRICT MiB = reinterpret_cast<Real* const>(&Box.min);
 		Real* const RESTRICT MaB = reinterpret_cast<Real* const>(&Box.max);
 
@@ -1132,7 +2512,7 @@ private:
 			{
 				for (const auto& ElemIdx : SelfNode.Nodes)
 				{
-					if (Box.IsInside(GetElementBox(ElemIdx)))
+					if (IsIntersectElement(Box, ElemIdx))
 					{
 						return Self_ID;
 					}
@@ -1154,6 +2534,18 @@ private:
 		return MaxIndexQt;
 	}
 
+	FORCEINLINE bool IsIntersectElement(const BoxType& Box, const TreeElementIdxType ObjID) const
+	{
+		IF_CONSTEXPR(bElementVector)
+		{
+			return Box.IsInside(GetElementBox(ObjID));
+		}
+		else
+		{
+			return Box.IsIntersect(GetElementBox(ObjID));
+		}
+	}
+
 	IndexQtType UpdateFromDown_Internal(IndexQtType Self_ID, const TreeElementIdxType ObjID, const VectorOrBox& New, const VectorOrBox Old)
 	{
 #if WITH_EDITOR
@@ -1162,8 +2554,8 @@ private:
 
 		TreeNodeType& SelfNode = Pool[Self_ID];
 
-		checkSlow(SelfNode.IsInside(Old));
-		if (SelfNode.IsInside(New))
+		checkSlow(IsInsideNode(SelfNode, Old));
+		if (IsInsideNode(SelfNode, New))
 		{
 			/*if (IsCanCollapse())
 			{
@@ -1188,25 +2580,27 @@ private:
 		RemoveNodeForElement(Self_ID, ObjID);
 #endif
 
+		// the nodes left by the element drop its mask and Z range, the common parent gets them back from Insert_Internal
+		bool bFilterChanged = true;
 		while (Self_ID != MaxIndexQt)
 		{
 			TreeNodeType& LoopRef = Pool[Self_ID];
 			LoopRef.ContainsCount--;
+			if (bFilterChanged)
+			{
+				bFilterChanged = RefreshNodeFilter(LoopRef);
+			}
 
-			if (LoopRef.IsInside(New))
+			if (IsInsideNode(LoopRef, New))
 			{
 				return Insert_Internal(Self_ID, ObjID, New);
 			}
 
 			checkSlow(LoopRef.Parent != MaxIndexQt);
 
-			if (LoopRef.Num() == 0)
-			{
-				Empty(Self_ID);
-			}
-			else if (LoopRef.Num() <= NodeCantSplit && !LoopRef.IsLeaf())
+			if (LoopRef.Num() <= NodeCantSplit && !LoopRef.IsLeaf())
 			{
-				CollectChildTreesToSelf(Self_ID);
+				QueueCollapse(LoopRef);
 			}
 			Self_ID = LoopRef.Parent;
 		}
@@ -1216,17 +2610,33 @@ private:
 	}
 
 
-	void Split(const IndexQtType Self_ID)
+	/** false - a BulkInsert task found no reserved node slot, the node stays a leaf */
+	bool Split(const IndexQtType Self_ID)
 	{
 
 		if (Pool[Self_ID].IsLeaf())
 		{
-			if (Pool.GetMaxIndex() < Pool.Num() + 8)
+			if (ParallelBulk)
 			{
-				Pool.Reserve(Pool.Num() + 64);
+				FScopeLock ScopeLock(&ParallelBulk->NodeLock);
+				if (Pool.GetMaxIndex() - Pool.Num() < SubNodesNum)
+				{
+					ParallelBulk->Unsplit.Add(Self_ID);
+					return false;
+				}
+				CreateChildLeaves(Pool[Self_ID]);
+				++Counters.Splits;
 			}
+			else
+			{
+				if (Pool.GetMaxIndex() < Pool.Num() + 8)
+				{
+					Pool.Reserve(Pool.Num() + 64);
+				}
 
-			CreateChildLeaves(Pool[Self_ID]);
+				CreateChildLeaves(Pool[Self_ID]);
+				++Counters.Splits;
+			}
 		}
 
 		TreeNodeType& TreeRef = Pool[Self_ID];
@@ -1235,8 +2645,7 @@ private:
 		{
 			const auto ObjID = TreeRef.Nodes[i];
 			const auto& Loc = GetElementBox(ObjID);
-			const uint8 Q = bElementVector ? TreeRef.GetQuad(Loc) : TreeRef.GetQuads(Loc);
-			const IndexQtType TreeInsertId = TreeRef.GetByQuadName(Q);
+			const IndexQtType TreeInsertId = GetInsertSubNode(TreeRef, Loc);
 
 			check(!bElementVector || (bElementVector && TreeInsertId != MaxIndexQt));
 
@@ -1251,12 +2660,14 @@ private:
 				}
 			}
 		}
+		return true;
 	}
 
 	IndexQtType ExtendToParent(IndexQtType Self_ID, const VectorOrBox& InBox)
 	{
-		while (!Pool[Self_ID].IsInside(InBox))
+		while (!IsInsideNode(Pool[Self_ID], InBox))
 		{
+			checkf(HasNodeCapacity(SubNodesNum + 1), TEXT("tree node index overflow, use a 32 bit node index for this SensorTag"));
 			if (Pool.GetMaxIndex() < (Pool.Num() + SubNodesNum))
 			{
 				Pool.Reserve(Pool.Num() + 8 * SubNodesNum);
@@ -1288,6 +2699,9 @@ private:
 
 			ParentRef.Self_ID = SelfNode.Parent;
 			ParentRef.ContainsCount = SelfNode.Num();
+			ParentRef.ChannelMask = SelfNode.ChannelMask;
+			ParentRef.ZRange = SelfNode.ZRange;
+			ParentRef.Stamp = SelfNode.Stamp;
 			CreateChildLeaves(ParentRef);
 			Self_ID = SelfNode.Parent;
 		}
@@ -1326,6 +2740,8 @@ private:
 	{
 		TreeNodeType& SelfNode = Pool[Self_ID];
 		SelfNode.ContainsCount = 0;
+		SelfNode.ChannelMask = 0;
+		SelfNode.ZRange = {};
 		SelfNode.Nodes.Empty();
 		EmptyLeaves_Recursive(Self_ID);
 	}
@@ -1344,6 +2760,17 @@ private:
 		}
 	}
 
+	/** ModStamp to the node elements and to the nodes up to the root, ends at a node already stamped by this change */
+	void StampNode(IndexQtType Self_ID)
+	{
+		Pool[Self_ID].ElementsStamp = ModStamp;
+		while (Self_ID != MaxIndexQt && Pool[Self_ID].Stamp != ModStamp)
+		{
+			Pool[Self_ID].Stamp = ModStamp;
+			Self_ID = Pool[Self_ID].Parent;
+		}
+	}
+
 	bool RemoveNodeForElement(const IndexQtType Self_ID, const TreeElementIdxType& ObjID)
 	{
 		auto& SelfNode = Pool[Self_ID];
@@ -1383,6 +2810,10 @@ private:
 		auto& SelfNode = Pool[Self_ID];
 		if (SelfNode.Num() <= NodeCantSplit)
 		{
+			if (!SelfNode.IsLeaf())
+			{
+				++Counters.Collapses;
+			}
 			if (SelfNode.Num() && !SelfNode.IsLeaf())
 			{
 #if WITH_EDITOR
@@ -1398,7 +2829,10 @@ private:
 				}
 				checkSlow(SelfNode.Nodes.Num() == SelfNode.Num());
 			}
+			// the elements of the children are kept by the node now
+			SelfNode.ElementsStamp = SelfNode.Stamp;
 			EmptyLeaves_Recursive(Self_ID);
+			RefreshNodeFilter(Pool[Self_ID]);
 
 #if WITH_EDITOR
 			checkSlow(CheckNum(Self_ID));
@@ -1413,23 +2847,23 @@ private:
 	void EmptyLeaves_Recursive(const IndexQtType Self_ID, const bool bExcludeSelf = true)
 	{
 		TreeNodeType& SelfNode = Pool[Self_ID];
-		if (!SelfNode.IsLeaf())
+		// not IsLeaf(), a parent whose first child was detached by CollapseRoot still owns the other children
+		bool bHasSubNodes = false;
+		for (int32 i = 0; i < SubNodesNum; i++)
 		{
-			for (int32 i = 0; i < SubNodesNum; i++)
+			const IndexQtType LeafId = SelfNode.SubNodes[i];
+			if (LeafId != MaxIndexQt)
 			{
-				const IndexQtType LeafId = SelfNode.SubNodes[i];
-				if (LeafId != MaxIndexQt)
-				{
-					Pool[LeafId].ContainsCount = 0;
-					Pool[LeafId].Nodes.Empty();
-					EmptyLeaves_Recursive(LeafId, false);
+				bHasSubNodes = true;
+				Pool[LeafId].ContainsCount = 0;
+				Pool[LeafId].Nodes.Empty();
+				EmptyLeaves_Recursive(LeafId, false);
 
-					Pool.RemoveAt(LeafId);
-					SelfNode.SubNodes[i] = MaxIndexQt;
-				}
+				Pool.RemoveAt(LeafId);
+				SelfNode.SubNodes[i] = MaxIndexQt;
 			}
 		}
-		else if (!bExcludeSelf)
+		if (!bHasSubNodes && !bExcludeSelf)
 		{
 			SelfNode.ContainsCount = 0;
 			SelfNode.Nodes.Empty();
@@ -1508,6 +2942,79 @@ private:
 	}
 
 
+	void CollapseRoot()
+	{
+		if (Root != MaxIndexQt)
+		{
+			const IndexQtType NewRootQuadTree = CheckCollapseParentDown_Recursive(Root);
+			if (NewRootQuadTree != Root)
+			{
+				DetachFromParent(NewRootQuadTree);
+				// the dropped nodes may cover regions out of the new root
+				DropStamp = FMath::Max(DropStamp, Pool[Root].Stamp);
+				Empty(Root);
+				Pool.RemoveAt(Root);
+				Root = NewRootQuadTree;
+				++Counters.Collapses;
+			}
+		}
+	}
+
+	/** recomputes the node mask and the 2D node Z range from its elements and children, true if either changed */
+	bool RefreshNodeFilter(TreeNodeType& SelfNode) const
+	{
+		uint64 Mask = 0;
+		FTreeZRange Z;
+		for (const TreeElementIdxType ObjID : SelfNode.Nodes)
+		{
+			Mask |= GetElementChannelMask(ObjID);
+			IF_CONSTEXPR(bTrackZ)
+			{
+				Z.Add(GetElementZ(ObjID));
+			}
+		}
+		if (!SelfNode.IsLeaf())
+		{
+			for (const IndexQtType It : SelfNode.SubNodes)
+			{
+				if (It != MaxIndexQt)
+				{
+					Mask |= Pool[It].ChannelMask;
+					IF_CONSTEXPR(bTrackZ)
+					{
+						Z.Add(Pool[It].ZRange);
+					}
+				}
+			}
+		}
+		bool bChanged = Mask != SelfNode.ChannelMask;
+		SelfNode.ChannelMask = Mask;
+		IF_CONSTEXPR(bTrackZ)
+		{
+			bChanged |= !(Z == SelfNode.ZRange);
+			SelfNode.ZRange = Z;
+		}
+		return bChanged;
+	}
+
+	/** from Self_ID to the root, stops at the first node whose mask and Z range did not change */
+	void RefreshNodeFilter_Up(IndexQtType Self_ID)
+	{
+		while (Self_ID != MaxIndexQt && RefreshNodeFilter(Pool[Self_ID]))
+		{
+			Self_ID = Pool[Self_ID].Parent;
+		}
+	}
+
+	FORCEINLINE void QueueCollapse(TreeNodeType& SelfNode)
+	{
+		if (!SelfNode.bCollapseQueued)
+		{
+			SelfNode.bCollapseQueued = true;
+			CollapseQueue.Add(SelfNode.Self_ID);
+		}
+	}
+
 	IndexQtType CheckCollapseParentDown_Recursive(const IndexQtType Self_ID) const
 	{
 		const auto& SelfNode = Pool[Self_ID];
@@ -1533,7 +3040,7 @@ private:
 		return Self_ID;
 	}
 
-	IndexQtType CollectChildTreesToSelf_Recursive(const IndexQtType Self_ID)
+	IndexQtType CollectChildTreesToSelf_Recursive(IndexQtType Self_ID)
 	{
 		while (Pool[Self_ID].Parent != MaxIndexQt && Pool[Pool[Self_ID].Parent].Num() <= NodeCantSplit)
 		{
@@ -1548,7 +3055,7 @@ private:
 	void CallChildLambdaIdx_Recursive(const IndexQtType Self_ID, CallLambdaType CallLambda, const BoxType& Box) const
 	{
 		const TreeNodeType& SelfNode = Pool[Self_ID];
-		if (SelfNode.Num() && SelfNode.GetTreeBox().IsIntersect(Box))
+		if (SelfNode.Num() && IsIntersectNode(SelfNode, Box))
 		{
 			IF_CONSTEXPR(bElementVector)
 			{
@@ -1595,7 +3102,7 @@ private:
 	void CallChildLambdaIdx_Recursive(const IndexQtType Self_ID, CallLambdaType CallLambda, const BoxType& Box)
 	{
 		const TreeNodeType& SelfNode = Pool[Self_ID];
-		if (SelfNode.Num() && SelfNode.GetTreeBox().IsIntersect(Box))
+		if (SelfNode.Num() && IsIntersectNode(SelfNode, Box))
 		{
 			IF_CONSTEXPR(bElementVector)
 			{
@@ -1641,7 +3148,7 @@ private:
 	template<typename CallLambdaType>
 	void CallParentLambdaIdx(const IndexQtType Self_ID, CallLambdaType CallLambda, const BoxType& Box) const
 	{
-		while (Pool[Self_ID].GetTreeBox().IsIntersect(Box) && Pool[Self_ID].Parent != MaxIndexQt)
+		while (IsIntersectNode(Pool[Self_ID], Box) && Pool[Self_ID].Parent != MaxIndexQt)
 		{
 			Self_ID = Pool[Self_ID].Parent;
 			const auto& ParentRef = Pool[Self_ID];
@@ -1658,7 +3165,7 @@ private:
 	template<typename CallLambdaType>
 	void CallParentLambdaIdx(const IndexQtType Self_ID, CallLambdaType CallLambda, const BoxType& Box)
 	{
-		while (Pool[Self_ID].GetTreeBox().IsIntersect(Box) && Pool[Self_ID].Parent != MaxIndexQt)
+		while (IsIntersectNode(Pool[Self_ID], Box) && Pool[Self_ID].Parent != MaxIndexQt)
 		{
 			Self_ID = Pool[Self_ID].Parent;
 			const auto& ParentRef = Pool[Self_ID];
@@ -1687,6 +3194,224 @@ private:
 			},
 			Box);
 	}
+	FORCEINLINE bool IsIntersectNodeZ(const TreeNodeType& SelfNode, const FElementQuery& Query) const
+	{
+		IF_CONSTEXPR(bTrackZ)
+		{
+			return SelfNode.ZRange.IsIntersect(Query.ZRange);
+		}
+		else
+		{
+			return true;
+		}
+	}
+
+	template<bool bSphere, typename IdxContainer>
+	void GetElemIDQuery_Recursive(const IndexQtType Self_ID, const FElementQuery& Query, IdxContainer& Out) const
+	{
+		const TreeNodeType& SelfNode = Pool[Self_ID];
+		++Query.VisitedNodes;
+		if (SelfNode.Num() && (SelfNode.ChannelMask & Query.Mask) && IsIntersectNodeZ(SelfNode, Query) && IsIntersectNode(SelfNode, Query.Box))
+		{
+			IF_CONSTEXPR(bSphere)
+			{
+				const BoxType NodeBox = bLooseTree ? GetLooseTreeBox(SelfNode) : SelfNode.GetTreeBox();
+				if (!NodeBox.SphereAABBIntersection(Query.Center, Query.Radius))
+				{
+					return;
+				}
+			}
+
+			if (SelfNode.Nodes.Num())
+			{
+				QueryElements<bSphere>(SelfNode.Nodes.GetData(), SelfNode.Nodes.Num(), Query, Out);
+			}
+			if (!SelfNode.IsLeaf())
+			{
+				for (auto It : SelfNode.SubNodes)
+				{
+					GetElemIDQuery_Recursive<bSphere>(It, Query, Out);
+				}
+			}
+		}
+	}
+
+	template<typename IdxContainer, typename NodeTestType, typename ElemTestType>
+	void GetElemIDVolume_Recursive(
+		const IndexQtType Self_ID,
+		const FElementQuery& Query,
+		NodeTestType& NodeTest,
+		ElemTestType& ElemTest,
+		IdxContainer& Out) const
+	{
+		const TreeNodeType& SelfNode = Pool[Self_ID];
+		++Query.VisitedNodes;
+		if (SelfNode.Num() == 0 || (SelfNode.ChannelMask & Query.Mask) == 0 || !IsIntersectNodeZ(SelfNode, Query) || !IsIntersectNode(SelfNode, Query.Box) ||
+			!NodeTest(bLooseTree ? GetLooseTreeBox(SelfNode) : SelfNode.GetTreeBox()))
+		{
+			return;
+		}
+		Query.VisitedElements += SelfNode.Nodes.Num();
+
+		for (const TreeElementIdxType ObjID : SelfNode.Nodes)
+		{
+			if ((ElementMasks[ObjID] & Query.Mask) == 0)
+			{
+				continue;
+			}
+			const FElementBounds& EB = ElementBounds[ObjID];
+			bool bOutside = false;
+			for (int32 j = 0; j < VSpace::GetInt32; ++j)
+			{
+				bOutside |= EB.Min[j] > Query.Box.max[j] || Query.Box.min[j] > EB.Max[j];
+			}
+			IF_CONSTEXPR(bTrackZ)
+			{
+				bOutside |= EB.Min[ZAxis] > Query.ZRange.Max || Query.ZRange.Min > EB.Max[ZAxis];
+			}
+			if (!bOutside && ElemTest(EB))
+			{
+				Out.Add(ObjID);
+			}
+		}
+		if (!SelfNode.IsLeaf())
+		{
+			for (auto It : SelfNode.SubNodes)
+			{
+				GetElemIDVolume_Recursive(It, Query, NodeTest, ElemTest, Out);
+			}
+		}
+	}
+
+	using FBatchIndices = TArray<int32, TInlineAllocator<32>>;
+
+	/** Active holds the queries that overlap the parent, each node narrows it before the element lists are tested */
+	template<typename IdxContainer>
+	void GetElemIDQueryBatch_Recursive(const IndexQtType Self_ID, const FElementQuery* Queries, const FBatchIndices& Active, TArray<IdxContainer>& Out) const
+	{
+		const TreeNodeType& SelfNode = Pool[Self_ID];
+		if (SelfNode.Num() == 0)
+		{
+			return;
+		}
+
+		const BoxType NodeBox = bLooseTree ? GetLooseTreeBox(SelfNode) : SelfNode.GetTreeBox();
+		FBatchIndices Overlap;
+		for (const int32 Q : Active)
+		{
+			const FElementQuery& Query = Queries[Q];
+			++Query.VisitedNodes;
+			if ((SelfNode.ChannelMask & Query.Mask) && IsIntersectNodeZ(SelfNode, Query) && NodeBox.IsIntersect(Query.Box) &&
+				(!Query.IsSphere() || NodeBox.SphereAABBIntersection(Query.Center, Query.Radius)))
+			{
+				Overlap.Add(Q);
+			}
+		}
+		if (Overlap.Num() == 0)
+		{
+			return;
+		}
+
+		if (SelfNode.Nodes.Num())
+		{
+			for (const int32 Q : Overlap)
+			{
+				if (Queries[Q].IsSphere())
+				{
+					QueryElements<true>(SelfNode.Nodes.GetData(), SelfNode.Nodes.Num(), Queries[Q], Out[Q]);
+				}
+				else
+				{
+					QueryElements<false>(SelfNode.Nodes.GetData(), SelfNode.Nodes.Num(), Queries[Q], Out[Q]);
+				}
+			}
+		}
+		if (!SelfNode.IsLeaf())
+		{
+			for (auto It : SelfNode.SubNodes)
+			{
+				GetElemIDQueryBatch_Recursive(It, Queries, Overlap, Out);
+			}
+		}
+	}
+
+	/** lanes hold four elements, one register per axis for min and max, the masks are tested before the bounds are gathered */
+	template<bool bSphere, typename IdxContainer>
+	void QueryElements(const TreeElementIdxType* RESTRICT IDs, const int32 Num, const FElementQuery& Query, IdxContainer& Out) const
+	{
+		using VectorType = TVectorRegisterType<Real>;
+		constexpr int32 Lanes = 4;
+
+		VectorType QMin[BoundsAxes];
+		VectorType QMax[BoundsAxes];
+		VectorType QCenter[VectorSpace];
+		for (int32 j = 0; j < VSpace::GetInt32; ++j)
+		{
+			QMin[j] = VectorSetFloat1(Query.Box.min[j]);
+			QMax[j] = VectorSetFloat1(Query.Box.max[j]);
+			QCenter[j] = VectorSetFloat1(Query.Center[j]);
+		}
+		IF_CONSTEXPR(bTrackZ)
+		{
+			QMin[ZAxis] = VectorSetFloat1(static_cast<Real>(Query.ZRange.Min));
+			QMax[ZAxis] = VectorSetFloat1(static_cast<Real>(Query.ZRange.Max));
+		}
+		const VectorType RadiusSquared = VectorSetFloat1(Query.Radius * Query.Radius);
+		const VectorType Zero = VectorSetFloat1(static_cast<Real>(0.f));
+
+		const FElementBounds* RESTRICT Bounds = ElementBounds.GetData();
+		const uint64* RESTRICT Masks = ElementMasks.GetData();
+		Query.VisitedElements += Num;
+
+		for (int32 i = 0; i < Num; i += Lanes)
+		{
+			// the tail repeats the last element, its lanes are cleared by LaneMask
+			int32 Lane[Lanes];
+			int32 LaneMask = 0;
+			for (int32 k = 0; k < Lanes; ++k)
+			{
+				Lane[k] = static_cast<int32>(IDs[FMath::Min(i + k, Num - 1)]);
+				LaneMask |= (i + k < Num && (Masks[Lane[k]] & Query.Mask)) ? (1 << k) : 0;
+			}
+			if (LaneMask == 0)
+			{
+				continue;
+			}
+
+			VectorType Outside = Zero;
+			VectorType DistSquared = Zero;
+			for (int32 j = 0; j < VSpace::GetInt32; ++j)
+			{
+				const VectorType EMin = MakeVectorRegister(Bounds[Lane[0]].Min[j], Bounds[Lane[1]].Min[j], Bounds[Lane[2]].Min[j], Bounds[Lane[3]].Min[j]);
+				const VectorType EMax = MakeVectorRegister(Bounds[Lane[0]].Max[j], Bounds[Lane[1]].Max[j], Bounds[Lane[2]].Max[j], Bounds[Lane[3]].Max[j]);
+				Outside = VectorBitwiseOr(Outside, VectorBitwiseOr(VectorCompareGT(EMin, QMax[j]), VectorCompareGT(QMin[j], EMax)));
+				IF_CONSTEXPR(bSphere)
+				{
+					const VectorType Delta = VectorSubtract(QCenter[j], VectorMin(VectorMax(QCenter[j], EMin), EMax));
+					DistSquared = VectorMultiplyAdd(Delta, Delta, DistSquared);
+				}
+			}
+			// the sphere stays on the tree axes, Z is a range test only
+			IF_CONSTEXPR(bTrackZ)
+			{
+				const VectorType EMin = MakeVectorRegister(Bounds[Lane[0]].Min[ZAxis], Bounds[Lane[1]].Min[ZAxis], Bounds[Lane[2]].Min[ZAxis], Bounds[Lane[3]].Min[ZAxis]);
+				const VectorType EMax = MakeVectorRegister(Bounds[Lane[0]].Max[ZAxis], Bounds[Lane[1]].Max[ZAxis], Bounds[Lane[2]].Max[ZAxis], Bounds[Lane[3]].Max[ZAxis]);
+				Outside = VectorBitwiseOr(Outside, VectorBitwiseOr(VectorCompareGT(EMin, QMax[ZAxis]), VectorCompareGT(QMin[ZAxis], EMax)));
+			}
+
+			uint32 Hit = static_cast<uint32>(LaneMask & ~VectorMaskBits(Outside));
+			IF_CONSTEXPR(bSphere)
+			{
+				Hit &= static_cast<uint32>(VectorMaskBits(VectorCompareLE(DistSquared, RadiusSquared)));
+			}
+			while (Hit)
+			{
+				Out.Add(IDs[i + FMath::CountTrailingZeros(Hit)]);
+				Hit &= Hit - 1;
+			}
+		}
+	}
+
 	//template<typename Predicate>
 	//void GetElemID_Recursive(const IndexQtType Self_ID, const BoxType& Box, Predicate FilterPredicate, TSet<TreeElementIdxType>& Out) const
 	//{
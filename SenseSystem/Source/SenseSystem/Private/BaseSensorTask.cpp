@@ -3,6 +3,7 @@
 #include "BaseSensorTask.h"
 #include "SenseManager.h"
 #include "Sensors/SensorBase.h"
+#include "QtOtContainer.h"
 #include "HAL/Platform.h"
 #include "UObject/UObjectGlobals.h"
 
@@ -64,42 +65,138 @@ bool FSenseRunnable::UpdateQueue()
 		return false;
 	}
 
-	FSensorQueue& Queue = HighSensorQueue.IsEmpty() ? SensorQueue : HighSensorQueue;
+	TArray<const IContainerTree*, TInlineAllocator<4>> MarkedTrees;
+	if (BatchSensors.Num() == 0)
+	{
+		FSensorQueue& Queue = HighSensorQueue.IsEmpty() ? SensorQueue : HighSensorQueue;
+
+		if (Queue.IsEmpty())
+		{
+			Thread->SetThreadPriority(EThreadPriority::TPri_Lowest);
+		}
+		if (Thread->GetThreadPriority() == EThreadPriority::TPri_Lowest /*IsThreadPaused()*/)
+		{
+			return true;
+		}
+
+		// CounterLimit sensors per wake, the batch shares one walk per tree
+		for (int32 i = 0; i < FMath::Max(CounterLimit, 1) && !Queue.IsEmpty(); ++i)
+		{
+			// counted before it leaves the queue, IsQueueEmpty never misses it
+			BatchNum.Increment();
+			BatchSensors.Add(Queue.Dequeue());
+		}
+		PrepareBatchQueries(MarkedTrees);
+	}
+
+	int32 NotDone = 0;
+	for (USensorBase* const Sensor : BatchSensors)
+	{
+		bool bPop = true;
+		if (LIKELY(IsValid(Sensor) && Sensor->IsValidForTest_Short()))
+		{
+			if (LIKELY(Sensor->UpdateState.Get() == ESensorState::ReadyToUpdate))
+			{
+				bPop = Sensor->UpdateSensor();
+			}
+			else
+			{
+				Sensor->UpdateState = ESensorState::NotUpdate; //skip
+				bPop = true;
+			}
+		}
+		if (IsValid(Sensor))
+		{
+			Sensor->ResetBatchIDs();
+		}
+
+		if (bPop)
+		{
+			Counter++;
+		}
+		else
+		{
+			//retry on the next update, with its own tree query
+			BatchSensors[NotDone++] = Sensor;
+		}
+	}
+	BatchSensors.SetNum(NotDone, false);
 
-	if (Queue.IsEmpty())
+	for (const IContainerTree* ContainerTree : MarkedTrees)
+	{
+		ContainerTree->ResetRemoveControl();
+	}
+	// the game thread deletes emptied trees only after this, MarkedTrees and the sensor trees stay valid until here
+	BatchNum.Set(NotDone);
+
+	if (BatchSensors.Num() == 0 && SensorQueue.IsEmpty() && HighSensorQueue.IsEmpty())
 	{
 		Thread->SetThreadPriority(EThreadPriority::TPri_Lowest);
 	}
-	if (Thread->GetThreadPriority() == EThreadPriority::TPri_Lowest /*IsThreadPaused()*/)
+	return BatchSensors.Num() == 0;
+}
+
+void FSenseRunnable::PrepareBatchQueries(TArray<const IContainerTree*, TInlineAllocator<4>>& OutMarkedTrees)
+{
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_FSenseRunnablePrepareBatch);
+
+	//sensors of the tags sharing a tree go in one walk
+	TMap<const IContainerTree*, TArray<USensorBase*, TInlineAllocator<16>>> TreeSensors;
+	for (USensorBase* const Sensor : BatchSensors)
 	{
-		return true;
+		if (IsValid(Sensor) && Sensor->IsValidForTest_Short())
+		{
+			const USenseManager* SM = Sensor->GetSenseManager();
+			if (const IContainerTree* ContainerTree = SM ? SM->GetNamedContainerTree(Sensor->SensorTag) : nullptr)
+			{
+				TreeSensors.FindOrAdd(ContainerTree).Add(Sensor);
+			}
+		}
 	}
 
-	bool bPop = true;
-	USensorBase* const Sensor = Queue.Peek();
-	if (LIKELY(IsValid(Sensor) && Sensor->IsValidForTest_Short()))
+	for (const auto& It : TreeSensors)
 	{
-		if (LIKELY(Sensor->UpdateState.Get() == ESensorState::ReadyToUpdate))
+		//a single sensor runs its own query
+		if (It.Value.Num() < 2)
 		{
-			bPop = Sensor->UpdateSensor();
+			continue;
 		}
-		else
+		const IContainerTree* ContainerTree = It.Key;
+
+		TArray<IContainerTree::FBatchQuery> Queries;
+		TArray<USensorBase*, TInlineAllocator<16>> QuerySensors;
+		Queries.Reserve(It.Value.Num());
+		for (USensorBase* const Sensor : It.Value)
 		{
-			Sensor->UpdateState = ESensorState::NotUpdate; //skip
-			bPop = true;
+			IContainerTree::FBatchQuery Query;
+			float Radius = 0.f;
+			if (Sensor->PrepareBatchQuery(Query.Box, Query.Center, Radius, Query.BitChannels))
+			{
+				Query.Radius = Radius;
+				Queries.Add(Query);
+				QuerySensors.Add(Sensor);
+			}
+		}
+		if (Queries.Num() == 0)
+		{
+			continue;
 		}
-	}
 
-	if (bPop)
-	{
-		Queue.Pop();
-		Counter++;
-		if (SensorQueue.IsEmpty() && HighSensorQueue.IsEmpty())
+		//removed IDs are tracked from the tree walk until the sensors of the batch have tested them
+		ContainerTree->MarkRemoveControl();
+		OutMarkedTrees.Add(ContainerTree);
+		for (USensorBase* const Sensor : It.Value)
 		{
-			Thread->SetThreadPriority(EThreadPriority::TPri_Lowest);
+			Sensor->SetBatchTreeMarked();
+		}
+
+		TArray<TArray<IContainerTree::ElementIndexType>> Out;
+		ContainerTree->GetInBoxRadiusIDsBatch(Queries, Out);
+		for (int32 i = 0; i < QuerySensors.Num(); ++i)
+		{
+			QuerySensors[i]->SetBatchIDs(MoveTemp(Out[i]));
 		}
 	}
-	return bPop;
 }
 
 bool FSenseRunnable::AddQueueSensors(USensorBase* Sensor, const bool bHighPriority)
@@ -12,11 +12,13 @@
 #include "HAL/Runnable.h"
 #include "HAL/RunnableThread.h"
 #include "HAL/ThreadSafeBool.h"
+#include "HAL/ThreadSafeCounter.h"
 #include "HAL/ThreadingBase.h"
 #include "Containers/Queue.h"
 
 
 class USensorBase;
+class IContainerTree;
 
 
 /**
@@ -71,14 +73,21 @@ public:
 	//FSenseRunnable AddQueueSensors
 	bool AddQueueSensors(USensorBase* Sensor, bool bHighPriority = false);
 
+	/** no sensor waits in the queues or in the current batch */
+	FORCEINLINE bool IsQueueEmpty() const { return SensorQueue.IsEmpty() && HighSensorQueue.IsEmpty() && BatchNum.GetValue() == 0; }
+
 private:
 	const double WaitTime;
+	/** sensors updated per wake, see USenseSysSettings::CountPerOneCyclesUpdate */
 	const int32 CounterLimit;
 	int32 Counter = 0;
 	uint32 SenseThreadId = 0;
 
 	bool UpdateQueue();
 
+	/** the sensors of one SensorTag get their IDs from a single tree walk, OutMarkedTrees keep the remove control until the batch is updated */
+	void PrepareBatchQueries(TArray<const IContainerTree*, TInlineAllocator<4>>& OutMarkedTrees);
+
 	//Thread to run the worker FRunnable on
 	FRunnableThread* Thread;
 	FEvent* WorkEvent;
@@ -89,6 +98,11 @@ private:
 
 	FSensorQueue SensorQueue;
 	FSensorQueue HighSensorQueue;
+
+	/** up to CounterLimit sensors taken from a queue, a sensor stays here until its UpdateSensor succeeds */
+	TArray<USensorBase*> BatchSensors;
+	/** BatchSensors.Num() for the game thread */
+	FThreadSafeCounter BatchNum;
 };
 
 
@@ -3,6 +3,8 @@
 #include "QtOtContainer.h"
 
 #include "DrawDebugHelpers.h"
+#include "Templates/Sorting.h"
+
 
 
 #if WITH_EDITOR
@@ -10,12 +12,18 @@ bool IContainerTree::IsRemoveControlClear() const
 {
 	FRWScopeLock SRWLock(RWLock, SLT_ReadOnly);
 
-	return IndexRemoveControl.bTrack == 0;
+	return IndexRemoveControl.bTrack == 0 && SnapshotQueries.GetValue() == 0;
 }
 #endif
 
 void IContainerTree::MarkRemoveControl() const
 {
+	// snapshot readers never read the live pool, only Compact has to wait for their IDs
+	if (bSnapshotReads)
+	{
+		SnapshotQueries.Increment();
+		return;
+	}
 	FRWScopeLock SRWLock(RWLock, SLT_Write);
 
 	if (IndexRemoveControl.bTrack == 0)
@@ -28,6 +36,11 @@ void IContainerTree::MarkRemoveControl() const
 
 void IContainerTree::ResetRemoveControl() const
 {
+	if (bSnapshotReads)
+	{
+		SnapshotQueries.Decrement();
+		return;
+	}
 	FRWScopeLock SRWLock(RWLock, SLT_Write);
 
 	IndexRemoveControl.bTrack--;
@@ -49,7 +62,66 @@ void IContainerTree::ResetRemoveControl(const int32 Idx) const
 	}
 }
 
-FSensedStimulus IContainerTree::GetSensedStimulusCopy_TS(const ElementIndexType InObjID) const
+IContainerTree::ElementIndexType IContainerTree::MarkPoolDirty_Internal(const ElementIndexType InObjID) const
+{
+	if (bSnapshotReads && !bPoolDirtyAll)
+	{
+		// past a pool worth of marks the whole copy is cheaper
+		if (DirtyIDs.Num() < GetCompDataPool().GetMaxIndex())
+		{
+			DirtyIDs.Add(InObjID);
+		}
+		else
+		{
+			bPoolDirtyAll = true;
+			DirtyIDs.Reset();
+		}
+	}
+	return InObjID;
+}
+
+void IContainerTree::MarkAllIDsChanged_Internal() const
+{
+	if (bSnapshotReads)
+	{
+		bPoolDirtyAll = true;
+		DirtyIDs.Reset();
+		if (ObjGenerations.Num() < GetCompDataPool().GetMaxIndex())
+		{
+			ObjGenerations.SetNumZeroed(GetCompDataPool().GetMaxIndex());
+		}
+		for (uint32& It : ObjGenerations)
+		{
+			++It;
+		}
+	}
+}
+
+void IContainerTree::RecordRemove_Internal(const ElementIndexType InObjID)
+{
+	// a reused ObjID starts on no tag
+	const int32 SlotNum = TagSlots.Num();
+	if (SlotNum && TagChannels.Num() >= (static_cast<int32>(InObjID) + 1) * SlotNum)
+	{
+		FMemory::Memzero(&TagChannels[static_cast<int32>(InObjID) * SlotNum], SlotNum * sizeof(uint64));
+	}
+	if (IndexRemoveControl.bTrack)
+	{
+		IndexRemoveControl.RemIDs.Add(InObjID);
+		IndexRemoveControl.bRemove = true;
+	}
+	if (bSnapshotReads)
+	{
+		if (ObjGenerations.Num() <= InObjID)
+		{
+			ObjGenerations.SetNumZeroed(InObjID + 1);
+		}
+		++ObjGenerations[InObjID];
+		MarkPoolDirty_Internal(InObjID);
+	}
+}
+
+FSensedStimulus IContainerTree::GetSensedStimulusCopy_TS(const ElementIndexType InObjID, const FSenseSysTagSlot& Slot) const
 {
 	int32 ID = INDEX_NONE;
 	{
@@ -62,7 +134,9 @@ FSensedStimulus IContainerTree::GetSensedStimulusCopy_TS(const ElementIndexType
 		{
 			if (GetCompDataPool().IsValidIndex(InObjID))
 			{
-				return GetSensedStimulus(InObjID);
+				FSensedStimulus Out = GetSensedStimulus(InObjID);
+				Out.BitChannels = GetTagChannels_Internal(InObjID, Slot, Out.BitChannels);
+				return Out;
 			}
 			return FSensedStimulus();
 		}
@@ -133,39 +207,121 @@ TSet<IContainerTree::ElementIndexType> IContainerTree::CheckHashSet_TS(const TMa
 	return MoveTemp(OutIDs);
 }
 
+void IContainerTree::GetKNearestIDs_Skip(
+	const FVector Center,
+	const int32 K,
+	const Real MaxRadius,
+	TArray<ElementIndexType>& Out,
+	const uint64 InBitChannels,
+	const int32 SkipHint,
+	const FSenseSysTagSlot& Slot,
+	TFunctionRef<bool(const FSensedStimulus&, uint64 TagChannels)> Skip) const
+{
+	int32 Fetch = K + FMath::Max(SkipHint, 0);
+	while (true)
+	{
+		GetKNearestIDs(Center, Fetch, MaxRadius, Out, InBitChannels);
+		const bool bAllFound = Out.Num() < Fetch;
+		{
+			FRWScopeLock SRWLock(RWLock, SLT_ReadOnly);
+			const TSparseArray<FSensedStimulus>& P = GetCompDataPool();
+			Out.RemoveAll([&](const ElementIndexType ID) { return !P.IsValidIndex(ID) || Skip(P[ID], GetTagChannels_Internal(ID, Slot, P[ID].BitChannels)); });
+		}
+		if (Out.Num() >= K || bAllFound || Fetch >= MAX_int32 / 2)
+		{
+			if (Out.Num() > K)
+			{
+				Out.SetNum(K, false);
+			}
+			return;
+		}
+		Fetch *= 2;
+	}
+}
+
+void IContainerTree::CheckHash_TS(const TMap<ElementIndexType, uint32>& InArr, FSenseSysQueryIDs& Out) const
+{
+	FRWScopeLock SRWLock(RWLock, SLT_ReadOnly);
+	const TSparseArray<FSensedStimulus>& P = GetCompDataPool();
+	for (const auto& Elem : InArr)
+	{
+		if (P.IsValidIndex(Elem.Key) && Elem.Value == P[Elem.Key].TmpHash)
+		{
+			Out.Add(Elem.Key);
+		}
+	}
+}
+
 
 void IContainerTree::SetAge_TS(const ElementIndexType ID, const float AgeValue)
 {
-	FRWScopeLock SRWLock(RWLock, SLT_Write);
+	FWriteScope SRWLock(*this, true);
 	if (GetCompDataPool().IsValidIndex(ID))
 	{
+		MarkPoolDirty_Internal(ID);
 		GetSensedStimulus(ID).Age = AgeValue;
 	}
 }
 
 void IContainerTree::SetScore_TS(const ElementIndexType ID, const float ScoreValue)
 {
-	FRWScopeLock SRWLock(RWLock, SLT_Write);
+	FWriteScope SRWLock(*this, true);
 	if (GetCompDataPool().IsValidIndex(ID))
 	{
+		MarkPoolDirty_Internal(ID);
 		GetSensedStimulus(ID).Score = ScoreValue;
 	}
 }
 
 void IContainerTree::SetChannels_TS(const ElementIndexType ID, const uint64 Channels)
 {
-	FRWScopeLock SRWLock(RWLock, SLT_Write);
+	FWriteScope SRWLock(*this, true);
 	if (GetCompDataPool().IsValidIndex(ID))
 	{
+		MarkPoolDirty_Internal(ID);
 		GetSensedStimulus(ID).BitChannels = Channels;
+		SetElementChannels_Internal(ID, Channels);
+	}
+}
+
+uint64 IContainerTree::SetTagChannels_TS(const ElementIndexType ID, const FSenseSysTagSlot& Slot, const uint64 Channels)
+{
+	FWriteScope SRWLock(*this, true);
+	if (GetCompDataPool().IsValidIndex(ID))
+	{
+		MarkPoolDirty_Internal(ID);
+		FSensedStimulus& Elem = GetSensedStimulus(ID);
+		if (!Slot.IsShared())
+		{
+			Elem.BitChannels = Channels;
+		}
+		else
+		{
+			const int32 SlotNum = TagSlots.Num();
+			const int32 First = static_cast<int32>(ID) * SlotNum;
+			if (TagChannels.Num() < First + SlotNum)
+			{
+				TagChannels.SetNumZeroed(First + SlotNum);
+			}
+			TagChannels[First + Slot.Index] = Channels;
+			Elem.BitChannels = 0;
+			for (int32 i = 0; i < SlotNum; ++i)
+			{
+				Elem.BitChannels |= TagChannels[First + i];
+			}
+		}
+		SetElementChannels_Internal(ID, Elem.BitChannels);
+		return Elem.BitChannels;
 	}
+	return 0;
 }
 
 void IContainerTree::SetSensedPoints_TS(const ElementIndexType ID, const TArray<FSensedPoint>& InSensedPoints, const float InCurrentTime)
 {
-	FRWScopeLock SRWLock(RWLock, SLT_Write);
+	FWriteScope SRWLock(*this, true);
 	if (GetCompDataPool().IsValidIndex(ID))
 	{
+		MarkPoolDirty_Internal(ID);
 		GetSensedStimulus(ID).SensedPoints = InSensedPoints;
 		GetSensedStimulus(ID).SensedTime = InCurrentTime;
 	}
@@ -173,9 +329,10 @@ void IContainerTree::SetSensedPoints_TS(const ElementIndexType ID, const TArray<
 
 void IContainerTree::SetSensedPoints_TS(const ElementIndexType ID, const FSensedPoint& InSensedPoints, const float InCurrentTime)
 {
-	FRWScopeLock SRWLock(RWLock, SLT_Write);
+	FWriteScope SRWLock(*this, true);
 	if (GetCompDataPool().IsValidIndex(ID))
 	{
+		MarkPoolDirty_Internal(ID);
 		GetSensedStimulus(ID).SensedPoints[0] = InSensedPoints;
 		GetSensedStimulus(ID).SensedTime = InCurrentTime;
 	}
@@ -184,9 +341,10 @@ void IContainerTree::SetSensedPoints_TS(const ElementIndexType ID, const FSensed
 
 void IContainerTree::SetSensedPoints_TS(const ElementIndexType ID, TArray<FSensedPoint>&& InSensedPoints, const float InCurrentTime)
 {
-	FRWScopeLock SRWLock(RWLock, SLT_Write);
+	FWriteScope SRWLock(*this, true);
 	if (GetCompDataPool().IsValidIndex(ID))
 	{
+		MarkPoolDirty_Internal(ID);
 		GetSensedStimulus(ID).SensedPoints = InSensedPoints;
 		GetSensedStimulus(ID).SensedTime = InCurrentTime;
 	}
@@ -194,237 +352,895 @@ void IContainerTree::SetSensedPoints_TS(const ElementIndexType ID, TArray<FSense
 
 void IContainerTree::SetSensedPoints_TS(const ElementIndexType ID, FSensedPoint&& InSensedPoints, const float InCurrentTime)
 {
-	FRWScopeLock SRWLock(RWLock, SLT_Write);
+	FWriteScope SRWLock(*this, true);
 	if (GetCompDataPool().IsValidIndex(ID))
 	{
+		MarkPoolDirty_Internal(ID);
 		GetSensedStimulus(ID).SensedPoints[0] = InSensedPoints;
 		GetSensedStimulus(ID).SensedTime = InCurrentTime;
 	}
 }
 
 
-IContainerTree::ElementIndexType FSenseSys_QuadTree::Insert(const FSensedStimulus& ComponentData, const FBox InBox)
+void IContainerTree::StageUpdate(FUpdateItem&& Item)
 {
-	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_QuadTree_Insert);
-
-	FRWScopeLock SRWLock(RWLock, SLT_Write);
-
-	return Tree.Insert(ComponentData, TreeHelper::ToBox2D(InBox));
+	FScopeLock ScopeLock(&StagedCS);
+	StagedUpdates.Add(MoveTemp(Item));
 }
-IContainerTree::ElementIndexType FSenseSys_QuadTree::Insert(FSensedStimulus&& ComponentData, const FBox InBox)
-{
-	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_QuadTree_Insert);
 
-	FRWScopeLock SRWLock(RWLock, SLT_Write);
+void IContainerTree::FlushStagedUpdates()
+{
+	if (bRetunePending)
+	{
+		return;
+	}
+	{
+		FScopeLock ScopeLock(&StagedCS);
+		if (StagedUpdates.Num() == 0)
+		{
+			return;
+		}
+		Swap(StagedUpdates, FlushUpdates);
+	}
+	UpdateBatch(FlushUpdates);
+	FlushUpdates.Reset();
+}
 
-	return Tree.Insert(MoveTemp(ComponentData), TreeHelper::ToBox2D(InBox));
+void IContainerTree::DiscardStagedUpdates()
+{
+	FScopeLock ScopeLock(&StagedCS);
+	StagedUpdates.Reset();
 }
 
-void FSenseSys_QuadTree::Update(const ElementIndexType InObjID, const FBox NewBox)
+void IContainerTree::SetSnapshotReads(const bool bEnable)
 {
-	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_QuadTree_Update);
+	FScopeLock ScopeLock(&SnapshotCS);
+	bSnapshotReads = bEnable;
+	bPoolDirtyAll = true;
+	DirtyIDs.Empty();
+	PrevDirtyIDs.Empty();
+	if (!bEnable)
+	{
+		Snapshot.Reset();
+		RetiredSnapshot.Reset();
+		ObjGenerations.Empty();
+	}
+}
 
-	FRWScopeLock SRWLock(RWLock, SLT_Write);
+void IContainerTree::PublishSnapshot()
+{
+	if (!bSnapshotReads)
+	{
+		return;
+	}
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_PublishSnapshot);
 
-	if (InObjID != MaxIndex())
+	FRWScopeLock SRWLock(RWLock, SLT_ReadOnly);
+	if (Snapshot.IsValid() && Snapshot->Epoch == PoolEpoch)
 	{
-		Tree.Update(InObjID, TreeHelper::ToBox2D(NewBox));
+		return;
 	}
+	PublishSnapshot_Internal();
 }
 
-bool FSenseSys_QuadTree::Remove(const ElementIndexType InObjID)
+void IContainerTree::PublishSnapshot_Internal()
 {
-	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_QuadTree_Remove);
+	TSharedPtr<FReadSnapshot, ESPMode::ThreadSafe> Next;
 
-	FRWScopeLock SRWLock(RWLock, SLT_Write);
+	// readers only ever pin the current version, a unique retired one is free to overwrite,
+	// it is two publishes old and misses the writes of both
+	bool bFullCopy = bPoolDirtyAll || bPrevDirtyAll;
+	if (RetiredSnapshot.IsValid() && RetiredSnapshot.IsUnique())
+	{
+		Next = MoveTemp(RetiredSnapshot);
+	}
+	else
+	{
+		Next = MakeShared<FReadSnapshot, ESPMode::ThreadSafe>();
+		bFullCopy = true;
+	}
 
-	if (IndexRemoveControl.bTrack)
+	const TSparseArray<FSensedStimulus>& Pool = GetCompDataPool();
+	const int32 MaxNum = Pool.GetMaxIndex();
+	const int32 SlotNum = TagSlots.Num();
+	Next->TagSlotNum = SlotNum;
+	const auto CopyElement = [&](const int32 i)
 	{
-		IndexRemoveControl.RemIDs.Add(InObjID);
-		IndexRemoveControl.bRemove = true;
+		if (Pool.IsAllocated(i))
+		{
+			Next->Elements[i] = Pool[i];
+		}
+		else
+		{
+			Next->Elements[i].TmpHash = MAX_uint32;
+		}
+		Next->Generations[i] = ObjGenerations.IsValidIndex(i) ? ObjGenerations[i] : 0;
+		for (int32 s = 0; s < SlotNum; ++s)
+		{
+			const int32 Idx = i * SlotNum + s;
+			Next->TagChannels[Idx] = TagChannels.IsValidIndex(Idx) ? TagChannels[Idx] : 0;
+		}
+	};
+
+	const int32 OldNum = bFullCopy ? 0 : FMath::Min(Next->Elements.Num(), MaxNum);
+	Next->Epoch = PoolEpoch;
+	Next->Elements.SetNum(MaxNum, false);
+	Next->Generations.SetNum(MaxNum, false);
+	Next->TagChannels.SetNum(MaxNum * SlotNum, false);
+	for (int32 i = OldNum; i < MaxNum; i++)
+	{
+		CopyElement(i);
 	}
-	check(InObjID != MaxIndex());
-	Tree.Remove(InObjID);
+	if (!bFullCopy)
+	{
+		const auto CopyDirty = [&](const TArray<ElementIndexType>& Dirty)
+		{
+			for (const ElementIndexType ID : Dirty)
+			{
+				if (ID < OldNum)
+				{
+					CopyElement(ID);
+				}
+			}
+		};
+		CopyDirty(PrevDirtyIDs);
+		CopyDirty(DirtyIDs);
+	}
+	Swap(PrevDirtyIDs, DirtyIDs);
+	DirtyIDs.Reset();
+	bPrevDirtyAll = bPoolDirtyAll;
+	bPoolDirtyAll = false;
 
-	return true;
+	FScopeLock ScopeLock(&SnapshotCS);
+	RetiredSnapshot = MoveTemp(Snapshot);
+	Snapshot = MoveTemp(Next);
 }
 
-void FSenseSys_QuadTree::Clear()
+IContainerTree::FSnapshotPtr IContainerTree::PinSnapshot() const
 {
-	FRWScopeLock SRWLock(RWLock, SLT_Write);
-
-	Tree.Clear();
+	FScopeLock ScopeLock(&SnapshotCS);
+	return Snapshot;
 }
 
-void FSenseSys_QuadTree::Collapse()
+void IContainerTree::GetGenerations_TS(const TArray<ElementIndexType>& IDs, TArray<uint32>& Out) const
 {
-	FRWScopeLock SRWLock(RWLock, SLT_Write);
+	Out.SetNumUninitialized(IDs.Num());
+	FRWScopeLock SRWLock(RWLock, SLT_ReadOnly);
+	for (int32 i = 0; i < IDs.Num(); ++i)
+	{
+		Out[i] = ObjGenerations.IsValidIndex(IDs[i]) ? ObjGenerations[IDs[i]] : 0;
+	}
+}
 
-	Tree.CollapseQt();
+void IContainerTree::SetTagSlots(TArray<TPair<FName, FSenseSysTagSlot>>&& InTagSlots)
+{
+	check(Num() == 0);
+	TagSlots = MoveTemp(InTagSlots);
+	TagChannels.Reset();
 }
 
+FSenseSysTagSlot IContainerTree::GetTagSlot(const FName Tag) const
+{
+	for (const TPair<FName, FSenseSysTagSlot>& It : TagSlots)
+	{
+		if (It.Key == Tag)
+		{
+			return It.Value;
+		}
+	}
+	return FSenseSysTagSlot();
+}
 
-IContainerTree::ElementIndexType FSenseSys_OcTree::Insert(const FSensedStimulus& ComponentData, const FBox InBox)
+int32 IContainerTree::NumFreeSlots() const
 {
-	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_OcTree_Insert);
+	FRWScopeLock SRWLock(RWLock, SLT_ReadOnly);
+	return GetCompDataPool().GetMaxIndex() - GetCompDataPool().Num();
+}
 
-	FRWScopeLock SRWLock(RWLock, SLT_Write);
+uint32 IContainerTree::NewSerial()
+{
+	static int32 LastSerial = 0;
+	return static_cast<uint32>(FPlatformAtomics::InterlockedIncrement(&LastSerial));
+}
 
-	return Tree.Insert(ComponentData, InBox);
+float IContainerTree::GetFragmentation() const
+{
+	FRWScopeLock SRWLock(RWLock, SLT_ReadOnly);
+	const int32 MaxNum = GetCompDataPool().GetMaxIndex();
+	return MaxNum > 0 ? static_cast<float>(MaxNum - GetCompDataPool().Num()) / MaxNum : 0.f;
 }
-IContainerTree::ElementIndexType FSenseSys_OcTree::Insert(FSensedStimulus&& ComponentData, const FBox InBox)
+
+bool IContainerTree::Compact(TArray<ElementIndexType>& OutRemap)
 {
-	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_OcTree_Insert);
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_Compact);
 
 	FRWScopeLock SRWLock(RWLock, SLT_Write);
+	// a running query would read its IDs in the new layout
+	if (IndexRemoveControl.bTrack || SnapshotQueries.GetValue() != 0)
+	{
+		return false;
+	}
+	++PoolEpoch;
+	MarkAllIDsChanged_Internal();
+	Compact_Internal(OutRemap);
+
+	if (const int32 SlotNum = TagSlots.Num())
+	{
+		TArray<uint64> Remapped;
+		Remapped.SetNumZeroed(OutRemap.Num() * SlotNum);
+		for (int32 Old = 0; Old < OutRemap.Num(); ++Old)
+		{
+			if (OutRemap[Old] != MaxIndex() && TagChannels.Num() >= (Old + 1) * SlotNum)
+			{
+				FMemory::Memcpy(&Remapped[static_cast<int32>(OutRemap[Old]) * SlotNum], &TagChannels[Old * SlotNum], SlotNum * sizeof(uint64));
+			}
+		}
+		TagChannels = MoveTemp(Remapped);
+	}
+
+	// sensors pin the snapshot after their query, the old one is never read with the new IDs
+	if (bSnapshotReads)
+	{
+		PublishSnapshot_Internal();
+	}
 
-	return Tree.Insert(MoveTemp(ComponentData), InBox);
+	FScopeLock ScopeLock(&StagedCS);
+	for (FUpdateItem& Item : StagedUpdates)
+	{
+		Item.ObjID = OutRemap.IsValidIndex(Item.ObjID) ? OutRemap[Item.ObjID] : MaxIndex();
+	}
+	return true;
 }
 
-void FSenseSys_OcTree::Update(const ElementIndexType InObjID, const FBox NewBox)
+void IContainerTree::GetStats(FSenseSysTreeStats& OutStats) const
 {
-	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_OcTree_Update);
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_GetStats);
 
-	FRWScopeLock SRWLock(RWLock, SLT_Write);
+	OutStats = FSenseSysTreeStats();
+	FRWScopeLock SRWLock(RWLock, SLT_ReadOnly);
+	OutStats.NumElements = GetCompDataPool().Num();
+	OutStats.ElementPoolBytes = GetCompDataPool().GetAllocatedSize();
+	GetStats_Internal(OutStats);
+}
 
-	if (InObjID != MaxIndex())
-	{
-		Tree.Update(InObjID, NewBox);
-	}
+void IContainerTree::ResetStats()
+{
+	FRWScopeLock SRWLock(RWLock, SLT_Write);
+	ResetStats_Internal();
 }
 
-bool FSenseSys_OcTree::Remove(const ElementIndexType InObjID)
+bool IContainerTree::ShiftOrigin(const FVector& Offset)
 {
-	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_OcTree_Remove);
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_ShiftOrigin);
 
 	FRWScopeLock SRWLock(RWLock, SLT_Write);
+	if (!ShiftOrigin_Internal(Offset))
+	{
+		return false;
+	}
+	++PoolEpoch;
+	bPoolDirtyAll = true;
+	for (FSensedStimulus& It : GetCompDataPool())
+	{
+		for (FSensedPoint& Point : It.SensedPoints)
+		{
+			Point.SensedPoint += Offset;
+		}
+	}
+	if (bSnapshotReads)
+	{
+		PublishSnapshot_Internal();
+	}
 
-	if (IndexRemoveControl.bTrack)
+	FScopeLock ScopeLock(&StagedCS);
+	for (FUpdateItem& Item : StagedUpdates)
 	{
-		IndexRemoveControl.RemIDs.Add(InObjID);
-		IndexRemoveControl.bRemove = true;
+		Item.Box = Item.Box.ShiftBy(Offset);
+		for (FVector& Point : Item.Points)
+		{
+			Point += Offset;
+		}
 	}
-	check(InObjID != MaxIndex());
-	Tree.Remove(InObjID);
 	return true;
 }
 
-void FSenseSys_OcTree::Clear()
+IContainerTree::FRetuneBuildPtr IContainerTree::BeginRetune(const float MinimumSize, const int32 NodeCantSplit)
 {
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_BeginRetune);
+	check(IsInGameThread());
 
-	FRWScopeLock SRWLock(RWLock, SLT_Write);
-
-	Tree.Clear();
+	FRetuneBuildPtr Build;
+	{
+		FRWScopeLock SRWLock(RWLock, SLT_ReadOnly);
+		Build = BeginRetune_Internal(MinimumSize, NodeCantSplit);
+	}
+	if (Build.IsValid())
+	{
+		Build->TreeSerial = Serial;
+		bRetunePending = true;
+	}
+	return Build;
 }
 
-void FSenseSys_OcTree::Collapse()
+bool IContainerTree::FinishRetune(FRetuneBuild& Build)
 {
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_FinishRetune);
+	check(IsInGameThread());
+	check(Build.TreeSerial == Serial);
 
+	bRetunePending = false;
+	// the element pool is not touched, no epoch advance and no snapshot
 	FRWScopeLock SRWLock(RWLock, SLT_Write);
-
-	Tree.CollapseQt();
+	return FinishRetune_Internal(Build);
 }
 
-
-void FSenseSys_QuadTree::GetInBoxIDs(const FBox Box, TArray<ElementIndexType>& Out, const uint64 InBitChannels) const
+float IContainerTree::GetMedianElementSize(const int32 MaxSamples) const
 {
-	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_OcTree_GetInBox);
-
 	FRWScopeLock SRWLock(RWLock, SLT_ReadOnly);
+	return GetMedianElementSize_Internal(MaxSamples);
+}
 
-	const FBox2D Box2D(FVector2D(Box.Min), FVector2D(Box.Max));
-	const auto InBox = FInBoxPredicate(Tree, Box2D, InBitChannels);
-	Tree.GetElementsIDs(Box2D, InBox, Out);
+void IContainerTree::CopyCounters(const FTreeCounters& Counters, FSenseSysTreeStats& OutStats)
+{
+	OutStats.Splits = Counters.Splits;
+	OutStats.Collapses = Counters.Collapses;
+	OutStats.Reinserts = Counters.Reinserts;
+	OutStats.Queries = Counters.Queries.GetValue();
+	OutStats.VisitedNodes = Counters.VisitedNodes.GetValue();
+	OutStats.VisitedElements = Counters.VisitedElements.GetValue();
 }
-void FSenseSys_QuadTree::GetInRadiusIDs(const FSenseSys_QuadTree::Real Radius, const FVector Center, TArray<ElementIndexType>& Out, const uint64 InBitChannels) const
+
+void IContainerTree::SortSegmentHits(FSegmentHits& Hits, TArray<ElementIndexType>& Out)
 {
-	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_OcTree_GetInRadius);
+	Hits.Sort();
+	Out.Reset();
+	Out.Reserve(Hits.Num());
+	for (const FSegmentHit& Hit : Hits)
+	{
+		Out.Add(Hit.ObjID);
+	}
+}
 
-	FRWScopeLock SRWLock(RWLock, SLT_ReadOnly);
+bool IContainerTree::SetUpdateItemPoints_Internal(const FUpdateItem& Item)
+{
+	TSparseArray<FSensedStimulus>& Pool = GetCompDataPool();
+	if (!Pool.IsValidIndex(Item.ObjID) || Item.Points.Num() == 0)
+	{
+		return false;
+	}
+	FSensedStimulus& SS = Pool[Item.ObjID];
+	if (SS.TmpHash != Item.TmpHash)
+	{
+		return false;
+	}
 
-	const auto InRadius = FInRadiusPredicate(Tree, Center, Radius, InBitChannels);
-	Tree.GetElementsIDs(InRadius.Box, InRadius, Out);
+	bool bNeedUpdt = false;
+	const int32 PNum = Item.bAllPoints ? Item.Points.Num() : 1;
+	if (Item.bAllPoints ? SS.SensedPoints.Num() != PNum : SS.SensedPoints.Num() == 0)
+	{
+		SS.SensedPoints.SetNum(PNum);
+		bNeedUpdt = true;
+	}
+	for (int32 i = 0; i < PNum; i++)
+	{
+		const FSensedPoint SP = FSensedPoint(Item.Points[i], SS.Score);
+		if (SS.SensedPoints[i] != SP)
+		{
+			SS.SensedPoints[i] = SP;
+			bNeedUpdt = true;
+		}
+	}
+	// a stopped swept stimulus still shrinks its box
+	if (SS.SweepOffset != Item.SweepOffset)
+	{
+		SS.SweepOffset = Item.SweepOffset;
+		bNeedUpdt = true;
+	}
+	if (bNeedUpdt)
+	{
+		SS.SensedTime = Item.Time;
+		MarkPoolDirty_Internal(Item.ObjID);
+	}
+	return bNeedUpdt;
 }
-void FSenseSys_QuadTree::GetInBoxRadiusIDs(
-	const FBox Box,
-	const FVector Center,
-	const FSenseSys_QuadTree::Real Radius,
-	TArray<ElementIndexType>& Out,
-	const uint64 InBitChannels) const
-{
-	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_OcTree_GetInBoxRadius);
 
-	FRWScopeLock SRWLock(RWLock, SLT_ReadOnly);
 
-	const FBox2D Box2D(FVector2D(Box.Min), FVector2D(Box.Max));
-	const auto InRadius = FInRadiusPredicate(Tree, Center, Radius, Box2D, InBitChannels);
-	Tree.GetElementsIDs(InRadius.Box, InRadius, Out);
+int32 IContainerTree::FitElementCount_Internal(const int32 AddNum, const int32 MaxElements) const
+{
+	const int32 FreeNum = FMath::Max(MaxElements - GetCompDataPool().Num(), 0);
+	if (AddNum > FreeNum)
+	{
+		UE_LOG(
+			LogSenseSys,
+			Warning,
+			TEXT("SenseSys container is full, %d of %d stimuli not added, max elements: %d, use 32 bit ElementIndexWidth for this SensorTag"),
+			AddNum - FreeNum,
+			AddNum,
+			MaxElements);
+		return FreeNum;
+	}
+	return AddNum;
 }
 
-void FSenseSys_QuadTree::GetInBoxIDs(const FBox Box, TSet<ElementIndexType>& Out, const uint64 InBitChannels) const
+template<typename TElementIdx, typename TNodeIdx>
+IContainerTree::ElementIndexType TSenseSys_QuadTree<TElementIdx, TNodeIdx>::Insert(const FSensedStimulus& ComponentData, const FBox InBox)
 {
-	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_OcTree_GetInBox);
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_QuadTree_Insert);
 
-	FRWScopeLock SRWLock(RWLock, SLT_ReadOnly);
+	FWriteScope SRWLock(*this, true);
 
-	const FBox2D Box2D(FVector2D(Box.Min), FVector2D(Box.Max));
-	const auto InBox = FInBoxPredicate(Tree, Box2D, InBitChannels);
-	Tree.GetElementsIDs(Box2D, InBox, Out);
+	if (FitElementCount_Internal(1, MaxElements) == 0)
+	{
+		return MaxIndex();
+	}
+	return MarkPoolDirty_Internal(Tree.Insert(ComponentData, TreeHelper::ToBox2D(InBox), ComponentData.BitChannels, FTreeZRange(InBox)));
 }
-void FSenseSys_QuadTree::GetInRadiusIDs(const FSenseSys_QuadTree::Real Radius, const FVector Center, TSet<ElementIndexType>& Out, const uint64 InBitChannels) const
+template<typename TElementIdx, typename TNodeIdx>
+IContainerTree::ElementIndexType TSenseSys_QuadTree<TElementIdx, TNodeIdx>::Insert(FSensedStimulus&& ComponentData, const FBox InBox)
 {
-	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_OcTree_GetInRadius);
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_QuadTree_Insert);
 
-	FRWScopeLock SRWLock(RWLock, SLT_ReadOnly);
+	FWriteScope SRWLock(*this, true);
 
-	const auto InRadius = FInRadiusPredicate(Tree, Center, Radius, InBitChannels);
-	Tree.GetElementsIDs(InRadius.Box, InRadius, Out);
+	if (FitElementCount_Internal(1, MaxElements) == 0)
+	{
+		return MaxIndex();
+	}
+	const uint64 Channels = ComponentData.BitChannels;
+	return MarkPoolDirty_Internal(Tree.Insert(MoveTemp(ComponentData), TreeHelper::ToBox2D(InBox), Channels, FTreeZRange(InBox)));
 }
-void FSenseSys_QuadTree::GetInBoxRadiusIDs(const FBox Box, const FVector Center, const FSenseSys_QuadTree::Real Radius, TSet<ElementIndexType>& Out, const uint64 InBitChannels) const
+
+template<typename TElementIdx, typename TNodeIdx>
+void TSenseSys_QuadTree<TElementIdx, TNodeIdx>::Update(const ElementIndexType InObjID, const FBox NewBox)
 {
-	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_OcTree_GetInBoxRadius);
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_QuadTree_Update);
 
-	FRWScopeLock SRWLock(RWLock, SLT_ReadOnly);
+	FWriteScope SRWLock(*this, true);
 
-	const FBox2D Box2D(FVector2D(Box.Min), FVector2D(Box.Max));
-	const auto InRadius = FInRadiusPredicate(Tree, Center, Radius, Box2D, InBitChannels);
-	Tree.GetElementsIDs(InRadius.Box, InRadius, Out);
+	if (InObjID != MaxIndex())
+	{
+		Tree.Update(static_cast<TElementIdx>(InObjID), TreeHelper::ToBox2D(NewBox));
+		Tree.SetElementZ(static_cast<TElementIdx>(InObjID), FTreeZRange(NewBox));
+	}
 }
 
-FBox FSenseSys_QuadTree::GetMaxIntersect(const FBox Box) const
+template<typename TElementIdx, typename TNodeIdx>
+void TSenseSys_QuadTree<TElementIdx, TNodeIdx>::UpdateBatch(const TArray<FUpdateItem>& Items)
 {
-	const TreeIndexType MaxIntersect = Tree.GetMaxIntersect(TreeHelper::ToBox2D(Box));
-	if (MaxIntersect != MaxIndex())
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_QuadTree_UpdateBatch);
+
+	FWriteScope SRWLock(*this, true);
+
+	// the points are written here, the tree moves the boxes in one batch
+	TArray<TElementIdx> TreeIDs;
+	TArray<typename TreeType::BoxType> Boxes;
+	TArray<FTreeZRange> ZRanges;
+	TreeIDs.Reserve(Items.Num());
+	Boxes.Reserve(Items.Num());
+	ZRanges.Reserve(Items.Num());
+	for (const FUpdateItem& It : Items)
 	{
-		const FBox2D Box2D = Tree.GetTreeBox(MaxIntersect);
-		return TreeHelper::ToBox(Box2D);
+		if (SetUpdateItemPoints_Internal(It))
+		{
+			TreeIDs.Add(static_cast<TElementIdx>(It.ObjID));
+			Boxes.Add(TreeHelper::ToBox2D(It.Box));
+			ZRanges.Add(FTreeZRange(It.Box));
+		}
 	}
-	return FBox(FVector::ZeroVector, FVector::ZeroVector);
+	Tree.UpdateBatch(TreeIDs.GetData(), Boxes.GetData(), TreeIDs.Num());
+
+	// the Z ranges walk up shared nodes, they stay on this thread
+	for (int32 i = 0; i < TreeIDs.Num(); ++i)
+	{
+		Tree.SetElementZ(TreeIDs[i], ZRanges[i]);
+	}
+}
+
+template<typename TElementIdx, typename TNodeIdx>
+void TSenseSys_QuadTree<TElementIdx, TNodeIdx>::BulkInsert(TArray<FSensedStimulus>&& ComponentsData, const TArray<FBox>& InBoxes, TArray<ElementIndexType>& OutIDs)
+{
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_QuadTree_BulkInsert);
+
+	TArray<typename TreeType::BoxType> Boxes;
+	TArray<FTreeZRange> ZRanges;
+	Boxes.Reserve(InBoxes.Num());
+	ZRanges.Reserve(InBoxes.Num());
+	for (const FBox& It : InBoxes)
+	{
+		Boxes.Add(TreeHelper::ToBox2D(It));
+		ZRanges.Add(FTreeZRange(It));
+	}
+
+	FWriteScope SRWLock(*this, true);
+
+	const int32 Count = FitElementCount_Internal(InBoxes.Num(), MaxElements);
+	ComponentsData.SetNum(Count);
+	Boxes.SetNum(Count);
+	ZRanges.SetNum(Count);
+
+	TArray<uint64> Masks;
+	Masks.SetNumUninitialized(Count);
+	for (int32 i = 0; i < Count; ++i)
+	{
+		Masks[i] = ComponentsData[i].BitChannels;
+	}
+
+	TArray<TElementIdx> TreeIDs;
+	Tree.BulkInsert(MoveTemp(ComponentsData), Boxes, TreeIDs, Masks.GetData(), ZRanges.GetData());
+	OutIDs.Init(MaxIndex(), InBoxes.Num());
+	for (int32 i = 0; i < Count; ++i)
+	{
+		OutIDs[i] = MarkPoolDirty_Internal(TreeIDs[i]);
+	}
+}
+
+template<typename TElementIdx, typename TNodeIdx>
+bool TSenseSys_QuadTree<TElementIdx, TNodeIdx>::Remove(const ElementIndexType InObjID)
+{
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_QuadTree_Remove);
+
+	FWriteScope SRWLock(*this, true);
+
+	check(InObjID != MaxIndex());
+	RecordRemove_Internal(InObjID);
+	Tree.Remove(static_cast<TElementIdx>(InObjID));
+
+	return true;
+}
+
+template<typename TElementIdx, typename TNodeIdx>
+void TSenseSys_QuadTree<TElementIdx, TNodeIdx>::Clear()
+{
+	FWriteScope SRWLock(*this);
+
+	Tree.Clear();
+	ClearTagChannels_Internal();
+	DiscardStagedUpdates();
+}
+
+template<typename TElementIdx, typename TNodeIdx>
+void TSenseSys_QuadTree<TElementIdx, TNodeIdx>::Collapse()
+{
+	FRWScopeLock SRWLock(RWLock, SLT_Write);
+
+	Tree.CollapseQt();
+}
+
+template<typename TElementIdx, typename TNodeIdx>
+void TSenseSys_QuadTree<TElementIdx, TNodeIdx>::CollapseQueued(const int32 Budget)
+{
+	{
+		FRWScopeLock SRWLock(RWLock, SLT_ReadOnly);
+		if (!Tree.IsCollapseQueued())
+		{
+			return;
+		}
+	}
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_QuadTree_CollapseQueued);
+
+	FRWScopeLock SRWLock(RWLock, SLT_Write);
+	Tree.CollapseQueued(Budget);
+}
+
+template<typename TElementIdx, typename TNodeIdx>
+void TSenseSys_QuadTree<TElementIdx, TNodeIdx>::Compact_Internal(TArray<ElementIndexType>& OutRemap)
+{
+	TArray<TElementIdx> TreeRemap;
+	Tree.Compact(TreeRemap);
+
+	OutRemap.SetNumUninitialized(TreeRemap.Num());
+	for (int32 i = 0; i < TreeRemap.Num(); ++i)
+	{
+		OutRemap[i] = TreeRemap[i] == TNumericLimits<TElementIdx>::Max() ? MaxIndex() : static_cast<ElementIndexType>(TreeRemap[i]);
+	}
+}
+
+namespace SenseSysRetune
+{
+	/** the tree copy is made on the game thread, the nodes are built where Build runs */
+	template<typename TreeType>
+	struct TRetuneBuild final : IContainerTree::FRetuneBuild
+	{
+		TRetuneBuild(const TreeType& Source, const float InMinimumSize, const int32 InNodeCantSplit)
+			: Tree(InMinimumSize, InNodeCantSplit, 0, 0, Source.GetLooseFactor())
+			, MinimumSize(InMinimumSize)
+			, NodeCantSplit(InNodeCantSplit)
+		{
+			Tree.CopyForRebuild(Source);
+		}
+
+		virtual void Build() override { Tree.Rebuild(MinimumSize, NodeCantSplit); }
+
+		TreeType Tree;
+		const float MinimumSize;
+		const int32 NodeCantSplit;
+	};
+
+	/** largest edge of every Step-th element box, the median of the sorted sample */
+	template<typename TreeType>
+	float MedianElementSize(const TreeType& Tree, const int32 MaxSamples)
+	{
+		const auto& ElementPool = Tree.GetElementPool();
+		if (ElementPool.Num() == 0 || MaxSamples <= 0)
+		{
+			return 0.f;
+		}
+		const int32 Step = FMath::Max(ElementPool.Num() / MaxSamples, 1);
+		TArray<float> Sizes;
+		Sizes.Reserve(FMath::Min(ElementPool.Num(), MaxSamples) + 1);
+		int32 i = 0;
+		for (auto It = ElementPool.CreateConstIterator(); It; ++It, ++i)
+		{
+			if (i % Step == 0)
+			{
+				const auto ObjID = static_cast<typename TreeType::TreeElementIdxType>(It.GetIndex());
+				Sizes.Add(static_cast<float>(Tree.GetElementBox(ObjID).GetSize().GetMax()));
+			}
+		}
+		Sizes.Sort();
+		return Sizes[Sizes.Num() / 2];
+	}
+} // namespace SenseSysRetune
+
+template<typename TElementIdx, typename TNodeIdx>
+void TSenseSys_QuadTree<TElementIdx, TNodeIdx>::GetStats_Internal(FSenseSysTreeStats& OutStats) const
+{
+	Tree.ForEachNode(
+		[&OutStats](const typename TreeType::TreeNodeType& Node, const int32 Depth)
+		{
+			++OutStats.NumNodes;
+			if (Node.IsLeaf())
+			{
+				OutStats.AddLeaf(Node.Nodes.Num(), Depth);
+			}
+		});
+	OutStats.PoolBytes = Tree.GetPoolAllocatedSize();
+	OutStats.DataBytes = Tree.GetDataAllocatedSize();
+	OutStats.MinimumSize = static_cast<float>(Tree.GetMinimumQuadSize());
+	OutStats.NodeCantSplit = Tree.GetNodeCantSplit();
+	CopyCounters(Tree.GetCounters(), OutStats);
+}
+
+template<typename TElementIdx, typename TNodeIdx>
+IContainerTree::FRetuneBuildPtr TSenseSys_QuadTree<TElementIdx, TNodeIdx>::BeginRetune_Internal(const float MinimumSize, const int32 NodeCantSplit) const
+{
+	return MakeShared<SenseSysRetune::TRetuneBuild<TreeType>, ESPMode::ThreadSafe>(Tree, MinimumSize, NodeCantSplit);
+}
+
+template<typename TElementIdx, typename TNodeIdx>
+bool TSenseSys_QuadTree<TElementIdx, TNodeIdx>::FinishRetune_Internal(FRetuneBuild& Build)
+{
+	return Tree.TakeRebuiltNodes(MoveTemp(static_cast<SenseSysRetune::TRetuneBuild<TreeType>&>(Build).Tree));
+}
+
+template<typename TElementIdx, typename TNodeIdx>
+float TSenseSys_QuadTree<TElementIdx, TNodeIdx>::GetMedianElementSize_Internal(const int32 MaxSamples) const
+{
+	return SenseSysRetune::MedianElementSize(Tree, MaxSamples);
+}
+
+
+template<typename TElementIdx, typename TNodeIdx>
+IContainerTree::ElementIndexType TSenseSys_OcTree<TElementIdx, TNodeIdx>::Insert(const FSensedStimulus& ComponentData, const FBox InBox)
+{
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_OcTree_Insert);
+
+	FWriteScope SRWLock(*this, true);
+
+	if (FitElementCount_Internal(1, MaxElements) == 0)
+	{
+		return MaxIndex();
+	}
+	return MarkPoolDirty_Internal(Tree.Insert(ComponentData, InBox, ComponentData.BitChannels));
+}
+template<typename TElementIdx, typename TNodeIdx>
+IContainerTree::ElementIndexType TSenseSys_OcTree<TElementIdx, TNodeIdx>::Insert(FSensedStimulus&& ComponentData, const FBox InBox)
+{
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_OcTree_Insert);
+
+	FWriteScope SRWLock(*this, true);
+
+	if (FitElementCount_Internal(1, MaxElements) == 0)
+	{
+		return MaxIndex();
+	}
+	const uint64 Channels = ComponentData.BitChannels;
+	return MarkPoolDirty_Internal(Tree.Insert(MoveTemp(ComponentData), InBox, Channels));
+}
+
+template<typename TElementIdx, typename TNodeIdx>
+void TSenseSys_OcTree<TElementIdx, TNodeIdx>::Update(const ElementIndexType InObjID, const FBox NewBox)
+{
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_OcTree_Update);
+
+	FWriteScope SRWLock(*this, true);
+
+	if (InObjID != MaxIndex())
+	{
+		Tree.Update(static_cast<TElementIdx>(InObjID), NewBox);
+	}
+}
+
+template<typename TElementIdx, typename TNodeIdx>
+void TSenseSys_OcTree<TElementIdx, TNodeIdx>::UpdateBatch(const TArray<FUpdateItem>& Items)
+{
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_OcTree_UpdateBatch);
+
+	FWriteScope SRWLock(*this, true);
+
+	// the points are written here, the tree moves the boxes in one batch
+	TArray<TElementIdx> TreeIDs;
+	TArray<typename TreeType::BoxType> Boxes;
+	TreeIDs.Reserve(Items.Num());
+	Boxes.Reserve(Items.Num());
+	for (const FUpdateItem& It : Items)
+	{
+		if (SetUpdateItemPoints_Internal(It))
+		{
+			TreeIDs.Add(static_cast<TElementIdx>(It.ObjID));
+			Boxes.Add(It.Box);
+		}
+	}
+	Tree.UpdateBatch(TreeIDs.GetData(), Boxes.GetData(), TreeIDs.Num());
+}
+
+template<typename TElementIdx, typename TNodeIdx>
+void TSenseSys_OcTree<TElementIdx, TNodeIdx>::BulkInsert(TArray<FSensedStimulus>&& ComponentsData, const TArray<FBox>& InBoxes, TArray<ElementIndexType>& OutIDs)
+{
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_OcTree_BulkInsert);
+
+	TArray<typename TreeType::BoxType> Boxes;
+	Boxes.Reserve(InBoxes.Num());
+	for (const FBox& It : InBoxes)
+	{
+		Boxes.Add(It);
+	}
+
+	FWriteScope SRWLock(*this, true);
+
+	const int32 Count = FitElementCount_Internal(InBoxes.Num(), MaxElements);
+	ComponentsData.SetNum(Count);
+	Boxes.SetNum(Count);
+
+	TArray<uint64> Masks;
+	Masks.SetNumUninitialized(Count);
+	for (int32 i = 0; i < Count; ++i)
+	{
+		Masks[i] = ComponentsData[i].BitChannels;
+	}
+
+	TArray<TElementIdx> TreeIDs;
+	Tree.BulkInsert(MoveTemp(ComponentsData), Boxes, TreeIDs, Masks.GetData());
+	OutIDs.Init(MaxIndex(), InBoxes.Num());
+	for (int32 i = 0; i < Count; ++i)
+	{
+		OutIDs[i] = MarkPoolDirty_Internal(TreeIDs[i]);
+	}
+}
+
+template<typename TElementIdx, typename TNodeIdx>
+bool TSenseSys_OcTree<TElementIdx, TNodeIdx>::Remove(const ElementIndexType InObjID)
+{
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_OcTree_Remove);
+
+	FWriteScope SRWLock(*this, true);
+
+	check(InObjID != MaxIndex());
+	RecordRemove_Internal(InObjID);
+	Tree.Remove(static_cast<TElementIdx>(InObjID));
+	return true;
+}
+
+template<typename TElementIdx, typename TNodeIdx>
+void TSenseSys_OcTree<TElementIdx, TNodeIdx>::Clear()
+{
+
+	FWriteScope SRWLock(*this);
+
+	Tree.Clear();
+	ClearTagChannels_Internal();
+	DiscardStagedUpdates();
+}
+
+template<typename TElementIdx, typename TNodeIdx>
+void TSenseSys_OcTree<TElementIdx, TNodeIdx>::Collapse()
+{
+
+	FRWScopeLock SRWLock(RWLock, SLT_Write);
+
+	Tree.CollapseQt();
+}
+
+template<typename TElementIdx, typename TNodeIdx>
+void TSenseSys_OcTree<TElementIdx, TNodeIdx>::CollapseQueued(const int32 Budget)
+{
+	{
+		FRWScopeLock SRWLock(RWLock, SLT_ReadOnly);
+		if (!Tree.IsCollapseQueued())
+		{
+			return;
+		}
+	}
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_OcTree_CollapseQueued);
+
+	FRWScopeLock SRWLock(RWLock, SLT_Write);
+	Tree.CollapseQueued(Budget);
+}
+
+template<typename TElementIdx, typename TNodeIdx>
+void TSenseSys_OcTree<TElementIdx, TNodeIdx>::Compact_Internal(TArray<ElementIndexType>& OutRemap)
+{
+	TArray<TElementIdx> TreeRemap;
+	Tree.Compact(TreeRemap);
+
+	OutRemap.SetNumUninitialized(TreeRemap.Num());
+	for (int32 i = 0; i < TreeRemap.Num(); ++i)
+	{
+		OutRemap[i] = TreeRemap[i] == TNumericLimits<TElementIdx>::Max() ? MaxIndex() : static_cast<ElementIndexType>(TreeRemap[i]);
+	}
+}
+
+template<typename TElementIdx, typename TNodeIdx>
+void TSenseSys_OcTree<TElementIdx, TNodeIdx>::GetStats_Internal(FSenseSysTreeStats& OutStats) const
+{
+	Tree.ForEachNode(
+		[&OutStats](const typename TreeType::TreeNodeType& Node, const int32 Depth)
+		{
+			++OutStats.NumNodes;
+			if (Node.IsLeaf())
+			{
+				OutStats.AddLeaf(Node.Nodes.Num(), Depth);
+			}
+		});
+	OutStats.PoolBytes = Tree.GetPoolAllocatedSize();
+	OutStats.DataBytes = Tree.GetDataAllocatedSize();
+	OutStats.MinimumSize = static_cast<float>(Tree.GetMinimumQuadSize());
+	OutStats.NodeCantSplit = Tree.GetNodeCantSplit();
+	CopyCounters(Tree.GetCounters(), OutStats);
+}
+
+template<typename TElementIdx, typename TNodeIdx>
+IContainerTree::FRetuneBuildPtr TSenseSys_OcTree<TElementIdx, TNodeIdx>::BeginRetune_Internal(const float MinimumSize, const int32 NodeCantSplit) const
+{
+	return MakeShared<SenseSysRetune::TRetuneBuild<TreeType>, ESPMode::ThreadSafe>(Tree, MinimumSize, NodeCantSplit);
+}
+
+template<typename TElementIdx, typename TNodeIdx>
+bool TSenseSys_OcTree<TElementIdx, TNodeIdx>::FinishRetune_Internal(FRetuneBuild& Build)
+{
+	return Tree.TakeRebuiltNodes(MoveTemp(static_cast<SenseSysRetune::TRetuneBuild<TreeType>&>(Build).Tree));
+}
+
+template<typename TElementIdx, typename TNodeIdx>
+float TSenseSys_OcTree<TElementIdx, TNodeIdx>::GetMedianElementSize_Internal(const int32 MaxSamples) const
+{
+	return SenseSysRetune::MedianElementSize(Tree, MaxSamples);
 }
 
 
-void FSenseSys_OcTree::GetInBoxIDs(const FBox Box, TArray<ElementIndexType>& Out, const uint64 InBitChannels) const
+template<typename TElementIdx, typename TNodeIdx>
+void TSenseSys_QuadTree<TElementIdx, TNodeIdx>::GetInBoxIDs(const FBox Box, TArray<ElementIndexType>& Out, const uint64 InBitChannels) const
 {
 	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_OcTree_GetInBox);
 
 	FRWScopeLock SRWLock(RWLock, SLT_ReadOnly);
 
-	const auto InBox = FInBoxPredicate(Tree, Box, InBitChannels);
-	Tree.GetElementsIDs(Box, InBox, Out);
+	Tree.GetElementsIDs(MakeBoxQuery(Box, InBitChannels), Out);
 }
-void FSenseSys_OcTree::GetInRadiusIDs(const FSenseSys_OcTree::Real Radius, const FVector Center, TArray<ElementIndexType>& Out, const uint64 InBitChannels) const
+template<typename TElementIdx, typename TNodeIdx>
+void TSenseSys_QuadTree<TElementIdx, TNodeIdx>::GetInRadiusIDs(const Real Radius, const FVector Center, TArray<ElementIndexType>& Out, const uint64 InBitChannels) const
 {
-	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_OcTree_GetInBox);
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_OcTree_GetInRadius);
 
 	FRWScopeLock SRWLock(RWLock, SLT_ReadOnly);
 
-	const auto InRadius = FInRadiusPredicate(Tree, Center, Radius, InBitChannels);
-	Tree.GetElementsIDs(InRadius.Box, InRadius, Out);
+	Tree.GetElementsIDs(MakeRadiusQuery(Radius, Center, InBitChannels), Out);
 }
-void FSenseSys_OcTree::GetInBoxRadiusIDs(
+template<typename TElementIdx, typename TNodeIdx>
+void TSenseSys_QuadTree<TElementIdx, TNodeIdx>::GetInBoxRadiusIDs(
 	const FBox Box,
 	const FVector Center,
-	const FSenseSys_OcTree::Real Radius,
+	const Real Radius,
 	TArray<ElementIndexType>& Out,
 	const uint64 InBitChannels) const
 {
@@ -432,80 +1248,3958 @@ void FSenseSys_OcTree::GetInBoxRadiusIDs(
 
 	FRWScopeLock SRWLock(RWLock, SLT_ReadOnly);
 
-	const auto InRadius = FInRadiusPredicate(Tree, Center, Radius, Box, InBitChannels);
-	Tree.GetElementsIDs(InRadius.Box, InRadius, Out);
+	Tree.GetElementsIDs(MakeBoxRadiusQuery(Box, Center, Radius, InBitChannels), Out);
 }
 
-void FSenseSys_OcTree::GetInBoxIDs(const FBox Box, TSet<ElementIndexType>& Out, const uint64 InBitChannels) const
+template<typename TElementIdx, typename TNodeIdx>
+void TSenseSys_QuadTree<TElementIdx, TNodeIdx>::GetInBoxIDs(const FBox Box, TSet<ElementIndexType>& Out, const uint64 InBitChannels) const
 {
 	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_OcTree_GetInBox);
 
 	FRWScopeLock SRWLock(RWLock, SLT_ReadOnly);
 
-	const auto InBox = FInBoxPredicate(Tree, Box, InBitChannels);
-	Tree.GetElementsIDs(Box, InBox, Out);
+	Tree.GetElementsIDs(MakeBoxQuery(Box, InBitChannels), Out);
+}
+template<typename TElementIdx, typename TNodeIdx>
+void TSenseSys_QuadTree<TElementIdx, TNodeIdx>::GetInRadiusIDs(const Real Radius, const FVector Center, TSet<ElementIndexType>& Out, const uint64 InBitChannels) const
+{
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_OcTree_GetInRadius);
+
+	FRWScopeLock SRWLock(RWLock, SLT_ReadOnly);
+
+	Tree.GetElementsIDs(MakeRadiusQuery(Radius, Center, InBitChannels), Out);
+}
+template<typename TElementIdx, typename TNodeIdx>
+void TSenseSys_QuadTree<TElementIdx, TNodeIdx>::GetInBoxRadiusIDs(const FBox Box, const FVector Center, const Real Radius, TSet<ElementIndexType>& Out, const uint64 InBitChannels) const
+{
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_OcTree_GetInBoxRadius);
+
+	FRWScopeLock SRWLock(RWLock, SLT_ReadOnly);
+
+	Tree.GetElementsIDs(MakeBoxRadiusQuery(Box, Center, Radius, InBitChannels), Out);
 }
-void FSenseSys_OcTree::GetInRadiusIDs(const FSenseSys_OcTree::Real Radius, const FVector Center, TSet<ElementIndexType>& Out, const uint64 InBitChannels) const
+template<typename TElementIdx, typename TNodeIdx>
+void TSenseSys_QuadTree<TElementIdx, TNodeIdx>::GetInBoxIDs(const FBox Box, FSenseSysQueryIDs& Out, const uint64 InBitChannels) const
 {
 	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_OcTree_GetInBox);
 
 	FRWScopeLock SRWLock(RWLock, SLT_ReadOnly);
 
-	const auto InRadius = FInRadiusPredicate(Tree, Center, Radius, InBitChannels);
-	Tree.GetElementsIDs(InRadius.Box, InRadius, Out);
+	Tree.GetElementsIDs(MakeBoxQuery(Box, InBitChannels), Out);
 }
-void FSenseSys_OcTree::GetInBoxRadiusIDs(const FBox Box, const FVector Center, const FSenseSys_OcTree::Real Radius, TSet<ElementIndexType>& Out, const uint64 InBitChannels) const
+template<typename TElementIdx, typename TNodeIdx>
+void TSenseSys_QuadTree<TElementIdx, TNodeIdx>::GetInRadiusIDs(const Real Radius, const FVector Center, FSenseSysQueryIDs& Out, const uint64 InBitChannels) const
+{
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_OcTree_GetInRadius);
+
+	FRWScopeLock SRWLock(RWLock, SLT_ReadOnly);
+
+	Tree.GetElementsIDs(MakeRadiusQuery(Radius, Center, InBitChannels), Out);
+}
+template<typename TElementIdx, typename TNodeIdx>
+void TSenseSys_QuadTree<TElementIdx, TNodeIdx>::GetInBoxRadiusIDs(const FBox Box, const FVector Center, const Real Radius, FSenseSysQueryIDs& Out, const uint64 InBitChannels) const
 {
 	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_OcTree_GetInBoxRadius);
 
 	FRWScopeLock SRWLock(RWLock, SLT_ReadOnly);
 
-	const auto InRadius = FInRadiusPredicate(Tree, Center, Radius, Box, InBitChannels);
-	Tree.GetElementsIDs(InRadius.Box, InRadius, Out);
+	Tree.GetElementsIDs(MakeBoxRadiusQuery(Box, Center, Radius, InBitChannels), Out);
 }
 
-FBox FSenseSys_OcTree::GetMaxIntersect(const FBox Box) const
+template<typename TElementIdx, typename TNodeIdx>
+void TSenseSys_QuadTree<TElementIdx, TNodeIdx>::GetInBoxRadiusIDsBatch(const TArray<FBatchQuery>& Queries, TArray<TArray<ElementIndexType>>& Out) const
 {
-	const TreeIndexType MaxIntersect = Tree.GetMaxIntersect(Box);
-	if (MaxIntersect != MaxIndex())
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_QuadTree_GetInBoxRadiusBatch);
+
+	TArray<FElementQuery, TInlineAllocator<32>> TreeQueries;
+	TreeQueries.Reserve(Queries.Num());
+	for (const FBatchQuery& It : Queries)
 	{
-		return FBox(Tree.GetTreeBox(MaxIntersect));
+		TreeQueries.Add(
+			It.Radius == 0.f //
+				? MakeBoxQuery(It.Box, It.BitChannels)
+				: MakeBoxRadiusQuery(It.Box, It.Center, It.Radius, It.BitChannels));
 	}
-	return FBox(FVector::ZeroVector, FVector::ZeroVector);
+
+	FRWScopeLock SRWLock(RWLock, SLT_ReadOnly);
+
+	Tree.GetElementsIDsBatch(TreeQueries.GetData(), TreeQueries.Num(), Out);
 }
 
-void FSenseSys_QuadTree::DrawTree(const class UWorld* World, const FTreeDrawSetup TreeNode, const FTreeDrawSetup Link, const FTreeDrawSetup ElemNode, const float LifeTime) const
+template<typename TElementIdx, typename TNodeIdx>
+void TSenseSys_QuadTree<TElementIdx, TNodeIdx>::GetKNearestIDs(
+	const FVector Center,
+	const int32 K,
+	const Real MaxRadius,
+	TArray<ElementIndexType>& Out,
+	const uint64 InBitChannels) const
 {
-#if ENABLE_DRAW_DEBUG
-	Tree.DrawTree(
-		World,
-		LifeTime,
-		TreeNode.Color,
-		TreeNode.Thickness,
-		TreeNode.DrawDepth,
-		Link.Color,
-		Link.Thickness,
-		Link.DrawDepth,
-		ElemNode.Color,
-		ElemNode.Thickness,
-		ElemNode.DrawDepth);
-#endif //ENABLE_DRAW_DEBUG
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_QuadTree_GetKNearest);
+
+	FRWScopeLock SRWLock(RWLock, SLT_ReadOnly);
+
+	Tree.GetKNearestIDs(FVector2D(Center), K, MaxRadius, InBitChannels, Out);
 }
 
-void FSenseSys_OcTree::DrawTree(const class UWorld* World, const FTreeDrawSetup TreeNode, const FTreeDrawSetup Link, const FTreeDrawSetup ElemNode, const float LifeTime) const
+template<typename TElementIdx, typename TNodeIdx>
+void TSenseSys_QuadTree<TElementIdx, TNodeIdx>::GetAlongSegmentIDs(
+	const FVector Start,
+	const FVector End,
+	const Real Radius,
+	TArray<ElementIndexType>& Out,
+	const uint64 InBitChannels) const
 {
-#if ENABLE_DRAW_DEBUG
-	Tree.DrawTree(
-		World,
-		LifeTime,
-		TreeNode.Color,
-		TreeNode.Thickness,
-		TreeNode.DrawDepth,
-		Link.Color,
-		Link.Thickness,
-		Link.DrawDepth,
-		ElemNode.Color,
-		ElemNode.Thickness,
-		ElemNode.DrawDepth);
-#endif //ENABLE_DRAW_DEBUG
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_QuadTree_GetAlongSegment);
+
+	FRWScopeLock SRWLock(RWLock, SLT_ReadOnly);
+
+	// the Z of the segment is clipped by the node and element Z ranges
+	Tree.GetAlongSegmentIDs(FSenseSysSegment(Start, End, Radius), InBitChannels, Out);
+}
+
+template<typename TElementIdx, typename TNodeIdx>
+template<typename VolumeType, typename ContainerType>
+void TSenseSys_QuadTree<TElementIdx, TNodeIdx>::GetInVolumeIDs(const FBox& Box, const VolumeType& Volume, const uint64 InBitChannels, ContainerType& Out) const
+{
+	const Real MinZ = Box.Min.Z;
+	const Real MaxZ = Box.Max.Z;
+	const auto NodeTest = [&Volume, MinZ, MaxZ](const typename TreeType::BoxType& NodeBox)
+	{
+		return Volume.IntersectBox(FBox(FVector(NodeBox.min.X, NodeBox.min.Y, MinZ), FVector(NodeBox.max.X, NodeBox.max.Y, MaxZ)));
+	};
+	// the tree passes the elements whose Z range overlaps the query box, the volume sees the overlap only
+	const auto ElemTest = [&Volume, MinZ, MaxZ](const auto& Bounds)
+	{
+		return Volume.IntersectBox(FBox(FVector(Bounds.Min[0], Bounds.Min[1], FMath::Max(Bounds.Min[2], MinZ)), FVector(Bounds.Max[0], Bounds.Max[1], FMath::Min(Bounds.Max[2], MaxZ))));
+	};
+	Tree.GetElementsIDsInVolume(MakeBoxQuery(Box, InBitChannels), NodeTest, ElemTest, Out);
+}
+template<typename TElementIdx, typename TNodeIdx>
+void TSenseSys_QuadTree<TElementIdx, TNodeIdx>::GetInConeIDs(const FBox Box, const FSenseSysCone& Cone, TArray<ElementIndexType>& Out, const uint64 InBitChannels) const
+{
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_QuadTree_GetInCone);
+
+	FRWScopeLock SRWLock(RWLock, SLT_ReadOnly);
+
+	GetInVolumeIDs(Box, Cone, InBitChannels, Out);
+}
+template<typename TElementIdx, typename TNodeIdx>
+void TSenseSys_QuadTree<TElementIdx, TNodeIdx>::GetInConeIDs(const FBox Box, const FSenseSysCone& Cone, TSet<ElementIndexType>& Out, const uint64 InBitChannels) const
+{
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_QuadTree_GetInCone);
+
+	FRWScopeLock SRWLock(RWLock, SLT_ReadOnly);
+
+	GetInVolumeIDs(Box, Cone, InBitChannels, Out);
+}
+template<typename TElementIdx, typename TNodeIdx>
+void TSenseSys_QuadTree<TElementIdx, TNodeIdx>::GetInConeIDs(const FBox Box, const FSenseSysCone& Cone, FSenseSysQueryIDs& Out, const uint64 InBitChannels) const
+{
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_QuadTree_GetInCone);
+
+	FRWScopeLock SRWLock(RWLock, SLT_ReadOnly);
+
+	GetInVolumeIDs(Box, Cone, InBitChannels, Out);
+}
+template<typename TElementIdx, typename TNodeIdx>
+void TSenseSys_QuadTree<TElementIdx, TNodeIdx>::GetInFrustumIDs(const FBox Box, const FSenseSysFrustum& Frustum, TArray<ElementIndexType>& Out, const uint64 InBitChannels) const
+{
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_QuadTree_GetInFrustum);
+
+	FRWScopeLock SRWLock(RWLock, SLT_ReadOnly);
+
+	GetInVolumeIDs(Box, Frustum, InBitChannels, Out);
+}
+template<typename TElementIdx, typename TNodeIdx>
+void TSenseSys_QuadTree<TElementIdx, TNodeIdx>::GetInFrustumIDs(const FBox Box, const FSenseSysFrustum& Frustum, TSet<ElementIndexType>& Out, const uint64 InBitChannels) const
+{
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_QuadTree_GetInFrustum);
+
+	FRWScopeLock SRWLock(RWLock, SLT_ReadOnly);
+
+	GetInVolumeIDs(Box, Frustum, InBitChannels, Out);
+}
+template<typename TElementIdx, typename TNodeIdx>
+void TSenseSys_QuadTree<TElementIdx, TNodeIdx>::GetInFrustumIDs(const FBox Box, const FSenseSysFrustum& Frustum, FSenseSysQueryIDs& Out, const uint64 InBitChannels) const
+{
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_QuadTree_GetInFrustum);
+
+	FRWScopeLock SRWLock(RWLock, SLT_ReadOnly);
+
+	GetInVolumeIDs(Box, Frustum, InBitChannels, Out);
+}
+
+template<typename TElementIdx, typename TNodeIdx>
+FBox TSenseSys_QuadTree<TElementIdx, TNodeIdx>::GetMaxIntersect(const FBox Box) const
+{
+	const TNodeIdx MaxIntersect = Tree.GetMaxIntersect(TreeHelper::ToBox2D(Box));
+	if (Tree.IsValidTreeIdx(MaxIntersect))
+	{
+		const FBox2D Box2D = Tree.GetTreeBox(MaxIntersect);
+		return TreeHelper::ToBox(Box2D);
+	}
+	return FBox(FVector::ZeroVector, FVector::ZeroVector);
+}
+
+template<typename TElementIdx, typename TNodeIdx>
+uint64 TSenseSys_QuadTree<TElementIdx, TNodeIdx>::GetModStamp() const
+{
+	FRWScopeLock SRWLock(RWLock, SLT_ReadOnly);
+	return Tree.GetModStamp();
+}
+
+template<typename TElementIdx, typename TNodeIdx>
+bool TSenseSys_QuadTree<TElementIdx, TNodeIdx>::IsChangedSince(const FBox Box, const uint64 Stamp) const
+{
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_QuadTree_IsChangedSince);
+
+	FRWScopeLock SRWLock(RWLock, SLT_ReadOnly);
+	// nodes keep no Z range of the removed elements, the XY test only
+	return Tree.IsChangedSince(TreeHelper::ToBox2D(Box), Stamp);
+}
+
+
+template<typename TElementIdx, typename TNodeIdx>
+void TSenseSys_OcTree<TElementIdx, TNodeIdx>::GetInBoxIDs(const FBox Box, TArray<ElementIndexType>& Out, const uint64 InBitChannels) const
+{
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_OcTree_GetInBox);
+
+	FRWScopeLock SRWLock(RWLock, SLT_ReadOnly);
+
+	Tree.GetElementsIDs(MakeBoxQuery(Box, InBitChannels), Out);
+}
+template<typename TElementIdx, typename TNodeIdx>
+void TSenseSys_OcTree<TElementIdx, TNodeIdx>::GetInRadiusIDs(const Real Radius, const FVector Center, TArray<ElementIndexType>& Out, const uint64 InBitChannels) const
+{
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_OcTree_GetInBox);
+
+	FRWScopeLock SRWLock(RWLock, SLT_ReadOnly);
+
+	Tree.GetElementsIDs(MakeRadiusQuery(Radius, Center, InBitChannels), Out);
+}
+template<typename TElementIdx, typename TNodeIdx>
+void TSenseSys_OcTree<TElementIdx, TNodeIdx>::GetInBoxRadiusIDs(
+	const FBox Box,
+	const FVector Center,
+	const Real Radius,
+	TArray<ElementIndexType>& Out,
+	const uint64 InBitChannels) const
+{
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_OcTree_GetInBoxRadius);
+
+	FRWScopeLock SRWLock(RWLock, SLT_ReadOnly);
+
+	Tree.GetElementsIDs(MakeBoxRadiusQuery(Box, Center, Radius, InBitChannels), Out);
+}
+
+template<typename TElementIdx, typename TNodeIdx>
+void TSenseSys_OcTree<TElementIdx, TNodeIdx>::GetInBoxIDs(const FBox Box, TSet<ElementIndexType>& Out, const uint64 InBitChannels) const
+{
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_OcTree_GetInBox);
+
+	FRWScopeLock SRWLock(RWLock, SLT_ReadOnly);
+
+	Tree.GetElementsIDs(MakeBoxQuery(Box, InBitChannels), Out);
+}
+template<typename TElementIdx, typename TNodeIdx>
+void TSenseSys_OcTree<TElementIdx, TNodeIdx>::GetInRadiusIDs(const Real Radius, const FVector Center, TSet<ElementIndexType>& Out, const uint64 InBitChannels) const
+{
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_OcTree_GetInBox);
+
+	FRWScopeLock SRWLock(RWLock, SLT_ReadOnly);
+
+	Tree.GetElementsIDs(MakeRadiusQuery(Radius, Center, InBitChannels), Out);
+}
+template<typename TElementIdx, typename TNodeIdx>
+void TSenseSys_OcTree<TElementIdx, TNodeIdx>::GetInBoxRadiusIDs(const FBox Box, const FVector Center, const Real Radius, TSet<ElementIndexType>& Out, const uint64 InBitChannels) const
+{
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_OcTree_GetInBoxRadius);
+
+	FRWScopeLock SRWLock(RWLock, SLT_ReadOnly);
+
+	Tree.GetElementsIDs(MakeBoxRadiusQuery(Box, Center, Radius, InBitChannels), Out);
+}
+template<typename TElementIdx, typename TNodeIdx>
+void TSenseSys_OcTree<TElementIdx, TNodeIdx>::GetInBoxIDs(const FBox Box, FSenseSysQueryIDs& Out, const uint64 InBitChannels) const
+{
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_OcTree_GetInBox);
+
+	FRWScopeLock SRWLock(RWLock, SLT_ReadOnly);
+
+	Tree.GetElementsIDs(MakeBoxQuery(Box, InBitChannels), Out);
+}
+template<typename TElementIdx, typename TNodeIdx>
+void TSenseSys_OcTree<TElementIdx, TNodeIdx>::GetInRadiusIDs(const Real Radius, const FVector Center, FSenseSysQueryIDs& Out, const uint64 InBitChannels) const
+{
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_OcTree_GetInBox);
+
+	FRWScopeLock SRWLock(RWLock, SLT_ReadOnly);
+
+	Tree.GetElementsIDs(MakeRadiusQuery(Radius, Center, InBitChannels), Out);
+}
+template<typename TElementIdx, typename TNodeIdx>
+void TSenseSys_OcTree<TElementIdx, TNodeIdx>::GetInBoxRadiusIDs(const FBox Box, const FVector Center, const Real Radius, FSenseSysQueryIDs& Out, const uint64 InBitChannels) const
+{
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_OcTree_GetInBoxRadius);
+
+	FRWScopeLock SRWLock(RWLock, SLT_ReadOnly);
+
+	Tree.GetElementsIDs(MakeBoxRadiusQuery(Box, Center, Radius, InBitChannels), Out);
+}
+
+template<typename TElementIdx, typename TNodeIdx>
+void TSenseSys_OcTree<TElementIdx, TNodeIdx>::GetInBoxRadiusIDsBatch(const TArray<FBatchQuery>& Queries, TArray<TArray<ElementIndexType>>& Out) const
+{
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_OcTree_GetInBoxRadiusBatch);
+
+	TArray<FElementQuery, TInlineAllocator<32>> TreeQueries;
+	TreeQueries.Reserve(Queries.Num());
+	for (const FBatchQuery& It : Queries)
+	{
+		TreeQueries.Add(
+			It.Radius == 0.f //
+				? MakeBoxQuery(It.Box, It.BitChannels)
+				: MakeBoxRadiusQuery(It.Box, It.Center, It.Radius, It.BitChannels));
+	}
+
+	FRWScopeLock SRWLock(RWLock, SLT_ReadOnly);
+
+	Tree.GetElementsIDsBatch(TreeQueries.GetData(), TreeQueries.Num(), Out);
+}
+
+template<typename TElementIdx, typename TNodeIdx>
+void TSenseSys_OcTree<TElementIdx, TNodeIdx>::GetKNearestIDs(
+	const FVector Center,
+	const int32 K,
+	const Real MaxRadius,
+	TArray<ElementIndexType>& Out,
+	const uint64 InBitChannels) const
+{
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_OcTree_GetKNearest);
+
+	FRWScopeLock SRWLock(RWLock, SLT_ReadOnly);
+
+	Tree.GetKNearestIDs(Center, K, MaxRadius, InBitChannels, Out);
+}
+
+template<typename TElementIdx, typename TNodeIdx>
+void TSenseSys_OcTree<TElementIdx, TNodeIdx>::GetAlongSegmentIDs(
+	const FVector Start,
+	const FVector End,
+	const Real Radius,
+	TArray<ElementIndexType>& Out,
+	const uint64 InBitChannels) const
+{
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_OcTree_GetAlongSegment);
+
+	FRWScopeLock SRWLock(RWLock, SLT_ReadOnly);
+
+	Tree.GetAlongSegmentIDs(FSenseSysSegment(Start, End, Radius), InBitChannels, Out);
+}
+
+template<typename TElementIdx, typename TNodeIdx>
+template<typename VolumeType, typename ContainerType>
+void TSenseSys_OcTree<TElementIdx, TNodeIdx>::GetInVolumeIDs(const FBox& Box, const VolumeType& Volume, const uint64 InBitChannels, ContainerType& Out) const
+{
+	const auto NodeTest = [&Volume](const typename TreeType::BoxType& NodeBox) { return Volume.IntersectBox(FBox(NodeBox.min, NodeBox.max)); };
+	const auto ElemTest = [&Volume](const auto& Bounds)
+	{
+		return Volume.IntersectBox(FBox(FVector(Bounds.Min[0], Bounds.Min[1], Bounds.Min[2]), FVector(Bounds.Max[0], Bounds.Max[1], Bounds.Max[2])));
+	};
+	Tree.GetElementsIDsInVolume(MakeBoxQuery(Box, InBitChannels), NodeTest, ElemTest, Out);
+}
+template<typename TElementIdx, typename TNodeIdx>
+void TSenseSys_OcTree<TElementIdx, TNodeIdx>::GetInConeIDs(const FBox Box, const FSenseSysCone& Cone, TArray<ElementIndexType>& Out, const uint64 InBitChannels) const
+{
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_OcTree_GetInCone);
+
+	FRWScopeLock SRWLock(RWLock, SLT_ReadOnly);
+
+	GetInVolumeIDs(Box, Cone, InBitChannels, Out);
+}
+template<typename TElementIdx, typename TNodeIdx>
+void TSenseSys_OcTree<TElementIdx, TNodeIdx>::GetInConeIDs(const FBox Box, const FSenseSysCone& Cone, TSet<ElementIndexType>& Out, const uint64 InBitChannels) const
+{
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_OcTree_GetInCone);
+
+	FRWScopeLock SRWLock(RWLock, SLT_ReadOnly);
+
+	GetInVolumeIDs(Box, Cone, InBitChannels, Out);
+}
+template<typename TElementIdx, typename TNodeIdx>
+void TSenseSys_OcTree<TElementIdx, TNodeIdx>::GetInConeIDs(const FBox Box, const FSenseSysCone& Cone, FSenseSysQueryIDs& Out, const uint64 InBitChannels) const
+{
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_OcTree_GetInCone);
+
+	FRWScopeLock SRWLock(RWLock, SLT_ReadOnly);
+
+	GetInVolumeIDs(Box, Cone, InBitChannels, Out);
+}
+template<typename TElementIdx, typename TNodeIdx>
+void TSenseSys_OcTree<TElementIdx, TNodeIdx>::GetInFrustumIDs(const FBox Box, const FSenseSysFrustum& Frustum, TArray<ElementIndexType>& Out, const uint64 InBitChannels) const
+{
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_OcTree_GetInFrustum);
+
+	FRWScopeLock SRWLock(RWLock, SLT_ReadOnly);
+
+	GetInVolumeIDs(Box, Frustum, InBitChannels, Out);
+}
+template<typename TElementIdx, typename TNodeIdx>
+void TSenseSys_OcTree<TElementIdx, TNodeIdx>::GetInFrustumIDs(const FBox Box, const FSenseSysFrustum& Frustum, TSet<ElementIndexType>& Out, const uint64 InBitChannels) const
+{
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_OcTree_GetInFrustum);
+
+	FRWScopeLock SRWLock(RWLock, SLT_ReadOnly);
+
+	GetInVolumeIDs(Box, Frustum, InBitChannels, Out);
+}
+template<typename TElementIdx, typename TNodeIdx>
+void TSenseSys_OcTree<TElementIdx, TNodeIdx>::GetInFrustumIDs(const FBox Box, const FSenseSysFrustum& Frustum, FSenseSysQueryIDs& Out, const uint64 InBitChannels) const
+{
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_OcTree_GetInFrustum);
+
+	FRWScopeLock SRWLock(RWLock, SLT_ReadOnly);
+
+	GetInVolumeIDs(Box, Frustum, InBitChannels, Out);
+}
+
+template<typename TElementIdx, typename TNodeIdx>
+FBox TSenseSys_OcTree<TElementIdx, TNodeIdx>::GetMaxIntersect(const FBox Box) const
+{
+	const TNodeIdx MaxIntersect = Tree.GetMaxIntersect(Box);
+	if (Tree.IsValidTreeIdx(MaxIntersect))
+	{
+		return FBox(Tree.GetTreeBox(MaxIntersect));
+	}
+	return FBox(FVector::ZeroVector, FVector::ZeroVector);
+}
+
+template<typename TElementIdx, typename TNodeIdx>
+uint64 TSenseSys_OcTree<TElementIdx, TNodeIdx>::GetModStamp() const
+{
+	FRWScopeLock SRWLock(RWLock, SLT_ReadOnly);
+	return Tree.GetModStamp();
+}
+
+template<typename TElementIdx, typename TNodeIdx>
+bool TSenseSys_OcTree<TElementIdx, TNodeIdx>::IsChangedSince(const FBox Box, const uint64 Stamp) const
+{
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_OcTree_IsChangedSince);
+
+	FRWScopeLock SRWLock(RWLock, SLT_ReadOnly);
+	return Tree.IsChangedSince(Box, Stamp);
+}
+
+template<typename TElementIdx, typename TNodeIdx>
+void TSenseSys_QuadTree<TElementIdx, TNodeIdx>::DrawTree(const class UWorld* World, const FTreeDrawSetup TreeNode, const FTreeDrawSetup Link, const FTreeDrawSetup ElemNode, const float LifeTime) const
+{
+#if ENABLE_DRAW_DEBUG
+	Tree.DrawTree(
+		World,
+		LifeTime,
+		TreeNode.Color,
+		TreeNode.Thickness,
+		TreeNode.DrawDepth,
+		Link.Color,
+		Link.Thickness,
+		Link.DrawDepth,
+		ElemNode.Color,
+		ElemNode.Thickness,
+		ElemNode.DrawDepth);
+#endif //ENABLE_DRAW_DEBUG
+}
+
+template<typename TElementIdx, typename TNodeIdx>
+void TSenseSys_OcTree<TElementIdx, TNodeIdx>::DrawTree(const class UWorld* World, const FTreeDrawSetup TreeNode, const FTreeDrawSetup Link, const FTreeDrawSetup ElemNode, const float LifeTime) const
+{
+#if ENABLE_DRAW_DEBUG
+	Tree.DrawTree(
+		World,
+		LifeTime,
+		TreeNode.Color,
+		TreeNode.Thickness,
+		TreeNode.DrawDepth,
+		Link.Color,
+		Link.Thickness,
+		Link.DrawDepth,
+		ElemNode.Color,
+		ElemNode.Thickness,
+		ElemNode.DrawDepth);
+#endif //ENABLE_DRAW_DEBUG
+}
+
+
+template<typename TElementIdx>
+void TSenseSys_HashGrid<TElementIdx>::AddToCell(const ElementIndexType ObjID, const FIntPoint Coord)
+{
+	int32 CellIdx = INDEX_NONE;
+	if (const int32* CellIdxPtr = CellMap.Find(Coord))
+	{
+		CellIdx = *CellIdxPtr;
+	}
+	else
+	{
+		CellIdx = Cells.Add(FGridCell(Coord));
+		CellMap.Add(Coord, CellIdx);
+		++Counters.Splits;
+	}
+	FGridElement& Elem = Elements[ObjID];
+	Elem.CellIdx = CellIdx;
+	Elem.Slot = Cells[CellIdx].IDs.Add(static_cast<TElementIdx>(ObjID));
+}
+
+template<typename TElementIdx>
+void TSenseSys_HashGrid<TElementIdx>::RemoveFromCell(const ElementIndexType ObjID)
+{
+	FGridElement& Elem = Elements[ObjID];
+	TArray<TElementIdx>& IDs = Cells[Elem.CellIdx].IDs;
+	check(IDs[Elem.Slot] == ObjID);
+	IDs.RemoveAtSwap(Elem.Slot, 1, false);
+	if (IDs.IsValidIndex(Elem.Slot))
+	{
+		Elements[IDs[Elem.Slot]].Slot = Elem.Slot;
+	}
+	if (IDs.Num() == 0)
+	{
+		EmptyCells.Add(Elem.CellIdx);
+	}
+	Elem.CellIdx = INDEX_NONE;
+	Elem.Slot = INDEX_NONE;
+}
+
+template<typename TElementIdx>
+void TSenseSys_HashGrid<TElementIdx>::Insert_Internal(const ElementIndexType ObjID, const FBox& InBox, const uint64 Channels)
+{
+	if (Elements.Num() <= ObjID)
+	{
+		Elements.SetNum(FMath::Max(ElementPool.GetMaxIndex(), ObjID + 1));
+	}
+	FGridElement& Elem = Elements[ObjID];
+	Elem.Box = InBox;
+	Elem.Mask = Channels;
+	QueryMargin = FMath::Max(QueryMargin, FMath::Max(InBox.GetExtent().X, InBox.GetExtent().Y));
+	ScanMargin = FMath::Max(ScanMargin, FMath::Max(InBox.GetExtent().X, InBox.GetExtent().Y));
+	AddToCell(ObjID, GetCellCoord(InBox.GetCenter()));
+}
+
+template<typename TElementIdx>
+void TSenseSys_HashGrid<TElementIdx>::Update_Internal(const ElementIndexType ObjID, const FBox& NewBox)
+{
+	FGridElement& Elem = Elements[ObjID];
+	const Real OldMargin = FMath::Max(Elem.Box.GetExtent().X, Elem.Box.GetExtent().Y);
+	const Real NewMargin = FMath::Max(NewBox.GetExtent().X, NewBox.GetExtent().Y);
+	bMarginDirty |= OldMargin >= QueryMargin && NewMargin < OldMargin;
+	Elem.Box = NewBox;
+	QueryMargin = FMath::Max(QueryMargin, NewMargin);
+	ScanMargin = FMath::Max(ScanMargin, NewMargin);
+
+	const FIntPoint Coord = GetCellCoord(NewBox.GetCenter());
+	if (Cells[Elem.CellIdx].Coord != Coord)
+	{
+		RemoveFromCell(ObjID);
+		AddToCell(ObjID, Coord);
+		++Counters.Reinserts;
+	}
+}
+
+template<typename TElementIdx>
+IContainerTree::ElementIndexType TSenseSys_HashGrid<TElementIdx>::Insert(const FSensedStimulus& ComponentData, const FBox InBox)
+{
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_HashGrid_Insert);
+
+	FWriteScope SRWLock(*this, true);
+
+	if (FitElementCount_Internal(1, MaxElements) == 0)
+	{
+		return MaxIndex();
+	}
+	const ElementIndexType ObjID = ElementPool.Add(ComponentData);
+	Insert_Internal(ObjID, InBox, ComponentData.BitChannels);
+	return MarkPoolDirty_Internal(ObjID);
+}
+template<typename TElementIdx>
+IContainerTree::ElementIndexType TSenseSys_HashGrid<TElementIdx>::Insert(FSensedStimulus&& ComponentData, const FBox InBox)
+{
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_HashGrid_Insert);
+
+	FWriteScope SRWLock(*this, true);
+
+	if (FitElementCount_Internal(1, MaxElements) == 0)
+	{
+		return MaxIndex();
+	}
+	const uint64 Channels = ComponentData.BitChannels;
+	const ElementIndexType ObjID = ElementPool.Add(MoveTemp(ComponentData));
+	Insert_Internal(ObjID, InBox, Channels);
+	return MarkPoolDirty_Internal(ObjID);
+}
+
+template<typename TElementIdx>
+void TSenseSys_HashGrid<TElementIdx>::Update(const ElementIndexType InObjID, const FBox NewBox)
+{
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_HashGrid_Update);
+
+	FWriteScope SRWLock(*this, true);
+
+	if (InObjID != MaxIndex())
+	{
+		Update_Internal(InObjID, NewBox);
+	}
+}
+
+template<typename TElementIdx>
+void TSenseSys_HashGrid<TElementIdx>::UpdateBatch(const TArray<FUpdateItem>& Items)
+{
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_HashGrid_UpdateBatch);
+
+	FWriteScope SRWLock(*this, true);
+
+	for (const FUpdateItem& It : Items)
+	{
+		if (SetUpdateItemPoints_Internal(It))
+		{
+			Update_Internal(It.ObjID, It.Box);
+		}
+	}
+}
+
+template<typename TElementIdx>
+void TSenseSys_HashGrid<TElementIdx>::BulkInsert(TArray<FSensedStimulus>&& ComponentsData, const TArray<FBox>& InBoxes, TArray<ElementIndexType>& OutIDs)
+{
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_HashGrid_BulkInsert);
+
+	check(ComponentsData.Num() == InBoxes.Num());
+
+	FWriteScope SRWLock(*this, true);
+
+	const int32 Count = FitElementCount_Internal(InBoxes.Num(), MaxElements);
+	OutIDs.Init(MaxIndex(), InBoxes.Num());
+	ElementPool.Reserve(ElementPool.Num() + Count);
+	Elements.Reserve(ElementPool.Num() + Count);
+	for (int32 i = 0; i < Count; ++i)
+	{
+		const uint64 Channels = ComponentsData[i].BitChannels;
+		const ElementIndexType ObjID = ElementPool.Add(MoveTemp(ComponentsData[i]));
+		Insert_Internal(ObjID, InBoxes[i], Channels);
+		OutIDs[i] = MarkPoolDirty_Internal(ObjID);
+	}
+	ComponentsData.Reset();
+}
+
+template<typename TElementIdx>
+bool TSenseSys_HashGrid<TElementIdx>::Remove(const ElementIndexType InObjID)
+{
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_HashGrid_Remove);
+
+	FWriteScope SRWLock(*this, true);
+
+	check(InObjID != MaxIndex());
+	RecordRemove_Internal(InObjID);
+	const FVector Extent = Elements[InObjID].Box.GetExtent();
+	bMarginDirty |= FMath::Max(Extent.X, Extent.Y) >= QueryMargin;
+	RemoveFromCell(InObjID);
+	ElementPool.RemoveAt(InObjID);
+	return true;
+}
+
+template<typename TElementIdx>
+void TSenseSys_HashGrid<TElementIdx>::Clear()
+{
+	FWriteScope SRWLock(*this);
+
+	ElementPool.Empty();
+	Elements.Empty();
+	Cells.Empty();
+	CellMap.Empty();
+	EmptyCells.Empty();
+	QueryMargin = 0.f;
+	MarginScanIdx = INDEX_NONE;
+	bMarginDirty = false;
+	ClearTagChannels_Internal();
+	DiscardStagedUpdates();
+}
+
+template<typename TElementIdx>
+void TSenseSys_HashGrid<TElementIdx>::Collapse()
+{
+	FRWScopeLock SRWLock(RWLock, SLT_Write);
+
+	for (auto It = Cells.CreateIterator(); It; ++It)
+	{
+		if (It->IDs.Num() == 0)
+		{
+			CellMap.Remove(It->Coord);
+			It.RemoveCurrent();
+			++Counters.Collapses;
+		}
+	}
+
+	EmptyCells.Reset();
+
+	QueryMargin = 0.f;
+	for (auto It = ElementPool.CreateConstIterator(); It; ++It)
+	{
+		const FVector Extent = Elements[It.GetIndex()].Box.GetExtent();
+		QueryMargin = FMath::Max(QueryMargin, FMath::Max(Extent.X, Extent.Y));
+	}
+	MarginScanIdx = INDEX_NONE;
+	bMarginDirty = false;
+}
+
+template<typename TElementIdx>
+void TSenseSys_HashGrid<TElementIdx>::CollapseQueued(const int32 Budget)
+{
+	{
+		FRWScopeLock SRWLock(RWLock, SLT_ReadOnly);
+		if (EmptyCells.Num() == 0 && !bMarginDirty && MarginScanIdx == INDEX_NONE)
+		{
+			return;
+		}
+	}
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_HashGrid_CollapseQueued);
+
+	FRWScopeLock SRWLock(RWLock, SLT_Write);
+
+	for (int32 i = FMath::Min(Budget, EmptyCells.Num()); i > 0; --i)
+	{
+		const int32 CellIdx = EmptyCells.Pop(false);
+		if (Cells.IsValidIndex(CellIdx) && Cells[CellIdx].IDs.Num() == 0)
+		{
+			CellMap.Remove(Cells[CellIdx].Coord);
+			Cells.RemoveAt(CellIdx);
+			++Counters.Collapses;
+		}
+	}
+
+	// margin shrinks only after a full rescan, inserts and updates during the scan raise ScanMargin as well
+	if (MarginScanIdx == INDEX_NONE && bMarginDirty)
+	{
+		bMarginDirty = false;
+		MarginScanIdx = 0;
+		ScanMargin = 0.f;
+	}
+	if (MarginScanIdx != INDEX_NONE)
+	{
+		const int32 ScanEnd = FMath::Min(ElementPool.GetMaxIndex(), MarginScanIdx + Budget * 64);
+		for (; MarginScanIdx < ScanEnd; ++MarginScanIdx)
+		{
+			if (ElementPool.IsAllocated(MarginScanIdx))
+			{
+				const FVector Extent = Elements[MarginScanIdx].Box.GetExtent();
+				ScanMargin = FMath::Max(ScanMargin, FMath::Max(Extent.X, Extent.Y));
+			}
+		}
+		if (MarginScanIdx >= ElementPool.GetMaxIndex())
+		{
+			QueryMargin = ScanMargin;
+			MarginScanIdx = INDEX_NONE;
+		}
+	}
+}
+
+template<typename TElementIdx>
+void TSenseSys_HashGrid<TElementIdx>::Compact_Internal(TArray<ElementIndexType>& OutRemap)
+{
+	OutRemap.Init(MaxIndex(), ElementPool.GetMaxIndex());
+
+	// empty cells are dropped, the elements of a cell get consecutive ObjIDs
+	TSparseArray<FGridCell> NewCells;
+	TArray<int32> ElementOrder;
+	NewCells.Reserve(Cells.Num());
+	ElementOrder.Reserve(ElementPool.Num());
+	CellMap.Reset();
+	for (FGridCell& Cell : Cells)
+	{
+		if (Cell.IDs.Num() == 0)
+		{
+			continue;
+		}
+		const int32 CellIdx = NewCells.Add(MoveTemp(Cell));
+		FGridCell& NewCell = NewCells[CellIdx];
+		CellMap.Add(NewCell.Coord, CellIdx);
+		for (TElementIdx& ObjID : NewCell.IDs)
+		{
+			const int32 NewID = ElementOrder.Add(ObjID);
+			OutRemap[ObjID] = NewID;
+			Elements[ObjID].CellIdx = CellIdx;
+			ObjID = static_cast<TElementIdx>(NewID);
+		}
+	}
+	checkSlow(ElementOrder.Num() == ElementPool.Num());
+	Cells = MoveTemp(NewCells);
+	EmptyCells.Reset();
+
+	TSparseArray<FSensedStimulus> NewElementPool;
+	TArray<FGridElement> NewElements;
+	NewElementPool.Reserve(ElementOrder.Num());
+	NewElements.SetNum(ElementOrder.Num());
+	for (int32 i = 0; i < ElementOrder.Num(); ++i)
+	{
+		NewElementPool.Add(MoveTemp(ElementPool[ElementOrder[i]]));
+		NewElements[i] = Elements[ElementOrder[i]];
+	}
+	ElementPool = MoveTemp(NewElementPool);
+	Elements = MoveTemp(NewElements);
+
+	// a margin scan in progress restarts over the new ObjIDs
+	if (MarginScanIdx != INDEX_NONE)
+	{
+		MarginScanIdx = INDEX_NONE;
+		bMarginDirty = true;
+	}
+}
+
+template<typename TElementIdx>
+void TSenseSys_HashGrid<TElementIdx>::GetStats_Internal(FSenseSysTreeStats& OutStats) const
+{
+	OutStats.NumNodes = Cells.Num();
+	OutStats.PoolBytes = Cells.GetAllocatedSize() + CellMap.GetAllocatedSize() + EmptyCells.GetAllocatedSize();
+	for (const FGridCell& Cell : Cells)
+	{
+		OutStats.AddLeaf(Cell.IDs.Num(), 0);
+		OutStats.PoolBytes += Cell.IDs.GetAllocatedSize();
+	}
+	OutStats.DataBytes = Elements.GetAllocatedSize();
+	CopyCounters(Counters, OutStats);
+}
+
+
+template<typename TElementIdx>
+template<typename CellLambdaType>
+void TSenseSys_HashGrid<TElementIdx>::ForEachQueryCell(const FBox& Box, CellLambdaType CellLambda) const
+{
+	const FVector2D MinReal = GetCellCoordReal(Box.Min - FVector(QueryMargin, QueryMargin, 0.f));
+	const FVector2D MaxReal = GetCellCoordReal(Box.Max + FVector(QueryMargin, QueryMargin, 0.f));
+	const FIntPoint MinCoord(static_cast<int32>(MinReal.X), static_cast<int32>(MinReal.Y));
+	const FIntPoint MaxCoord(static_cast<int32>(MaxReal.X), static_cast<int32>(MaxReal.Y));
+	// in floating point, an unbounded box or a tiny cell size has more cells than int64 holds
+	const Real RangeNum = (MaxReal.X - MinReal.X + 1) * (MaxReal.Y - MinReal.Y + 1);
+
+	// a query wider than the occupied area walks the cells instead of the coordinates
+	if (RangeNum > Cells.Num())
+	{
+		for (const FGridCell& Cell : Cells)
+		{
+			if (Cell.Coord.X >= MinCoord.X && Cell.Coord.X <= MaxCoord.X && Cell.Coord.Y >= MinCoord.Y && Cell.Coord.Y <= MaxCoord.Y)
+			{
+				CellLambda(Cell);
+			}
+		}
+	}
+	else
+	{
+		for (int32 Y = MinCoord.Y; Y <= MaxCoord.Y; ++Y)
+		{
+			for (int32 X = MinCoord.X; X <= MaxCoord.X; ++X)
+			{
+				if (const int32* CellIdx = CellMap.Find(FIntPoint(X, Y)))
+				{
+					CellLambda(Cells[*CellIdx]);
+				}
+			}
+		}
+	}
+}
+
+template<typename TElementIdx>
+template<typename ContainerType>
+void TSenseSys_HashGrid<TElementIdx>::GetElementsIDs(const FBox& Box, const FVector& Center, const Real Radius, const uint64 InBitChannels, ContainerType& Out) const
+{
+	const bool bSphere = Radius >= 0.f;
+	const Real RadiusSquared = Radius * Radius;
+	int32 VisitedCells = 0;
+	int32 VisitedElements = 0;
+	ForEachQueryCell(
+		Box,
+		[&](const FGridCell& Cell)
+		{
+			++VisitedCells;
+			VisitedElements += Cell.IDs.Num();
+			for (const ElementIndexType ObjID : Cell.IDs)
+			{
+				const FGridElement& Elem = Elements[ObjID];
+				if ((Elem.Mask & InBitChannels) && Box.Intersect(Elem.Box) && (!bSphere || FMath::SphereAABBIntersection(Center, RadiusSquared, Elem.Box)))
+				{
+					Out.Add(ObjID);
+				}
+			}
+		});
+	Counters.AddQuery(VisitedCells, VisitedElements);
+}
+
+template<typename TElementIdx>
+template<typename VolumeType, typename ContainerType>
+void TSenseSys_HashGrid<TElementIdx>::GetInVolumeIDs(const FBox& Box, const VolumeType& Volume, const uint64 InBitChannels, ContainerType& Out) const
+{
+	const FVector Margin(QueryMargin, QueryMargin, 0.f);
+	int32 VisitedCells = 0;
+	int32 VisitedElements = 0;
+	ForEachQueryCell(
+		Box,
+		[&](const FGridCell& Cell)
+		{
+			++VisitedCells;
+			// elements stick out of the cell of their center by up to the query margin
+			const FBox CellBox = GetCellBox(Cell.Coord, Box.Min.Z, Box.Max.Z);
+			if (!Volume.IntersectBox(FBox(CellBox.Min - Margin, CellBox.Max + Margin)))
+			{
+				return;
+			}
+			VisitedElements += Cell.IDs.Num();
+			for (const ElementIndexType ObjID : Cell.IDs)
+			{
+				const FGridElement& Elem = Elements[ObjID];
+				if ((Elem.Mask & InBitChannels) && Box.Intersect(Elem.Box) && Volume.IntersectBox(Elem.Box))
+				{
+					Out.Add(ObjID);
+				}
+			}
+		});
+	Counters.AddQuery(VisitedCells, VisitedElements);
+}
+
+template<typename TElementIdx>
+void TSenseSys_HashGrid<TElementIdx>::GetInBoxIDs(const FBox Box, TArray<ElementIndexType>& Out, const uint64 InBitChannels) const
+{
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_HashGrid_GetInBox);
+
+	FRWScopeLock SRWLock(RWLock, SLT_ReadOnly);
+
+	GetElementsIDs(Box, FVector::ZeroVector, -1.f, InBitChannels, Out);
+}
+template<typename TElementIdx>
+void TSenseSys_HashGrid<TElementIdx>::GetInRadiusIDs(const Real Radius, const FVector Center, TArray<ElementIndexType>& Out, const uint64 InBitChannels) const
+{
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_HashGrid_GetInRadius);
+
+	FRWScopeLock SRWLock(RWLock, SLT_ReadOnly);
+
+	GetElementsIDs(FBox::BuildAABB(Center, FVector(Radius)), Center, Radius, InBitChannels, Out);
+}
+template<typename TElementIdx>
+void TSenseSys_HashGrid<TElementIdx>::GetInBoxRadiusIDs(
+	const FBox Box,
+	const FVector Center,
+	const Real Radius,
+	TArray<ElementIndexType>& Out,
+	const uint64 InBitChannels) const
+{
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_HashGrid_GetInBoxRadius);
+
+	FRWScopeLock SRWLock(RWLock, SLT_ReadOnly);
+
+	GetElementsIDs(Box, Center, Radius, InBitChannels, Out);
+}
+
+template<typename TElementIdx>
+void TSenseSys_HashGrid<TElementIdx>::GetInBoxIDs(const FBox Box, TSet<ElementIndexType>& Out, const uint64 InBitChannels) const
+{
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_HashGrid_GetInBox);
+
+	FRWScopeLock SRWLock(RWLock, SLT_ReadOnly);
+
+	GetElementsIDs(Box, FVector::ZeroVector, -1.f, InBitChannels, Out);
+}
+template<typename TElementIdx>
+void TSenseSys_HashGrid<TElementIdx>::GetInRadiusIDs(const Real Radius, const FVector Center, TSet<ElementIndexType>& Out, const uint64 InBitChannels) const
+{
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_HashGrid_GetInRadius);
+
+	FRWScopeLock SRWLock(RWLock, SLT_ReadOnly);
+
+	GetElementsIDs(FBox::BuildAABB(Center, FVector(Radius)), Center, Radius, InBitChannels, Out);
+}
+template<typename TElementIdx>
+void TSenseSys_HashGrid<TElementIdx>::GetInBoxRadiusIDs(const FBox Box, const FVector Center, const Real Radius, TSet<ElementIndexType>& Out, const uint64 InBitChannels) const
+{
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_HashGrid_GetInBoxRadius);
+
+	FRWScopeLock SRWLock(RWLock, SLT_ReadOnly);
+
+	GetElementsIDs(Box, Center, Radius, InBitChannels, Out);
+}
+template<typename TElementIdx>
+void TSenseSys_HashGrid<TElementIdx>::GetInBoxIDs(const FBox Box, FSenseSysQueryIDs& Out, const uint64 InBitChannels) const
+{
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_HashGrid_GetInBox);
+
+	FRWScopeLock SRWLock(RWLock, SLT_ReadOnly);
+
+	GetElementsIDs(Box, FVector::ZeroVector, -1.f, InBitChannels, Out);
+}
+template<typename TElementIdx>
+void TSenseSys_HashGrid<TElementIdx>::GetInRadiusIDs(const Real Radius, const FVector Center, FSenseSysQueryIDs& Out, const uint64 InBitChannels) const
+{
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_HashGrid_GetInRadius);
+
+	FRWScopeLock SRWLock(RWLock, SLT_ReadOnly);
+
+	GetElementsIDs(FBox::BuildAABB(Center, FVector(Radius)), Center, Radius, InBitChannels, Out);
+}
+template<typename TElementIdx>
+void TSenseSys_HashGrid<TElementIdx>::GetInBoxRadiusIDs(const FBox Box, const FVector Center, const Real Radius, FSenseSysQueryIDs& Out, const uint64 InBitChannels) const
+{
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_HashGrid_GetInBoxRadius);
+
+	FRWScopeLock SRWLock(RWLock, SLT_ReadOnly);
+
+	GetElementsIDs(Box, Center, Radius, InBitChannels, Out);
+}
+
+template<typename TElementIdx>
+void TSenseSys_HashGrid<TElementIdx>::GetInBoxRadiusIDsBatch(const TArray<FBatchQuery>& Queries, TArray<TArray<ElementIndexType>>& Out) const
+{
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_HashGrid_GetInBoxRadiusBatch);
+
+	FRWScopeLock SRWLock(RWLock, SLT_ReadOnly);
+
+	// no upper levels to share, the batch only saves the lock per query
+	Out.SetNum(Queries.Num());
+	for (int32 i = 0; i < Queries.Num(); ++i)
+	{
+		const FBatchQuery& It = Queries[i];
+		GetElementsIDs(It.Box, It.Center, It.Radius == 0.f ? -1.f : It.Radius, It.BitChannels, Out[i]);
+	}
+}
+
+template<typename TElementIdx>
+void TSenseSys_HashGrid<TElementIdx>::GetKNearestIDs(
+	const FVector Center,
+	const int32 K,
+	const Real MaxRadius,
+	TArray<ElementIndexType>& Out,
+	const uint64 InBitChannels) const
+{
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_HashGrid_GetKNearest);
+
+	Out.Reset();
+	if (K <= 0)
+	{
+		return;
+	}
+
+	struct FElemDist
+	{
+		Real DistSquared;
+		ElementIndexType ObjID;
+		// max heap, the worst kept element on top
+		FORCEINLINE bool operator<(const FElemDist& Other) const { return DistSquared > Other.DistSquared; }
+	};
+	TArray<FElemDist, TInlineAllocator<16>> Best;
+	Best.Reserve(K + 1);
+	const Real MaxDistSquared = FMath::Square(MaxRadius);
+
+	FRWScopeLock SRWLock(RWLock, SLT_ReadOnly);
+
+	int32 VisitedCells = 0;
+	int32 VisitedElements = 0;
+	const auto TestCell = [&](const FGridCell& Cell)
+	{
+		++VisitedCells;
+		VisitedElements += Cell.IDs.Num();
+		for (const ElementIndexType ObjID : Cell.IDs)
+		{
+			const FGridElement& Elem = Elements[ObjID];
+			if (Elem.Mask & InBitChannels)
+			{
+				const Real DistSquared = Elem.Box.ComputeSquaredDistanceToPoint(Center);
+				if (DistSquared <= MaxDistSquared && (Best.Num() < K || DistSquared < Best.HeapTop().DistSquared))
+				{
+					if (Best.Num() == K)
+					{
+						Best.HeapPopDiscard(false);
+					}
+					Best.HeapPush(FElemDist{DistSquared, ObjID});
+				}
+			}
+		}
+	};
+
+	// rings of cells around the cell of Center, ring cells are at least (Ring - 1) * CellSize away on XY
+	// and an element reaches at most QueryMargin out of the cell of its center
+	const FIntPoint C = GetCellCoord(Center);
+	// clamped before the int conversion, a huge MaxRadius would overflow
+	const int32 MaxRing = FMath::CeilToInt(FMath::Min<Real>((MaxRadius + QueryMargin) / CellSize, MAX_int32 / 4)) + 1;
+	for (int32 Ring = 0; Ring <= MaxRing; ++Ring)
+	{
+		const Real RingDist = FMath::Max<Real>(0.f, (Ring - 1) * CellSize - QueryMargin);
+		if (RingDist > MaxRadius || (Best.Num() == K && FMath::Square(RingDist) > Best.HeapTop().DistSquared))
+		{
+			break;
+		}
+
+		// the ring is longer than the occupied cells, the rest is tested cell by cell
+		if (8 * Ring > Cells.Num())
+		{
+			for (const FGridCell& Cell : Cells)
+			{
+				if (FMath::Max(FMath::Abs(Cell.Coord.X - C.X), FMath::Abs(Cell.Coord.Y - C.Y)) >= Ring)
+				{
+					TestCell(Cell);
+				}
+			}
+			break;
+		}
+
+		for (int32 Y = C.Y - Ring; Y <= C.Y + Ring; ++Y)
+		{
+			const bool bEdgeRow = Y == C.Y - Ring || Y == C.Y + Ring;
+			const int32 Step = bEdgeRow ? 1 : FMath::Max(2 * Ring, 1);
+			for (int32 X = C.X - Ring; X <= C.X + Ring; X += Step)
+			{
+				if (const int32* CellIdx = CellMap.Find(FIntPoint(X, Y)))
+				{
+					TestCell(Cells[*CellIdx]);
+				}
+			}
+		}
+	}
+
+	Counters.AddQuery(VisitedCells, VisitedElements);
+
+	Best.Sort([](const FElemDist& A, const FElemDist& B) { return A.DistSquared < B.DistSquared; });
+	Out.Reserve(Best.Num());
+	for (const FElemDist& It : Best)
+	{
+		Out.Add(It.ObjID);
+	}
+}
+
+template<typename TElementIdx>
+void TSenseSys_HashGrid<TElementIdx>::GetAlongSegmentIDs(
+	const FVector Start,
+	const FVector End,
+	const Real Radius,
+	TArray<ElementIndexType>& Out,
+	const uint64 InBitChannels) const
+{
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_HashGrid_GetAlongSegment);
+
+	const FSenseSysSegment Segment(Start, End, Radius);
+	FSegmentHits Hits;
+	Out.Reset();
+
+	FRWScopeLock SRWLock(RWLock, SLT_ReadOnly);
+
+	GetInVolumeIDs(Segment.GetBounds(), Segment, InBitChannels, Out);
+	for (const ElementIndexType ObjID : Out)
+	{
+		const FBox& Box = Elements[ObjID].Box;
+		Real Entry;
+		if (Segment.ClipBox(Box.Min, Box.Max, 3, Entry))
+		{
+			Hits.Add(FSegmentHit{Entry, ObjID});
+		}
+	}
+	SortSegmentHits(Hits, Out);
+}
+
+template<typename TElementIdx>
+void TSenseSys_HashGrid<TElementIdx>::GetInConeIDs(const FBox Box, const FSenseSysCone& Cone, TArray<ElementIndexType>& Out, const uint64 InBitChannels) const
+{
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_HashGrid_GetInCone);
+
+	FRWScopeLock SRWLock(RWLock, SLT_ReadOnly);
+
+	GetInVolumeIDs(Box, Cone, InBitChannels, Out);
+}
+template<typename TElementIdx>
+void TSenseSys_HashGrid<TElementIdx>::GetInConeIDs(const FBox Box, const FSenseSysCone& Cone, TSet<ElementIndexType>& Out, const uint64 InBitChannels) const
+{
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_HashGrid_GetInCone);
+
+	FRWScopeLock SRWLock(RWLock, SLT_ReadOnly);
+
+	GetInVolumeIDs(Box, Cone, InBitChannels, Out);
+}
+template<typename TElementIdx>
+void TSenseSys_HashGrid<TElementIdx>::GetInConeIDs(const FBox Box, const FSenseSysCone& Cone, FSenseSysQueryIDs& Out, const uint64 InBitChannels) const
+{
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_HashGrid_GetInCone);
+
+	FRWScopeLock SRWLock(RWLock, SLT_ReadOnly);
+
+	GetInVolumeIDs(Box, Cone, InBitChannels, Out);
+}
+template<typename TElementIdx>
+void TSenseSys_HashGrid<TElementIdx>::GetInFrustumIDs(const FBox Box, const FSenseSysFrustum& Frustum, TArray<ElementIndexType>& Out, const uint64 InBitChannels) const
+{
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_HashGrid_GetInFrustum);
+
+	FRWScopeLock SRWLock(RWLock, SLT_ReadOnly);
+
+	GetInVolumeIDs(Box, Frustum, InBitChannels, Out);
+}
+template<typename TElementIdx>
+void TSenseSys_HashGrid<TElementIdx>::GetInFrustumIDs(const FBox Box, const FSenseSysFrustum& Frustum, TSet<ElementIndexType>& Out, const uint64 InBitChannels) const
+{
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_HashGrid_GetInFrustum);
+
+	FRWScopeLock SRWLock(RWLock, SLT_ReadOnly);
+
+	GetInVolumeIDs(Box, Frustum, InBitChannels, Out);
+}
+template<typename TElementIdx>
+void TSenseSys_HashGrid<TElementIdx>::GetInFrustumIDs(const FBox Box, const FSenseSysFrustum& Frustum, FSenseSysQueryIDs& Out, const uint64 InBitChannels) const
+{
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_HashGrid_GetInFrustum);
+
+	FRWScopeLock SRWLock(RWLock, SLT_ReadOnly);
+
+	GetInVolumeIDs(Box, Frustum, InBitChannels, Out);
+}
+
+template<typename TElementIdx>
+FBox TSenseSys_HashGrid<TElementIdx>::GetMaxIntersect(const FBox Box) const
+{
+	FRWScopeLock SRWLock(RWLock, SLT_ReadOnly);
+
+	FBox Out(ForceInit);
+	for (const FGridCell& Cell : Cells)
+	{
+		const FBox CellBox = GetCellBox(Cell.Coord, Box.Min.Z, Box.Max.Z);
+		if (Cell.IDs.Num() && CellBox.Intersect(Box))
+		{
+			Out += CellBox;
+		}
+	}
+	return Out.IsValid ? Out : FBox(FVector::ZeroVector, FVector::ZeroVector);
+}
+
+template<typename TElementIdx>
+void TSenseSys_HashGrid<TElementIdx>::DrawTree(const class UWorld* World, const FTreeDrawSetup TreeNode, const FTreeDrawSetup Link, const FTreeDrawSetup ElemNode, const float LifeTime) const
+{
+#if ENABLE_DRAW_DEBUG
+	FRWScopeLock SRWLock(RWLock, SLT_ReadOnly);
+
+	for (const FGridCell& Cell : Cells)
+	{
+		if (Cell.IDs.Num() == 0)
+		{
+			continue;
+		}
+		FBox ElemBounds(ForceInit);
+		for (const ElementIndexType ObjID : Cell.IDs)
+		{
+			const FBox& ElemBox = Elements[ObjID].Box;
+			ElemBounds += ElemBox;
+			DrawDebugBox(World, ElemBox.GetCenter(), ElemBox.GetExtent(), ElemNode.Color, false, LifeTime, ElemNode.DrawDepth, ElemNode.Thickness);
+		}
+		const FBox CellBox = GetCellBox(Cell.Coord, ElemBounds.Min.Z, ElemBounds.Max.Z);
+		DrawDebugBox(World, CellBox.GetCenter(), CellBox.GetExtent(), TreeNode.Color, false, LifeTime, TreeNode.DrawDepth, TreeNode.Thickness);
+	}
+#endif //ENABLE_DRAW_DEBUG
+}
+
+
+template<typename TElementIdx, uint32 Dim>
+void TSenseSys_LinearTree<TElementIdx, Dim>::AddToPending(const ElementIndexType ObjID)
+{
+	FLinearElement& Elem = Elements[ObjID];
+	Elem.NodeIdx = INDEX_NONE;
+	Elem.Slot = Pending.Add(static_cast<TElementIdx>(ObjID));
+}
+
+template<typename TElementIdx, uint32 Dim>
+void TSenseSys_LinearTree<TElementIdx, Dim>::RemoveFromPending(const ElementIndexType ObjID)
+{
+	FLinearElement& Elem = Elements[ObjID];
+	check(Pending[Elem.Slot] == ObjID);
+	Pending.RemoveAtSwap(Elem.Slot, 1, false);
+	if (Pending.IsValidIndex(Elem.Slot))
+	{
+		Elements[Pending[Elem.Slot]].Slot = Elem.Slot;
+	}
+	Elem.Slot = INDEX_NONE;
+}
+
+template<typename TElementIdx, uint32 Dim>
+void TSenseSys_LinearTree<TElementIdx, Dim>::MoveToPending(const ElementIndexType ObjID)
+{
+	SortedMasks[Elements[ObjID].Slot] = 0;
+	++DeadCount;
+	AddToPending(ObjID);
+	++Counters.Reinserts;
+}
+
+template<typename TElementIdx, uint32 Dim>
+void TSenseSys_LinearTree<TElementIdx, Dim>::Insert_Internal(const ElementIndexType ObjID, const FBox& InBox, const uint64 Channels)
+{
+	if (Elements.Num() <= ObjID)
+	{
+		Elements.SetNum(FMath::Max(ElementPool.GetMaxIndex(), ObjID + 1));
+	}
+	FLinearElement& Elem = Elements[ObjID];
+	Elem.Box = InBox;
+	Elem.Mask = Channels;
+	AddToPending(ObjID);
+}
+
+template<typename TElementIdx, uint32 Dim>
+void TSenseSys_LinearTree<TElementIdx, Dim>::Update_Internal(const ElementIndexType ObjID, const FBox& NewBox)
+{
+	FLinearElement& Elem = Elements[ObjID];
+	Elem.Box = NewBox;
+	if (Elem.NodeIdx != INDEX_NONE)
+	{
+		// the ancestors bound the leaf, the slot stays valid while the box is inside it
+		if (IsInsideBox(Nodes[Elem.NodeIdx].Bounds, NewBox))
+		{
+			SortedBoxes[Elem.Slot] = NewBox;
+		}
+		else
+		{
+			MoveToPending(ObjID);
+		}
+	}
+}
+
+template<typename TElementIdx, uint32 Dim>
+void TSenseSys_LinearTree<TElementIdx, Dim>::SetElementChannels_Internal(const ElementIndexType ID, const uint64 Channels)
+{
+	FLinearElement& Elem = Elements[ID];
+	Elem.Mask = Channels;
+	if (Elem.NodeIdx != INDEX_NONE)
+	{
+		if ((Channels & ~Nodes[Elem.NodeIdx].ChannelMask) == 0)
+		{
+			SortedMasks[Elem.Slot] = Channels;
+		}
+		else
+		{
+			MoveToPending(ID);
+		}
+	}
+}
+
+template<typename TElementIdx, uint32 Dim>
+void TSenseSys_LinearTree<TElementIdx, Dim>::Rebuild_Internal()
+{
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_LinearTree_Rebuild);
+
+	++Counters.Collapses;
+
+	SortedIDs.Reset();
+	SortedBoxes.Reset();
+	SortedMasks.Reset();
+	Nodes.Reset();
+	Pending.Reset();
+	DeadCount = 0;
+	MaxDepth = 0;
+
+	const int32 Count = ElementPool.Num();
+	if (Count == 0)
+	{
+		return;
+	}
+
+	FBox Bounds(ForceInit);
+	for (auto It = ElementPool.CreateConstIterator(); It; ++It)
+	{
+		Bounds += Elements[It.GetIndex()].Box.GetCenter();
+	}
+
+	// codes over the cube of the centers, levels below MinimumQuadSize cells are not split
+	Real Size = 0.f;
+	for (int32 j = 0; j < static_cast<int32>(Dim); ++j)
+	{
+		Size = FMath::Max(Size, Bounds.Max[j] - Bounds.Min[j]);
+	}
+	for (Real CellSize = Size; CellSize > MinimumQuadSize && MaxDepth < AxisBits; CellSize *= 0.5f)
+	{
+		++MaxDepth;
+	}
+	constexpr Real AxisCells = static_cast<Real>(1U << AxisBits);
+	const Real Scale = Size > 0.f ? AxisCells / Size : 0.f;
+
+	struct FCodeIdx
+	{
+		uint32 Code;
+		TElementIdx ObjID;
+	};
+	TArray<FCodeIdx> Unsorted;
+	Unsorted.Reserve(Count);
+	for (auto It = ElementPool.CreateConstIterator(); It; ++It)
+	{
+		const FVector Center = Elements[It.GetIndex()].Box.GetCenter();
+		uint32 Code = 0;
+		for (int32 j = 0; j < static_cast<int32>(Dim); ++j)
+		{
+			const Real Cell = FMath::Clamp<Real>((Center[j] - Bounds.Min[j]) * Scale, 0.f, AxisCells - 1.f);
+			Code |= MortonSpreadBits<Dim>(static_cast<uint32>(Cell)) << j;
+		}
+		Unsorted.Add(FCodeIdx{Code, static_cast<TElementIdx>(It.GetIndex())});
+	}
+	TArray<FCodeIdx> Sorted;
+	Sorted.SetNumUninitialized(Count);
+	RadixSort32(Sorted.GetData(), Unsorted.GetData(), Count, [](const FCodeIdx& It) { return It.Code; });
+
+	TArray<uint32> Codes;
+	Codes.SetNumUninitialized(Count);
+	SortedIDs.SetNumUninitialized(Count);
+	SortedBoxes.SetNumUninitialized(Count);
+	SortedMasks.SetNumUninitialized(Count);
+	for (int32 i = 0; i < Count; ++i)
+	{
+		const FLinearElement& Elem = Elements[Sorted[i].ObjID];
+		Codes[i] = Sorted[i].Code;
+		SortedIDs[i] = Sorted[i].ObjID;
+		SortedBoxes[i] = Elem.Box;
+		SortedMasks[i] = Elem.Mask;
+	}
+
+	Nodes.Reserve(2 * Count / NodeCantSplit + 1);
+	BuildNode(Codes, 0, Count, 0);
+}
+
+template<typename TElementIdx, uint32 Dim>
+int32 TSenseSys_LinearTree<TElementIdx, Dim>::BuildNode(const TArray<uint32>& Codes, const int32 Begin, const int32 End, int32 Depth)
+{
+	const int32 NodeIdx = Nodes.AddDefaulted();
+	const auto CanSplit = [&]() { return End - Begin > NodeCantSplit && Depth < MaxDepth; };
+	const auto LevelShift = [&]() { return static_cast<uint32>((AxisBits - Depth - 1) * Dim); };
+
+	// levels with a single child are not stored, the range is sorted so the first and last code bound it
+	while (CanSplit() && (Codes[Begin] >> LevelShift()) == (Codes[End - 1] >> LevelShift()))
+	{
+		++Depth;
+	}
+
+	FBox Bounds(ForceInit);
+	uint64 Mask = 0;
+	if (CanSplit())
+	{
+		const uint32 Shift = LevelShift();
+		for (int32 ChildBegin = Begin; ChildBegin < End;)
+		{
+			const uint32 Prefix = Codes[ChildBegin] >> Shift;
+			int32 ChildEnd = ChildBegin + 1;
+			while (ChildEnd < End && (Codes[ChildEnd] >> Shift) == Prefix)
+			{
+				++ChildEnd;
+			}
+			const int32 Child = BuildNode(Codes, ChildBegin, ChildEnd, Depth + 1);
+			Bounds += Nodes[Child].Bounds;
+			Mask |= Nodes[Child].ChannelMask;
+			ChildBegin = ChildEnd;
+		}
+	}
+	else
+	{
+		for (int32 i = Begin; i < End; ++i)
+		{
+			Bounds += SortedBoxes[i];
+			Mask |= SortedMasks[i];
+			FLinearElement& Elem = Elements[SortedIDs[i]];
+			Elem.NodeIdx = NodeIdx;
+			Elem.Slot = i;
+		}
+		Bounds = Bounds.ExpandBy(LeafMargin);
+	}
+
+	FLinearNode& Node = Nodes[NodeIdx];
+	Node.Bounds = Bounds;
+	Node.ChannelMask = Mask;
+	Node.Begin = Begin;
+	Node.End = End;
+	Node.Skip = Nodes.Num();
+	return NodeIdx;
+}
+
+template<typename TElementIdx, uint32 Dim>
+IContainerTree::ElementIndexType TSenseSys_LinearTree<TElementIdx, Dim>::Insert(const FSensedStimulus& ComponentData, const FBox InBox)
+{
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_LinearTree_Insert);
+
+	FWriteScope SRWLock(*this, true);
+
+	if (FitElementCount_Internal(1, MaxElements) == 0)
+	{
+		return MaxIndex();
+	}
+	const ElementIndexType ObjID = ElementPool.Add(ComponentData);
+	Insert_Internal(ObjID, InBox, ComponentData.BitChannels);
+	return MarkPoolDirty_Internal(ObjID);
+}
+template<typename TElementIdx, uint32 Dim>
+IContainerTree::ElementIndexType TSenseSys_LinearTree<TElementIdx, Dim>::Insert(FSensedStimulus&& ComponentData, const FBox InBox)
+{
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_LinearTree_Insert);
+
+	FWriteScope SRWLock(*this, true);
+
+	if (FitElementCount_Internal(1, MaxElements) == 0)
+	{
+		return MaxIndex();
+	}
+	const uint64 Channels = ComponentData.BitChannels;
+	const ElementIndexType ObjID = ElementPool.Add(MoveTemp(ComponentData));
+	Insert_Internal(ObjID, InBox, Channels);
+	return MarkPoolDirty_Internal(ObjID);
+}
+
+template<typename TElementIdx, uint32 Dim>
+void TSenseSys_LinearTree<TElementIdx, Dim>::Update(const ElementIndexType InObjID, const FBox NewBox)
+{
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_LinearTree_Update);
+
+	FWriteScope SRWLock(*this, true);
+
+	if (InObjID != MaxIndex())
+	{
+		Update_Internal(InObjID, NewBox);
+	}
+}
+
+template<typename TElementIdx, uint32 Dim>
+void TSenseSys_LinearTree<TElementIdx, Dim>::UpdateBatch(const TArray<FUpdateItem>& Items)
+{
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_LinearTree_UpdateBatch);
+
+	FWriteScope SRWLock(*this, true);
+
+	for (const FUpdateItem& It : Items)
+	{
+		if (SetUpdateItemPoints_Internal(It))
+		{
+			Update_Internal(It.ObjID, It.Box);
+		}
+	}
+}
+
+template<typename TElementIdx, uint32 Dim>
+void TSenseSys_LinearTree<TElementIdx, Dim>::BulkInsert(
+	TArray<FSensedStimulus>&& ComponentsData,
+	const TArray<FBox>& InBoxes,
+	TArray<ElementIndexType>& OutIDs)
+{
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_LinearTree_BulkInsert);
+
+	check(ComponentsData.Num() == InBoxes.Num());
+
+	FWriteScope SRWLock(*this, true);
+
+	const int32 Count = FitElementCount_Internal(InBoxes.Num(), MaxElements);
+	OutIDs.Init(MaxIndex(), InBoxes.Num());
+	ElementPool.Reserve(ElementPool.Num() + Count);
+	Elements.Reserve(ElementPool.Num() + Count);
+	for (int32 i = 0; i < Count; ++i)
+	{
+		const uint64 Channels = ComponentsData[i].BitChannels;
+		const ElementIndexType ObjID = ElementPool.Add(MoveTemp(ComponentsData[i]));
+		Insert_Internal(ObjID, InBoxes[i], Channels);
+		OutIDs[i] = MarkPoolDirty_Internal(ObjID);
+	}
+	ComponentsData.Reset();
+
+	if (Count > 0)
+	{
+		Rebuild_Internal();
+	}
+}
+
+template<typename TElementIdx, uint32 Dim>
+bool TSenseSys_LinearTree<TElementIdx, Dim>::Remove(const ElementIndexType InObjID)
+{
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_LinearTree_Remove);
+
+	FWriteScope SRWLock(*this, true);
+
+	check(InObjID != MaxIndex());
+	RecordRemove_Internal(InObjID);
+	FLinearElement& Elem = Elements[InObjID];
+	if (Elem.NodeIdx != INDEX_NONE)
+	{
+		SortedMasks[Elem.Slot] = 0;
+		++DeadCount;
+	}
+	else
+	{
+		RemoveFromPending(InObjID);
+	}
+	Elem = FLinearElement();
+	ElementPool.RemoveAt(InObjID);
+	return true;
+}
+
+template<typename TElementIdx, uint32 Dim>
+void TSenseSys_LinearTree<TElementIdx, Dim>::Clear()
+{
+	FWriteScope SRWLock(*this);
+
+	ElementPool.Empty();
+	Elements.Empty();
+	SortedIDs.Empty();
+	SortedBoxes.Empty();
+	SortedMasks.Empty();
+	Nodes.Empty();
+	Pending.Empty();
+	DeadCount = 0;
+	MaxDepth = 0;
+	ClearTagChannels_Internal();
+	DiscardStagedUpdates();
+}
+
+template<typename TElementIdx, uint32 Dim>
+void TSenseSys_LinearTree<TElementIdx, Dim>::Collapse()
+{
+	FRWScopeLock SRWLock(RWLock, SLT_Write);
+
+	if (Pending.Num() > 0 || DeadCount > 0)
+	{
+		Rebuild_Internal();
+	}
+}
+
+template<typename TElementIdx, uint32 Dim>
+void TSenseSys_LinearTree<TElementIdx, Dim>::CollapseQueued(const int32 Budget)
+{
+	{
+		FRWScopeLock SRWLock(RWLock, SLT_ReadOnly);
+		// a rebuild sorts all elements, it pays off once the pending scan is a share of the tree, or past Budget on small trees
+		if (Pending.Num() + DeadCount <= FMath::Max(Budget, SortedIDs.Num() / RebuildShare))
+		{
+			return;
+		}
+	}
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_LinearTree_CollapseQueued);
+
+	FRWScopeLock SRWLock(RWLock, SLT_Write);
+
+	Rebuild_Internal();
+}
+
+template<typename TElementIdx, uint32 Dim>
+void TSenseSys_LinearTree<TElementIdx, Dim>::Compact_Internal(TArray<ElementIndexType>& OutRemap)
+{
+	// ObjIDs follow the Morton order of the rebuild, a sorted slot holds its own ObjID
+	Rebuild_Internal();
+
+	OutRemap.Init(MaxIndex(), ElementPool.GetMaxIndex());
+	TSparseArray<FSensedStimulus> NewElementPool;
+	TArray<FLinearElement> NewElements;
+	NewElementPool.Reserve(SortedIDs.Num());
+	NewElements.SetNum(SortedIDs.Num());
+	for (int32 i = 0; i < SortedIDs.Num(); ++i)
+	{
+		const int32 OldID = SortedIDs[i];
+		OutRemap[OldID] = i;
+		NewElementPool.Add(MoveTemp(ElementPool[OldID]));
+		NewElements[i] = Elements[OldID];
+		SortedIDs[i] = static_cast<TElementIdx>(i);
+	}
+	ElementPool = MoveTemp(NewElementPool);
+	Elements = MoveTemp(NewElements);
+}
+
+template<typename TElementIdx, uint32 Dim>
+void TSenseSys_LinearTree<TElementIdx, Dim>::GetStats_Internal(FSenseSysTreeStats& OutStats) const
+{
+	// preorder, the depth of a node is the number of open subtrees that end after it
+	TArray<int32, TInlineAllocator<64>> SubtreeEnds;
+	for (int32 NodeIdx = 0; NodeIdx < Nodes.Num(); ++NodeIdx)
+	{
+		while (SubtreeEnds.Num() && SubtreeEnds.Last() <= NodeIdx)
+		{
+			SubtreeEnds.Pop(false);
+		}
+		const FLinearNode& Node = Nodes[NodeIdx];
+		if (Node.Skip == NodeIdx + 1)
+		{
+			OutStats.AddLeaf(Node.End - Node.Begin, SubtreeEnds.Num());
+		}
+		else
+		{
+			SubtreeEnds.Add(Node.Skip);
+		}
+	}
+	OutStats.NumNodes = Nodes.Num();
+	OutStats.PoolBytes = Nodes.GetAllocatedSize();
+	OutStats.DataBytes = Elements.GetAllocatedSize() + SortedIDs.GetAllocatedSize() + SortedBoxes.GetAllocatedSize() + SortedMasks.GetAllocatedSize() +
+		Pending.GetAllocatedSize();
+	CopyCounters(Counters, OutStats);
+}
+
+
+template<typename TElementIdx, uint32 Dim>
+template<typename NodeTestType, typename ElemTestType, typename ContainerType>
+void TSenseSys_LinearTree<TElementIdx, Dim>::GetElementsIDs(
+	const uint64 InBitChannels,
+	NodeTestType NodeTest,
+	ElemTestType ElemTest,
+	ContainerType& Out) const
+{
+	// a missed node jumps over its subtree, a hit goes on to its first child
+	int32 NodeIdx = 0;
+	int32 VisitedNodes = 0;
+	int32 VisitedElements = Pending.Num();
+	while (NodeIdx < Nodes.Num())
+	{
+		const FLinearNode& Node = Nodes[NodeIdx];
+		++VisitedNodes;
+		if ((Node.ChannelMask & InBitChannels) == 0 || !NodeTest(Node.Bounds))
+		{
+			NodeIdx = Node.Skip;
+			continue;
+		}
+		if (Node.Skip == NodeIdx + 1)
+		{
+			VisitedElements += Node.End - Node.Begin;
+			for (int32 i = Node.Begin; i < Node.End; ++i)
+			{
+				if ((SortedMasks[i] & InBitChannels) && ElemTest(SortedBoxes[i]))
+				{
+					Out.Add(SortedIDs[i]);
+				}
+			}
+		}
+		++NodeIdx;
+	}
+
+	for (const TElementIdx ObjID : Pending)
+	{
+		const FLinearElement& Elem = Elements[ObjID];
+		if ((Elem.Mask & InBitChannels) && ElemTest(Elem.Box))
+		{
+			Out.Add(ObjID);
+		}
+	}
+	Counters.AddQuery(VisitedNodes, VisitedElements);
+}
+
+template<typename TElementIdx, uint32 Dim>
+template<typename ContainerType>
+void TSenseSys_LinearTree<TElementIdx, Dim>::GetInBoxRadiusIDs_Internal(
+	const FBox& Box,
+	const FVector& Center,
+	const Real Radius,
+	const uint64 InBitChannels,
+	ContainerType& Out) const
+{
+	const bool bSphere = Radius >= 0.f;
+	const Real RadiusSquared = Radius * Radius;
+	const auto Test = [&](const FBox& InBox) { return IntersectBox(Box, InBox) && (!bSphere || DistSquared(InBox, Center) <= RadiusSquared); };
+	GetElementsIDs(InBitChannels, Test, Test, Out);
+}
+
+template<typename TElementIdx, uint32 Dim>
+template<typename VolumeType, typename ContainerType>
+void TSenseSys_LinearTree<TElementIdx, Dim>::GetInVolumeIDs(const FBox& Box, const VolumeType& Volume, const uint64 InBitChannels, ContainerType& Out) const
+{
+	const auto Test = [&](const FBox& InBox) { return IntersectBox(Box, InBox) && Volume.IntersectBox(LiftBox(InBox, Box)); };
+	GetElementsIDs(InBitChannels, Test, Test, Out);
+}
+
+template<typename TElementIdx, uint32 Dim>
+void TSenseSys_LinearTree<TElementIdx, Dim>::GetInBoxIDs(const FBox Box, TArray<ElementIndexType>& Out, const uint64 InBitChannels) const
+{
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_LinearTree_GetInBox);
+
+	FRWScopeLock SRWLock(RWLock, SLT_ReadOnly);
+
+	GetInBoxRadiusIDs_Internal(Box, FVector::ZeroVector, -1.f, InBitChannels, Out);
+}
+template<typename TElementIdx, uint32 Dim>
+void TSenseSys_LinearTree<TElementIdx, Dim>::GetInRadiusIDs(const Real Radius, const FVector Center, TArray<ElementIndexType>& Out, const uint64 InBitChannels) const
+{
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_LinearTree_GetInRadius);
+
+	FRWScopeLock SRWLock(RWLock, SLT_ReadOnly);
+
+	GetInBoxRadiusIDs_Internal(FBox::BuildAABB(Center, FVector(Radius)), Center, Radius, InBitChannels, Out);
+}
+template<typename TElementIdx, uint32 Dim>
+void TSenseSys_LinearTree<TElementIdx, Dim>::GetInBoxRadiusIDs(
+	const FBox Box,
+	const FVector Center,
+	const Real Radius,
+	TArray<ElementIndexType>& Out,
+	const uint64 InBitChannels) const
+{
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_LinearTree_GetInBoxRadius);
+
+	FRWScopeLock SRWLock(RWLock, SLT_ReadOnly);
+
+	GetInBoxRadiusIDs_Internal(Box, Center, Radius, InBitChannels, Out);
+}
+
+template<typename TElementIdx, uint32 Dim>
+void TSenseSys_LinearTree<TElementIdx, Dim>::GetInBoxIDs(const FBox Box, TSet<ElementIndexType>& Out, const uint64 InBitChannels) const
+{
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_LinearTree_GetInBox);
+
+	FRWScopeLock SRWLock(RWLock, SLT_ReadOnly);
+
+	GetInBoxRadiusIDs_Internal(Box, FVector::ZeroVector, -1.f, InBitChannels, Out);
+}
+template<typename TElementIdx, uint32 Dim>
+void TSenseSys_LinearTree<TElementIdx, Dim>::GetInRadiusIDs(const Real Radius, const FVector Center, TSet<ElementIndexType>& Out, const uint64 InBitChannels) const
+{
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_LinearTree_GetInRadius);
+
+	FRWScopeLock SRWLock(RWLock, SLT_ReadOnly);
+
+	GetInBoxRadiusIDs_Internal(FBox::BuildAABB(Center, FVector(Radius)), Center, Radius, InBitChannels, Out);
+}
+template<typename TElementIdx, uint32 Dim>
+void TSenseSys_LinearTree<TElementIdx, Dim>::GetInBoxRadiusIDs(
+	const FBox Box,
+	const FVector Center,
+	const Real Radius,
+	TSet<ElementIndexType>& Out,
+	const uint64 InBitChannels) const
+{
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_LinearTree_GetInBoxRadius);
+
+	FRWScopeLock SRWLock(RWLock, SLT_ReadOnly);
+
+	GetInBoxRadiusIDs_Internal(Box, Center, Radius, InBitChannels, Out);
+}
+template<typename TElementIdx, uint32 Dim>
+void TSenseSys_LinearTree<TElementIdx, Dim>::GetInBoxIDs(const FBox Box, FSenseSysQueryIDs& Out, const uint64 InBitChannels) const
+{
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_LinearTree_GetInBox);
+
+	FRWScopeLock SRWLock(RWLock, SLT_ReadOnly);
+
+	GetInBoxRadiusIDs_Internal(Box, FVector::ZeroVector, -1.f, InBitChannels, Out);
+}
+template<typename TElementIdx, uint32 Dim>
+void TSenseSys_LinearTree<TElementIdx, Dim>::GetInRadiusIDs(const Real Radius, const FVector Center, FSenseSysQueryIDs& Out, const uint64 InBitChannels) const
+{
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_LinearTree_GetInRadius);
+
+	FRWScopeLock SRWLock(RWLock, SLT_ReadOnly);
+
+	GetInBoxRadiusIDs_Internal(FBox::BuildAABB(Center, FVector(Radius)), Center, Radius, InBitChannels, Out);
+}
+template<typename TElementIdx, uint32 Dim>
+void TSenseSys_LinearTree<TElementIdx, Dim>::GetInBoxRadiusIDs(
+	const FBox Box,
+	const FVector Center,
+	const Real Radius,
+	FSenseSysQueryIDs& Out,
+	const uint64 InBitChannels) const
+{
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_LinearTree_GetInBoxRadius);
+
+	FRWScopeLock SRWLock(RWLock, SLT_ReadOnly);
+
+	GetInBoxRadiusIDs_Internal(Box, Center, Radius, InBitChannels, Out);
+}
+
+template<typename TElementIdx, uint32 Dim>
+void TSenseSys_LinearTree<TElementIdx, Dim>::GetInBoxRadiusIDsBatch(const TArray<FBatchQuery>& Queries, TArray<TArray<ElementIndexType>>& Out) const
+{
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_LinearTree_GetInBoxRadiusBatch);
+
+	FRWScopeLock SRWLock(RWLock, SLT_ReadOnly);
+
+	// the walk is a linear pass over the node array, the batch only saves the lock per query
+	Out.SetNum(Queries.Num());
+	for (int32 i = 0; i < Queries.Num(); ++i)
+	{
+		const FBatchQuery& It = Queries[i];
+		GetInBoxRadiusIDs_Internal(It.Box, It.Center, It.Radius == 0.f ? -1.f : It.Radius, It.BitChannels, Out[i]);
+	}
+}
+
+template<typename TElementIdx, uint32 Dim>
+void TSenseSys_LinearTree<TElementIdx, Dim>::GetKNearestIDs(
+	const FVector Center,
+	const int32 K,
+	const Real MaxRadius,
+	TArray<ElementIndexType>& Out,
+	const uint64 InBitChannels) const
+{
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_LinearTree_GetKNearest);
+
+	Out.Reset();
+	if (K <= 0)
+	{
+		return;
+	}
+
+	struct FElemDist
+	{
+		Real DistSquared;
+		ElementIndexType ObjID;
+		// max heap, the worst kept element on top
+		FORCEINLINE bool operator<(const FElemDist& Other) const { return DistSquared > Other.DistSquared; }
+	};
+	struct FNodeDist
+	{
+		Real DistSquared;
+		int32 NodeIdx;
+		// min heap, the nearest open node on top
+		FORCEINLINE bool operator<(const FNodeDist& Other) const { return DistSquared < Other.DistSquared; }
+	};
+	TArray<FElemDist, TInlineAllocator<16>> Best;
+	Best.Reserve(K + 1);
+	TArray<FNodeDist, TInlineAllocator<64>> Open;
+	const Real MaxDistSquared = FMath::Square(MaxRadius);
+
+	FRWScopeLock SRWLock(RWLock, SLT_ReadOnly);
+
+	int32 VisitedNodes = 0;
+	int32 VisitedElements = Pending.Num();
+	const auto TestElement = [&](const ElementIndexType ObjID, const FBox& ElemBox)
+	{
+		const Real ElemDistSquared = DistSquared(ElemBox, Center);
+		if (ElemDistSquared <= MaxDistSquared && (Best.Num() < K || ElemDistSquared < Best.HeapTop().DistSquared))
+		{
+			if (Best.Num() == K)
+			{
+				Best.HeapPopDiscard(false);
+			}
+			Best.HeapPush(FElemDist{ElemDistSquared, ObjID});
+		}
+	};
+	const auto OpenNode = [&](const int32 NodeIdx)
+	{
+		const FLinearNode& Node = Nodes[NodeIdx];
+		if (Node.ChannelMask & InBitChannels)
+		{
+			const Real NodeDistSquared = DistSquared(Node.Bounds, Center);
+			if (NodeDistSquared <= MaxDistSquared)
+			{
+				Open.HeapPush(FNodeDist{NodeDistSquared, NodeIdx});
+			}
+		}
+	};
+
+	for (const TElementIdx ObjID : Pending)
+	{
+		const FLinearElement& Elem = Elements[ObjID];
+		if (Elem.Mask & InBitChannels)
+		{
+			TestElement(ObjID, Elem.Box);
+		}
+	}
+
+	if (Nodes.Num() > 0)
+	{
+		OpenNode(0);
+	}
+	while (Open.Num() > 0)
+	{
+		FNodeDist Top;
+		Open.HeapPop(Top, false);
+		if (Best.Num() == K && Top.DistSquared > Best.HeapTop().DistSquared)
+		{
+			break;
+		}
+		const FLinearNode& Node = Nodes[Top.NodeIdx];
+		++VisitedNodes;
+		if (Node.Skip == Top.NodeIdx + 1)
+		{
+			VisitedElements += Node.End - Node.Begin;
+			for (int32 i = Node.Begin; i < Node.End; ++i)
+			{
+				if (SortedMasks[i] & InBitChannels)
+				{
+					TestElement(SortedIDs[i], SortedBoxes[i]);
+				}
+			}
+		}
+		else
+		{
+			// children follow the node, each one skips to the next
+			for (int32 Child = Top.NodeIdx + 1; Child < Node.Skip; Child = Nodes[Child].Skip)
+			{
+				OpenNode(Child);
+			}
+		}
+	}
+
+	Counters.AddQuery(VisitedNodes, VisitedElements);
+
+	Best.Sort([](const FElemDist& A, const FElemDist& B) { return A.DistSquared < B.DistSquared; });
+	Out.Reserve(Best.Num());
+	for (const FElemDist& It : Best)
+	{
+		Out.Add(It.ObjID);
+	}
+}
+
+template<typename TElementIdx, uint32 Dim>
+void TSenseSys_LinearTree<TElementIdx, Dim>::GetAlongSegmentIDs(
+	const FVector Start,
+	const FVector End,
+	const Real Radius,
+	TArray<ElementIndexType>& Out,
+	const uint64 InBitChannels) const
+{
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_LinearTree_GetAlongSegment);
+
+	const FSenseSysSegment Segment(Start, End, Radius);
+	FSegmentHits Hits;
+	Out.Reset();
+
+	FRWScopeLock SRWLock(RWLock, SLT_ReadOnly);
+
+	GetInVolumeIDs(Segment.GetBounds(), Segment, InBitChannels, Out);
+	for (const ElementIndexType ObjID : Out)
+	{
+		const FBox& Box = Elements[ObjID].Box;
+		Real Entry;
+		if (Segment.ClipBox(Box.Min, Box.Max, Dim, Entry))
+		{
+			Hits.Add(FSegmentHit{Entry, ObjID});
+		}
+	}
+	SortSegmentHits(Hits, Out);
+}
+
+template<typename TElementIdx, uint32 Dim>
+void TSenseSys_LinearTree<TElementIdx, Dim>::GetInConeIDs(const FBox Box, const FSenseSysCone& Cone, TArray<ElementIndexType>& Out, const uint64 InBitChannels) const
+{
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_LinearTree_GetInCone);
+
+	FRWScopeLock SRWLock(RWLock, SLT_ReadOnly);
+
+	GetInVolumeIDs(Box, Cone, InBitChannels, Out);
+}
+template<typename TElementIdx, uint32 Dim>
+void TSenseSys_LinearTree<TElementIdx, Dim>::GetInConeIDs(const FBox Box, const FSenseSysCone& Cone, TSet<ElementIndexType>& Out, const uint64 InBitChannels) const
+{
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_LinearTree_GetInCone);
+
+	FRWScopeLock SRWLock(RWLock, SLT_ReadOnly);
+
+	GetInVolumeIDs(Box, Cone, InBitChannels, Out);
+}
+template<typename TElementIdx, uint32 Dim>
+void TSenseSys_LinearTree<TElementIdx, Dim>::GetInConeIDs(const FBox Box, const FSenseSysCone& Cone, FSenseSysQueryIDs& Out, const uint64 InBitChannels) const
+{
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_LinearTree_GetInCone);
+
+	FRWScopeLock SRWLock(RWLock, SLT_ReadOnly);
+
+	GetInVolumeIDs(Box, Cone, InBitChannels, Out);
+}
+template<typename TElementIdx, uint32 Dim>
+void TSenseSys_LinearTree<TElementIdx, Dim>::GetInFrustumIDs(
+	const FBox Box,
+	const FSenseSysFrustum& Frustum,
+	TArray<ElementIndexType>& Out,
+	const uint64 InBitChannels) const
+{
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_LinearTree_GetInFrustum);
+
+	FRWScopeLock SRWLock(RWLock, SLT_ReadOnly);
+
+	GetInVolumeIDs(Box, Frustum, InBitChannels, Out);
+}
+template<typename TElementIdx, uint32 Dim>
+void TSenseSys_LinearTree<TElementIdx, Dim>::GetInFrustumIDs(
+	const FBox Box,
+	const FSenseSysFrustum& Frustum,
+	TSet<ElementIndexType>& Out,
+	const uint64 InBitChannels) const
+{
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_LinearTree_GetInFrustum);
+
+	FRWScopeLock SRWLock(RWLock, SLT_ReadOnly);
+
+	GetInVolumeIDs(Box, Frustum, InBitChannels, Out);
+}
+template<typename TElementIdx, uint32 Dim>
+void TSenseSys_LinearTree<TElementIdx, Dim>::GetInFrustumIDs(
+	const FBox Box,
+	const FSenseSysFrustum& Frustum,
+	FSenseSysQueryIDs& Out,
+	const uint64 InBitChannels) const
+{
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_LinearTree_GetInFrustum);
+
+	FRWScopeLock SRWLock(RWLock, SLT_ReadOnly);
+
+	GetInVolumeIDs(Box, Frustum, InBitChannels, Out);
+}
+
+template<typename TElementIdx, uint32 Dim>
+FBox TSenseSys_LinearTree<TElementIdx, Dim>::GetMaxIntersect(const FBox Box) const
+{
+	FRWScopeLock SRWLock(RWLock, SLT_ReadOnly);
+
+	FBox Out(ForceInit);
+	for (int32 NodeIdx = 0; NodeIdx < Nodes.Num(); ++NodeIdx)
+	{
+		const FLinearNode& Node = Nodes[NodeIdx];
+		if (Node.Skip == NodeIdx + 1 && IntersectBox(Node.Bounds, Box))
+		{
+			Out += LiftBox(Node.Bounds, Box);
+		}
+	}
+	for (const TElementIdx ObjID : Pending)
+	{
+		if (IntersectBox(Elements[ObjID].Box, Box))
+		{
+			Out += LiftBox(Elements[ObjID].Box, Box);
+		}
+	}
+	return Out.IsValid ? Out : FBox(FVector::ZeroVector, FVector::ZeroVector);
+}
+
+template<typename TElementIdx, uint32 Dim>
+void TSenseSys_LinearTree<TElementIdx, Dim>::DrawTree(
+	const class UWorld* World,
+	const FTreeDrawSetup TreeNode,
+	const FTreeDrawSetup Link,
+	const FTreeDrawSetup ElemNode,
+	const float LifeTime) const
+{
+#if ENABLE_DRAW_DEBUG
+	FRWScopeLock SRWLock(RWLock, SLT_ReadOnly);
+
+	for (const FLinearNode& Node : Nodes)
+	{
+		DrawDebugBox(World, Node.Bounds.GetCenter(), Node.Bounds.GetExtent(), TreeNode.Color, false, LifeTime, TreeNode.DrawDepth, TreeNode.Thickness);
+	}
+	for (auto It = ElementPool.CreateConstIterator(); It; ++It)
+	{
+		const FBox& ElemBox = Elements[It.GetIndex()].Box;
+		DrawDebugBox(World, ElemBox.GetCenter(), ElemBox.GetExtent(), ElemNode.Color, false, LifeTime, ElemNode.DrawDepth, ElemNode.Thickness);
+	}
+#endif //ENABLE_DRAW_DEBUG
+}
+
+
+template<typename TElementIdx, uint32 Dim>
+void TSenseSys_TiledTree<TElementIdx, Dim>::QueueTileCollapse(const int32 TileIdx)
+{
+	FTile& Tile = Tiles[TileIdx];
+	if (!Tile.bCollapseListed && Tile.Tree.IsCollapseQueued())
+	{
+		Tile.bCollapseListed = true;
+		CollapseTiles.Add(TileIdx);
+	}
+}
+
+template<typename TElementIdx, uint32 Dim>
+void TSenseSys_TiledTree<TElementIdx, Dim>::RemoveFromTile(const ElementIndexType ObjID)
+{
+	FTiledElement& Elem = Elements[ObjID];
+	FTile& Tile = Tiles[Elem.TileIdx];
+	check(Tile.Tree.GetElement(Elem.LocalID) == ObjID);
+	Tile.Tree.Remove(Elem.LocalID);
+	if (Tile.Tree.NumElements() == 0)
+	{
+		EmptyTiles.Add(Elem.TileIdx);
+	}
+	else
+	{
+		QueueTileCollapse(Elem.TileIdx);
+	}
+	Elem.TileIdx = INDEX_NONE;
+	Elem.LocalID = TNumericLimits<TElementIdx>::Max();
+}
+
+template<typename TElementIdx, uint32 Dim>
+void TSenseSys_TiledTree<TElementIdx, Dim>::Insert_Internal(const ElementIndexType ObjID, const FBox& InBox, const uint64 Channels)
+{
+	if (Elements.Num() <= ObjID)
+	{
+		Elements.SetNum(FMath::Max(ElementPool.GetMaxIndex(), ObjID + 1));
+	}
+	QueryMargin = FMath::Max(QueryMargin, FMath::Max(InBox.GetExtent().X, InBox.GetExtent().Y));
+
+	const FIntPoint Coord = GetTileCoord(InBox.GetCenter());
+	int32 TileIdx = INDEX_NONE;
+	if (const int32* TileIdxPtr = TileMap.Find(Coord))
+	{
+		TileIdx = *TileIdxPtr;
+	}
+	else
+	{
+		TileIdx = Tiles.Emplace(Coord, GetTileOrigin(Coord), static_cast<float>(MinimumQuadSize), NodeCantSplit);
+		TileMap.Add(Coord, TileIdx);
+		++Counters.Splits;
+	}
+	FTile& Tile = Tiles[TileIdx];
+	FTiledElement& Elem = Elements[ObjID];
+	Elem.TileIdx = TileIdx;
+	Elem.LocalID = Tile.Tree.Insert(static_cast<TElementIdx>(ObjID), ToLocal(InBox, Tile.Origin), Channels);
+	QueueTileCollapse(TileIdx);
+}
+
+template<typename TElementIdx, uint32 Dim>
+void TSenseSys_TiledTree<TElementIdx, Dim>::Update_Internal(const ElementIndexType ObjID, const FBox& NewBox)
+{
+	const FTiledElement& Elem = Elements[ObjID];
+	FTile& Tile = Tiles[Elem.TileIdx];
+	if (Tile.Coord == GetTileCoord(NewBox.GetCenter()))
+	{
+		QueryMargin = FMath::Max(QueryMargin, FMath::Max(NewBox.GetExtent().X, NewBox.GetExtent().Y));
+		Tile.Tree.Update(Elem.LocalID, ToLocal(NewBox, Tile.Origin));
+		QueueTileCollapse(Elem.TileIdx);
+		return;
+	}
+	const uint64 Channels = Tile.Tree.GetElementMask(Elem.LocalID);
+	RemoveFromTile(ObjID);
+	Insert_Internal(ObjID, NewBox, Channels);
+	++Counters.Reinserts;
+}
+
+template<typename TElementIdx, uint32 Dim>
+void TSenseSys_TiledTree<TElementIdx, Dim>::SetElementChannels_Internal(const ElementIndexType ID, const uint64 Channels)
+{
+	const FTiledElement& Elem = Elements[ID];
+	Tiles[Elem.TileIdx].Tree.SetElementMask(Elem.LocalID, Channels);
+}
+
+template<typename TElementIdx, uint32 Dim>
+IContainerTree::ElementIndexType TSenseSys_TiledTree<TElementIdx, Dim>::Insert(const FSensedStimulus& ComponentData, const FBox InBox)
+{
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_TiledTree_Insert);
+
+	FWriteScope SRWLock(*this, true);
+
+	if (FitElementCount_Internal(1, MaxElements) == 0)
+	{
+		return MaxIndex();
+	}
+	const ElementIndexType ObjID = ElementPool.Add(ComponentData);
+	Insert_Internal(ObjID, InBox, ComponentData.BitChannels);
+	return MarkPoolDirty_Internal(ObjID);
+}
+template<typename TElementIdx, uint32 Dim>
+IContainerTree::ElementIndexType TSenseSys_TiledTree<TElementIdx, Dim>::Insert(FSensedStimulus&& ComponentData, const FBox InBox)
+{
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_TiledTree_Insert);
+
+	FWriteScope SRWLock(*this, true);
+
+	if (FitElementCount_Internal(1, MaxElements) == 0)
+	{
+		return MaxIndex();
+	}
+	const uint64 Channels = ComponentData.BitChannels;
+	const ElementIndexType ObjID = ElementPool.Add(MoveTemp(ComponentData));
+	Insert_Internal(ObjID, InBox, Channels);
+	return MarkPoolDirty_Internal(ObjID);
+}
+
+template<typename TElementIdx, uint32 Dim>
+void TSenseSys_TiledTree<TElementIdx, Dim>::Update(const ElementIndexType InObjID, const FBox NewBox)
+{
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_TiledTree_Update);
+
+	FWriteScope SRWLock(*this, true);
+
+	if (InObjID != MaxIndex())
+	{
+		Update_Internal(InObjID, NewBox);
+	}
+}
+
+template<typename TElementIdx, uint32 Dim>
+void TSenseSys_TiledTree<TElementIdx, Dim>::UpdateBatch(const TArray<FUpdateItem>& Items)
+{
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_TiledTree_UpdateBatch);
+
+	FWriteScope SRWLock(*this, true);
+
+	for (const FUpdateItem& It : Items)
+	{
+		if (SetUpdateItemPoints_Internal(It))
+		{
+			Update_Internal(It.ObjID, It.Box);
+		}
+	}
+}
+
+template<typename TElementIdx, uint32 Dim>
+void TSenseSys_TiledTree<TElementIdx, Dim>::BulkInsert(TArray<FSensedStimulus>&& ComponentsData, const TArray<FBox>& InBoxes, TArray<ElementIndexType>& OutIDs)
+{
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_TiledTree_BulkInsert);
+
+	check(ComponentsData.Num() == InBoxes.Num());
+
+	FWriteScope SRWLock(*this, true);
+
+	const int32 Count = FitElementCount_Internal(InBoxes.Num(), MaxElements);
+	OutIDs.Init(MaxIndex(), InBoxes.Num());
+	ElementPool.Reserve(ElementPool.Num() + Count);
+	Elements.Reserve(ElementPool.Num() + Count);
+	for (int32 i = 0; i < Count; ++i)
+	{
+		const uint64 Channels = ComponentsData[i].BitChannels;
+		const ElementIndexType ObjID = ElementPool.Add(MoveTemp(ComponentsData[i]));
+		Insert_Internal(ObjID, InBoxes[i], Channels);
+		OutIDs[i] = MarkPoolDirty_Internal(ObjID);
+	}
+	ComponentsData.Reset();
+}
+
+template<typename TElementIdx, uint32 Dim>
+bool TSenseSys_TiledTree<TElementIdx, Dim>::Remove(const ElementIndexType InObjID)
+{
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_TiledTree_Remove);
+
+	FWriteScope SRWLock(*this, true);
+
+	check(InObjID != MaxIndex());
+	RecordRemove_Internal(InObjID);
+	RemoveFromTile(InObjID);
+	ElementPool.RemoveAt(InObjID);
+	return true;
+}
+
+template<typename TElementIdx, uint32 Dim>
+void TSenseSys_TiledTree<TElementIdx, Dim>::Clear()
+{
+	FWriteScope SRWLock(*this);
+
+	ElementPool.Empty();
+	Elements.Empty();
+	Tiles.Empty();
+	TileMap.Empty();
+	EmptyTiles.Empty();
+	CollapseTiles.Empty();
+	QueryMargin = 0.f;
+	ClearTagChannels_Internal();
+	DiscardStagedUpdates();
+}
+
+template<typename TElementIdx, uint32 Dim>
+void TSenseSys_TiledTree<TElementIdx, Dim>::Collapse()
+{
+	FRWScopeLock SRWLock(RWLock, SLT_Write);
+
+	EmptyTiles.Reset();
+	CollapseTiles.Reset();
+	QueryMargin = 0.f;
+	for (auto It = Tiles.CreateIterator(); It; ++It)
+	{
+		FTile& Tile = *It;
+		if (Tile.Tree.NumElements() == 0)
+		{
+			TileMap.Remove(Tile.Coord);
+			It.RemoveCurrent();
+			++Counters.Collapses;
+			continue;
+		}
+		Tile.Tree.CollapseQt();
+		Tile.bCollapseListed = false;
+		QueueTileCollapse(It.GetIndex());
+
+		for (auto ElemIt = Tile.Tree.GetElementPool().CreateConstIterator(); ElemIt; ++ElemIt)
+		{
+			const PointType Extent = Tile.Tree.GetElementBox(static_cast<TElementIdx>(ElemIt.GetIndex())).GetExtent();
+			QueryMargin = FMath::Max<Real>(QueryMargin, FMath::Max(Extent[0], Extent[1]));
+		}
+	}
+}
+
+template<typename TElementIdx, uint32 Dim>
+void TSenseSys_TiledTree<TElementIdx, Dim>::CollapseQueued(const int32 Budget)
+{
+	{
+		FRWScopeLock SRWLock(RWLock, SLT_ReadOnly);
+		if (EmptyTiles.Num() == 0 && CollapseTiles.Num() == 0)
+		{
+			return;
+		}
+	}
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_TiledTree_CollapseQueued);
+
+	FRWScopeLock SRWLock(RWLock, SLT_Write);
+
+	for (int32 i = FMath::Min(Budget, EmptyTiles.Num()); i > 0; --i)
+	{
+		const int32 TileIdx = EmptyTiles.Pop(false);
+		if (Tiles.IsValidIndex(TileIdx) && Tiles[TileIdx].Tree.NumElements() == 0)
+		{
+			TileMap.Remove(Tiles[TileIdx].Coord);
+			Tiles.RemoveAt(TileIdx);
+			++Counters.Collapses;
+		}
+	}
+
+	// the tile trees share the budget, a tile stays listed until its tree has nothing queued
+	int32 NodeBudget = Budget;
+	while (NodeBudget > 0 && CollapseTiles.Num())
+	{
+		const int32 TileIdx = CollapseTiles.Last();
+		if (Tiles.IsValidIndex(TileIdx))
+		{
+			FTile& Tile = Tiles[TileIdx];
+			NodeBudget -= FMath::Max(Tile.Tree.CollapseQueued(NodeBudget), 1);
+			if (Tile.Tree.IsCollapseQueued())
+			{
+				continue;
+			}
+			Tile.bCollapseListed = false;
+		}
+		CollapseTiles.Pop(false);
+	}
+}
+
+template<typename TElementIdx, uint32 Dim>
+void TSenseSys_TiledTree<TElementIdx, Dim>::Compact_Internal(TArray<ElementIndexType>& OutRemap)
+{
+	OutRemap.Init(MaxIndex(), ElementPool.GetMaxIndex());
+
+	// empty tiles are dropped, a tile tree is repacked and its elements get consecutive ObjIDs in its local order
+	TArray<int32> ElementOrder;
+	TArray<FTiledElement> NewElements;
+	TArray<TElementIdx> TileRemap;
+	ElementOrder.Reserve(ElementPool.Num());
+	NewElements.Reserve(ElementPool.Num());
+	for (auto It = Tiles.CreateIterator(); It; ++It)
+	{
+		FTile& Tile = *It;
+		if (Tile.Tree.NumElements() == 0)
+		{
+			TileMap.Remove(Tile.Coord);
+			It.RemoveCurrent();
+			++Counters.Collapses;
+			continue;
+		}
+		Tile.Tree.Compact(TileRemap);
+		TSparseArray<TElementIdx>& ObjIDs = Tile.Tree.GetElementPool();
+		for (int32 LocalID = 0; LocalID < ObjIDs.Num(); ++LocalID)
+		{
+			TElementIdx& ObjID = ObjIDs[LocalID];
+			const int32 NewID = ElementOrder.Add(ObjID);
+			OutRemap[ObjID] = NewID;
+			NewElements.Add(FTiledElement{It.GetIndex(), static_cast<TElementIdx>(LocalID)});
+			ObjID = static_cast<TElementIdx>(NewID);
+		}
+	}
+	checkSlow(ElementOrder.Num() == ElementPool.Num());
+	EmptyTiles.Reset();
+
+	TSparseArray<FSensedStimulus> NewElementPool;
+	NewElementPool.Reserve(ElementOrder.Num());
+	for (const int32 OldID : ElementOrder)
+	{
+		NewElementPool.Add(MoveTemp(ElementPool[OldID]));
+	}
+	ElementPool = MoveTemp(NewElementPool);
+	Elements = MoveTemp(NewElements);
+}
+
+template<typename TElementIdx, uint32 Dim>
+void TSenseSys_TiledTree<TElementIdx, Dim>::GetStats_Internal(FSenseSysTreeStats& OutStats) const
+{
+	OutStats.PoolBytes = Tiles.GetAllocatedSize() + TileMap.GetAllocatedSize() + EmptyTiles.GetAllocatedSize() + CollapseTiles.GetAllocatedSize();
+	OutStats.DataBytes = Elements.GetAllocatedSize();
+	CopyCounters(Counters, OutStats);
+	for (const FTile& Tile : Tiles)
+	{
+		// the tile is depth 0, the root of its tree depth 1
+		Tile.Tree.ForEachNode(
+			[&OutStats](const typename TileTreeType::TreeNodeType& Node, const int32 Depth)
+			{
+				++OutStats.NumNodes;
+				if (Node.IsLeaf())
+				{
+					OutStats.AddLeaf(Node.Nodes.Num(), Depth + 1);
+				}
+			});
+		OutStats.PoolBytes += Tile.Tree.GetPoolAllocatedSize();
+		OutStats.DataBytes += Tile.Tree.GetDataAllocatedSize() + Tile.Tree.GetElementPoolAllocatedSize();
+		const FTreeCounters& TileCounters = Tile.Tree.GetCounters();
+		OutStats.Splits += TileCounters.Splits;
+		OutStats.Collapses += TileCounters.Collapses;
+		OutStats.Reinserts += TileCounters.Reinserts;
+	}
+}
+
+template<typename TElementIdx, uint32 Dim>
+void TSenseSys_TiledTree<TElementIdx, Dim>::ResetStats_Internal()
+{
+	Counters.Reset();
+	for (FTile& Tile : Tiles)
+	{
+		Tile.Tree.ResetCounters();
+	}
+}
+
+template<typename TElementIdx, uint32 Dim>
+bool TSenseSys_TiledTree<TElementIdx, Dim>::ShiftOrigin_Internal(const FVector& Offset)
+{
+	// the local boxes stay, the tile coordinates follow the shifted grid
+	GridShift += Offset;
+	for (FTile& Tile : Tiles)
+	{
+		Tile.Origin += Offset;
+	}
+	return true;
+}
+
+
+template<typename TElementIdx, uint32 Dim>
+template<typename TileLambdaType>
+void TSenseSys_TiledTree<TElementIdx, Dim>::ForEachQueryTile(const FBox& Box, TileLambdaType TileLambda) const
+{
+	const FVector2D MinReal = GetTileCoordReal(Box.Min - FVector(QueryMargin, QueryMargin, 0.f));
+	const FVector2D MaxReal = GetTileCoordReal(Box.Max + FVector(QueryMargin, QueryMargin, 0.f));
+	const FIntPoint MinCoord(static_cast<int32>(MinReal.X), static_cast<int32>(MinReal.Y));
+	const FIntPoint MaxCoord(static_cast<int32>(MaxReal.X), static_cast<int32>(MaxReal.Y));
+	// in floating point, an unbounded box or a tiny tile size has more tiles than int64 holds
+	const Real RangeNum = (MaxReal.X - MinReal.X + 1) * (MaxReal.Y - MinReal.Y + 1);
+
+	// a query wider than the occupied area walks the tiles instead of the coordinates
+	if (RangeNum > Tiles.Num())
+	{
+		for (const FTile& Tile : Tiles)
+		{
+			if (Tile.Coord.X >= MinCoord.X && Tile.Coord.X <= MaxCoord.X && Tile.Coord.Y >= MinCoord.Y && Tile.Coord.Y <= MaxCoord.Y && Tile.Tree.NumElements())
+			{
+				TileLambda(Tile);
+			}
+		}
+	}
+	else
+	{
+		for (int32 Y = MinCoord.Y; Y <= MaxCoord.Y; ++Y)
+		{
+			for (int32 X = MinCoord.X; X <= MaxCoord.X; ++X)
+			{
+				const int32* TileIdx = TileMap.Find(FIntPoint(X, Y));
+				if (TileIdx && Tiles[*TileIdx].Tree.NumElements())
+				{
+					TileLambda(Tiles[*TileIdx]);
+				}
+			}
+		}
+	}
+}
+
+template<typename TElementIdx, uint32 Dim>
+template<typename ContainerType>
+void TSenseSys_TiledTree<TElementIdx, Dim>::GetElementsIDs(const FBox& Box, const FVector& Center, const Real Radius, const uint64 InBitChannels, ContainerType& Out) const
+{
+	int32 VisitedNodes = 0;
+	int32 VisitedElements = 0;
+	ForEachQueryTile(
+		Box,
+		[&](const FTile& Tile)
+		{
+			const FElementQuery Query = Radius < 0.f //
+				? FElementQuery(ToLocal(Box, Tile.Origin), InBitChannels)
+				: FElementQuery(ToLocal(Box, Tile.Origin), ToLocal(Center, Tile.Origin), static_cast<float>(Radius), InBitChannels);
+			TTileOut<ContainerType> TileOut(Tile.Tree.GetElementPool(), Out);
+			Tile.Tree.GetElementsIDs(Query, TileOut);
+			VisitedNodes += Query.VisitedNodes;
+			VisitedElements += Query.VisitedElements;
+		});
+	Counters.AddQuery(VisitedNodes, VisitedElements);
+}
+
+template<typename TElementIdx, uint32 Dim>
+template<typename VolumeType, typename ContainerType>
+void TSenseSys_TiledTree<TElementIdx, Dim>::GetInVolumeIDs(const FBox& Box, const VolumeType& Volume, const uint64 InBitChannels, ContainerType& Out) const
+{
+	int32 VisitedNodes = 0;
+	int32 VisitedElements = 0;
+	ForEachQueryTile(
+		Box,
+		[&](const FTile& Tile)
+		{
+			const FVector& Origin = Tile.Origin;
+			const auto NodeTest = [&Volume, &Origin, &Box](const TileBoxType& NodeBox) { return Volume.IntersectBox(ToWorld(NodeBox, Origin, Box)); };
+			const auto ElemTest = [&Volume, &Origin, &Box](const auto& Bounds) { return Volume.IntersectBox(ToWorld(Bounds, Origin, Box)); };
+			const FElementQuery Query(ToLocal(Box, Origin), InBitChannels);
+			TTileOut<ContainerType> TileOut(Tile.Tree.GetElementPool(), Out);
+			Tile.Tree.GetElementsIDsInVolume(Query, NodeTest, ElemTest, TileOut);
+			VisitedNodes += Query.VisitedNodes;
+			VisitedElements += Query.VisitedElements;
+		});
+	Counters.AddQuery(VisitedNodes, VisitedElements);
+}
+
+template<typename TElementIdx, uint32 Dim>
+void TSenseSys_TiledTree<TElementIdx, Dim>::GetInBoxIDs(const FBox Box, TArray<ElementIndexType>& Out, const uint64 InBitChannels) const
+{
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_TiledTree_GetInBox);
+
+	FRWScopeLock SRWLock(RWLock, SLT_ReadOnly);
+
+	GetElementsIDs(Box, FVector::ZeroVector, -1.f, InBitChannels, Out);
+}
+template<typename TElementIdx, uint32 Dim>
+void TSenseSys_TiledTree<TElementIdx, Dim>::GetInRadiusIDs(const Real Radius, const FVector Center, TArray<ElementIndexType>& Out, const uint64 InBitChannels) const
+{
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_TiledTree_GetInRadius);
+
+	FRWScopeLock SRWLock(RWLock, SLT_ReadOnly);
+
+	GetElementsIDs(FBox::BuildAABB(Center, FVector(Radius)), Center, Radius, InBitChannels, Out);
+}
+template<typename TElementIdx, uint32 Dim>
+void TSenseSys_TiledTree<TElementIdx, Dim>::GetInBoxRadiusIDs(
+	const FBox Box,
+	const FVector Center,
+	const Real Radius,
+	TArray<ElementIndexType>& Out,
+	const uint64 InBitChannels) const
+{
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_TiledTree_GetInBoxRadius);
+
+	FRWScopeLock SRWLock(RWLock, SLT_ReadOnly);
+
+	GetElementsIDs(Box, Center, Radius, InBitChannels, Out);
+}
+
+template<typename TElementIdx, uint32 Dim>
+void TSenseSys_TiledTree<TElementIdx, Dim>::GetInBoxIDs(const FBox Box, TSet<ElementIndexType>& Out, const uint64 InBitChannels) const
+{
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_TiledTree_GetInBox);
+
+	FRWScopeLock SRWLock(RWLock, SLT_ReadOnly);
+
+	GetElementsIDs(Box, FVector::ZeroVector, -1.f, InBitChannels, Out);
+}
+template<typename TElementIdx, uint32 Dim>
+void TSenseSys_TiledTree<TElementIdx, Dim>::GetInRadiusIDs(const Real Radius, const FVector Center, TSet<ElementIndexType>& Out, const uint64 InBitChannels) const
+{
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_TiledTree_GetInRadius);
+
+	FRWScopeLock SRWLock(RWLock, SLT_ReadOnly);
+
+	GetElementsIDs(FBox::BuildAABB(Center, FVector(Radius)), Center, Radius, InBitChannels, Out);
+}
+template<typename TElementIdx, uint32 Dim>
+void TSenseSys_TiledTree<TElementIdx, Dim>::GetInBoxRadiusIDs(const FBox Box, const FVector Center, const Real Radius, TSet<ElementIndexType>& Out, const uint64 InBitChannels) const
+{
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_TiledTree_GetInBoxRadius);
+
+	FRWScopeLock SRWLock(RWLock, SLT_ReadOnly);
+
+	GetElementsIDs(Box, Center, Radius, InBitChannels, Out);
+}
+template<typename TElementIdx, uint32 Dim>
+void TSenseSys_TiledTree<TElementIdx, Dim>::GetInBoxIDs(const FBox Box, FSenseSysQueryIDs& Out, const uint64 InBitChannels) const
+{
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_TiledTree_GetInBox);
+
+	FRWScopeLock SRWLock(RWLock, SLT_ReadOnly);
+
+	GetElementsIDs(Box, FVector::ZeroVector, -1.f, InBitChannels, Out);
+}
+template<typename TElementIdx, uint32 Dim>
+void TSenseSys_TiledTree<TElementIdx, Dim>::GetInRadiusIDs(const Real Radius, const FVector Center, FSenseSysQueryIDs& Out, const uint64 InBitChannels) const
+{
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_TiledTree_GetInRadius);
+
+	FRWScopeLock SRWLock(RWLock, SLT_ReadOnly);
+
+	GetElementsIDs(FBox::BuildAABB(Center, FVector(Radius)), Center, Radius, InBitChannels, Out);
+}
+template<typename TElementIdx, uint32 Dim>
+void TSenseSys_TiledTree<TElementIdx, Dim>::GetInBoxRadiusIDs(const FBox Box, const FVector Center, const Real Radius, FSenseSysQueryIDs& Out, const uint64 InBitChannels) const
+{
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_TiledTree_GetInBoxRadius);
+
+	FRWScopeLock SRWLock(RWLock, SLT_ReadOnly);
+
+	GetElementsIDs(Box, Center, Radius, InBitChannels, Out);
+}
+
+template<typename TElementIdx, uint32 Dim>
+void TSenseSys_TiledTree<TElementIdx, Dim>::GetInBoxRadiusIDsBatch(const TArray<FBatchQuery>& Queries, TArray<TArray<ElementIndexType>>& Out) const
+{
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_TiledTree_GetInBoxRadiusBatch);
+
+	FRWScopeLock SRWLock(RWLock, SLT_ReadOnly);
+
+	Out.SetNum(Queries.Num());
+	TArray<FIntPoint, TInlineAllocator<32>> MinCoords;
+	TArray<FIntPoint, TInlineAllocator<32>> MaxCoords;
+	TArray<int32, TInlineAllocator<32>> VisitedNodes;
+	TArray<int32, TInlineAllocator<32>> VisitedElements;
+	MinCoords.Reserve(Queries.Num());
+	MaxCoords.Reserve(Queries.Num());
+	VisitedNodes.SetNumZeroed(Queries.Num());
+	VisitedElements.SetNumZeroed(Queries.Num());
+	const FVector Margin(QueryMargin, QueryMargin, 0.f);
+	for (const FBatchQuery& It : Queries)
+	{
+		MinCoords.Add(GetTileCoord(It.Box.Min - Margin));
+		MaxCoords.Add(GetTileCoord(It.Box.Max + Margin));
+	}
+
+	// one walk of a tile tree for all queries that reach the tile
+	TArray<FElementQuery, TInlineAllocator<32>> TileQueries;
+	TArray<int32, TInlineAllocator<32>> TileQueryIdx;
+	TArray<TArray<TElementIdx>> TileOut;
+	for (const FTile& Tile : Tiles)
+	{
+		if (Tile.Tree.NumElements() == 0)
+		{
+			continue;
+		}
+		TileQueries.Reset();
+		TileQueryIdx.Reset();
+		for (int32 i = 0; i < Queries.Num(); ++i)
+		{
+			if (Tile.Coord.X >= MinCoords[i].X && Tile.Coord.X <= MaxCoords[i].X && Tile.Coord.Y >= MinCoords[i].Y && Tile.Coord.Y <= MaxCoords[i].Y)
+			{
+				const FBatchQuery& It = Queries[i];
+				TileQueries.Add(
+					It.Radius == 0.f //
+						? FElementQuery(ToLocal(It.Box, Tile.Origin), It.BitChannels)
+						: FElementQuery(ToLocal(It.Box, Tile.Origin), ToLocal(It.Center, Tile.Origin), static_cast<float>(It.Radius), It.BitChannels));
+				TileQueryIdx.Add(i);
+			}
+		}
+		if (TileQueries.Num() == 0)
+		{
+			continue;
+		}
+
+		Tile.Tree.GetElementsIDsBatch(TileQueries.GetData(), TileQueries.Num(), TileOut);
+		const TSparseArray<TElementIdx>& ObjIDs = Tile.Tree.GetElementPool();
+		for (int32 k = 0; k < TileQueries.Num(); ++k)
+		{
+			const int32 QueryIdx = TileQueryIdx[k];
+			TArray<ElementIndexType>& QueryOut = Out[QueryIdx];
+			QueryOut.Reserve(QueryOut.Num() + TileOut[k].Num());
+			for (const TElementIdx LocalID : TileOut[k])
+			{
+				QueryOut.Add(ObjIDs[LocalID]);
+			}
+			TileOut[k].Reset();
+			VisitedNodes[QueryIdx] += TileQueries[k].VisitedNodes;
+			VisitedElements[QueryIdx] += TileQueries[k].VisitedElements;
+		}
+	}
+	for (int32 i = 0; i < Queries.Num(); ++i)
+	{
+		Counters.AddQuery(VisitedNodes[i], VisitedElements[i]);
+	}
+}
+
+template<typename TElementIdx, uint32 Dim>
+void TSenseSys_TiledTree<TElementIdx, Dim>::GetKNearestIDs(
+	const FVector Center,
+	const int32 K,
+	const Real MaxRadius,
+	TArray<ElementIndexType>& Out,
+	const uint64 InBitChannels) const
+{
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_TiledTree_GetKNearest);
+
+	Out.Reset();
+	if (K <= 0)
+	{
+		return;
+	}
+
+	struct FTileDist
+	{
+		Real DistSquared;
+		int32 TileIdx;
+	};
+	struct FElemDist
+	{
+		Real DistSquared;
+		ElementIndexType ObjID;
+		// max heap, the worst kept element on top
+		FORCEINLINE bool operator<(const FElemDist& Other) const { return DistSquared > Other.DistSquared; }
+	};
+	TArray<FTileDist, TInlineAllocator<16>> TileOrder;
+	TArray<FElemDist, TInlineAllocator<16>> Best;
+	TArray<TElementIdx, TInlineAllocator<16>> LocalIDs;
+	Best.Reserve(K + 1);
+	const Real MaxDistSquared = FMath::Square(MaxRadius);
+	// Dim 2 boxes get the Z of Center, the distance is measured on XY as in the QuadTree
+	const FBox CenterBox(Center, Center);
+
+	FRWScopeLock SRWLock(RWLock, SLT_ReadOnly);
+
+	// tiles by the distance to their root box, a strict tile tree root holds all of its elements
+	for (auto It = Tiles.CreateConstIterator(); It; ++It)
+	{
+		const FTile& Tile = *It;
+		if (Tile.Tree.NumElements() && Tile.Tree.IsValidRoot())
+		{
+			const Real DistSquared = ToWorld(Tile.Tree.GetRootBox(), Tile.Origin, CenterBox).ComputeSquaredDistanceToPoint(Center);
+			if (DistSquared <= MaxDistSquared)
+			{
+				TileOrder.Add(FTileDist{DistSquared, It.GetIndex()});
+			}
+		}
+	}
+	TileOrder.Sort([](const FTileDist& A, const FTileDist& B) { return A.DistSquared < B.DistSquared; });
+
+	// the tile trees pick their K nearest in float, the candidates are ranked again in world space
+	int32 VisitedTiles = 0;
+	int32 VisitedElements = 0;
+	for (const FTileDist& It : TileOrder)
+	{
+		if (Best.Num() == K && It.DistSquared > Best.HeapTop().DistSquared)
+		{
+			break;
+		}
+		const FTile& Tile = Tiles[It.TileIdx];
+		++VisitedTiles;
+		Tile.Tree.GetKNearestIDs(ToLocal(Center, Tile.Origin), K, static_cast<float>(MaxRadius), InBitChannels, LocalIDs);
+		VisitedElements += LocalIDs.Num();
+		for (const TElementIdx LocalID : LocalIDs)
+		{
+			const Real DistSquared = ToWorld(Tile.Tree.GetElementBox(LocalID), Tile.Origin, CenterBox).ComputeSquaredDistanceToPoint(Center);
+			if (DistSquared <= MaxDistSquared && (Best.Num() < K || DistSquared < Best.HeapTop().DistSquared))
+			{
+				if (Best.Num() == K)
+				{
+					Best.HeapPopDiscard(false);
+				}
+				Best.HeapPush(FElemDist{DistSquared, Tile.Tree.GetElement(LocalID)});
+			}
+		}
+	}
+
+	Counters.AddQuery(VisitedTiles, VisitedElements);
+
+	Best.Sort([](const FElemDist& A, const FElemDist& B) { return A.DistSquared < B.DistSquared; });
+	Out.Reserve(Best.Num());
+	for (const FElemDist& It : Best)
+	{
+		Out.Add(It.ObjID);
+	}
+}
+
+template<typename TElementIdx, uint32 Dim>
+void TSenseSys_TiledTree<TElementIdx, Dim>::GetAlongSegmentIDs(
+	const FVector Start,
+	const FVector End,
+	const Real Radius,
+	TArray<ElementIndexType>& Out,
+	const uint64 InBitChannels) const
+{
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_TiledTree_GetAlongSegment);
+
+	const FSenseSysSegment Segment(Start, End, Radius);
+	const FBox Bounds = Segment.GetBounds();
+	FSegmentHits Hits;
+	Out.Reset();
+
+	FRWScopeLock SRWLock(RWLock, SLT_ReadOnly);
+
+	GetInVolumeIDs(Bounds, Segment, InBitChannels, Out);
+	for (const ElementIndexType ObjID : Out)
+	{
+		const FTiledElement& Elem = Elements[ObjID];
+		const FTile& Tile = Tiles[Elem.TileIdx];
+		const FBox Box = ToWorld(Tile.Tree.GetElementBox(Elem.LocalID), Tile.Origin, Bounds);
+		Real Entry;
+		if (Segment.ClipBox(Box.Min, Box.Max, 3, Entry))
+		{
+			Hits.Add(FSegmentHit{Entry, ObjID});
+		}
+	}
+	SortSegmentHits(Hits, Out);
+}
+
+template<typename TElementIdx, uint32 Dim>
+void TSenseSys_TiledTree<TElementIdx, Dim>::GetInConeIDs(const FBox Box, const FSenseSysCone& Cone, TArray<ElementIndexType>& Out, const uint64 InBitChannels) const
+{
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_TiledTree_GetInCone);
+
+	FRWScopeLock SRWLock(RWLock, SLT_ReadOnly);
+
+	GetInVolumeIDs(Box, Cone, InBitChannels, Out);
+}
+template<typename TElementIdx, uint32 Dim>
+void TSenseSys_TiledTree<TElementIdx, Dim>::GetInConeIDs(const FBox Box, const FSenseSysCone& Cone, TSet<ElementIndexType>& Out, const uint64 InBitChannels) const
+{
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_TiledTree_GetInCone);
+
+	FRWScopeLock SRWLock(RWLock, SLT_ReadOnly);
+
+	GetInVolumeIDs(Box, Cone, InBitChannels, Out);
+}
+template<typename TElementIdx, uint32 Dim>
+void TSenseSys_TiledTree<TElementIdx, Dim>::GetInConeIDs(const FBox Box, const FSenseSysCone& Cone, FSenseSysQueryIDs& Out, const uint64 InBitChannels) const
+{
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_TiledTree_GetInCone);
+
+	FRWScopeLock SRWLock(RWLock, SLT_ReadOnly);
+
+	GetInVolumeIDs(Box, Cone, InBitChannels, Out);
+}
+template<typename TElementIdx, uint32 Dim>
+void TSenseSys_TiledTree<TElementIdx, Dim>::GetInFrustumIDs(const FBox Box, const FSenseSysFrustum& Frustum, TArray<ElementIndexType>& Out, const uint64 InBitChannels) const
+{
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_TiledTree_GetInFrustum);
+
+	FRWScopeLock SRWLock(RWLock, SLT_ReadOnly);
+
+	GetInVolumeIDs(Box, Frustum, InBitChannels, Out);
+}
+template<typename TElementIdx, uint32 Dim>
+void TSenseSys_TiledTree<TElementIdx, Dim>::GetInFrustumIDs(const FBox Box, const FSenseSysFrustum& Frustum, TSet<ElementIndexType>& Out, const uint64 InBitChannels) const
+{
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_TiledTree_GetInFrustum);
+
+	FRWScopeLock SRWLock(RWLock, SLT_ReadOnly);
+
+	GetInVolumeIDs(Box, Frustum, InBitChannels, Out);
+}
+template<typename TElementIdx, uint32 Dim>
+void TSenseSys_TiledTree<TElementIdx, Dim>::GetInFrustumIDs(const FBox Box, const FSenseSysFrustum& Frustum, FSenseSysQueryIDs& Out, const uint64 InBitChannels) const
+{
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_TiledTree_GetInFrustum);
+
+	FRWScopeLock SRWLock(RWLock, SLT_ReadOnly);
+
+	GetInVolumeIDs(Box, Frustum, InBitChannels, Out);
+}
+
+template<typename TElementIdx, uint32 Dim>
+FBox TSenseSys_TiledTree<TElementIdx, Dim>::GetMaxIntersect(const FBox Box) const
+{
+	FRWScopeLock SRWLock(RWLock, SLT_ReadOnly);
+
+	FBox Out(ForceInit);
+	ForEachQueryTile(
+		Box,
+		[&](const FTile& Tile)
+		{
+			const int32 MaxIntersect = Tile.Tree.GetMaxIntersect(ToLocal(Box, Tile.Origin));
+			if (Tile.Tree.IsValidTreeIdx(MaxIntersect))
+			{
+				Out += ToWorld(Tile.Tree.GetTreeBox(MaxIntersect), Tile.Origin, Box);
+			}
+		});
+	return Out.IsValid ? Out : FBox(FVector::ZeroVector, FVector::ZeroVector);
+}
+
+template<typename TElementIdx, uint32 Dim>
+void TSenseSys_TiledTree<TElementIdx, Dim>::DrawTree(const class UWorld* World, const FTreeDrawSetup TreeNode, const FTreeDrawSetup Link, const FTreeDrawSetup ElemNode, const float LifeTime) const
+{
+#if ENABLE_DRAW_DEBUG
+	FRWScopeLock SRWLock(RWLock, SLT_ReadOnly);
+
+	for (const FTile& Tile : Tiles)
+	{
+		if (Tile.Tree.NumElements() == 0)
+		{
+			continue;
+		}
+		const FBox OriginBox(Tile.Origin, Tile.Origin);
+		FBox ElemBounds(ForceInit);
+		for (auto It = Tile.Tree.GetElementPool().CreateConstIterator(); It; ++It)
+		{
+			const FBox ElemBox = ToWorld(Tile.Tree.GetElementBox(static_cast<TElementIdx>(It.GetIndex())), Tile.Origin, OriginBox);
+			ElemBounds += ElemBox;
+			DrawDebugBox(World, ElemBox.GetCenter(), ElemBox.GetExtent(), ElemNode.Color, false, LifeTime, ElemNode.DrawDepth, ElemNode.Thickness);
+		}
+		Tile.Tree.ForEachNode(
+			[&](const typename TileTreeType::TreeNodeType& Node, const int32 Depth)
+			{
+				const FBox NodeBox = ToWorld(Node.GetTreeBox(), Tile.Origin, ElemBounds);
+				DrawDebugBox(World, NodeBox.GetCenter(), NodeBox.GetExtent(), TreeNode.Color, false, LifeTime, TreeNode.DrawDepth, TreeNode.Thickness);
+			});
+	}
+#endif //ENABLE_DRAW_DEBUG
+}
+
+
+template<typename TElementIdx, uint32 Dim>
+void TSenseSys_SplitTree<TElementIdx, Dim>::InsertDynamic(const ElementIndexType ObjID)
+{
+	FSplitElement& Elem = Elements[ObjID];
+	Elem.LocalID = Tree.Insert(static_cast<TElementIdx>(ObjID), ToTreeBox(Elem.Box), Elem.Mask);
+}
+
+template<typename TElementIdx, uint32 Dim>
+void TSenseSys_SplitTree<TElementIdx, Dim>::RemoveStatic(const ElementIndexType ObjID)
+{
+	FSplitElement& Elem = Elements[ObjID];
+	if (Elem.bStaticPending)
+	{
+		check(StaticPending[Elem.StaticSlot] == ObjID);
+		StaticPending.RemoveAtSwap(Elem.StaticSlot, 1, false);
+		if (StaticPending.IsValidIndex(Elem.StaticSlot))
+		{
+			Elements[StaticPending[Elem.StaticSlot]].StaticSlot = Elem.StaticSlot;
+		}
+	}
+	else
+	{
+		check(StaticIDs[Elem.StaticSlot] == ObjID);
+		StaticMasks[Elem.StaticSlot] = 0;
+		++StaticDeadCount;
+	}
+	Elem.StaticSlot = INDEX_NONE;
+	Elem.bStaticPending = false;
+}
+
+template<typename TElementIdx, uint32 Dim>
+void TSenseSys_SplitTree<TElementIdx, Dim>::Insert_Internal(const ElementIndexType ObjID, const FBox& InBox, const uint64 Channels, const bool bStatic)
+{
+	if (Elements.Num() <= ObjID)
+	{
+		Elements.SetNum(FMath::Max(ElementPool.GetMaxIndex(), ObjID + 1));
+	}
+	FSplitElement& Elem = Elements[ObjID];
+	Elem = FSplitElement();
+	Elem.Box = InBox;
+	Elem.Mask = Channels;
+	if (bStatic)
+	{
+		Elem.bStaticPending = true;
+		Elem.StaticSlot = StaticPending.Add(static_cast<TElementIdx>(ObjID));
+	}
+	else
+	{
+		InsertDynamic(ObjID);
+	}
+}
+
+template<typename TElementIdx, uint32 Dim>
+void TSenseSys_SplitTree<TElementIdx, Dim>::Update_Internal(const ElementIndexType ObjID, const FBox& NewBox)
+{
+	FSplitElement& Elem = Elements[ObjID];
+	if (Elem.IsDynamic())
+	{
+		Elem.Box = NewBox;
+		Tree.Update(Elem.LocalID, ToTreeBox(NewBox));
+	}
+	else if (!(Elem.Box == NewBox))
+	{
+		// a static stimulus that moved is treated as movable from now on
+		RemoveStatic(ObjID);
+		Elem.Box = NewBox;
+		InsertDynamic(ObjID);
+		++Counters.Reinserts;
+	}
+}
+
+template<typename TElementIdx, uint32 Dim>
+void TSenseSys_SplitTree<TElementIdx, Dim>::SetElementChannels_Internal(const ElementIndexType ID, const uint64 Channels)
+{
+	FSplitElement& Elem = Elements[ID];
+	Elem.Mask = Channels;
+	if (Elem.IsDynamic())
+	{
+		Tree.SetElementMask(Elem.LocalID, Channels);
+	}
+	else if (!Elem.bStaticPending)
+	{
+		// the ranges of the slot ancestors cover the slot, the node masks only grow until the next rebuild
+		StaticMasks[Elem.StaticSlot] = Channels;
+		int32 NodeIdx = 0;
+		while (NodeIdx < StaticNodes.Num())
+		{
+			FStaticNode& Node = StaticNodes[NodeIdx];
+			if (Elem.StaticSlot >= Node.Begin && Elem.StaticSlot < Node.End)
+			{
+				Node.ChannelMask |= Channels;
+				++NodeIdx;
+			}
+			else
+			{
+				NodeIdx = Node.Skip;
+			}
+		}
+	}
+}
+
+template<typename TElementIdx, uint32 Dim>
+void TSenseSys_SplitTree<TElementIdx, Dim>::RebuildStatic_Internal()
+{
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_SplitTree_RebuildStatic);
+
+	++Counters.Collapses;
+
+	struct FStaticItem
+	{
+		FVector Center;
+		TElementIdx ObjID;
+	};
+	TArray<FStaticItem> Items;
+	Items.Reserve(NumStatic());
+	for (auto It = ElementPool.CreateConstIterator(); It; ++It)
+	{
+		const FSplitElement& Elem = Elements[It.GetIndex()];
+		if (Elem.StaticSlot != INDEX_NONE)
+		{
+			Items.Add(FStaticItem{Elem.Box.GetCenter(), static_cast<TElementIdx>(It.GetIndex())});
+		}
+	}
+
+	StaticNodes.Reset();
+	StaticPending.Reset();
+	StaticDeadCount = 0;
+	StaticIDs.SetNumUninitialized(Items.Num());
+	StaticBoxes.SetNumUninitialized(Items.Num());
+	StaticMasks.SetNumUninitialized(Items.Num());
+	if (Items.Num() > 0)
+	{
+		StaticNodes.Reserve(2 * Items.Num() / NodeCantSplit + 1);
+		BuildStaticNode(Items, 0, Items.Num());
+	}
+}
+
+template<typename TElementIdx, uint32 Dim>
+template<typename ItemType>
+int32 TSenseSys_SplitTree<TElementIdx, Dim>::BuildStaticNode(TArray<ItemType>& Items, const int32 Begin, const int32 End)
+{
+	const int32 NodeIdx = StaticNodes.AddDefaulted();
+
+	FBox Bounds(ForceInit);
+	uint64 Mask = 0;
+	if (End - Begin > NodeCantSplit)
+	{
+		FBox CenterBounds(ForceInit);
+		for (int32 i = Begin; i < End; ++i)
+		{
+			CenterBounds += Items[i].Center;
+		}
+		const FVector Size = CenterBounds.GetSize();
+		int32 Axis = 0;
+		for (int32 j = 1; j < static_cast<int32>(Dim); ++j)
+		{
+			Axis = Size[j] > Size[Axis] ? j : Axis;
+		}
+		// the parent range is sorted before its children, a leaf range is final when it is written
+		Sort(Items.GetData() + Begin, End - Begin, [Axis](const ItemType& A, const ItemType& B) { return A.Center[Axis] < B.Center[Axis]; });
+
+		const int32 Mid = Begin + (End - Begin) / 2;
+		const int32 Left = BuildStaticNode(Items, Begin, Mid);
+		const int32 Right = BuildStaticNode(Items, Mid, End);
+		Bounds = StaticNodes[Left].Bounds + StaticNodes[Right].Bounds;
+		Mask = StaticNodes[Left].ChannelMask | StaticNodes[Right].ChannelMask;
+	}
+	else
+	{
+		for (int32 i = Begin; i < End; ++i)
+		{
+			FSplitElement& Elem = Elements[Items[i].ObjID];
+			Elem.StaticSlot = i;
+			Elem.bStaticPending = false;
+			StaticIDs[i] = Items[i].ObjID;
+			StaticBoxes[i] = Elem.Box;
+			StaticMasks[i] = Elem.Mask;
+			Bounds += Elem.Box;
+			Mask |= Elem.Mask;
+		}
+	}
+
+	FStaticNode& Node = StaticNodes[NodeIdx];
+	Node.Bounds = Bounds;
+	Node.ChannelMask = Mask;
+	Node.Begin = Begin;
+	Node.End = End;
+	Node.Skip = StaticNodes.Num();
+	return NodeIdx;
+}
+
+template<typename TElementIdx, uint32 Dim>
+IContainerTree::ElementIndexType TSenseSys_SplitTree<TElementIdx, Dim>::Insert(const FSensedStimulus& ComponentData, const FBox InBox)
+{
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_SplitTree_Insert);
+
+	FWriteScope SRWLock(*this, true);
+
+	if (FitElementCount_Internal(1, MaxElements) == 0)
+	{
+		return MaxIndex();
+	}
+	const ElementIndexType ObjID = ElementPool.Add(ComponentData);
+	Insert_Internal(ObjID, InBox, ComponentData.BitChannels, ComponentData.bStaticMobility);
+	return MarkPoolDirty_Internal(ObjID);
+}
+template<typename TElementIdx, uint32 Dim>
+IContainerTree::ElementIndexType TSenseSys_SplitTree<TElementIdx, Dim>::Insert(FSensedStimulus&& ComponentData, const FBox InBox)
+{
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_SplitTree_Insert);
+
+	FWriteScope SRWLock(*this, true);
+
+	if (FitElementCount_Internal(1, MaxElements) == 0)
+	{
+		return MaxIndex();
+	}
+	const uint64 Channels = ComponentData.BitChannels;
+	const bool bStatic = ComponentData.bStaticMobility;
+	const ElementIndexType ObjID = ElementPool.Add(MoveTemp(ComponentData));
+	Insert_Internal(ObjID, InBox, Channels, bStatic);
+	return MarkPoolDirty_Internal(ObjID);
+}
+
+template<typename TElementIdx, uint32 Dim>
+void TSenseSys_SplitTree<TElementIdx, Dim>::Update(const ElementIndexType InObjID, const FBox NewBox)
+{
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_SplitTree_Update);
+
+	FWriteScope SRWLock(*this, true);
+
+	if (InObjID != MaxIndex())
+	{
+		Update_Internal(InObjID, NewBox);
+	}
+}
+
+template<typename TElementIdx, uint32 Dim>
+void TSenseSys_SplitTree<TElementIdx, Dim>::UpdateBatch(const TArray<FUpdateItem>& Items)
+{
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_SplitTree_UpdateBatch);
+
+	FWriteScope SRWLock(*this, true);
+
+	for (const FUpdateItem& It : Items)
+	{
+		if (SetUpdateItemPoints_Internal(It))
+		{
+			Update_Internal(It.ObjID, It.Box);
+		}
+	}
+}
+
+template<typename TElementIdx, uint32 Dim>
+void TSenseSys_SplitTree<TElementIdx, Dim>::BulkInsert(TArray<FSensedStimulus>&& ComponentsData, const TArray<FBox>& InBoxes, TArray<ElementIndexType>& OutIDs)
+{
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_SplitTree_BulkInsert);
+
+	check(ComponentsData.Num() == InBoxes.Num());
+
+	FWriteScope SRWLock(*this, true);
+
+	const int32 Count = FitElementCount_Internal(InBoxes.Num(), MaxElements);
+	OutIDs.Init(MaxIndex(), InBoxes.Num());
+	ElementPool.Reserve(ElementPool.Num() + Count);
+	Elements.Reserve(ElementPool.Num() + Count);
+	const int32 PendingNum = StaticPending.Num();
+	for (int32 i = 0; i < Count; ++i)
+	{
+		const uint64 Channels = ComponentsData[i].BitChannels;
+		const bool bStatic = ComponentsData[i].bStaticMobility;
+		const ElementIndexType ObjID = ElementPool.Add(MoveTemp(ComponentsData[i]));
+		Insert_Internal(ObjID, InBoxes[i], Channels, bStatic);
+		OutIDs[i] = MarkPoolDirty_Internal(ObjID);
+	}
+	ComponentsData.Reset();
+
+	// a registration batch is the point where the static part is packed again
+	if (StaticPending.Num() > PendingNum)
+	{
+		RebuildStatic_Internal();
+	}
+}
+
+template<typename TElementIdx, uint32 Dim>
+bool TSenseSys_SplitTree<TElementIdx, Dim>::Remove(const ElementIndexType InObjID)
+{
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_SplitTree_Remove);
+
+	FWriteScope SRWLock(*this, true);
+
+	check(InObjID != MaxIndex());
+	RecordRemove_Internal(InObjID);
+	FSplitElement& Elem = Elements[InObjID];
+	if (Elem.IsDynamic())
+	{
+		check(Tree.GetElement(Elem.LocalID) == InObjID);
+		Tree.Remove(Elem.LocalID);
+	}
+	else
+	{
+		RemoveStatic(InObjID);
+	}
+	Elem = FSplitElement();
+	ElementPool.RemoveAt(InObjID);
+	return true;
+}
+
+template<typename TElementIdx, uint32 Dim>
+void TSenseSys_SplitTree<TElementIdx, Dim>::Clear()
+{
+	FWriteScope SRWLock(*this);
+
+	ElementPool.Empty();
+	Elements.Empty();
+	StaticIDs.Empty();
+	StaticBoxes.Empty();
+	StaticMasks.Empty();
+	StaticNodes.Empty();
+	StaticPending.Empty();
+	StaticDeadCount = 0;
+	Tree.Clear();
+	ClearTagChannels_Internal();
+	DiscardStagedUpdates();
+}
+
+template<typename TElementIdx, uint32 Dim>
+void TSenseSys_SplitTree<TElementIdx, Dim>::Collapse()
+{
+	FRWScopeLock SRWLock(RWLock, SLT_Write);
+
+	Tree.CollapseQt();
+	if (StaticPending.Num() > 0 || StaticDeadCount > 0)
+	{
+		RebuildStatic_Internal();
+	}
+}
+
+template<typename TElementIdx, uint32 Dim>
+void TSenseSys_SplitTree<TElementIdx, Dim>::CollapseQueued(const int32 Budget)
+{
+	{
+		FRWScopeLock SRWLock(RWLock, SLT_ReadOnly);
+		if (!IsStaticRebuildDue_Internal(Budget) && !Tree.IsCollapseQueued())
+		{
+			return;
+		}
+	}
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_SplitTree_CollapseQueued);
+
+	FRWScopeLock SRWLock(RWLock, SLT_Write);
+
+	if (IsStaticRebuildDue_Internal(Budget))
+	{
+		RebuildStatic_Internal();
+	}
+	Tree.CollapseQueued(Budget);
+}
+
+template<typename TElementIdx, uint32 Dim>
+void TSenseSys_SplitTree<TElementIdx, Dim>::Compact_Internal(TArray<ElementIndexType>& OutRemap)
+{
+	RebuildStatic_Internal();
+	TArray<TElementIdx> TreeRemap;
+	Tree.Compact(TreeRemap);
+
+	OutRemap.Init(MaxIndex(), ElementPool.GetMaxIndex());
+	TArray<int32> ElementOrder;
+	TArray<FSplitElement> NewElements;
+	ElementOrder.Reserve(ElementPool.Num());
+	NewElements.Reserve(ElementPool.Num());
+	for (TElementIdx& ObjID : StaticIDs)
+	{
+		const int32 NewID = ElementOrder.Add(ObjID);
+		OutRemap[ObjID] = NewID;
+		NewElements.Add(Elements[ObjID]);
+		ObjID = static_cast<TElementIdx>(NewID);
+	}
+	TSparseArray<TElementIdx>& ObjIDs = Tree.GetElementPool();
+	for (int32 LocalID = 0; LocalID < ObjIDs.Num(); ++LocalID)
+	{
+		TElementIdx& ObjID = ObjIDs[LocalID];
+		const int32 NewID = ElementOrder.Add(ObjID);
+		OutRemap[ObjID] = NewID;
+		NewElements.Add(Elements[ObjID]);
+		NewElements.Last().LocalID = static_cast<TElementIdx>(LocalID);
+		ObjID = static_cast<TElementIdx>(NewID);
+	}
+	checkSlow(ElementOrder.Num() == ElementPool.Num());
+
+	TSparseArray<FSensedStimulus> NewElementPool;
+	NewElementPool.Reserve(ElementOrder.Num());
+	for (const int32 OldID : ElementOrder)
+	{
+		NewElementPool.Add(MoveTemp(ElementPool[OldID]));
+	}
+	ElementPool = MoveTemp(NewElementPool);
+	Elements = MoveTemp(NewElements);
+}
+
+template<typename TElementIdx, uint32 Dim>
+void TSenseSys_SplitTree<TElementIdx, Dim>::GetStats_Internal(FSenseSysTreeStats& OutStats) const
+{
+	// both roots are depth 0, the static depth is the number of open subtrees as in the LinearTree
+	TArray<int32, TInlineAllocator<64>> SubtreeEnds;
+	for (int32 NodeIdx = 0; NodeIdx < StaticNodes.Num(); ++NodeIdx)
+	{
+		while (SubtreeEnds.Num() && SubtreeEnds.Last() <= NodeIdx)
+		{
+			SubtreeEnds.Pop(false);
+		}
+		const FStaticNode& Node = StaticNodes[NodeIdx];
+		if (Node.Skip == NodeIdx + 1)
+		{
+			OutStats.AddLeaf(Node.End - Node.Begin, SubtreeEnds.Num());
+		}
+		else
+		{
+			SubtreeEnds.Add(Node.Skip);
+		}
+	}
+	OutStats.NumNodes = StaticNodes.Num();
+	Tree.ForEachNode(
+		[&OutStats](const typename DynamicTreeType::TreeNodeType& Node, const int32 Depth)
+		{
+			++OutStats.NumNodes;
+			if (Node.IsLeaf())
+			{
+				OutStats.AddLeaf(Node.Nodes.Num(), Depth);
+			}
+		});
+	OutStats.PoolBytes = StaticNodes.GetAllocatedSize() + Tree.GetPoolAllocatedSize();
+	OutStats.DataBytes = Elements.GetAllocatedSize() + StaticIDs.GetAllocatedSize() + StaticBoxes.GetAllocatedSize() + StaticMasks.GetAllocatedSize() +
+		StaticPending.GetAllocatedSize() + Tree.GetDataAllocatedSize() + Tree.GetElementPoolAllocatedSize();
+	CopyCounters(Counters, OutStats);
+	const FTreeCounters& TreeCounters = Tree.GetCounters();
+	OutStats.Splits += TreeCounters.Splits;
+	OutStats.Collapses += TreeCounters.Collapses;
+	OutStats.Reinserts += TreeCounters.Reinserts;
+}
+
+template<typename TElementIdx, uint32 Dim>
+void TSenseSys_SplitTree<TElementIdx, Dim>::ResetStats_Internal()
+{
+	Counters.Reset();
+	Tree.ResetCounters();
+}
+
+
+template<typename TElementIdx, uint32 Dim>
+template<typename NodeTestType, typename ElemTestType, typename ContainerType>
+void TSenseSys_SplitTree<TElementIdx, Dim>::GetStaticIDs(
+	const uint64 InBitChannels,
+	NodeTestType NodeTest,
+	ElemTestType ElemTest,
+	ContainerType& Out,
+	int32& VisitedNodes,
+	int32& VisitedElements) const
+{
+	int32 NodeIdx = 0;
+	while (NodeIdx < StaticNodes.Num())
+	{
+		const FStaticNode& Node = StaticNodes[NodeIdx];
+		++VisitedNodes;
+		if ((Node.ChannelMask & InBitChannels) == 0 || !NodeTest(Node.Bounds))
+		{
+			NodeIdx = Node.Skip;
+			continue;
+		}
+		if (Node.Skip == NodeIdx + 1)
+		{
+			VisitedElements += Node.End - Node.Begin;
+			for (int32 i = Node.Begin; i < Node.End; ++i)
+			{
+				if ((StaticMasks[i] & InBitChannels) && ElemTest(StaticBoxes[i]))
+				{
+					Out.Add(StaticIDs[i]);
+				}
+			}
+		}
+		++NodeIdx;
+	}
+
+	VisitedElements += StaticPending.Num();
+	for (const TElementIdx ObjID : StaticPending)
+	{
+		const FSplitElement& Elem = Elements[ObjID];
+		if ((Elem.Mask & InBitChannels) && ElemTest(Elem.Box))
+		{
+			Out.Add(ObjID);
+		}
+	}
+}
+
+template<typename TElementIdx, uint32 Dim>
+template<typename ContainerType>
+void TSenseSys_SplitTree<TElementIdx, Dim>::GetInBoxRadiusIDs_Internal(
+	const FBox& Box,
+	const FVector& Center,
+	const Real Radius,
+	const uint64 InBitChannels,
+	ContainerType& Out) const
+{
+	const bool bSphere = Radius >= 0.f;
+	const Real RadiusSquared = Radius * Radius;
+	const auto Test = [&](const FBox& InBox) { return IntersectBox(Box, InBox) && (!bSphere || DistSquared(InBox, Center) <= RadiusSquared); };
+	int32 VisitedNodes = 0;
+	int32 VisitedElements = 0;
+	GetStaticIDs(InBitChannels, Test, Test, Out, VisitedNodes, VisitedElements);
+
+	if (Tree.NumElements())
+	{
+		const FElementQuery Query = bSphere //
+			? FElementQuery(ToTreeBox(Box), PointType(Center), Radius, InBitChannels)
+			: FElementQuery(ToTreeBox(Box), InBitChannels);
+		TDynamicOut<ContainerType> DynamicOut(Tree.GetElementPool(), Out);
+		Tree.GetElementsIDs(Query, DynamicOut);
+		VisitedNodes += Query.VisitedNodes;
+		VisitedElements += Query.VisitedElements;
+	}
+	Counters.AddQuery(VisitedNodes, VisitedElements);
+}
+
+template<typename TElementIdx, uint32 Dim>
+template<typename VolumeType, typename ContainerType>
+void TSenseSys_SplitTree<TElementIdx, Dim>::GetInVolumeIDs(const FBox& Box, const VolumeType& Volume, const uint64 InBitChannels, ContainerType& Out) const
+{
+	const auto Test = [&](const FBox& InBox) { return IntersectBox(Box, InBox) && Volume.IntersectBox(LiftBox(InBox, Box)); };
+	int32 VisitedNodes = 0;
+	int32 VisitedElements = 0;
+	GetStaticIDs(InBitChannels, Test, Test, Out, VisitedNodes, VisitedElements);
+
+	if (Tree.NumElements())
+	{
+		const auto NodeTest = [&Volume, &Box](const BoxType& NodeBox) { return Volume.IntersectBox(ToWorld(NodeBox, Box)); };
+		const auto ElemTest = [&Volume, &Box](const auto& Bounds) { return Volume.IntersectBox(ToWorld(Bounds, Box)); };
+		const FElementQuery Query(ToTreeBox(Box), InBitChannels);
+		TDynamicOut<ContainerType> DynamicOut(Tree.GetElementPool(), Out);
+		Tree.GetElementsIDsInVolume(Query, NodeTest, ElemTest, DynamicOut);
+		VisitedNodes += Query.VisitedNodes;
+		VisitedElements += Query.VisitedElements;
+	}
+	Counters.AddQuery(VisitedNodes, VisitedElements);
+}
+
+template<typename TElementIdx, uint32 Dim>
+void TSenseSys_SplitTree<TElementIdx, Dim>::GetInBoxIDs(const FBox Box, TArray<ElementIndexType>& Out, const uint64 InBitChannels) const
+{
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_SplitTree_GetInBox);
+
+	FRWScopeLock SRWLock(RWLock, SLT_ReadOnly);
+
+	GetInBoxRadiusIDs_Internal(Box, FVector::ZeroVector, -1.f, InBitChannels, Out);
+}
+template<typename TElementIdx, uint32 Dim>
+void TSenseSys_SplitTree<TElementIdx, Dim>::GetInRadiusIDs(const Real Radius, const FVector Center, TArray<ElementIndexType>& Out, const uint64 InBitChannels) const
+{
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_SplitTree_GetInRadius);
+
+	FRWScopeLock SRWLock(RWLock, SLT_ReadOnly);
+
+	GetInBoxRadiusIDs_Internal(FBox::BuildAABB(Center, FVector(Radius)), Center, Radius, InBitChannels, Out);
+}
+template<typename TElementIdx, uint32 Dim>
+void TSenseSys_SplitTree<TElementIdx, Dim>::GetInBoxRadiusIDs(
+	const FBox Box,
+	const FVector Center,
+	const Real Radius,
+	TArray<ElementIndexType>& Out,
+	const uint64 InBitChannels) const
+{
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_SplitTree_GetInBoxRadius);
+
+	FRWScopeLock SRWLock(RWLock, SLT_ReadOnly);
+
+	GetInBoxRadiusIDs_Internal(Box, Center, Radius, InBitChannels, Out);
+}
+
+template<typename TElementIdx, uint32 Dim>
+void TSenseSys_SplitTree<TElementIdx, Dim>::GetInBoxIDs(const FBox Box, TSet<ElementIndexType>& Out, const uint64 InBitChannels) const
+{
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_SplitTree_GetInBox);
+
+	FRWScopeLock SRWLock(RWLock, SLT_ReadOnly);
+
+	GetInBoxRadiusIDs_Internal(Box, FVector::ZeroVector, -1.f, InBitChannels, Out);
+}
+template<typename TElementIdx, uint32 Dim>
+void TSenseSys_SplitTree<TElementIdx, Dim>::GetInRadiusIDs(const Real Radius, const FVector Center, TSet<ElementIndexType>& Out, const uint64 InBitChannels) const
+{
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_SplitTree_GetInRadius);
+
+	FRWScopeLock SRWLock(RWLock, SLT_ReadOnly);
+
+	GetInBoxRadiusIDs_Internal(FBox::BuildAABB(Center, FVector(Radius)), Center, Radius, InBitChannels, Out);
+}
+template<typename TElementIdx, uint32 Dim>
+void TSenseSys_SplitTree<TElementIdx, Dim>::GetInBoxRadiusIDs(
+	const FBox Box,
+	const FVector Center,
+	const Real Radius,
+	TSet<ElementIndexType>& Out,
+	const uint64 InBitChannels) const
+{
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_SplitTree_GetInBoxRadius);
+
+	FRWScopeLock SRWLock(RWLock, SLT_ReadOnly);
+
+	GetInBoxRadiusIDs_Internal(Box, Center, Radius, InBitChannels, Out);
+}
+template<typename TElementIdx, uint32 Dim>
+void TSenseSys_SplitTree<TElementIdx, Dim>::GetInBoxIDs(const FBox Box, FSenseSysQueryIDs& Out, const uint64 InBitChannels) const
+{
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_SplitTree_GetInBox);
+
+	FRWScopeLock SRWLock(RWLock, SLT_ReadOnly);
+
+	GetInBoxRadiusIDs_Internal(Box, FVector::ZeroVector, -1.f, InBitChannels, Out);
+}
+template<typename TElementIdx, uint32 Dim>
+void TSenseSys_SplitTree<TElementIdx, Dim>::GetInRadiusIDs(const Real Radius, const FVector Center, FSenseSysQueryIDs& Out, const uint64 InBitChannels) const
+{
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_SplitTree_GetInRadius);
+
+	FRWScopeLock SRWLock(RWLock, SLT_ReadOnly);
+
+	GetInBoxRadiusIDs_Internal(FBox::BuildAABB(Center, FVector(Radius)), Center, Radius, InBitChannels, Out);
+}
+template<typename TElementIdx, uint32 Dim>
+void TSenseSys_SplitTree<TElementIdx, Dim>::GetInBoxRadiusIDs(
+	const FBox Box,
+	const FVector Center,
+	const Real Radius,
+	FSenseSysQueryIDs& Out,
+	const uint64 InBitChannels) const
+{
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_SplitTree_GetInBoxRadius);
+
+	FRWScopeLock SRWLock(RWLock, SLT_ReadOnly);
+
+	GetInBoxRadiusIDs_Internal(Box, Center, Radius, InBitChannels, Out);
+}
+
+template<typename TElementIdx, uint32 Dim>
+void TSenseSys_SplitTree<TElementIdx, Dim>::GetInBoxRadiusIDsBatch(const TArray<FBatchQuery>& Queries, TArray<TArray<ElementIndexType>>& Out) const
+{
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_SplitTree_GetInBoxRadiusBatch);
+
+	FRWScopeLock SRWLock(RWLock, SLT_ReadOnly);
+
+	Out.SetNum(Queries.Num());
+	TArray<FElementQuery, TInlineAllocator<32>> DynamicQueries;
+	TArray<int32, TInlineAllocator<32>> VisitedNodes;
+	TArray<int32, TInlineAllocator<32>> VisitedElements;
+	DynamicQueries.Reserve(Queries.Num());
+	VisitedNodes.SetNumZeroed(Queries.Num());
+	VisitedElements.SetNumZeroed(Queries.Num());
+	for (int32 i = 0; i < Queries.Num(); ++i)
+	{
+		const FBatchQuery& It = Queries[i];
+		const bool bSphere = It.Radius != 0.f;
+		const Real RadiusSquared = It.Radius * It.Radius;
+		const auto Test = [&](const FBox& InBox) { return IntersectBox(It.Box, InBox) && (!bSphere || DistSquared(InBox, It.Center) <= RadiusSquared); };
+		GetStaticIDs(It.BitChannels, Test, Test, Out[i], VisitedNodes[i], VisitedElements[i]);
+		DynamicQueries.Add(
+			bSphere //
+				? FElementQuery(ToTreeBox(It.Box), PointType(It.Center), It.Radius, It.BitChannels)
+				: FElementQuery(ToTreeBox(It.Box), It.BitChannels));
+	}
+
+	// one walk of the dynamic tree for the whole batch
+	if (Tree.NumElements())
+	{
+		TArray<TArray<TElementIdx>> DynamicOut;
+		Tree.GetElementsIDsBatch(DynamicQueries.GetData(), DynamicQueries.Num(), DynamicOut);
+		const TSparseArray<TElementIdx>& ObjIDs = Tree.GetElementPool();
+		for (int32 i = 0; i < Queries.Num(); ++i)
+		{
+			TArray<ElementIndexType>& QueryOut = Out[i];
+			QueryOut.Reserve(QueryOut.Num() + DynamicOut[i].Num());
+			for (const TElementIdx LocalID : DynamicOut[i])
+			{
+				QueryOut.Add(ObjIDs[LocalID]);
+			}
+			VisitedNodes[i] += DynamicQueries[i].VisitedNodes;
+			VisitedElements[i] += DynamicQueries[i].VisitedElements;
+		}
+	}
+	for (int32 i = 0; i < Queries.Num(); ++i)
+	{
+		Counters.AddQuery(VisitedNodes[i], VisitedElements[i]);
+	}
+}
+
+template<typename TElementIdx, uint32 Dim>
+void TSenseSys_SplitTree<TElementIdx, Dim>::GetKNearestIDs(
+	const FVector Center,
+	const int32 K,
+	const Real MaxRadius,
+	TArray<ElementIndexType>& Out,
+	const uint64 InBitChannels) const
+{
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_SplitTree_GetKNearest);
+
+	Out.Reset();
+	if (K <= 0)
+	{
+		return;
+	}
+
+	struct FElemDist
+	{
+		Real DistSquared;
+		ElementIndexType ObjID;
+		// max heap, the worst kept element on top
+		FORCEINLINE bool operator<(const FElemDist& Other) const { return DistSquared > Other.DistSquared; }
+	};
+	struct FNodeDist
+	{
+		Real DistSquared;
+		int32 NodeIdx;
+		// min heap, the nearest open node on top
+		FORCEINLINE bool operator<(const FNodeDist& Other) const { return DistSquared < Other.DistSquared; }
+	};
+	TArray<FElemDist, TInlineAllocator<16>> Best;
+	Best.Reserve(K + 1);
+	TArray<FNodeDist, TInlineAllocator<64>> Open;
+	TArray<TElementIdx, TInlineAllocator<16>> LocalIDs;
+	const Real MaxDistSquared = FMath::Square(MaxRadius);
+
+	FRWScopeLock SRWLock(RWLock, SLT_ReadOnly);
+
+	int32 VisitedNodes = 0;
+	int32 VisitedElements = StaticPending.Num();
+	const auto TestElement = [&](const ElementIndexType ObjID, const FBox& ElemBox)
+	{
+		const Real ElemDistSquared = DistSquared(ElemBox, Center);
+		if (ElemDistSquared <= MaxDistSquared && (Best.Num() < K || ElemDistSquared < Best.HeapTop().DistSquared))
+		{
+			if (Best.Num() == K)
+			{
+				Best.HeapPopDiscard(false);
+			}
+			Best.HeapPush(FElemDist{ElemDistSquared, ObjID});
+		}
+	};
+
+	// the dynamic tree picks its K nearest, they are ranked together with the static ones
+	if (Tree.NumElements())
+	{
+		Tree.GetKNearestIDs(PointType(Center), K, MaxRadius, InBitChannels, LocalIDs);
+		VisitedElements += LocalIDs.Num();
+		for (const TElementIdx LocalID : LocalIDs)
+		{
+			const ElementIndexType ObjID = Tree.GetElement(LocalID);
+			TestElement(ObjID, Elements[ObjID].Box);
+		}
+	}
+	for (const TElementIdx ObjID : StaticPending)
+	{
+		const FSplitElement& Elem = Elements[ObjID];
+		if (Elem.Mask & InBitChannels)
+		{
+			TestElement(ObjID, Elem.Box);
+		}
+	}
+
+	const auto OpenNode = [&](const int32 NodeIdx)
+	{
+		const FStaticNode& Node = StaticNodes[NodeIdx];
+		if (Node.ChannelMask & InBitChannels)
+		{
+			const Real NodeDistSquared = DistSquared(Node.Bounds, Center);
+			if (NodeDistSquared <= MaxDistSquared)
+			{
+				Open.HeapPush(FNodeDist{NodeDistSquared, NodeIdx});
+			}
+		}
+	};
+	if (StaticNodes.Num() > 0)
+	{
+		OpenNode(0);
+	}
+	while (Open.Num() > 0)
+	{
+		FNodeDist Top;
+		Open.HeapPop(Top, false);
+		if (Best.Num() == K && Top.DistSquared > Best.HeapTop().DistSquared)
+		{
+			break;
+		}
+		const FStaticNode& Node = StaticNodes[Top.NodeIdx];
+		++VisitedNodes;
+		if (Node.Skip == Top.NodeIdx + 1)
+		{
+			VisitedElements += Node.End - Node.Begin;
+			for (int32 i = Node.Begin; i < Node.End; ++i)
+			{
+				if (StaticMasks[i] & InBitChannels)
+				{
+					TestElement(StaticIDs[i], StaticBoxes[i]);
+				}
+			}
+		}
+		else
+		{
+			for (int32 Child = Top.NodeIdx + 1; Child < Node.Skip; Child = StaticNodes[Child].Skip)
+			{
+				OpenNode(Child);
+			}
+		}
+	}
+
+	Counters.AddQuery(VisitedNodes, VisitedElements);
+
+	Best.Sort([](const FElemDist& A, const FElemDist& B) { return A.DistSquared < B.DistSquared; });
+	Out.Reserve(Best.Num());
+	for (const FElemDist& It : Best)
+	{
+		Out.Add(It.ObjID);
+	}
+}
+
+template<typename TElementIdx, uint32 Dim>
+void TSenseSys_SplitTree<TElementIdx, Dim>::GetAlongSegmentIDs(
+	const FVector Start,
+	const FVector End,
+	const Real Radius,
+	TArray<ElementIndexType>& Out,
+	const uint64 InBitChannels) const
+{
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_SplitTree_GetAlongSegment);
+
+	const FSenseSysSegment Segment(Start, End, Radius);
+	FSegmentHits Hits;
+	Out.Reset();
+
+	FRWScopeLock SRWLock(RWLock, SLT_ReadOnly);
+
+	// static and dynamic elements keep their world box here
+	GetInVolumeIDs(Segment.GetBounds(), Segment, InBitChannels, Out);
+	for (const ElementIndexType ObjID : Out)
+	{
+		const FBox& Box = Elements[ObjID].Box;
+		Real Entry;
+		if (Segment.ClipBox(Box.Min, Box.Max, Dim, Entry))
+		{
+			Hits.Add(FSegmentHit{Entry, ObjID});
+		}
+	}
+	SortSegmentHits(Hits, Out);
+}
+
+template<typename TElementIdx, uint32 Dim>
+void TSenseSys_SplitTree<TElementIdx, Dim>::GetInConeIDs(const FBox Box, const FSenseSysCone& Cone, TArray<ElementIndexType>& Out, const uint64 InBitChannels) const
+{
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_SplitTree_GetInCone);
+
+	FRWScopeLock SRWLock(RWLock, SLT_ReadOnly);
+
+	GetInVolumeIDs(Box, Cone, InBitChannels, Out);
+}
+template<typename TElementIdx, uint32 Dim>
+void TSenseSys_SplitTree<TElementIdx, Dim>::GetInConeIDs(const FBox Box, const FSenseSysCone& Cone, TSet<ElementIndexType>& Out, const uint64 InBitChannels) const
+{
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_SplitTree_GetInCone);
+
+	FRWScopeLock SRWLock(RWLock, SLT_ReadOnly);
+
+	GetInVolumeIDs(Box, Cone, InBitChannels, Out);
+}
+template<typename TElementIdx, uint32 Dim>
+void TSenseSys_SplitTree<TElementIdx, Dim>::GetInConeIDs(const FBox Box, const FSenseSysCone& Cone, FSenseSysQueryIDs& Out, const uint64 InBitChannels) const
+{
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_SplitTree_GetInCone);
+
+	FRWScopeLock SRWLock(RWLock, SLT_ReadOnly);
+
+	GetInVolumeIDs(Box, Cone, InBitChannels, Out);
+}
+template<typename TElementIdx, uint32 Dim>
+void TSenseSys_SplitTree<TElementIdx, Dim>::GetInFrustumIDs(
+	const FBox Box,
+	const FSenseSysFrustum& Frustum,
+	TArray<ElementIndexType>& Out,
+	const uint64 InBitChannels) const
+{
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_SplitTree_GetInFrustum);
+
+	FRWScopeLock SRWLock(RWLock, SLT_ReadOnly);
+
+	GetInVolumeIDs(Box, Frustum, InBitChannels, Out);
+}
+template<typename TElementIdx, uint32 Dim>
+void TSenseSys_SplitTree<TElementIdx, Dim>::GetInFrustumIDs(
+	const FBox Box,
+	const FSenseSysFrustum& Frustum,
+	TSet<ElementIndexType>& Out,
+	const uint64 InBitChannels) const
+{
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_SplitTree_GetInFrustum);
+
+	FRWScopeLock SRWLock(RWLock, SLT_ReadOnly);
+
+	GetInVolumeIDs(Box, Frustum, InBitChannels, Out);
+}
+template<typename TElementIdx, uint32 Dim>
+void TSenseSys_SplitTree<TElementIdx, Dim>::GetInFrustumIDs(
+	const FBox Box,
+	const FSenseSysFrustum& Frustum,
+	FSenseSysQueryIDs& Out,
+	const uint64 InBitChannels) const
+{
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_SplitTree_GetInFrustum);
+
+	FRWScopeLock SRWLock(RWLock, SLT_ReadOnly);
+
+	GetInVolumeIDs(Box, Frustum, InBitChannels, Out);
+}
+
+template<typename TElementIdx, uint32 Dim>
+FBox TSenseSys_SplitTree<TElementIdx, Dim>::GetMaxIntersect(const FBox Box) const
+{
+	FRWScopeLock SRWLock(RWLock, SLT_ReadOnly);
+
+	FBox Out(ForceInit);
+	for (int32 NodeIdx = 0; NodeIdx < StaticNodes.Num(); ++NodeIdx)
+	{
+		const FStaticNode& Node = StaticNodes[NodeIdx];
+		if (Node.Skip == NodeIdx + 1 && IntersectBox(Node.Bounds, Box))
+		{
+			Out += LiftBox(Node.Bounds, Box);
+		}
+	}
+	for (const TElementIdx ObjID : StaticPending)
+	{
+		if (IntersectBox(Elements[ObjID].Box, Box))
+		{
+			Out += LiftBox(Elements[ObjID].Box, Box);
+		}
+	}
+	if (Tree.NumElements())
+	{
+		const int32 MaxIntersect = Tree.GetMaxIntersect(ToTreeBox(Box));
+		if (Tree.IsValidTreeIdx(MaxIntersect))
+		{
+			Out += ToWorld(Tree.GetTreeBox(MaxIntersect), Box);
+		}
+	}
+	return Out.IsValid ? Out : FBox(FVector::ZeroVector, FVector::ZeroVector);
+}
+
+template<typename TElementIdx, uint32 Dim>
+void TSenseSys_SplitTree<TElementIdx, Dim>::DrawTree(const class UWorld* World, const FTreeDrawSetup TreeNode, const FTreeDrawSetup Link, const FTreeDrawSetup ElemNode, const float LifeTime) const
+{
+#if ENABLE_DRAW_DEBUG
+	FRWScopeLock SRWLock(RWLock, SLT_ReadOnly);
+
+	FBox ElemBounds(ForceInit);
+	for (auto It = ElementPool.CreateConstIterator(); It; ++It)
+	{
+		const FBox& ElemBox = Elements[It.GetIndex()].Box;
+		ElemBounds += ElemBox;
+		DrawDebugBox(World, ElemBox.GetCenter(), ElemBox.GetExtent(), ElemNode.Color, false, LifeTime, ElemNode.DrawDepth, ElemNode.Thickness);
+	}
+	for (const FStaticNode& Node : StaticNodes)
+	{
+		DrawDebugBox(World, Node.Bounds.GetCenter(), Node.Bounds.GetExtent(), TreeNode.Color, false, LifeTime, TreeNode.DrawDepth, TreeNode.Thickness);
+	}
+	Tree.ForEachNode(
+		[&](const typename DynamicTreeType::TreeNodeType& Node, const int32 Depth)
+		{
+			const FBox NodeBox = ToWorld(Node.GetTreeBox(), ElemBounds);
+			DrawDebugBox(World, NodeBox.GetCenter(), NodeBox.GetExtent(), TreeNode.Color, false, LifeTime, TreeNode.DrawDepth, TreeNode.Thickness);
+		});
+#endif //ENABLE_DRAW_DEBUG
 }
+
+
+template class TSenseSys_QuadTree<uint16, uint16>;
+template class TSenseSys_QuadTree<uint16, int32>;
+template class TSenseSys_QuadTree<int32, uint16>;
+template class TSenseSys_QuadTree<int32, int32>;
+template class TSenseSys_OcTree<uint16, uint16>;
+template class TSenseSys_OcTree<uint16, int32>;
+template class TSenseSys_OcTree<int32, uint16>;
+template class TSenseSys_OcTree<int32, int32>;
+template class TSenseSys_HashGrid<uint16>;
+template class TSenseSys_HashGrid<int32>;
+template class TSenseSys_LinearTree<uint16, 2>;
+template class TSenseSys_LinearTree<uint16, 3>;
+template class TSenseSys_LinearTree<int32, 2>;
+template class TSenseSys_LinearTree<int32, 3>;
+template class TSenseSys_TiledTree<uint16, 2>;
+template class TSenseSys_TiledTree<uint16, 3>;
+template class TSenseSys_TiledTree<int32, 2>;
+template class TSenseSys_TiledTree<int32, 3>;
+template class TSenseSys_SplitTree<uint16, 2>;
+template class TSenseSys_SplitTree<uint16, 3>;
+template class TSenseSys_SplitTree<int32, 2>;
+template class TSenseSys_SplitTree<int32, 3>;
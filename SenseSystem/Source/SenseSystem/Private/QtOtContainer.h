@@ -5,12 +5,15 @@
 #include "AbstractTree.h"
 #include "HAL/Platform.h"
 #include "Misc/ScopeRWLock.h"
+#include "Misc/ScopeLock.h"
 #include "Misc/MemStack.h"
 #include "Math/Box2D.h"
 #include "Math/Box.h"
 #include "Math/NumericLimits.h"
 #include "Containers/Array.h"
 #include "Containers/SparseArray.h"
+#include "HAL/ThreadSafeCounter.h"
+#include "Templates/SharedPointer.h"
 
 #include "SenseSystem.h"
 #include "SensedStimulStruct.h"
@@ -33,6 +36,49 @@ struct FTreeDrawSetup final
 	ESceneDepthPriorityGroup DrawDepth = ESceneDepthPriorityGroup::SDPG_World;
 };
 
+/** nodes with new split parameters built from a copy of the element boxes, see IContainerTree::BeginRetune */
+struct FSenseSysRetuneBuild
+{
+	virtual ~FSenseSysRetuneBuild() = default;
+	/** any thread, touches only the copy */
+	virtual void Build() = 0;
+	/** IContainerTree::GetSerial of the copied tree */
+	uint32 TreeSerial = 0;
+};
+
+/** immutable element pool copy published by IContainerTree::PublishSnapshot, index ObjID, free slots have TmpHash MAX_uint32 */
+struct FSenseSysReadSnapshot
+{
+	uint32 Epoch = 0;
+	TArray<FSensedStimulus> Elements;
+	/** IContainerTree::GetGenerations_TS of each ObjID at the copy */
+	TArray<uint32> Generations;
+	/** copy of the tree tag channels, TagSlotNum per ObjID, empty for a tree of one tag */
+	TArray<uint64> TagChannels;
+	int32 TagSlotNum = 0;
+
+	FORCEINLINE FSensedStimulus GetSensedStimulusCopy(const FSenseSystemModule::ElementIndexType InObjID) const
+	{
+		return Elements.IsValidIndex(InObjID) && Elements[InObjID].TmpHash != MAX_uint32 ? Elements[InObjID] : FSensedStimulus();
+	}
+	/** empty if the ObjID was freed or moved between the copy and the moment Generation was taken */
+	FORCEINLINE FSensedStimulus GetSensedStimulusCopy(const FSenseSystemModule::ElementIndexType InObjID, const uint32 Generation) const
+	{
+		return Generations.IsValidIndex(InObjID) && Generations[InObjID] == Generation ? GetSensedStimulusCopy(InObjID) : FSensedStimulus();
+	}
+	/** BitChannels of the copy are the channels of the tag at Slot */
+	FORCEINLINE FSensedStimulus GetSensedStimulusCopy(const FSenseSystemModule::ElementIndexType InObjID, const uint32 Generation, const FSenseSysTagSlot& Slot) const
+	{
+		FSensedStimulus Out = GetSensedStimulusCopy(InObjID, Generation);
+		if (Slot.IsShared() && Out.TmpHash != MAX_uint32)
+		{
+			const int32 Idx = static_cast<int32>(InObjID) * TagSlotNum + Slot.Index;
+			Out.BitChannels = TagChannels.IsValidIndex(Idx) ? TagChannels[Idx] : 0;
+		}
+		return Out;
+	}
+};
+
 /** abstract QuadTree - OcTree */
 class SENSESYSTEM_API IContainerTree 
 {
@@ -55,9 +101,145 @@ public:
 	void Lock() const { RWLock.WriteLock(); }
 	void UnLock() const { RWLock.WriteUnlock(); }
 
+	/** staged stimulus position, Points[0] is the single sense point */
+	struct FUpdateItem
+	{
+		ElementIndexType ObjID = MaxIndex();
+		/** FSensedStimulus::TmpHash, skip the item if the ObjID was reused */
+		uint32 TmpHash = MAX_uint32;
+		float Time = 0.f;
+		bool bAllPoints = true;
+		FBox Box = FBox(ForceInit);
+		TArray<FVector> Points;
+		/** FSensedStimulus::SweepOffset, Box already covers the previous position */
+		FVector SweepOffset = FVector::ZeroVector;
+	};
+
+	/** one query of GetInBoxRadiusIDsBatch, Radius 0 tests the box only as GetInBoxIDs */
+	struct FBatchQuery
+	{
+		FBox Box = FBox(ForceInit);
+		FVector Center = FVector::ZeroVector;
+		Real Radius = 0.f;
+		uint64 BitChannels = MAX_uint64;
+	};
+
+	using FReadSnapshot = FSenseSysReadSnapshot;
+	using FSnapshotPtr = TSharedPtr<const FReadSnapshot, ESPMode::ThreadSafe>;
+	using FRetuneBuild = FSenseSysRetuneBuild;
+	using FRetuneBuildPtr = TSharedPtr<FRetuneBuild, ESPMode::ThreadSafe>;
+
 protected:
 	mutable FIndexRemoveControl<ElementIndexType> IndexRemoveControl;
 	mutable FRWLock RWLock;
+	/** advanced by every pool write, PublishSnapshot skips the copy while it matches the published epoch */
+	mutable uint32 PoolEpoch = 0;
+	const uint32 Serial = NewSerial();
+	static uint32 NewSerial();
+
+	/** write lock for element pool changes, bTrackedIDs - the writer marks its ObjIDs, else the next snapshot copies the whole pool */
+	struct FWriteScope
+	{
+		explicit FWriteScope(const IContainerTree& InTree, const bool bTrackedIDs = false) : SRWLock(InTree.RWLock, SLT_Write)
+		{
+			++InTree.PoolEpoch;
+			if (!bTrackedIDs)
+			{
+				InTree.MarkAllIDsChanged_Internal();
+			}
+		}
+		FRWScopeLock SRWLock;
+	};
+
+	/** write lock must be held, the element of InObjID changed, returns InObjID */
+	ElementIndexType MarkPoolDirty_Internal(ElementIndexType InObjID) const;
+	/** write lock must be held, every ObjID may be freed or moved */
+	void MarkAllIDsChanged_Internal() const;
+	/** write lock must be held, InObjID is freed, queries tracking removals and snapshot readers see it */
+	void RecordRemove_Internal(ElementIndexType InObjID);
+	/** write lock must be held, every element is gone, the tag slots stay */
+	void ClearTagChannels_Internal() { TagChannels.Reset(); }
+
+	/** write lock must be held, true if the tree box needs update */
+	bool SetUpdateItemPoints_Internal(const FUpdateItem& Item);
+	/** write lock must be held, keeps the tree element mask in sync with FSensedStimulus::BitChannels */
+	virtual void SetElementChannels_Internal(ElementIndexType ID, uint64 Channels) = 0;
+	/** write lock must be held, how many of AddNum new elements fit below MaxElements, warns when not all */
+	int32 FitElementCount_Internal(int32 AddNum, int32 MaxElements) const;
+	/** write lock must be held, repacks the element pool, OutRemap[OldObjID] is the new ObjID or MaxIndex() for a free slot */
+	virtual void Compact_Internal(TArray<ElementIndexType>& OutRemap) = 0;
+	/** read lock must be held, nodes, memory and counters, the element count and pool bytes are set by GetStats */
+	virtual void GetStats_Internal(FSenseSysTreeStats& OutStats) const = 0;
+	/** write lock must be held */
+	virtual void ResetStats_Internal() = 0;
+	/** any thread, the query counters of the tree, not of its inner tile or dynamic trees */
+	virtual void SetQueryCounting_Internal(bool bCount) = 0;
+	/** write lock must be held, moves the tree by Offset without touching the element boxes, false if the tree keeps world boxes */
+	virtual bool ShiftOrigin_Internal(const FVector& Offset) { return false; }
+	/** read lock must be held, copy of the element boxes for nodes with new split parameters, null if the tree has none */
+	virtual FRetuneBuildPtr BeginRetune_Internal(float MinimumSize, int32 NodeCantSplit) const { return nullptr; }
+	/** write lock must be held, swaps in the built nodes, ObjIDs stay, false if the elements changed since the copy */
+	virtual bool FinishRetune_Internal(FRetuneBuild& Build) { return false; }
+	/** read lock must be held, median largest box edge of up to MaxSamples elements, 0 if the tree has no split parameters */
+	virtual float GetMedianElementSize_Internal(int32 MaxSamples) const { return 0.f; }
+	static void CopyCounters(const FTreeCounters& Counters, FSenseSysTreeStats& OutStats);
+
+	/** element entered by a segment at Entry, see GetAlongSegmentIDs */
+	struct FSegmentHit
+	{
+		Real Entry;
+		ElementIndexType ObjID;
+		FORCEINLINE bool operator<(const FSegmentHit& Other) const { return Entry < Other.Entry; }
+	};
+	using FSegmentHits = TArray<FSegmentHit, TInlineAllocator<16>>;
+	/** Out gets the ObjIDs of Hits, nearest entry first */
+	static void SortSegmentHits(FSegmentHits& Hits, TArray<ElementIndexType>& Out);
+
+private:
+	FCriticalSection StagedCS;
+	TArray<FUpdateItem> StagedUpdates;
+	TArray<FUpdateItem> FlushUpdates;
+	/** game thread, set from BeginRetune to FinishRetune, the staged updates wait meanwhile */
+	bool bRetunePending = false;
+
+	/** guards the Snapshot pointer only, readers copy it and read the pool without locks */
+	mutable FCriticalSection SnapshotCS;
+	TSharedPtr<FReadSnapshot, ESPMode::ThreadSafe> Snapshot;
+	/** previous version, reused by the next publish once no reader pins it */
+	TSharedPtr<FReadSnapshot, ESPMode::ThreadSafe> RetiredSnapshot;
+	bool bSnapshotReads = false;
+	/** queries of snapshot readers in flight, they skip the remove control, Compact waits for them */
+	mutable FThreadSafeCounter SnapshotQueries;
+
+	/** ObjIDs written since the current snapshot and between the retired and the current one, the retired copy misses both */
+	mutable TArray<ElementIndexType> DirtyIDs;
+	TArray<ElementIndexType> PrevDirtyIDs;
+	mutable bool bPoolDirtyAll = true;
+	bool bPrevDirtyAll = true;
+	/** advanced when an ObjID is freed or moved, missing entries are 0 */
+	mutable TArray<uint32> ObjGenerations;
+
+	/** set once before the first insert, empty for a tree of one sensor tag, ordered by tag name */
+	TArray<TPair<FName, FSenseSysTagSlot>> TagSlots;
+	/**
+	 * channels of each tag slot of a shared tree element, TagSlots.Num() entries per ObjID, 0 - the element is not on the tag,
+	 * FSensedStimulus::BitChannels is their union, kept out of the element so its copies stay allocation free
+	 */
+	TArray<uint64> TagChannels;
+
+	/** read lock must be held, Default for the slot of a tree of one tag */
+	FORCEINLINE uint64 GetTagChannels_Internal(const ElementIndexType ID, const FSenseSysTagSlot& Slot, const uint64 Default) const
+	{
+		if (!Slot.IsShared())
+		{
+			return Default;
+		}
+		const int32 Idx = static_cast<int32>(ID) * TagSlots.Num() + Slot.Index;
+		return TagChannels.IsValidIndex(Idx) ? TagChannels[Idx] : 0;
+	}
+
+	/** pool lock must be held */
+	void PublishSnapshot_Internal();
 
 public:
 #if WITH_EDITOR
@@ -74,11 +256,79 @@ public:
 	virtual ElementIndexType Insert(const FSensedStimulus& ComponentData, FBox InBox) = 0;
 	virtual ElementIndexType Insert(FSensedStimulus&& ComponentData, FBox InBox) = 0;
 	virtual void Update(ElementIndexType InObjID, FBox NewBox) = 0;
+
+	/** one pass insert under a single write lock, OutIDs[i] is the ObjID of ComponentsData[i] */
+	virtual void BulkInsert(TArray<FSensedStimulus>&& ComponentsData, const TArray<FBox>& InBoxes, TArray<ElementIndexType>& OutIDs) = 0;
+
+	/** points and boxes of all items under a single write lock */
+	virtual void UpdateBatch(const TArray<FUpdateItem>& Items) = 0;
+
+	/** queue for the next FlushStagedUpdates, thread safe */
+	void StageUpdate(FUpdateItem&& Item);
+	void FlushStagedUpdates();
+	void DiscardStagedUpdates();
 	/** end FStimulusTagResponse */
 
+	/** sensors read the published pool copy instead of locking per element */
+	void SetSnapshotReads(bool bEnable);
+	FORCEINLINE bool IsSnapshotReads() const { return bSnapshotReads; }
+	/** game thread once per frame, copies the elements written since the reused version, the whole pool after Clear or Compact */
+	void PublishSnapshot();
+	/** sense thread, keeps the last published version alive while held, null if snapshot reads are off */
+	FSnapshotPtr PinSnapshot() const;
+	/** Out[i] is the generation of IDs[i], compared with FSenseSysReadSnapshot::Generations */
+	void GetGenerations_TS(const TArray<ElementIndexType>& IDs, TArray<uint32>& Out) const;
+
+	/** game thread before the first insert, the sensor tags sharing this tree and their tag channels index */
+	void SetTagSlots(TArray<TPair<FName, FSenseSysTagSlot>>&& InTagSlots);
+	/** the default slot for a tag that does not share the tree */
+	FSenseSysTagSlot GetTagSlot(FName Tag) const;
+	FORCEINLINE const TArray<TPair<FName, FSenseSysTagSlot>>& GetTagSlots() const { return TagSlots; }
+
+	/** free slots of the element pool left by removes */
+	int32 NumFreeSlots() const;
+	/** free slots over the allocated range of the element pool, 0 for a packed pool */
+	float GetFragmentation() const;
+	/**
+	 * game thread, repack the pools while no sensor holds IDs of this tree, false if one does.
+	 * OutRemap[OldObjID] is the new ObjID or MaxIndex() for a free slot, the staged updates and the snapshot follow it here,
+	 * FStimulusTagResponse and the sensor pending IDs are moved by the caller
+	 */
+	bool Compact(TArray<ElementIndexType>& OutRemap);
+
+	/** walks the nodes under the read lock, for the console and stats, not for per frame use */
+	void GetStats(FSenseSysTreeStats& OutStats) const;
+	/** restarts the split, collapse, reinsert and query counters */
+	void ResetStats();
+	/** queries advance the query counters only while on, set every tick from the cvar, stats and bAutoTune of the tree */
+	FORCEINLINE void SetQueryCounting(const bool bCount) { SetQueryCounting_Internal(bCount); }
+
+	/**
+	 * game thread, moves all elements by Offset for a world origin rebase, false if the tree has to be rebuilt instead.
+	 * the sensed points, the staged updates and the snapshot follow the shift
+	 */
+	bool ShiftOrigin(const FVector& Offset);
+
+	/**
+	 * game thread, copies the element boxes for nodes with a new minimum node size and element count per node,
+	 * FRetuneBuild::Build runs on a worker and FinishRetune swaps the nodes in. null if the tree has no such parameters.
+	 * the staged updates wait until FinishRetune, so moving stimuli do not make the copy stale
+	 */
+	FRetuneBuildPtr BeginRetune(float MinimumSize, int32 NodeCantSplit);
+	/**
+	 * game thread, once Build is done, false if an element was inserted, removed or changed since BeginRetune and the build is dropped.
+	 * ObjIDs, the element pool and the snapshot stay, the stamps report a change of every box
+	 */
+	bool FinishRetune(FRetuneBuild& Build);
+	/** strided sample of the element boxes for the split parameters, 0 for an empty tree or a tree without them */
+	float GetMedianElementSize(int32 MaxSamples) const;
+
 	/** virtual Tree */
 	virtual void Clear() = 0;
+	/** full pass over the tree */
 	virtual void Collapse() = 0;
+	/** collapse up to Budget nodes queued by removes, no lock and no work while nothing is queued */
+	virtual void CollapseQueued(int32 Budget) = 0;
 
 	virtual void GetInBoxIDs(FBox Box, TArray<ElementIndexType>& Out, uint64 InBitChannels = MAX_uint64) const = 0;
 	virtual void GetInRadiusIDs(Real Radius, FVector Center, TArray<ElementIndexType>& Out, uint64 InBitChannels = MAX_uint64) const = 0;
@@ -88,20 +338,67 @@ public:
 	virtual void GetInRadiusIDs(Real Radius, FVector Center, TSet<ElementIndexType>& Out, uint64 InBitChannels = MAX_uint64) const = 0;
 	virtual void GetInBoxRadiusIDs(FBox Box, FVector Center, Real Radius, TSet<ElementIndexType>& Out, uint64 InBitChannels = MAX_uint64) const = 0;
 
+	/** Out is appended without a Reset, IDs already in Out are skipped */
+	virtual void GetInBoxIDs(FBox Box, FSenseSysQueryIDs& Out, uint64 InBitChannels = MAX_uint64) const = 0;
+	virtual void GetInRadiusIDs(Real Radius, FVector Center, FSenseSysQueryIDs& Out, uint64 InBitChannels = MAX_uint64) const = 0;
+	virtual void GetInBoxRadiusIDs(FBox Box, FVector Center, Real Radius, FSenseSysQueryIDs& Out, uint64 InBitChannels = MAX_uint64) const = 0;
+
+	/** single walk for all queries, Out[i] holds the IDs of Queries[i] */
+	virtual void GetInBoxRadiusIDsBatch(const TArray<FBatchQuery>& Queries, TArray<TArray<ElementIndexType>>& Out) const = 0;
+
+	/** up to K IDs nearest to Center within MaxRadius, nearest first, distance to the stimulus box */
+	virtual void GetKNearestIDs(FVector Center, int32 K, Real MaxRadius, TArray<ElementIndexType>& Out, uint64 InBitChannels = MAX_uint64) const = 0;
+
+	/**
+	 * GetKNearestIDs without the elements Skip returns true for, they do not take the K slots,
+	 * SkipHint - the expected skipped count fetched over K, the query is repeated wider if it was not enough,
+	 * Skip gets the element and the channels of the tag at Slot
+	 */
+	void GetKNearestIDs_Skip(
+		FVector Center,
+		int32 K,
+		Real MaxRadius,
+		TArray<ElementIndexType>& Out,
+		uint64 InBitChannels,
+		int32 SkipHint,
+		const FSenseSysTagSlot& Slot,
+		TFunctionRef<bool(const FSensedStimulus&, uint64 TagChannels)> Skip) const;
+	/** IDs of the elements whose bounds grown by Radius the segment Start - End enters, nearest entry first */
+	virtual void GetAlongSegmentIDs(FVector Start, FVector End, Real Radius, TArray<ElementIndexType>& Out, uint64 InBitChannels = MAX_uint64) const = 0;
+
+	/** box query narrowed to the cone, nodes outside the cone are skipped, elements are kept by their bounds */
+	virtual void GetInConeIDs(FBox Box, const FSenseSysCone& Cone, TArray<ElementIndexType>& Out, uint64 InBitChannels = MAX_uint64) const = 0;
+	virtual void GetInConeIDs(FBox Box, const FSenseSysCone& Cone, TSet<ElementIndexType>& Out, uint64 InBitChannels = MAX_uint64) const = 0;
+	virtual void GetInConeIDs(FBox Box, const FSenseSysCone& Cone, FSenseSysQueryIDs& Out, uint64 InBitChannels = MAX_uint64) const = 0;
+	/** as GetInConeIDs for the frustum planes */
+	virtual void GetInFrustumIDs(FBox Box, const FSenseSysFrustum& Frustum, TArray<ElementIndexType>& Out, uint64 InBitChannels = MAX_uint64) const = 0;
+	virtual void GetInFrustumIDs(FBox Box, const FSenseSysFrustum& Frustum, TSet<ElementIndexType>& Out, uint64 InBitChannels = MAX_uint64) const = 0;
+	virtual void GetInFrustumIDs(FBox Box, const FSenseSysFrustum& Frustum, FSenseSysQueryIDs& Out, uint64 InBitChannels = MAX_uint64) const = 0;
+
 	virtual FBox GetMaxIntersect(FBox Box) const = 0;
 
+	/** unique per tree instance, nonzero, a result kept with a stamp belongs to the tree of the same serial only */
+	FORCEINLINE uint32 GetSerial() const { return Serial; }
+	/** stamp of the last element change, read before a query and kept with its result, 0 for a tree without stamps */
+	virtual uint64 GetModStamp() const { return 0; }
+	/** false if no element that can touch Box was inserted, removed, moved or got new channels after Stamp, always true for a tree without stamps */
+	virtual bool IsChangedSince(FBox Box, uint64 Stamp) const { return true; }
+
 	virtual void DrawTree(const class UWorld* World, FTreeDrawSetup TreeNode, FTreeDrawSetup Link, FTreeDrawSetup ElemNode, float LifeTime) const {}
 	/** end virtual Tree */
 
 	FORCEINLINE int32 Num() const { return GetCompDataPool().Num(); }
 
-	FSensedStimulus GetSensedStimulusCopy_TS(ElementIndexType InObjID) const;
+	/** BitChannels of the copy are the channels of the tag at Slot */
+	FSensedStimulus GetSensedStimulusCopy_TS(ElementIndexType InObjID, const FSenseSysTagSlot& Slot = FSenseSysTagSlot()) const;
 	FSensedStimulus GetSensedStimulusCopy_Simple_TS(ElementIndexType InObjID) const;
 
 	/** TMap<Id, Hash> */
 	TArray<ElementIndexType> CheckHash_TS(const TMap<ElementIndexType, uint32>& InArr) const;
 	TArray<ElementIndexType, TMemStackAllocator<>> CheckHashStack_TS(const TMap<ElementIndexType, uint32>& InArr) const;
 	TSet<ElementIndexType> CheckHashSet_TS(const TMap<ElementIndexType, uint32>& InArr) const;
+	/** adds the IDs whose hash still matches */
+	void CheckHash_TS(const TMap<ElementIndexType, uint32>& InArr, FSenseSysQueryIDs& Out) const;
 
 	FORCEINLINE const FSensedStimulus& GetSensedStimulus(const ElementIndexType InObjID) const { return GetCompDataPool()[InObjID]; }
 	FORCEINLINE FSensedStimulus& GetSensedStimulus(const ElementIndexType InObjID) { return GetCompDataPool()[InObjID]; }
@@ -110,6 +407,8 @@ public:
 	void SetAge_TS(ElementIndexType ID, float AgeValue);
 	void SetScore_TS(ElementIndexType ID, float ScoreValue);
 	void SetChannels_TS(ElementIndexType ID, uint64 Channels);
+	/** replaces the channels of one tag in a shared element, returns the channels left for all tags, 0 - the element can be removed */
+	uint64 SetTagChannels_TS(ElementIndexType ID, const FSenseSysTagSlot& Slot, uint64 Channels);
 	void SetSensedPoints_TS(ElementIndexType ID, const TArray<FSensedPoint>& InSensedPoints, float InCurrentTime);
 	void SetSensedPoints_TS(ElementIndexType ID, const FSensedPoint& InSensedPoints, float InCurrentTime);
 
@@ -117,13 +416,17 @@ public:
 	void SetSensedPoints_TS(ElementIndexType ID, FSensedPoint&& InSensedPoints, float InCurrentTime);
 };
 
-/** QuadTree */
-class SENSESYSTEM_API FSenseSys_QuadTree final : public IContainerTree
+/**
+ * QuadTree
+ * TElementIdx - ObjID stored in the nodes, TNodeIdx - node index, uint16 or int32,
+ * 16 bit limits the tree to MAX_uint16 - 1 elements or nodes
+ */
+template<typename TElementIdx, typename TNodeIdx>
+class TSenseSys_QuadTree final : public IContainerTree
 {
 private:
 	using ElementIndexType = IContainerTree::ElementIndexType;
-	using TreeIndexType = IContainerTree::TreeIndexType;
-	using TreeType = TTree_Base<FSensedStimulus, FVector2D, ElementIndexType, TreeIndexType, 2U>;
+	using TreeType = TTree_Base<FSensedStimulus, FVector2D, TElementIdx, TNodeIdx, 2U>;
 	TreeType Tree;
 
 	virtual TSparseArray<FSensedStimulus>& GetCompDataPool() override { return Tree.GetElementPool(); }
@@ -132,19 +435,26 @@ private:
 public:
 	using Real = FVector::FReal;
 
-	explicit FSenseSys_QuadTree( //
+	explicit TSenseSys_QuadTree( //
 		const Real MinimumQuadSize,
 		const int32 InNodeCantSplit = 8,
 		const int32 OtCount = 128,
-		const int32 ObjCount = 128)
-		: Tree(MinimumQuadSize, InNodeCantSplit, OtCount, ObjCount)
+		const int32 ObjCount = 128,
+		const Real LooseFactor = 1.f)
+		: Tree(MinimumQuadSize, InNodeCantSplit, OtCount, ObjCount, LooseFactor)
 	{
 #if WITH_EDITOR
-		UE_LOG(LogSenseSys, Log, TEXT("SenseSys_QuadTree created"));
+		UE_LOG(
+			LogSenseSys,
+			Log,
+			TEXT("SenseSys_QuadTree created, LooseFactor: %f, ElementIndex: %d bit, NodeIndex: %d bit"),
+			Tree.GetLooseFactor(),
+			sizeof(TElementIdx) * 8,
+			sizeof(TNodeIdx) * 8);
 #endif
 	}
 
-	virtual ~FSenseSys_QuadTree() override { Clear(); }
+	virtual ~TSenseSys_QuadTree() override { Clear(); }
 
 
 	/**FStimulusTagResponse*/
@@ -152,8 +462,11 @@ public:
 	virtual ElementIndexType Insert(FSensedStimulus&& ComponentData, FBox InBox) override;
 	virtual ElementIndexType Insert(const FSensedStimulus& ComponentData, FBox InBox) override;
 	virtual void Update(ElementIndexType InObjID, FBox NewBox) override;
+	virtual void BulkInsert(TArray<FSensedStimulus>&& ComponentsData, const TArray<FBox>& InBoxes, TArray<ElementIndexType>& OutIDs) override;
+	virtual void UpdateBatch(const TArray<FUpdateItem>& Items) override;
 	virtual void Clear() override;
 	virtual void Collapse() override;
+	virtual void CollapseQueued(int32 Budget) override;
 
 	virtual void GetInBoxIDs(FBox Box, TArray<ElementIndexType>& Out, uint64 InBitChannels = MAX_uint64) const override;
 	virtual void GetInRadiusIDs(Real Radius, FVector Center, TArray<ElementIndexType>& Out, uint64 InBitChannels = MAX_uint64) const override;
@@ -163,65 +476,75 @@ public:
 	virtual void GetInRadiusIDs(Real Radius, FVector Center, TSet<ElementIndexType>& Out, uint64 InBitChannels = MAX_uint64) const override;
 	virtual void GetInBoxRadiusIDs(FBox Box, FVector Center, Real Radius, TSet<ElementIndexType>& Out, uint64 InBitChannels = MAX_uint64) const override;
 
+	virtual void GetInBoxIDs(FBox Box, FSenseSysQueryIDs& Out, uint64 InBitChannels = MAX_uint64) const override;
+	virtual void GetInRadiusIDs(Real Radius, FVector Center, FSenseSysQueryIDs& Out, uint64 InBitChannels = MAX_uint64) const override;
+	virtual void GetInBoxRadiusIDs(FBox Box, FVector Center, Real Radius, FSenseSysQueryIDs& Out, uint64 InBitChannels = MAX_uint64) const override;
+
+	virtual void GetInBoxRadiusIDsBatch(const TArray<FBatchQuery>& Queries, TArray<TArray<ElementIndexType>>& Out) const override;
+	virtual void GetKNearestIDs(FVector Center, int32 K, Real MaxRadius, TArray<ElementIndexType>& Out, uint64 InBitChannels = MAX_uint64) const override;
+	virtual void GetAlongSegmentIDs(FVector Start, FVector End, Real Radius, TArray<ElementIndexType>& Out, uint64 InBitChannels = MAX_uint64) const override;
+
+	virtual void GetInConeIDs(FBox Box, const FSenseSysCone& Cone, TArray<ElementIndexType>& Out, uint64 InBitChannels = MAX_uint64) const override;
+	virtual void GetInConeIDs(FBox Box, const FSenseSysCone& Cone, TSet<ElementIndexType>& Out, uint64 InBitChannels = MAX_uint64) const override;
+	virtual void GetInConeIDs(FBox Box, const FSenseSysCone& Cone, FSenseSysQueryIDs& Out, uint64 InBitChannels = MAX_uint64) const override;
+	virtual void GetInFrustumIDs(FBox Box, const FSenseSysFrustum& Frustum, TArray<ElementIndexType>& Out, uint64 InBitChannels = MAX_uint64) const override;
+	virtual void GetInFrustumIDs(FBox Box, const FSenseSysFrustum& Frustum, TSet<ElementIndexType>& Out, uint64 InBitChannels = MAX_uint64) const override;
+	virtual void GetInFrustumIDs(FBox Box, const FSenseSysFrustum& Frustum, FSenseSysQueryIDs& Out, uint64 InBitChannels = MAX_uint64) const override;
+
 	virtual void DrawTree(const class UWorld* World, FTreeDrawSetup TreeNode, FTreeDrawSetup Link, FTreeDrawSetup ElemNode, float LifeTime) const override;
 
 	virtual FBox GetMaxIntersect(FBox Box) const override;
 
-private:
-	struct FInRadiusPredicate
-	{
-		FInRadiusPredicate(const TreeType& InTree, const FVector& InCenter, const Real InRadius, const FBox2D& InBox, const uint64 InBitChannels = MAX_uint64)
-			: Tree(InTree)
-			, Center(InCenter)
-			, Radius(InRadius)
-			, Box(InBox)
-			, BitChannels(InBitChannels)
-		{}
-		FInRadiusPredicate(const TreeType& InTree, const FVector& InCenter, const Real InRadius, const uint64 InBitChannels = MAX_uint64)
-			: Tree(InTree)
-			, Center(InCenter)
-			, Radius(InRadius)
-			, Box(FBox2D(FVector2D(Center.X - InRadius, Center.Y - InRadius), FVector2D(Center.X + InRadius, Center.Y + InRadius)))
-			, BitChannels(InBitChannels)
-		{}
+	virtual uint64 GetModStamp() const override;
+	virtual bool IsChangedSince(FBox Box, uint64 Stamp) const override;
 
-		FORCEINLINE bool operator()(const ElementIndexType ObjID) const
-		{
-			const auto& B = Tree.GetElementBox(ObjID);
-			return B.IsIntersect(Box.Min, Box.Max) && B.SphereAABBIntersection(Center, Radius) && (BitChannels & Tree.GetElement(ObjID).BitChannels);
-		}
-
-		const TreeType& Tree;
-		const FVector2D Center;
-		const Real Radius;
-		const FBox2D Box;
-		const uint64 BitChannels;
-	};
+private:
+	using FElementQuery = typename TreeType::FElementQuery;
+	static constexpr int32 MaxElements = TNumericLimits<TElementIdx>::Max();
 
-	struct FInBoxPredicate
+	/** the circle is tested on XY, the Z range of the query box or sphere prunes the nodes and elements */
+	static FORCEINLINE FElementQuery MakeBoxQuery(const FBox& Box, const uint64 InBitChannels)
 	{
-		FInBoxPredicate(const TreeType& InQt, const FBox2D& InBox, const uint64 InBitChannels = MAX_uint64) : Tree(InQt), Box(InBox), BitChannels(InBitChannels)
-		{}
+		FElementQuery Query(TreeHelper::ToBox2D(Box), InBitChannels);
+		Query.ZRange = FTreeZRange(Box);
+		return Query;
+	}
+	static FORCEINLINE FElementQuery MakeRadiusQuery(const Real Radius, const FVector& Center, const uint64 InBitChannels)
+	{
+		const FVector2D Center2D = FVector2D(Center);
+		FElementQuery Query(TreeType::BoxType::BuildAABB(Center2D, FVector2D(Radius)), Center2D, Radius, InBitChannels);
+		Query.ZRange = FTreeZRange(Center.Z - Radius, Center.Z + Radius);
+		return Query;
+	}
+	static FORCEINLINE FElementQuery MakeBoxRadiusQuery(const FBox& Box, const FVector& Center, const Real Radius, const uint64 InBitChannels)
+	{
+		FElementQuery Query(TreeHelper::ToBox2D(Box), FVector2D(Center), Radius, InBitChannels);
+		Query.ZRange = FTreeZRange(FMath::Max(Box.Min.Z, Center.Z - Radius), FMath::Min(Box.Max.Z, Center.Z + Radius));
+		return Query;
+	}
 
-		FORCEINLINE bool operator()(const ElementIndexType ObjID) const
-		{
-			const auto& B = Tree.GetElementBox(ObjID);
-			return B.IsIntersect(Box.Min, Box.Max) && (BitChannels & Tree.GetElement(ObjID).BitChannels);
-		}
+	/** VolumeType - FSenseSysCone or FSenseSysFrustum, node boxes are tested over the Z range of the query box, elements over their own Z range inside it */
+	template<typename VolumeType, typename ContainerType>
+	void GetInVolumeIDs(const FBox& Box, const VolumeType& Volume, uint64 InBitChannels, ContainerType& Out) const;
 
-		const TreeType& Tree;
-		const FBox2D Box;
-		const uint64 BitChannels;
-	};
+	virtual void SetElementChannels_Internal(const ElementIndexType ID, const uint64 Channels) override { Tree.SetElementMask(static_cast<TElementIdx>(ID), Channels); }
+	/** nodes in preorder, elements in the order of their nodes */
+	virtual void Compact_Internal(TArray<ElementIndexType>& OutRemap) override;
+	virtual void GetStats_Internal(FSenseSysTreeStats& OutStats) const override;
+	virtual void ResetStats_Internal() override { Tree.ResetCounters(); }
+	virtual void SetQueryCounting_Internal(const bool bCount) override { Tree.SetQueryCounting(bCount); }
+	virtual FRetuneBuildPtr BeginRetune_Internal(float MinimumSize, int32 NodeCantSplit) const override;
+	virtual bool FinishRetune_Internal(FRetuneBuild& Build) override;
+	virtual float GetMedianElementSize_Internal(int32 MaxSamples) const override;
 };
 
-/** OcTree */
-class SENSESYSTEM_API FSenseSys_OcTree final : public IContainerTree
+/** OcTree, index widths as TSenseSys_QuadTree */
+template<typename TElementIdx, typename TNodeIdx>
+class TSenseSys_OcTree final : public IContainerTree
 {
 private:
 	using ElementIndexType = IContainerTree::ElementIndexType;
-	using TreeIndexType = IContainerTree::TreeIndexType;
-	using TreeType = TTree_Base<FSensedStimulus, FVector, ElementIndexType, TreeIndexType, 3U>;
+	using TreeType = TTree_Base<FSensedStimulus, FVector, TElementIdx, TNodeIdx, 3U>;
 	TreeType Tree;
 
 	virtual TSparseArray<FSensedStimulus>& GetCompDataPool() override { return Tree.GetElementPool(); }
@@ -230,27 +553,37 @@ private:
 public:
 	using Real = FVector::FReal;
 
-	explicit FSenseSys_OcTree( //
+	explicit TSenseSys_OcTree( //
 		const Real MinimumCubeSize,
 		const int32 InNodeCantSplit = 8,
 		const int32 OtCount = 128,
-		const int32 ObjCount = 128)
-		: Tree(MinimumCubeSize, InNodeCantSplit, OtCount, ObjCount)
+		const int32 ObjCount = 128,
+		const Real LooseFactor = 1.f)
+		: Tree(MinimumCubeSize, InNodeCantSplit, OtCount, ObjCount, LooseFactor)
 	{
 #if WITH_EDITOR
-		UE_LOG(LogSenseSys, Log, TEXT("SenseSys_OcTree created"));
+		UE_LOG(
+			LogSenseSys,
+			Log,
+			TEXT("SenseSys_OcTree created, LooseFactor: %f, ElementIndex: %d bit, NodeIndex: %d bit"),
+			Tree.GetLooseFactor(),
+			sizeof(TElementIdx) * 8,
+			sizeof(TNodeIdx) * 8);
 #endif
 	}
 
-	virtual ~FSenseSys_OcTree() override { Clear(); }
+	virtual ~TSenseSys_OcTree() override { Clear(); }
 
 
 	virtual bool Remove(ElementIndexType InObjID) override;
 	virtual ElementIndexType Insert(FSensedStimulus&& ComponentData, FBox InBox) override;
 	virtual ElementIndexType Insert(const FSensedStimulus& ComponentData, FBox InBox) override;
 	virtual void Update(ElementIndexType InObjID, FBox NewBox) override;
+	virtual void BulkInsert(TArray<FSensedStimulus>&& ComponentsData, const TArray<FBox>& InBoxes, TArray<ElementIndexType>& OutIDs) override;
+	virtual void UpdateBatch(const TArray<FUpdateItem>& Items) override;
 	virtual void Clear() override;
 	virtual void Collapse() override;
+	virtual void CollapseQueued(int32 Budget) override;
 
 	virtual void GetInBoxIDs(FBox Box, TArray<ElementIndexType>& Out, uint64 InBitChannels = MAX_uint64) const override;
 	virtual void GetInRadiusIDs(Real Radius, FVector Center, TArray<ElementIndexType>& Out, uint64 InBitChannels = MAX_uint64) const override;
@@ -260,60 +593,893 @@ public:
 	virtual void GetInRadiusIDs(Real Radius, FVector Center, TSet<ElementIndexType>& Out, uint64 InBitChannels = MAX_uint64) const override;
 	virtual void GetInBoxRadiusIDs(FBox Box, FVector Center, Real Radius, TSet<ElementIndexType>& Out, uint64 InBitChannels = MAX_uint64) const override;
 
+	virtual void GetInBoxIDs(FBox Box, FSenseSysQueryIDs& Out, uint64 InBitChannels = MAX_uint64) const override;
+	virtual void GetInRadiusIDs(Real Radius, FVector Center, FSenseSysQueryIDs& Out, uint64 InBitChannels = MAX_uint64) const override;
+	virtual void GetInBoxRadiusIDs(FBox Box, FVector Center, Real Radius, FSenseSysQueryIDs& Out, uint64 InBitChannels = MAX_uint64) const override;
+
+	virtual void GetInBoxRadiusIDsBatch(const TArray<FBatchQuery>& Queries, TArray<TArray<ElementIndexType>>& Out) const override;
+	virtual void GetKNearestIDs(FVector Center, int32 K, Real MaxRadius, TArray<ElementIndexType>& Out, uint64 InBitChannels = MAX_uint64) const override;
+	virtual void GetAlongSegmentIDs(FVector Start, FVector End, Real Radius, TArray<ElementIndexType>& Out, uint64 InBitChannels = MAX_uint64) const override;
+
+	virtual void GetInConeIDs(FBox Box, const FSenseSysCone& Cone, TArray<ElementIndexType>& Out, uint64 InBitChannels = MAX_uint64) const override;
+	virtual void GetInConeIDs(FBox Box, const FSenseSysCone& Cone, TSet<ElementIndexType>& Out, uint64 InBitChannels = MAX_uint64) const override;
+	virtual void GetInConeIDs(FBox Box, const FSenseSysCone& Cone, FSenseSysQueryIDs& Out, uint64 InBitChannels = MAX_uint64) const override;
+	virtual void GetInFrustumIDs(FBox Box, const FSenseSysFrustum& Frustum, TArray<ElementIndexType>& Out, uint64 InBitChannels = MAX_uint64) const override;
+	virtual void GetInFrustumIDs(FBox Box, const FSenseSysFrustum& Frustum, TSet<ElementIndexType>& Out, uint64 InBitChannels = MAX_uint64) const override;
+	virtual void GetInFrustumIDs(FBox Box, const FSenseSysFrustum& Frustum, FSenseSysQueryIDs& Out, uint64 InBitChannels = MAX_uint64) const override;
+
 	virtual void DrawTree(const class UWorld* World, FTreeDrawSetup TreeNode, FTreeDrawSetup Link, FTreeDrawSetup ElemNode, float LifeTime) const override;
 
 	virtual FBox GetMaxIntersect(FBox Box) const override;
 
+	virtual uint64 GetModStamp() const override;
+	virtual bool IsChangedSince(FBox Box, uint64 Stamp) const override;
+
 private:
-	struct FInRadiusPredicate
-	{
-		FInRadiusPredicate(const TreeType& InTree, const FVector& InCenter, const Real InRadius, const uint64 InBitChannels = MAX_uint64)
-			: Tree(InTree)
-			, Center(InCenter)
-			, RSquared(InRadius * InRadius)
-			, Box(FBox(
-				  FVector(Center.X - InRadius, Center.Y - InRadius, Center.Z - InRadius),
-				  FVector(Center.X + InRadius, Center.Y + InRadius, Center.Z + InRadius)))
-			, BitChannels(InBitChannels)
-		{}
+	using FElementQuery = typename TreeType::FElementQuery;
+	static constexpr int32 MaxElements = TNumericLimits<TElementIdx>::Max();
 
-		FInRadiusPredicate(const TreeType& InTree, const FVector& InCenter, const Real InRadius, const FBox& Box, const uint64 InBitChannels = MAX_uint64)
-			: Tree(InTree)
-			, Center(InCenter)
-			, RSquared(InRadius * InRadius)
-			, Box(Box)
-			, BitChannels(InBitChannels)
-		{}
+	static FORCEINLINE FElementQuery MakeBoxQuery(const FBox& Box, const uint64 InBitChannels) { return FElementQuery(Box, InBitChannels); }
+	static FORCEINLINE FElementQuery MakeRadiusQuery(const Real Radius, const FVector& Center, const uint64 InBitChannels)
+	{
+		return FElementQuery(TreeType::BoxType::BuildAABB(Center, FVector(Radius)), Center, Radius, InBitChannels);
+	}
+	static FORCEINLINE FElementQuery MakeBoxRadiusQuery(const FBox& Box, const FVector& Center, const Real Radius, const uint64 InBitChannels)
+	{
+		return FElementQuery(Box, Center, Radius, InBitChannels);
+	}
+
+	/** VolumeType - FSenseSysCone or FSenseSysFrustum */
+	template<typename VolumeType, typename ContainerType>
+	void GetInVolumeIDs(const FBox& Box, const VolumeType& Volume, uint64 InBitChannels, ContainerType& Out) const;
+
+	virtual void SetElementChannels_Internal(const ElementIndexType ID, const uint64 Channels) override { Tree.SetElementMask(static_cast<TElementIdx>(ID), Channels); }
+	/** nodes in preorder, elements in the order of their nodes */
+	virtual void Compact_Internal(TArray<ElementIndexType>& OutRemap) override;
+	virtual void GetStats_Internal(FSenseSysTreeStats& OutStats) const override;
+	virtual void ResetStats_Internal() override { Tree.ResetCounters(); }
+	virtual void SetQueryCounting_Internal(const bool bCount) override { Tree.SetQueryCounting(bCount); }
+	virtual FRetuneBuildPtr BeginRetune_Internal(float MinimumSize, int32 NodeCantSplit) const override;
+	virtual bool FinishRetune_Internal(FRetuneBuild& Build) override;
+	virtual float GetMedianElementSize_Internal(int32 MaxSamples) const override;
+};
+
+/**
+ * HashGrid
+ * uniform XY grid for dense evenly spread stimuli, no split or collapse of nodes.
+ * each element is stored in the cell of its center, queries are inflated by the largest element half size,
+ * Insert Update Remove are O(1), TElementIdx - ObjID stored in the cells, uint16 or int32
+ */
+template<typename TElementIdx>
+class TSenseSys_HashGrid final : public IContainerTree
+{
+private:
+	using ElementIndexType = IContainerTree::ElementIndexType;
+	static constexpr int32 MaxElements = TNumericLimits<TElementIdx>::Max();
+
+	struct FGridElement
+	{
+		FBox Box = FBox(ForceInit);
+		uint64 Mask = MAX_uint64;
+		int32 CellIdx = INDEX_NONE;
+		/** index in FGridCell::IDs */
+		int32 Slot = INDEX_NONE;
+	};
+
+	struct FGridCell
+	{
+		explicit FGridCell(const FIntPoint InCoord) : Coord(InCoord) {}
+		FIntPoint Coord;
+		TArray<TElementIdx> IDs;
+	};
+
+	TSparseArray<FSensedStimulus> ElementPool;
+	/** indexed by ObjID */
+	TArray<FGridElement> Elements;
+	TSparseArray<FGridCell> Cells;
+	TMap<FIntPoint, int32> CellMap;
+	/** cells emptied by RemoveFromCell, may be refilled or reused before CollapseQueued */
+	TArray<int32> EmptyCells;
+	/** a new cell counts as a split, a dropped one as a collapse, a move to another cell as a reinsert */
+	mutable FTreeCounters Counters;
+
+	virtual TSparseArray<FSensedStimulus>& GetCompDataPool() override { return ElementPool; }
+	virtual const TSparseArray<FSensedStimulus>& GetCompDataPool() const override { return ElementPool; }
+
+public:
+	using Real = FVector::FReal;
+
+	explicit TSenseSys_HashGrid(const Real InCellSize, const int32 ObjCount = 128)
+		: CellSize(FMath::Max<Real>(InCellSize, 1.f))
+	{
+		ElementPool.Reserve(ObjCount);
+		Elements.Reserve(ObjCount);
+#if WITH_EDITOR
+		UE_LOG(LogSenseSys, Log, TEXT("SenseSys_HashGrid created, CellSize: %f"), CellSize);
+#endif
+	}
+
+	virtual ~TSenseSys_HashGrid() override { Clear(); }
+
+
+	virtual bool Remove(ElementIndexType InObjID) override;
+	virtual ElementIndexType Insert(FSensedStimulus&& ComponentData, FBox InBox) override;
+	virtual ElementIndexType Insert(const FSensedStimulus& ComponentData, FBox InBox) override;
+	virtual void Update(ElementIndexType InObjID, FBox NewBox) override;
+	virtual void BulkInsert(TArray<FSensedStimulus>&& ComponentsData, const TArray<FBox>& InBoxes, TArray<ElementIndexType>& OutIDs) override;
+	virtual void UpdateBatch(const TArray<FUpdateItem>& Items) override;
+	virtual void Clear() override;
+	/** drops empty cells and recomputes the query margin */
+	virtual void Collapse() override;
+	/** drops up to Budget emptied cells, the query margin is rescanned over several calls */
+	virtual void CollapseQueued(int32 Budget) override;
+
+	virtual void GetInBoxIDs(FBox Box, TArray<ElementIndexType>& Out, uint64 InBitChannels = MAX_uint64) const override;
+	virtual void GetInRadiusIDs(Real Radius, FVector Center, TArray<ElementIndexType>& Out, uint64 InBitChannels = MAX_uint64) const override;
+	virtual void GetInBoxRadiusIDs(FBox Box, FVector Center, Real Radius, TArray<ElementIndexType>& Out, uint64 InBitChannels = MAX_uint64) const override;
+
+	virtual void GetInBoxIDs(FBox Box, TSet<ElementIndexType>& Out, uint64 InBitChannels = MAX_uint64) const override;
+	virtual void GetInRadiusIDs(Real Radius, FVector Center, TSet<ElementIndexType>& Out, uint64 InBitChannels = MAX_uint64) const override;
+	virtual void GetInBoxRadiusIDs(FBox Box, FVector Center, Real Radius, TSet<ElementIndexType>& Out, uint64 InBitChannels = MAX_uint64) const override;
+
+	virtual void GetInBoxIDs(FBox Box, FSenseSysQueryIDs& Out, uint64 InBitChannels = MAX_uint64) const override;
+	virtual void GetInRadiusIDs(Real Radius, FVector Center, FSenseSysQueryIDs& Out, uint64 InBitChannels = MAX_uint64) const override;
+	virtual void GetInBoxRadiusIDs(FBox Box, FVector Center, Real Radius, FSenseSysQueryIDs& Out, uint64 InBitChannels = MAX_uint64) const override;
+
+	virtual void GetInBoxRadiusIDsBatch(const TArray<FBatchQuery>& Queries, TArray<TArray<ElementIndexType>>& Out) const override;
+	virtual void GetKNearestIDs(FVector Center, int32 K, Real MaxRadius, TArray<ElementIndexType>& Out, uint64 InBitChannels = MAX_uint64) const override;
+	virtual void GetAlongSegmentIDs(FVector Start, FVector End, Real Radius, TArray<ElementIndexType>& Out, uint64 InBitChannels = MAX_uint64) const override;
+
+	virtual void GetInConeIDs(FBox Box, const FSenseSysCone& Cone, TArray<ElementIndexType>& Out, uint64 InBitChannels = MAX_uint64) const override;
+	virtual void GetInConeIDs(FBox Box, const FSenseSysCone& Cone, TSet<ElementIndexType>& Out, uint64 InBitChannels = MAX_uint64) const override;
+	virtual void GetInConeIDs(FBox Box, const FSenseSysCone& Cone, FSenseSysQueryIDs& Out, uint64 InBitChannels = MAX_uint64) const override;
+	virtual void GetInFrustumIDs(FBox Box, const FSenseSysFrustum& Frustum, TArray<ElementIndexType>& Out, uint64 InBitChannels = MAX_uint64) const override;
+	virtual void GetInFrustumIDs(FBox Box, const FSenseSysFrustum& Frustum, TSet<ElementIndexType>& Out, uint64 InBitChannels = MAX_uint64) const override;
+	virtual void GetInFrustumIDs(FBox Box, const FSenseSysFrustum& Frustum, FSenseSysQueryIDs& Out, uint64 InBitChannels = MAX_uint64) const override;
+
+	virtual void DrawTree(const class UWorld* World, FTreeDrawSetup TreeNode, FTreeDrawSetup Link, FTreeDrawSetup ElemNode, float LifeTime) const override;
+
+	virtual FBox GetMaxIntersect(FBox Box) const override;
+
+	FORCEINLINE Real GetCellSize() const { return CellSize; }
+
+private:
+	const Real CellSize;
+	/** largest element half size on XY, elements are found from the cells of their centers */
+	Real QueryMargin = 0.f;
+	/** CollapseQueued margin rescan, ScanMargin replaces QueryMargin once MarginScanIdx passes all elements */
+	Real ScanMargin = 0.f;
+	int32 MarginScanIdx = INDEX_NONE;
+	bool bMarginDirty = false;
+
+	/** cells past it are merged into the border cell, ring and range arithmetic around a coordinate stays in int32 */
+	static constexpr Real MaxCellCoord = MAX_int32 / 4;
+
+	/** Location / CellSize floored on each axis, clamped to MaxCellCoord before the int conversion */
+	FORCEINLINE FVector2D GetCellCoordReal(const FVector& Location) const
+	{
+		return FVector2D(
+			FMath::Clamp<Real>(FMath::FloorToDouble(Location.X / CellSize), -MaxCellCoord, MaxCellCoord),
+			FMath::Clamp<Real>(FMath::FloorToDouble(Location.Y / CellSize), -MaxCellCoord, MaxCellCoord));
+	}
+	FORCEINLINE FIntPoint GetCellCoord(const FVector& Location) const
+	{
+		const FVector2D Coord = GetCellCoordReal(Location);
+		return FIntPoint(static_cast<int32>(Coord.X), static_cast<int32>(Coord.Y));
+	}
+	FORCEINLINE FBox GetCellBox(const FIntPoint Coord, const Real MinZ, const Real MaxZ) const
+	{
+		return FBox(FVector(Coord.X * CellSize, Coord.Y * CellSize, MinZ), FVector((Coord.X + 1) * CellSize, (Coord.Y + 1) * CellSize, MaxZ));
+	}
+
+	void Insert_Internal(ElementIndexType ObjID, const FBox& InBox, uint64 Channels);
+	void Update_Internal(ElementIndexType ObjID, const FBox& NewBox);
+	void AddToCell(ElementIndexType ObjID, FIntPoint Coord);
+	void RemoveFromCell(ElementIndexType ObjID);
+
+	/** calls CellLambda(const FGridCell&) for the filled cells that may hold elements overlapping Box */
+	template<typename CellLambdaType>
+	void ForEachQueryCell(const FBox& Box, CellLambdaType CellLambda) const;
+
+	/** Radius < 0 - box test only */
+	template<typename ContainerType>
+	void GetElementsIDs(const FBox& Box, const FVector& Center, Real Radius, uint64 InBitChannels, ContainerType& Out) const;
+	/** VolumeType - FSenseSysCone or FSenseSysFrustum, cells are tested with the query margin over the Z range of the box */
+	template<typename VolumeType, typename ContainerType>
+	void GetInVolumeIDs(const FBox& Box, const VolumeType& Volume, uint64 InBitChannels, ContainerType& Out) const;
+
+	virtual void SetElementChannels_Internal(const ElementIndexType ID, const uint64 Channels) override { Elements[ID].Mask = Channels; }
+	/** drops the empty cells, elements in the order of their cells */
+	virtual void Compact_Internal(TArray<ElementIndexType>& OutRemap) override;
+	/** a cell is a leaf at depth 0 */
+	virtual void GetStats_Internal(FSenseSysTreeStats& OutStats) const override;
+	virtual void ResetStats_Internal() override { Counters.Reset(); }
+	virtual void SetQueryCounting_Internal(const bool bCount) override { Counters.bCountQueries = bCount; }
+};
+
+/**
+ * LinearTree
+ * OcTree (Dim 3) or QuadTree (Dim 2) in flat arrays, elements are sorted by the Morton code of their center
+ * and nodes are stored in preorder, a node holds the contiguous range of its subtree, queries walk the nodes without a stack.
+ * Insert and moves out of the leaf bounds go to a pending list scanned by every query, Collapse rebuilds from the sorted codes.
+ * TElementIdx - ObjID stored in the sorted array, uint16 or int32
+ */
+template<typename TElementIdx, uint32 Dim>
+class TSenseSys_LinearTree final : public IContainerTree
+{
+private:
+	static_assert(Dim == 2 || Dim == 3, "TSenseSys_LinearTree: Dim error");
+	using ElementIndexType = IContainerTree::ElementIndexType;
+	static constexpr int32 MaxElements = TNumericLimits<TElementIdx>::Max();
+	/** Morton code bits per axis, 30 bit code for Dim 3, 32 bit for Dim 2 */
+	static constexpr int32 AxisBits = 32 / Dim;
+	/** CollapseQueued rebuilds once the pending and cleared slots pass 1 / RebuildShare of the sorted ones */
+	static constexpr int32 RebuildShare = 8;
+
+	struct FLinearElement
+	{
+		FBox Box = FBox(ForceInit);
+		uint64 Mask = MAX_uint64;
+		/** leaf of the sorted slot, INDEX_NONE while pending */
+		int32 NodeIdx = INDEX_NONE;
+		/** index in the sorted arrays, or in Pending while NodeIdx is INDEX_NONE */
+		int32 Slot = INDEX_NONE;
+	};
+
+	struct FLinearNode
+	{
+		/** bounds of the subtree elements, leaves are inflated by LeafMargin */
+		FBox Bounds = FBox(ForceInit);
+		uint64 ChannelMask = 0;
+		/** subtree range in the sorted arrays */
+		int32 Begin = 0;
+		int32 End = 0;
+		/** next node after the subtree, Skip == index + 1 for a leaf */
+		int32 Skip = 0;
+	};
+
+	TSparseArray<FSensedStimulus> ElementPool;
+	/** indexed by ObjID */
+	TArray<FLinearElement> Elements;
+
+	/** sorted by Morton code, the mask of a removed or moved out slot is 0 */
+	TArray<TElementIdx> SortedIDs;
+	TArray<FBox> SortedBoxes;
+	TArray<uint64> SortedMasks;
+	/** preorder, Nodes[0] is the root */
+	TArray<FLinearNode> Nodes;
+
+	/** inserted or moved out of the leaf since the last rebuild */
+	TArray<TElementIdx> Pending;
+	/** sorted slots cleared since the last rebuild */
+	int32 DeadCount = 0;
+	/** a rebuild counts as a collapse, a move to the pending list as a reinsert, nodes are never split */
+	mutable FTreeCounters Counters;
+
+	virtual TSparseArray<FSensedStimulus>& GetCompDataPool() override { return ElementPool; }
+	virtual const TSparseArray<FSensedStimulus>& GetCompDataPool() const override { return ElementPool; }
+
+public:
+	using Real = FVector::FReal;
+
+	explicit TSenseSys_LinearTree(const Real InMinimumQuadSize, const int32 InNodeCantSplit = 8, const int32 ObjCount = 128)
+		: MinimumQuadSize(FMath::Max<Real>(InMinimumQuadSize, 1.f))
+		, NodeCantSplit(FMath::Max(InNodeCantSplit, 1))
+		, LeafMargin(MinimumQuadSize / 4.f)
+	{
+		ElementPool.Reserve(ObjCount);
+		Elements.Reserve(ObjCount);
+#if WITH_EDITOR
+		UE_LOG(LogSenseSys, Log, TEXT("SenseSys_LinearTree created, Dim: %d, MinimumQuadSize: %f"), Dim, MinimumQuadSize);
+#endif
+	}
+
+	virtual ~TSenseSys_LinearTree() override { Clear(); }
+
+
+	virtual bool Remove(ElementIndexType InObjID) override;
+	virtual ElementIndexType Insert(FSensedStimulus&& ComponentData, FBox InBox) override;
+	virtual ElementIndexType Insert(const FSensedStimulus& ComponentData, FBox InBox) override;
+	virtual void Update(ElementIndexType InObjID, FBox NewBox) override;
+	/** adds the elements and rebuilds the sorted arrays once */
+	virtual void BulkInsert(TArray<FSensedStimulus>&& ComponentsData, const TArray<FBox>& InBoxes, TArray<ElementIndexType>& OutIDs) override;
+	virtual void UpdateBatch(const TArray<FUpdateItem>& Items) override;
+	virtual void Clear() override;
+	/** rebuild if anything is pending or removed */
+	virtual void Collapse() override;
+	/** rebuild once the pending and removed entries exceed Budget */
+	virtual void CollapseQueued(int32 Budget) override;
 
-		FORCEINLINE bool operator()(const ElementIndexType ObjID) const
+	virtual void GetInBoxIDs(FBox Box, TArray<ElementIndexType>& Out, uint64 InBitChannels = MAX_uint64) const override;
+	virtual void GetInRadiusIDs(Real Radius, FVector Center, TArray<ElementIndexType>& Out, uint64 InBitChannels = MAX_uint64) const override;
+	virtual void GetInBoxRadiusIDs(FBox Box, FVector Center, Real Radius, TArray<ElementIndexType>& Out, uint64 InBitChannels = MAX_uint64) const override;
+
+	virtual void GetInBoxIDs(FBox Box, TSet<ElementIndexType>& Out, uint64 InBitChannels = MAX_uint64) const override;
+	virtual void GetInRadiusIDs(Real Radius, FVector Center, TSet<ElementIndexType>& Out, uint64 InBitChannels = MAX_uint64) const override;
+	virtual void GetInBoxRadiusIDs(FBox Box, FVector Center, Real Radius, TSet<ElementIndexType>& Out, uint64 InBitChannels = MAX_uint64) const override;
+
+	virtual void GetInBoxIDs(FBox Box, FSenseSysQueryIDs& Out, uint64 InBitChannels = MAX_uint64) const override;
+	virtual void GetInRadiusIDs(Real Radius, FVector Center, FSenseSysQueryIDs& Out, uint64 InBitChannels = MAX_uint64) const override;
+	virtual void GetInBoxRadiusIDs(FBox Box, FVector Center, Real Radius, FSenseSysQueryIDs& Out, uint64 InBitChannels = MAX_uint64) const override;
+
+	virtual void GetInBoxRadiusIDsBatch(const TArray<FBatchQuery>& Queries, TArray<TArray<ElementIndexType>>& Out) const override;
+	virtual void GetKNearestIDs(FVector Center, int32 K, Real MaxRadius, TArray<ElementIndexType>& Out, uint64 InBitChannels = MAX_uint64) const override;
+	virtual void GetAlongSegmentIDs(FVector Start, FVector End, Real Radius, TArray<ElementIndexType>& Out, uint64 InBitChannels = MAX_uint64) const override;
+
+	virtual void GetInConeIDs(FBox Box, const FSenseSysCone& Cone, TArray<ElementIndexType>& Out, uint64 InBitChannels = MAX_uint64) const override;
+	virtual void GetInConeIDs(FBox Box, const FSenseSysCone& Cone, TSet<ElementIndexType>& Out, uint64 InBitChannels = MAX_uint64) const override;
+	virtual void GetInConeIDs(FBox Box, const FSenseSysCone& Cone, FSenseSysQueryIDs& Out, uint64 InBitChannels = MAX_uint64) const override;
+	virtual void GetInFrustumIDs(FBox Box, const FSenseSysFrustum& Frustum, TArray<ElementIndexType>& Out, uint64 InBitChannels = MAX_uint64) const override;
+	virtual void GetInFrustumIDs(FBox Box, const FSenseSysFrustum& Frustum, TSet<ElementIndexType>& Out, uint64 InBitChannels = MAX_uint64) const override;
+	virtual void GetInFrustumIDs(FBox Box, const FSenseSysFrustum& Frustum, FSenseSysQueryIDs& Out, uint64 InBitChannels = MAX_uint64) const override;
+
+	virtual void DrawTree(const class UWorld* World, FTreeDrawSetup TreeNode, FTreeDrawSetup Link, FTreeDrawSetup ElemNode, float LifeTime) const override;
+
+	virtual FBox GetMaxIntersect(FBox Box) const override;
+
+private:
+	const Real MinimumQuadSize;
+	const int32 NodeCantSplit;
+	/** leaf bounds inflation, updates inside the leaf bounds keep the sorted slot */
+	const Real LeafMargin;
+	/** depth of MinimumQuadSize cells in the last rebuild */
+	int32 MaxDepth = 0;
+
+	/** Dim 2 ignores Z */
+	static FORCEINLINE bool IntersectBox(const FBox& A, const FBox& B)
+	{
+		for (int32 j = 0; j < static_cast<int32>(Dim); ++j)
+		{
+			if (A.Min[j] > B.Max[j] || B.Min[j] > A.Max[j])
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+	static FORCEINLINE bool IsInsideBox(const FBox& Outer, const FBox& Inner)
+	{
+		for (int32 j = 0; j < static_cast<int32>(Dim); ++j)
+		{
+			if (Inner.Min[j] < Outer.Min[j] || Inner.Max[j] > Outer.Max[j])
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+	static FORCEINLINE Real DistSquared(const FBox& Box, const FVector& Point)
+	{
+		Real Out = 0.f;
+		for (int32 j = 0; j < static_cast<int32>(Dim); ++j)
+		{
+			const Real D = Point[j] < Box.Min[j] ? Box.Min[j] - Point[j] : (Point[j] > Box.Max[j] ? Point[j] - Box.Max[j] : 0.f);
+			Out += D * D;
+		}
+		return Out;
+	}
+	/** Dim 2 boxes get the Z range of the query box */
+	static FORCEINLINE FBox LiftBox(const FBox& InBox, const FBox& QueryBox)
+	{
+		IF_CONSTEXPR(Dim == 2)
 		{
-			const auto& B = Tree.GetElementBox(ObjID);
-			return B.IsIntersect(Box.Min, Box.Max) && B.SphereAABBIntersection(Center, RSquared) && (BitChannels & Tree.GetElement(ObjID).BitChannels);
+			return FBox(FVector(InBox.Min.X, InBox.Min.Y, QueryBox.Min.Z), FVector(InBox.Max.X, InBox.Max.Y, QueryBox.Max.Z));
 		}
+		return InBox;
+	}
+
+	void Insert_Internal(ElementIndexType ObjID, const FBox& InBox, uint64 Channels);
+	void Update_Internal(ElementIndexType ObjID, const FBox& NewBox);
+	void AddToPending(ElementIndexType ObjID);
+	void RemoveFromPending(ElementIndexType ObjID);
+	/** clears the sorted slot and queues the element as pending */
+	void MoveToPending(ElementIndexType ObjID);
 
-		const TreeType& Tree;
-		const FVector Center;
-		const Real RSquared;
-		const FBox Box;
-		const uint64 BitChannels;
+	/** sorts all elements by Morton code and rebuilds the nodes, write lock must be held */
+	void Rebuild_Internal();
+	/** preorder node of the sorted range, Depth - levels of the code shared by the range */
+	int32 BuildNode(const TArray<uint32>& Codes, int32 Begin, int32 End, int32 Depth);
+
+	/** NodeTest(const FBox& Bounds), ElemTest(const FBox& ElemBox), adds sorted and pending IDs that pass both */
+	template<typename NodeTestType, typename ElemTestType, typename ContainerType>
+	void GetElementsIDs(uint64 InBitChannels, NodeTestType NodeTest, ElemTestType ElemTest, ContainerType& Out) const;
+	/** Radius < 0 - box test only */
+	template<typename ContainerType>
+	void GetInBoxRadiusIDs_Internal(const FBox& Box, const FVector& Center, Real Radius, uint64 InBitChannels, ContainerType& Out) const;
+	/** VolumeType - FSenseSysCone or FSenseSysFrustum */
+	template<typename VolumeType, typename ContainerType>
+	void GetInVolumeIDs(const FBox& Box, const VolumeType& Volume, uint64 InBitChannels, ContainerType& Out) const;
+
+	virtual void SetElementChannels_Internal(ElementIndexType ID, uint64 Channels) override;
+	/** rebuilds, elements in Morton order */
+	virtual void Compact_Internal(TArray<ElementIndexType>& OutRemap) override;
+	/** pending elements are counted in NumElements only */
+	virtual void GetStats_Internal(FSenseSysTreeStats& OutStats) const override;
+	virtual void ResetStats_Internal() override { Counters.Reset(); }
+	virtual void SetQueryCounting_Internal(const bool bCount) override { Counters.bCountQueries = bCount; }
+};
+
+/**
+ * TiledTree
+ * sparse XY grid of OcTree (Dim 3) or QuadTree (Dim 2) roots, each tile tree keeps the element boxes in float
+ * relative to the tile origin, so the boxes are half the size and the node depth follows the tile instead of the map.
+ * an element lives in the tile of its center, queries are inflated by the largest element half size as in the HashGrid.
+ * world origin shifts move the tile origins only, TElementIdx - ObjID and tile local ID, uint16 or int32
+ */
+template<typename TElementIdx, uint32 Dim>
+class TSenseSys_TiledTree final : public IContainerTree
+{
+private:
+	static_assert(Dim == 2 || Dim == 3, "TSenseSys_TiledTree: Dim error");
+	using ElementIndexType = IContainerTree::ElementIndexType;
+	static constexpr int32 MaxElements = TNumericLimits<TElementIdx>::Max();
+
+	using PointType = typename TChooseClass<Dim == 3, FVector3f, FVector2f>::Result;
+	/** the tile tree stores the ObjID as its element, its local IDs are not ObjIDs */
+	using TileTreeType = TTree_Base<TElementIdx, PointType, TElementIdx, int32, Dim>;
+	using TileBoxType = typename TileTreeType::BoxType;
+	using FElementQuery = typename TileTreeType::FElementQuery;
+
+	struct FTiledElement
+	{
+		int32 TileIdx = INDEX_NONE;
+		TElementIdx LocalID = TNumericLimits<TElementIdx>::Max();
 	};
 
-	struct FInBoxPredicate
+	struct FTile
 	{
-		FInBoxPredicate(const TreeType& InTree, const FBox& InBox, const uint64 InBitChannels = MAX_uint64)
-			: Tree(InTree)
-			, Box(InBox)
-			, BitChannels(InBitChannels)
+		FTile(const FIntPoint InCoord, const FVector& InOrigin, const float MinimumQuadSize, const int32 NodeCantSplit)
+			: Coord(InCoord)
+			, Origin(InOrigin)
+			, Tree(MinimumQuadSize, NodeCantSplit, 16, 16)
 		{}
+		FIntPoint Coord;
+		/** world position of the local zero, the tile center on XY */
+		FVector Origin;
+		TileTreeType Tree;
+		/** in CollapseTiles */
+		bool bCollapseListed = false;
+	};
+
+	TSparseArray<FSensedStimulus> ElementPool;
+	/** indexed by ObjID */
+	TArray<FTiledElement> Elements;
+	TSparseArray<FTile> Tiles;
+	TMap<FIntPoint, int32> TileMap;
+	/** tiles emptied by a remove or a move, may be refilled before CollapseQueued */
+	TArray<int32> EmptyTiles;
+	/** tiles with nodes queued for collapse by their tree */
+	TArray<int32> CollapseTiles;
+	/** a new tile counts as a split, a dropped one as a collapse, a move to another tile as a reinsert, the tile trees add their own */
+	mutable FTreeCounters Counters;
 
-		FORCEINLINE bool operator()(const ElementIndexType ObjID) const
+	virtual TSparseArray<FSensedStimulus>& GetCompDataPool() override { return ElementPool; }
+	virtual const TSparseArray<FSensedStimulus>& GetCompDataPool() const override { return ElementPool; }
+
+public:
+	using Real = FVector::FReal;
+
+	explicit TSenseSys_TiledTree(const Real InTileSize, const Real InMinimumQuadSize, const int32 InNodeCantSplit = 8, const int32 ObjCount = 128)
+		: TileSize(FMath::Max<Real>(InTileSize, 1.f))
+		, MinimumQuadSize(FMath::Clamp<Real>(InMinimumQuadSize, 1.f, TileSize))
+		, NodeCantSplit(FMath::Max(InNodeCantSplit, 1))
+	{
+		ElementPool.Reserve(ObjCount);
+		Elements.Reserve(ObjCount);
+#if WITH_EDITOR
+		UE_LOG(LogSenseSys, Log, TEXT("SenseSys_TiledTree created, Dim: %d, TileSize: %f, MinimumQuadSize: %f"), Dim, TileSize, MinimumQuadSize);
+#endif
+	}
+
+	virtual ~TSenseSys_TiledTree() override { Clear(); }
+
+
+	virtual bool Remove(ElementIndexType InObjID) override;
+	virtual ElementIndexType Insert(FSensedStimulus&& ComponentData, FBox InBox) override;
+	virtual ElementIndexType Insert(const FSensedStimulus& ComponentData, FBox InBox) override;
+	virtual void Update(ElementIndexType InObjID, FBox NewBox) override;
+	virtual void BulkInsert(TArray<FSensedStimulus>&& ComponentsData, const TArray<FBox>& InBoxes, TArray<ElementIndexType>& OutIDs) override;
+	virtual void UpdateBatch(const TArray<FUpdateItem>& Items) override;
+	virtual void Clear() override;
+	/** drops empty tiles, collapses the tile trees and recomputes the query margin */
+	virtual void Collapse() override;
+	/** drops up to Budget emptied tiles and collapses up to Budget queued nodes of the tile trees */
+	virtual void CollapseQueued(int32 Budget) override;
+
+	virtual void GetInBoxIDs(FBox Box, TArray<ElementIndexType>& Out, uint64 InBitChannels = MAX_uint64) const override;
+	virtual void GetInRadiusIDs(Real Radius, FVector Center, TArray<ElementIndexType>& Out, uint64 InBitChannels = MAX_uint64) const override;
+	virtual void GetInBoxRadiusIDs(FBox Box, FVector Center, Real Radius, TArray<ElementIndexType>& Out, uint64 InBitChannels = MAX_uint64) const override;
+
+	virtual void GetInBoxIDs(FBox Box, TSet<ElementIndexType>& Out, uint64 InBitChannels = MAX_uint64) const override;
+	virtual void GetInRadiusIDs(Real Radius, FVector Center, TSet<ElementIndexType>& Out, uint64 InBitChannels = MAX_uint64) const override;
+	virtual void GetInBoxRadiusIDs(FBox Box, FVector Center, Real Radius, TSet<ElementIndexType>& Out, uint64 InBitChannels = MAX_uint64) const override;
+
+	virtual void GetInBoxIDs(FBox Box, FSenseSysQueryIDs& Out, uint64 InBitChannels = MAX_uint64) const override;
+	virtual void GetInRadiusIDs(Real Radius, FVector Center, FSenseSysQueryIDs& Out, uint64 InBitChannels = MAX_uint64) const override;
+	virtual void GetInBoxRadiusIDs(FBox Box, FVector Center, Real Radius, FSenseSysQueryIDs& Out, uint64 InBitChannels = MAX_uint64) const override;
+
+	virtual void GetInBoxRadiusIDsBatch(const TArray<FBatchQuery>& Queries, TArray<TArray<ElementIndexType>>& Out) const override;
+	virtual void GetKNearestIDs(FVector Center, int32 K, Real MaxRadius, TArray<ElementIndexType>& Out, uint64 InBitChannels = MAX_uint64) const override;
+	virtual void GetAlongSegmentIDs(FVector Start, FVector End, Real Radius, TArray<ElementIndexType>& Out, uint64 InBitChannels = MAX_uint64) const override;
+
+	virtual void GetInConeIDs(FBox Box, const FSenseSysCone& Cone, TArray<ElementIndexType>& Out, uint64 InBitChannels = MAX_uint64) const override;
+	virtual void GetInConeIDs(FBox Box, const FSenseSysCone& Cone, TSet<ElementIndexType>& Out, uint64 InBitChannels = MAX_uint64) const override;
+	virtual void GetInConeIDs(FBox Box, const FSenseSysCone& Cone, FSenseSysQueryIDs& Out, uint64 InBitChannels = MAX_uint64) const override;
+	virtual void GetInFrustumIDs(FBox Box, const FSenseSysFrustum& Frustum, TArray<ElementIndexType>& Out, uint64 InBitChannels = MAX_uint64) const override;
+	virtual void GetInFrustumIDs(FBox Box, const FSenseSysFrustum& Frustum, TSet<ElementIndexType>& Out, uint64 InBitChannels = MAX_uint64) const override;
+	virtual void GetInFrustumIDs(FBox Box, const FSenseSysFrustum& Frustum, FSenseSysQueryIDs& Out, uint64 InBitChannels = MAX_uint64) const override;
+
+	virtual void DrawTree(const class UWorld* World, FTreeDrawSetup TreeNode, FTreeDrawSetup Link, FTreeDrawSetup ElemNode, float LifeTime) const override;
+
+	virtual FBox GetMaxIntersect(FBox Box) const override;
+
+	FORCEINLINE Real GetTileSize() const { return TileSize; }
+
+private:
+	const Real TileSize;
+	const Real MinimumQuadSize;
+	const int32 NodeCantSplit;
+	/** largest element half size on XY, elements are found from the tiles of their centers, only shrinks in Collapse */
+	Real QueryMargin = 0.f;
+	/** world offset of the tile grid, moved by ShiftOrigin */
+	FVector GridShift = FVector::ZeroVector;
+
+	/** tiles past it are merged into the border tile, range arithmetic around a coordinate stays in int32 */
+	static constexpr Real MaxTileCoord = MAX_int32 / 4;
+
+	/** (Location - GridShift) / TileSize floored on each axis, clamped to MaxTileCoord before the int conversion */
+	FORCEINLINE FVector2D GetTileCoordReal(const FVector& Location) const
+	{
+		return FVector2D(
+			FMath::Clamp<Real>(FMath::FloorToDouble((Location.X - GridShift.X) / TileSize), -MaxTileCoord, MaxTileCoord),
+			FMath::Clamp<Real>(FMath::FloorToDouble((Location.Y - GridShift.Y) / TileSize), -MaxTileCoord, MaxTileCoord));
+	}
+	FORCEINLINE FIntPoint GetTileCoord(const FVector& Location) const
+	{
+		const FVector2D Coord = GetTileCoordReal(Location);
+		return FIntPoint(static_cast<int32>(Coord.X), static_cast<int32>(Coord.Y));
+	}
+	FORCEINLINE FVector GetTileOrigin(const FIntPoint Coord) const
+	{
+		return GridShift + FVector((Coord.X + 0.5f) * TileSize, (Coord.Y + 0.5f) * TileSize, 0.f);
+	}
+	static FORCEINLINE PointType ToLocal(const FVector& Point, const FVector& Origin)
+	{
+		PointType Out;
+		for (int32 j = 0; j < static_cast<int32>(Dim); ++j)
 		{
-			const auto& B = Tree.GetElementBox(ObjID);
-			return B.IsIntersect(Box.Min, Box.Max) && (BitChannels & Tree.GetElement(ObjID).BitChannels);
+			Out[j] = static_cast<float>(Point[j] - Origin[j]);
 		}
+		return Out;
+	}
+	static FORCEINLINE TileBoxType ToLocal(const FBox& Box, const FVector& Origin) { return TileBoxType(ToLocal(Box.Min, Origin), ToLocal(Box.Max, Origin)); }
+	/** BoundsType - TileBoxType or FElementBounds of the tile tree, Dim 2 boxes get the Z range of the query box */
+	template<typename BoundsType>
+	static FORCEINLINE FBox ToWorld(const BoundsType& Bounds, const FVector& Origin, const FBox& QueryBox)
+	{
+		FBox Out(QueryBox.Min, QueryBox.Max);
+		for (int32 j = 0; j < static_cast<int32>(Dim); ++j)
+		{
+			Out.Min[j] = Origin[j] + GetMin(Bounds)[j];
+			Out.Max[j] = Origin[j] + GetMax(Bounds)[j];
+		}
+		return Out;
+	}
+	static FORCEINLINE const PointType& GetMin(const TileBoxType& Box) { return Box.min; }
+	static FORCEINLINE const PointType& GetMax(const TileBoxType& Box) { return Box.max; }
+	template<typename BoundsType>
+	static FORCEINLINE const float* GetMin(const BoundsType& Bounds) { return Bounds.Min; }
+	template<typename BoundsType>
+	static FORCEINLINE const float* GetMax(const BoundsType& Bounds) { return Bounds.Max; }
+
+	/** tile tree query output, adds the ObjIDs of the tile local IDs to Out */
+	template<typename ContainerType>
+	struct TTileOut
+	{
+		TTileOut(const TSparseArray<TElementIdx>& InObjIDs, ContainerType& InOut) : ObjIDs(InObjIDs), Out(InOut) {}
+		const TSparseArray<TElementIdx>& ObjIDs;
+		ContainerType& Out;
+
+		FORCEINLINE void Add(const TElementIdx LocalID) { Out.Add(ObjIDs[LocalID]); }
+		FORCEINLINE void Reserve(const int32 Number) { Out.Reserve(Out.Num() + Number); }
+		FORCEINLINE void Shrink() {}
+	};
+
+	void Insert_Internal(ElementIndexType ObjID, const FBox& InBox, uint64 Channels);
+	void Update_Internal(ElementIndexType ObjID, const FBox& NewBox);
+	void RemoveFromTile(ElementIndexType ObjID);
+	/** lists the tile for CollapseQueued once its tree queued nodes */
+	void QueueTileCollapse(int32 TileIdx);
+
+	/** calls TileLambda(const FTile&) for the filled tiles that may hold elements overlapping Box */
+	template<typename TileLambdaType>
+	void ForEachQueryTile(const FBox& Box, TileLambdaType TileLambda) const;
+
+	/** Radius < 0 - box test only */
+	template<typename ContainerType>
+	void GetElementsIDs(const FBox& Box, const FVector& Center, Real Radius, uint64 InBitChannels, ContainerType& Out) const;
+	/** VolumeType - FSenseSysCone or FSenseSysFrustum, the tile nodes and elements are tested in world space */
+	template<typename VolumeType, typename ContainerType>
+	void GetInVolumeIDs(const FBox& Box, const VolumeType& Volume, uint64 InBitChannels, ContainerType& Out) const;
+
+	virtual void SetElementChannels_Internal(ElementIndexType ID, uint64 Channels) override;
+	/** drops the empty tiles, compacts the tile trees, elements in the order of their tiles */
+	virtual void Compact_Internal(TArray<ElementIndexType>& OutRemap) override;
+	/** the tile trees add their nodes, memory and restructure counters, queries are counted once per tiled query */
+	virtual void GetStats_Internal(FSenseSysTreeStats& OutStats) const override;
+	virtual void ResetStats_Internal() override;
+	virtual void SetQueryCounting_Internal(const bool bCount) override { Counters.bCountQueries = bCount; }
+	virtual bool ShiftOrigin_Internal(const FVector& Offset) override;
+};
+
+/**
+ * SplitTree
+ * EStimulusMobility::Static stimuli in a packed BVH built from all of them at once, movable ones in an OcTree (Dim 3)
+ * or QuadTree (Dim 2), so the moves restructure only the dynamic tree. Queries merge both.
+ * a static stimulus inserted one by one waits in a pending list scanned by every query until the next rebuild,
+ * a static stimulus that moves goes to the dynamic tree for good. TElementIdx - ObjID, uint16 or int32
+ */
+template<typename TElementIdx, uint32 Dim>
+class TSenseSys_SplitTree final : public IContainerTree
+{
+private:
+	static_assert(Dim == 2 || Dim == 3, "TSenseSys_SplitTree: Dim error");
+	using ElementIndexType = IContainerTree::ElementIndexType;
+	static constexpr int32 MaxElements = TNumericLimits<TElementIdx>::Max();
+
+	using PointType = typename TChooseClass<Dim == 3, FVector, FVector2D>::Result;
+	/** the dynamic tree stores the ObjID as its element, its local IDs are not ObjIDs */
+	using DynamicTreeType = TTree_Base<TElementIdx, PointType, TElementIdx, int32, Dim>;
+	using BoxType = typename DynamicTreeType::BoxType;
+	using FElementQuery = typename DynamicTreeType::FElementQuery;
+
+	struct FSplitElement
+	{
+		FBox Box = FBox(ForceInit);
+		uint64 Mask = MAX_uint64;
+		/** index in the static arrays, or in StaticPending while bStaticPending, INDEX_NONE for a movable element */
+		int32 StaticSlot = INDEX_NONE;
+		bool bStaticPending = false;
+		/** dynamic tree local ID of a movable element */
+		TElementIdx LocalID = TNumericLimits<TElementIdx>::Max();
+
+		FORCEINLINE bool IsDynamic() const { return LocalID != TNumericLimits<TElementIdx>::Max(); }
+	};
+
+	struct FStaticNode
+	{
+		/** bounds of the subtree elements */
+		FBox Bounds = FBox(ForceInit);
+		uint64 ChannelMask = 0;
+		/** subtree range in the static arrays */
+		int32 Begin = 0;
+		int32 End = 0;
+		/** next node after the subtree, Skip == index + 1 for a leaf */
+		int32 Skip = 0;
+	};
+
+	TSparseArray<FSensedStimulus> ElementPool;
+	/** indexed by ObjID */
+	TArray<FSplitElement> Elements;
+
+	/** BVH order, the mask of a removed or moved slot is 0 */
+	TArray<TElementIdx> StaticIDs;
+	TArray<FBox> StaticBoxes;
+	TArray<uint64> StaticMasks;
+	/** preorder, StaticNodes[0] is the root */
+	TArray<FStaticNode> StaticNodes;
+	/** static stimuli inserted since the last rebuild */
+	TArray<TElementIdx> StaticPending;
+	/** static slots cleared since the last rebuild */
+	int32 StaticDeadCount = 0;
+	/** CollapseQueued rebuilds the static part once the pending and cleared slots pass 1 / RebuildShare of the packed ones */
+	static constexpr int32 RebuildShare = 8;
+
+	DynamicTreeType Tree;
+	/** a static rebuild counts as a collapse, a static element moved to the dynamic tree as a reinsert, the dynamic tree adds its own */
+	mutable FTreeCounters Counters;
+
+	virtual TSparseArray<FSensedStimulus>& GetCompDataPool() override { return ElementPool; }
+	virtual const TSparseArray<FSensedStimulus>& GetCompDataPool() const override { return ElementPool; }
+
+public:
+	using Real = FVector::FReal;
+
+	explicit TSenseSys_SplitTree(
+		const Real InMinimumQuadSize,
+		const int32 InNodeCantSplit = 8,
+		const int32 ObjCount = 128,
+		const Real LooseFactor = 1.f)
+		: Tree(FMath::Max<Real>(InMinimumQuadSize, 1.f), FMath::Max(InNodeCantSplit, 1), 128, ObjCount, LooseFactor)
+		, NodeCantSplit(FMath::Max(InNodeCantSplit, 1))
+	{
+		ElementPool.Reserve(ObjCount);
+		Elements.Reserve(ObjCount);
+#if WITH_EDITOR
+		UE_LOG(LogSenseSys, Log, TEXT("SenseSys_SplitTree created, Dim: %d, LooseFactor: %f"), Dim, Tree.GetLooseFactor());
+#endif
+	}
+
+	virtual ~TSenseSys_SplitTree() override { Clear(); }
+
+
+	virtual bool Remove(ElementIndexType InObjID) override;
+	virtual ElementIndexType Insert(FSensedStimulus&& ComponentData, FBox InBox) override;
+	virtual ElementIndexType Insert(const FSensedStimulus& ComponentData, FBox InBox) override;
+	virtual void Update(ElementIndexType InObjID, FBox NewBox) override;
+	/** adds the elements and rebuilds the static BVH once if the batch had static stimuli */
+	virtual void BulkInsert(TArray<FSensedStimulus>&& ComponentsData, const TArray<FBox>& InBoxes, TArray<ElementIndexType>& OutIDs) override;
+	virtual void UpdateBatch(const TArray<FUpdateItem>& Items) override;
+	virtual void Clear() override;
+	/** collapses the dynamic tree, rebuilds the static BVH if anything static is pending or removed */
+	virtual void Collapse() override;
+	/** collapses up to Budget queued nodes of the dynamic tree, rebuilds the static BVH once its pending and removed entries exceed Budget */
+	virtual void CollapseQueued(int32 Budget) override;
 
-		const TreeType& Tree;
-		const FBox Box;
-		const uint64 BitChannels;
+	virtual void GetInBoxIDs(FBox Box, TArray<ElementIndexType>& Out, uint64 InBitChannels = MAX_uint64) const override;
+	virtual void GetInRadiusIDs(Real Radius, FVector Center, TArray<ElementIndexType>& Out, uint64 InBitChannels = MAX_uint64) const override;
+	virtual void GetInBoxRadiusIDs(FBox Box, FVector Center, Real Radius, TArray<ElementIndexType>& Out, uint64 InBitChannels = MAX_uint64) const override;
+
+	virtual void GetInBoxIDs(FBox Box, TSet<ElementIndexType>& Out, uint64 InBitChannels = MAX_uint64) const override;
+	virtual void GetInRadiusIDs(Real Radius, FVector Center, TSet<ElementIndexType>& Out, uint64 InBitChannels = MAX_uint64) const override;
+	virtual void GetInBoxRadiusIDs(FBox Box, FVector Center, Real Radius, TSet<ElementIndexType>& Out, uint64 InBitChannels = MAX_uint64) const override;
+
+	virtual void GetInBoxIDs(FBox Box, FSenseSysQueryIDs& Out, uint64 InBitChannels = MAX_uint64) const override;
+	virtual void GetInRadiusIDs(Real Radius, FVector Center, FSenseSysQueryIDs& Out, uint64 InBitChannels = MAX_uint64) const override;
+	virtual void GetInBoxRadiusIDs(FBox Box, FVector Center, Real Radius, FSenseSysQueryIDs& Out, uint64 InBitChannels = MAX_uint64) const override;
+
+	virtual void GetInBoxRadiusIDsBatch(const TArray<FBatchQuery>& Queries, TArray<TArray<ElementIndexType>>& Out) const override;
+	virtual void GetKNearestIDs(FVector Center, int32 K, Real MaxRadius, TArray<ElementIndexType>& Out, uint64 InBitChannels = MAX_uint64) const override;
+	virtual void GetAlongSegmentIDs(FVector Start, FVector End, Real Radius, TArray<ElementIndexType>& Out, uint64 InBitChannels = MAX_uint64) const override;
+
+	virtual void GetInConeIDs(FBox Box, const FSenseSysCone& Cone, TArray<ElementIndexType>& Out, uint64 InBitChannels = MAX_uint64) const override;
+	virtual void GetInConeIDs(FBox Box, const FSenseSysCone& Cone, TSet<ElementIndexType>& Out, uint64 InBitChannels = MAX_uint64) const override;
+	virtual void GetInConeIDs(FBox Box, const FSenseSysCone& Cone, FSenseSysQueryIDs& Out, uint64 InBitChannels = MAX_uint64) const override;
+	virtual void GetInFrustumIDs(FBox Box, const FSenseSysFrustum& Frustum, TArray<ElementIndexType>& Out, uint64 InBitChannels = MAX_uint64) const override;
+	virtual void GetInFrustumIDs(FBox Box, const FSenseSysFrustum& Frustum, TSet<ElementIndexType>& Out, uint64 InBitChannels = MAX_uint64) const override;
+	virtual void GetInFrustumIDs(FBox Box, const FSenseSysFrustum& Frustum, FSenseSysQueryIDs& Out, uint64 InBitChannels = MAX_uint64) const override;
+
+	virtual void DrawTree(const class UWorld* World, FTreeDrawSetup TreeNode, FTreeDrawSetup Link, FTreeDrawSetup ElemNode, float LifeTime) const override;
+
+	virtual FBox GetMaxIntersect(FBox Box) const override;
+
+	/** static elements in the BVH and the pending list */
+	FORCEINLINE int32 NumStatic() const { return StaticIDs.Num() - StaticDeadCount + StaticPending.Num(); }
+
+private:
+	const int32 NodeCantSplit;
+
+	/** Dim 2 ignores Z */
+	static FORCEINLINE bool IntersectBox(const FBox& A, const FBox& B)
+	{
+		for (int32 j = 0; j < static_cast<int32>(Dim); ++j)
+		{
+			if (A.Min[j] > B.Max[j] || B.Min[j] > A.Max[j])
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+	static FORCEINLINE Real DistSquared(const FBox& Box, const FVector& Point)
+	{
+		Real Out = 0.f;
+		for (int32 j = 0; j < static_cast<int32>(Dim); ++j)
+		{
+			const Real D = Point[j] < Box.Min[j] ? Box.Min[j] - Point[j] : (Point[j] > Box.Max[j] ? Point[j] - Box.Max[j] : 0.f);
+			Out += D * D;
+		}
+		return Out;
+	}
+	/** Dim 2 boxes get the Z range of the query box */
+	static FORCEINLINE FBox LiftBox(const FBox& InBox, const FBox& QueryBox)
+	{
+		IF_CONSTEXPR(Dim == 2)
+		{
+			return FBox(FVector(InBox.Min.X, InBox.Min.Y, QueryBox.Min.Z), FVector(InBox.Max.X, InBox.Max.Y, QueryBox.Max.Z));
+		}
+		return InBox;
+	}
+	static FORCEINLINE BoxType ToTreeBox(const FBox& Box) { return BoxType(PointType(Box.Min), PointType(Box.Max)); }
+	/** BoundsType - BoxType or FElementBounds of the dynamic tree, Dim 2 boxes get the Z range of the query box */
+	template<typename BoundsType>
+	static FORCEINLINE FBox ToWorld(const BoundsType& Bounds, const FBox& QueryBox)
+	{
+		FBox Out(QueryBox.Min, QueryBox.Max);
+		for (int32 j = 0; j < static_cast<int32>(Dim); ++j)
+		{
+			Out.Min[j] = GetMin(Bounds)[j];
+			Out.Max[j] = GetMax(Bounds)[j];
+		}
+		return Out;
+	}
+	static FORCEINLINE const PointType& GetMin(const BoxType& Box) { return Box.min; }
+	static FORCEINLINE const PointType& GetMax(const BoxType& Box) { return Box.max; }
+	template<typename BoundsType>
+	static FORCEINLINE const Real* GetMin(const BoundsType& Bounds) { return Bounds.Min; }
+	template<typename BoundsType>
+	static FORCEINLINE const Real* GetMax(const BoundsType& Bounds) { return Bounds.Max; }
+
+	/** dynamic tree query output, adds the ObjIDs of the local IDs to Out */
+	template<typename ContainerType>
+	struct TDynamicOut
+	{
+		TDynamicOut(const TSparseArray<TElementIdx>& InObjIDs, ContainerType& InOut) : ObjIDs(InObjIDs), Out(InOut) {}
+		const TSparseArray<TElementIdx>& ObjIDs;
+		ContainerType& Out;
+
+		FORCEINLINE void Add(const TElementIdx LocalID) { Out.Add(ObjIDs[LocalID]); }
+		FORCEINLINE void Reserve(const int32 Number) { Out.Reserve(Out.Num() + Number); }
+		FORCEINLINE void Shrink() {}
 	};
+
+	/** bStatic - the stimulus was registered as EStimulusMobility::Static */
+	void Insert_Internal(ElementIndexType ObjID, const FBox& InBox, uint64 Channels, bool bStatic);
+	void Update_Internal(ElementIndexType ObjID, const FBox& NewBox);
+	void InsertDynamic(ElementIndexType ObjID);
+	/** clears the static slot or the pending entry */
+	void RemoveStatic(ElementIndexType ObjID);
+	FORCEINLINE bool IsStaticRebuildDue_Internal(const int32 Budget) const
+	{
+		return StaticPending.Num() + StaticDeadCount > FMath::Max(Budget, StaticIDs.Num() / RebuildShare);
+	}
+
+	/** rebuilds the BVH from the built and pending static elements, write lock must be held */
+	void RebuildStatic_Internal();
+	/** preorder node of the static range, split at the median of the centers on the longest axis */
+	template<typename ItemType>
+	int32 BuildStaticNode(TArray<ItemType>& Items, int32 Begin, int32 End);
+
+	/** NodeTest(const FBox& Bounds), ElemTest(const FBox& ElemBox), adds the static and pending IDs that pass both */
+	template<typename NodeTestType, typename ElemTestType, typename ContainerType>
+	void GetStaticIDs(uint64 InBitChannels, NodeTestType NodeTest, ElemTestType ElemTest, ContainerType& Out, int32& VisitedNodes, int32& VisitedElements) const;
+	/** Radius < 0 - box test only */
+	template<typename ContainerType>
+	void GetInBoxRadiusIDs_Internal(const FBox& Box, const FVector& Center, Real Radius, uint64 InBitChannels, ContainerType& Out) const;
+	/** VolumeType - FSenseSysCone or FSenseSysFrustum */
+	template<typename VolumeType, typename ContainerType>
+	void GetInVolumeIDs(const FBox& Box, const VolumeType& Volume, uint64 InBitChannels, ContainerType& Out) const;
+
+	virtual void SetElementChannels_Internal(ElementIndexType ID, uint64 Channels) override;
+	/** rebuilds the BVH, static elements first in BVH order, then the dynamic ones in the order of their nodes */
+	virtual void Compact_Internal(TArray<ElementIndexType>& OutRemap) override;
+	/** the static BVH and the dynamic tree nodes, pending static elements are counted in NumElements only */
+	virtual void GetStats_Internal(FSenseSysTreeStats& OutStats) const override;
+	virtual void ResetStats_Internal() override;
+	virtual void SetQueryCounting_Internal(const bool bCount) override { Counters.bCountQueries = bCount; }
 };
+
+/** default widths, 16 bit elements and 32 bit nodes */
+using FSenseSys_QuadTree = TSenseSys_QuadTree<uint16, int32>;
+using FSenseSys_OcTree = TSenseSys_OcTree<uint16, int32>;
+using FSenseSys_HashGrid = TSenseSys_HashGrid<uint16>;
+using FSenseSys_LinearOcTree = TSenseSys_LinearTree<uint16, 3>;
+using FSenseSys_LinearQuadTree = TSenseSys_LinearTree<uint16, 2>;
+using FSenseSys_TiledOcTree = TSenseSys_TiledTree<uint16, 3>;
+using FSenseSys_TiledQuadTree = TSenseSys_TiledTree<uint16, 2>;
+using FSenseSys_SplitOcTree = TSenseSys_SplitTree<uint16, 3>;
+using FSenseSys_SplitQuadTree = TSenseSys_SplitTree<uint16, 2>;
+
+/** instantiated in QtOtContainer.cpp */
+extern template class TSenseSys_QuadTree<uint16, uint16>;
+extern template class TSenseSys_QuadTree<uint16, int32>;
+extern template class TSenseSys_QuadTree<int32, uint16>;
+extern template class TSenseSys_QuadTree<int32, int32>;
+extern template class TSenseSys_OcTree<uint16, uint16>;
+extern template class TSenseSys_OcTree<uint16, int32>;
+extern template class TSenseSys_OcTree<int32, uint16>;
+extern template class TSenseSys_OcTree<int32, int32>;
+extern template class TSenseSys_HashGrid<uint16>;
+extern template class TSenseSys_HashGrid<int32>;
+extern template class TSenseSys_LinearTree<uint16, 2>;
+extern template class TSenseSys_LinearTree<uint16, 3>;
+extern template class TSenseSys_LinearTree<int32, 2>;
+extern template class TSenseSys_LinearTree<int32, 3>;
+extern template class TSenseSys_TiledTree<uint16, 2>;
+extern template class TSenseSys_TiledTree<uint16, 3>;
+extern template class TSenseSys_TiledTree<int32, 2>;
+extern template class TSenseSys_TiledTree<int32, 3>;
+extern template class TSenseSys_SplitTree<uint16, 2>;
+extern template class TSenseSys_SplitTree<uint16, 3>;
+extern template class TSenseSys_SplitTree<int32, 2>;
+extern template class TSenseSys_SplitTree<int32, 3>;
@@ -12,41 +12,215 @@
 
 //#include "UObject/UObjectGlobals.h"
 #include "Async/ParallelFor.h"
+#include "Async/Async.h"
 #include "Engine/Engine.h"
 #include "Engine/World.h"
+#include "HAL/IConsoleManager.h"
 
 #include "DrawDebugHelpers.h"
 
 
-TUniquePtr<IContainerTree> FRegisteredSensorTags::MakeTree(const FName Tag)
+DECLARE_STATS_GROUP(TEXT("SenseSys"), STATGROUP_SenseSys, STATCAT_Advanced);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Tree Elements"), STAT_SenseSys_TreeElements, STATGROUP_SenseSys);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Tree Nodes"), STAT_SenseSys_TreeNodes, STATGROUP_SenseSys);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Tree Leaves"), STAT_SenseSys_TreeLeaves, STATGROUP_SenseSys);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Tree Max Depth"), STAT_SenseSys_TreeMaxDepth, STATGROUP_SenseSys);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Tree Queries"), STAT_SenseSys_TreeQueries, STATGROUP_SenseSys);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Tree Visited Nodes"), STAT_SenseSys_TreeVisitedNodes, STATGROUP_SenseSys);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Tree Visited Elements"), STAT_SenseSys_TreeVisitedElements, STATGROUP_SenseSys);
+DECLARE_MEMORY_STAT(TEXT("Tree Memory"), STAT_SenseSys_TreeMemory, STATGROUP_SenseSys);
+
+static bool GSenseSysTreeQueryCounters = false;
+static FAutoConsoleVariableRef CVarSenseSysTreeQueryCounters(
+	TEXT("SenseSys.TreeQueryCounters"),
+	GSenseSysTreeQueryCounters,
+	TEXT("Counts the tree queries and the visited nodes and elements for SenseSys.TreeStats. Always on for bAutoTune tags and while stats are collected"));
+
+static bool HasAutoTuneTag(const USenseSysSettings& Settings)
+{
+	for (const auto& It : Settings.SensorTagSettings)
+	{
+		if (It.Value.bAutoTune)
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+static FAutoConsoleCommandWithWorldAndArgs SenseSysTreeStatsCmd(
+	TEXT("SenseSys.TreeStats"),
+	TEXT("Logs the tree statistics of the sensor tags. SenseSys.TreeStats [Tag ...] | reset [Tag ...]"),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateStatic(
+		[](const TArray<FString>& Args, UWorld* World)
+		{
+			USenseManager* SenseManager = USenseManager::GetSenseManager(World);
+			if (!SenseManager)
+			{
+				return;
+			}
+			const bool bReset = Args.Num() > 0 && Args[0] == TEXT("reset");
+			if (Args.Num() == (bReset ? 1 : 0))
+			{
+				bReset ? SenseManager->ResetTreeStats() : SenseManager->LogTreeStats();
+				return;
+			}
+			for (int32 i = bReset ? 1 : 0; i < Args.Num(); i++)
+			{
+				bReset ? SenseManager->ResetTreeStats(FName(*Args[i])) : SenseManager->LogTreeStats(FName(*Args[i]));
+			}
+		}));
+
+
+template<typename TElementIdx>
+static TUniquePtr<IContainerTree> MakeTree_Internal(const FSensorTagSettings& STagSettings)
+{
+	const float MinSize = STagSettings.MinimumQuadTreeSize;
+	const int32 NodeCantSplit = STagSettings.NodeCantSplit;
+	switch (STagSettings.QtOtSwitch)
+	{
+		case ESenseSys_QtOtSwitch::OcTree: return MakeUnique<TSenseSys_OcTree<TElementIdx, int32>>(MinSize, NodeCantSplit);
+		case ESenseSys_QtOtSwitch::QuadTree: return MakeUnique<TSenseSys_QuadTree<TElementIdx, int32>>(MinSize, NodeCantSplit);
+		case ESenseSys_QtOtSwitch::LooseOcTree:
+			return MakeUnique<TSenseSys_OcTree<TElementIdx, int32>>(MinSize, NodeCantSplit, 128, 128, STagSettings.LooseFactor);
+		case ESenseSys_QtOtSwitch::LooseQuadTree:
+			return MakeUnique<TSenseSys_QuadTree<TElementIdx, int32>>(MinSize, NodeCantSplit, 128, 128, STagSettings.LooseFactor);
+		case ESenseSys_QtOtSwitch::HashGrid: return MakeUnique<TSenseSys_HashGrid<TElementIdx>>(STagSettings.HashGridCellSize);
+		case ESenseSys_QtOtSwitch::OcTree16: return MakeUnique<TSenseSys_OcTree<TElementIdx, uint16>>(MinSize, NodeCantSplit);
+		case ESenseSys_QtOtSwitch::QuadTree16: return MakeUnique<TSenseSys_QuadTree<TElementIdx, uint16>>(MinSize, NodeCantSplit);
+		case ESenseSys_QtOtSwitch::LinearOcTree: return MakeUnique<TSenseSys_LinearTree<TElementIdx, 3>>(MinSize, NodeCantSplit);
+		case ESenseSys_QtOtSwitch::LinearQuadTree: return MakeUnique<TSenseSys_LinearTree<TElementIdx, 2>>(MinSize, NodeCantSplit);
+		case ESenseSys_QtOtSwitch::TiledOcTree: return MakeUnique<TSenseSys_TiledTree<TElementIdx, 3>>(STagSettings.TileSize, MinSize, NodeCantSplit);
+		case ESenseSys_QtOtSwitch::TiledQuadTree: return MakeUnique<TSenseSys_TiledTree<TElementIdx, 2>>(STagSettings.TileSize, MinSize, NodeCantSplit);
+		case ESenseSys_QtOtSwitch::SplitOcTree:
+			return MakeUnique<TSenseSys_SplitTree<TElementIdx, 3>>(MinSize, NodeCantSplit, 128, STagSettings.LooseFactor);
+		case ESenseSys_QtOtSwitch::SplitQuadTree:
+			return MakeUnique<TSenseSys_SplitTree<TElementIdx, 2>>(MinSize, NodeCantSplit, 128, STagSettings.LooseFactor);
+	}
+	return nullptr;
+}
+
+const FSensorTagSettings* FRegisteredSensorTags::FindTreeSettings(const FName TreeKey)
 {
 	const auto Settings = GetDefault<USenseSysSettings>();
 	check(Settings);
-	const TMap<FName, FSensorTagSettings>& TagSettings = Settings->SensorTagSettings;
-	if (const FSensorTagSettings* STagSettings = TagSettings.Find(Tag))
+	if (const FSensorTagSettings* STagSettings = Settings->SensorTagSettings.Find(TreeKey))
+	{
+		return STagSettings;
+	}
+	// the first tag by name, the map order is not stable between runs
+	const FSensorTagSettings* Out = nullptr;
+	FName OutTag = NAME_None;
+	for (const auto& It : Settings->SensorTagSettings)
+	{
+		if (It.Value.SharedTree == TreeKey && (Out == nullptr || It.Key.LexicalLess(OutTag)))
+		{
+			Out = &It.Value;
+			OutTag = It.Key;
+		}
+	}
+	return Out;
+}
+
+static bool IsSameTreeSettings(const FSensorTagSettings& A, const FSensorTagSettings& B)
+{
+	return A.QtOtSwitch == B.QtOtSwitch && A.MinimumQuadTreeSize == B.MinimumQuadTreeSize && A.NodeCantSplit == B.NodeCantSplit &&
+		A.LooseFactor == B.LooseFactor && A.HashGridCellSize == B.HashGridCellSize && A.TileSize == B.TileSize &&
+		A.ElementIndexWidth == B.ElementIndexWidth && A.bSnapshotReads == B.bSnapshotReads && A.bAutoTune == B.bAutoTune;
+}
+
+TUniquePtr<IContainerTree> FRegisteredSensorTags::MakeTree(const FName TreeKey) const
+{
+	const FSensorTagSettings* STagSettings = FindTreeSettings(TreeKey);
+	if (STagSettings == nullptr)
+	{
+		return MakeUnique<FSenseSys_OcTree>(500.f);
+	}
+	TUniquePtr<IContainerTree> Tree = STagSettings->ElementIndexWidth == ESenseSys_IndexWidth::Bit32 //
+		? MakeTree_Internal<int32>(*STagSettings)
+		: MakeTree_Internal<uint16>(*STagSettings);
+	if (!Tree.IsValid())
+	{
+		return MakeUnique<FSenseSys_OcTree>(500.f);
+	}
+	Tree->SetSnapshotReads(STagSettings->bSnapshotReads);
+
+	TArray<FName, TInlineAllocator<8>> Tags;
+	for (const auto& It : GetDefault<USenseSysSettings>()->SensorTagSettings)
 	{
-		const float MinSize = STagSettings->MinimumQuadTreeSize;
-		const int32 NodeCantSplit = STagSettings->NodeCantSplit;
-		const ESenseSys_QtOtSwitch QtOtSwitch = STagSettings->QtOtSwitch;
-		switch (QtOtSwitch)
+		if (GetTreeKey(It.Key) == TreeKey)
 		{
-			case ESenseSys_QtOtSwitch::OcTree: return MakeUnique<FSenseSys_OcTree>(MinSize);
-			case ESenseSys_QtOtSwitch::QuadTree: return MakeUnique<FSenseSys_QuadTree>(MinSize);
+			Tags.Add(It.Key);
+			if (!IsSameTreeSettings(It.Value, *STagSettings))
+			{
+				UE_LOG(LogSenseSys, Warning, TEXT("SensorTag %s shares tree %s, its own tree settings are not used"), *It.Key.ToString(), *TreeKey.ToString());
+			}
 		}
 	}
-	return MakeUnique<FSenseSys_OcTree>(500.f);
+	if (Tags.Num() > 1)
+	{
+		// the index of a tag in the tree tag channels, every tag keeps all 64 channels
+		Tags.Sort(FNameLexicalLess());
+		TArray<TPair<FName, FSenseSysTagSlot>> TagSlots;
+		for (int32 i = 0; i < Tags.Num(); ++i)
+		{
+			FSenseSysTagSlot Slot;
+			Slot.Index = i;
+			TagSlots.Emplace(Tags[i], Slot);
+			UE_LOG(LogSenseSys, Log, TEXT("SensorTag %s shares tree %s"), *Tags[i].ToString(), *TreeKey.ToString());
+		}
+		Tree->SetTagSlots(MoveTemp(TagSlots));
+	}
+	return Tree;
 }
 
 
-FRegisteredSensorTags::FRegisteredSensorTags() = default;
+FRegisteredSensorTags::FRegisteredSensorTags()
+{
+	if (const auto Settings = GetDefault<USenseSysSettings>())
+	{
+		for (const auto& It : Settings->SensorTagSettings)
+		{
+			if (!It.Value.SharedTree.IsNone() && It.Value.SharedTree != It.Key)
+			{
+				SharedTreeKeys.Add(It.Key, It.Value.SharedTree);
+			}
+		}
+	}
+}
 FRegisteredSensorTags::~FRegisteredSensorTags()
 {
 	Empty_Internal();
 }
 
+FName FRegisteredSensorTags::GetTreeKey(const FName& Tag) const
+{
+	const FName* TreeKey = SharedTreeKeys.Find(Tag);
+	return TreeKey ? *TreeKey : Tag;
+}
+
 bool FRegisteredSensorTags::IsValidTag(const FName& SensorTag) const
 {
-	return SenseRegChannels.Contains(SensorTag);
+	const TUniquePtr<IContainerTree>* Ptr = SenseRegChannels.Find(GetTreeKey(SensorTag));
+	return Ptr && (*Ptr)->Num() > 0;
+}
+
+bool FRegisteredSensorTags::RemoveEmptyTrees()
+{
+	FScopeLock ScopeLock(&CriticalSection);
+
+	bool bRemoved = false;
+	for (const FName& TreeKey : EmptyTreeKeys)
+	{
+		const TUniquePtr<IContainerTree>* Ptr = SenseRegChannels.Find(TreeKey);
+		if (Ptr && (*Ptr)->Num() <= 0)
+		{
+			SenseRegChannels.Remove(TreeKey);
+			bRemoved = true;
+		}
+	}
+	EmptyTreeKeys.Reset();
+	return bRemoved;
 }
 
 void FRegisteredSensorTags::CollapseAllTrees()
@@ -58,6 +232,55 @@ void FRegisteredSensorTags::CollapseAllTrees()
 	}
 }
 
+void FRegisteredSensorTags::CollapseQueuedTrees(const int32 Budget)
+{
+	for (const auto& It : SenseRegChannels)
+	{
+		check(It.Value.Get());
+		It.Value.Get()->CollapseQueued(Budget);
+	}
+}
+
+void FRegisteredSensorTags::FlushStagedUpdates()
+{
+	for (const auto& It : SenseRegChannels)
+	{
+		check(It.Value.Get());
+		It.Value.Get()->FlushStagedUpdates();
+	}
+}
+
+void FRegisteredSensorTags::PublishSnapshots()
+{
+	for (const auto& It : SenseRegChannels)
+	{
+		check(It.Value.Get());
+		It.Value.Get()->PublishSnapshot();
+	}
+}
+
+
+FStimulusTagResponse* FRegisteredSensorTags::FindSharedResponse(
+	USenseStimulusBase* Ssc,
+	const FName& SensorTag,
+	const FStimulusTagResponse& Str,
+	const IContainerTree* ContainerTree)
+{
+	if (ContainerTree->GetTagSlots().Num() == 0)
+	{
+		return nullptr;
+	}
+	for (auto& It : Ssc->TagResponse)
+	{
+		FStimulusTagResponse& Other = It.Value;
+		if (&Other != &Str && Other.ContainerTree == ContainerTree && Other.Score == Str.Score && Other.Age == Str.Age &&
+			Ssc->GetSingleSensePoint(It.Key) == Ssc->GetSingleSensePoint(SensorTag) && Ssc->GetSensePoints(It.Key) == Ssc->GetSensePoints(SensorTag))
+		{
+			return &Other;
+		}
+	}
+	return nullptr;
+}
 
 bool FRegisteredSensorTags::AddSenseStimulus_Internal(USenseStimulusBase* Ssc, const FName& SensorTag, FStimulusTagResponse& Str)
 {
@@ -66,19 +289,36 @@ bool FRegisteredSensorTags::AddSenseStimulus_Internal(USenseStimulusBase* Ssc, c
 		IContainerTree* ContainerTree = GetContainerTree(SensorTag);
 		if (ContainerTree == nullptr)
 		{
-			ContainerTree = SenseRegChannels.Add(SensorTag, MakeTree(SensorTag)).Get();
+			const FName TreeKey = GetTreeKey(SensorTag);
+			ContainerTree = SenseRegChannels.Add(TreeKey, MakeTree(TreeKey)).Get();
 		}
 		check(ContainerTree);
+		const FSenseSysTagSlot TagSlot = ContainerTree->GetTagSlot(SensorTag);
+		if (const FStimulusTagResponse* SharedStr = FindSharedResponse(Ssc, SensorTag, Str, ContainerTree))
+		{
+			ContainerTree->SetTagChannels_TS(SharedStr->GetObjID(), TagSlot, Str.BitChannels.Value);
+			Str.SetObjID(SharedStr->GetObjID());
+			Str.ContainerTree = ContainerTree;
+			Str.TagSlot = TagSlot;
+			return true;
+		}
 		{
 			const float CurrentTime = Ssc->GetWorld()->GetTimeSeconds();
 			FSensedStimulus NewElem;
 			const FBox Box = NewElem.Init(SensorTag, Ssc, Str.Score, Str.Age, CurrentTime, Str.BitChannels.Value);
 			if (NewElem.TmpHash != MAX_uint32 && NewElem.StimulusComponent.IsValid())
 			{
-				const uint16 ObjID = ContainerTree->Insert(MoveTemp(NewElem), Box);
-				Str.SetObjID(ObjID);
-				check(Str.GetObjID() != TNumericLimits<IContainerTree::ElementIndexType>::Max());
-				Str.ContainerTree = ContainerTree;
+				const IContainerTree::ElementIndexType ObjID = ContainerTree->Insert(MoveTemp(NewElem), Box);
+				if (ObjID != ContainerTree->MaxIndex()) // container full, stimulus stays unregistered on this tag
+				{
+					if (TagSlot.IsShared())
+					{
+						ContainerTree->SetTagChannels_TS(ObjID, TagSlot, Str.BitChannels.Value);
+					}
+					Str.SetObjID(ObjID);
+					Str.ContainerTree = ContainerTree;
+					Str.TagSlot = TagSlot;
+				}
 			}
 		}
 		return true;
@@ -92,13 +332,28 @@ bool FRegisteredSensorTags::RemoveSenseStimulus_Internal(USenseStimulusBase* Ssc
 	{
 		if (IContainerTree* ContainerTree = GetContainerTree(SensorTag))
 		{
-			ContainerTree->Remove(Str.GetObjID());
+			if (Str.GetObjID() != ContainerTree->MaxIndex())
+			{
+				// the element stays for the other tags sharing it
+				if (Str.ContainerTree == ContainerTree && Ssc->IsSharedTreeElement(Str))
+				{
+					ContainerTree->SetTagChannels_TS(Str.GetObjID(), Str.TagSlot, 0);
+				}
+				else
+				{
+					ContainerTree->Remove(Str.GetObjID());
+				}
+			}
 
 			Str.SetObjID(TNumericLimits<IContainerTree::ElementIndexType>::Max());
 			Str.ContainerTree = nullptr;
+			Str.TagSlot = FSenseSysTagSlot();
 			if (ContainerTree->Num() <= 0)
 			{
-				return SenseRegChannels.Remove(SensorTag) != 0;
+				// a sense thread batch may still hold the tree, RemoveEmptyTrees deletes it
+				bool bAlreadyEmpty = false;
+				EmptyTreeKeys.Add(GetTreeKey(SensorTag), &bAlreadyEmpty);
+				return !bAlreadyEmpty;
 			}
 		}
 	}
@@ -122,6 +377,126 @@ bool FRegisteredSensorTags::AddSenseStimulus(USenseStimulusBase* Ssc)
 	return bDone;
 }
 
+void FRegisteredSensorTags::AddSenseStimulusBatch(const TArray<USenseStimulusBase*>& InStimuli, TArray<USenseStimulusBase*>& OutRegistered)
+{
+	struct FTagBatch
+	{
+		IContainerTree* ContainerTree = nullptr;
+		TArray<FSensedStimulus> Elements;
+		TArray<FBox> Boxes;
+		TArray<FStimulusTagResponse*> Responses;
+		/** responses of further tags carried by Elements[Key] of a shared tree */
+		TArray<TPair<int32, FStimulusTagResponse*>> SharedResponses;
+	};
+	TMap<FName, FTagBatch> TagBatches;
+
+	FScopeLock ScopeLock(&CriticalSection);
+
+	OutRegistered.Reserve(OutRegistered.Num() + InStimuli.Num());
+	for (USenseStimulusBase* Ssc : InStimuli)
+	{
+		if (!IsValid(Ssc) || !Ssc->GetWorld())
+		{
+			continue;
+		}
+
+		bool bDone = false;
+		const float CurrentTime = Ssc->GetWorld()->GetTimeSeconds();
+		// elements of this stimulus added to shared trees, the batch key and the element index
+		TArray<TPair<FName, int32>, TInlineAllocator<4>> SharedElements;
+		for (auto& It : Ssc->TagResponse)
+		{
+			FStimulusTagResponse& Str = It.Value;
+			if (It.Key != NAME_None && Str.BitChannels.Value != 0)
+			{
+				bDone = true;
+				const FName TreeKey = GetTreeKey(It.Key);
+				FTagBatch& Batch = TagBatches.FindOrAdd(TreeKey);
+				if (Batch.ContainerTree == nullptr)
+				{
+					Batch.ContainerTree = GetContainerTree(It.Key);
+					if (Batch.ContainerTree == nullptr)
+					{
+						Batch.ContainerTree = SenseRegChannels.Add(TreeKey, MakeTree(TreeKey)).Get();
+					}
+				}
+				check(Batch.ContainerTree);
+				Str.TagSlot = Batch.ContainerTree->GetTagSlot(It.Key);
+
+				FSensedStimulus NewElem;
+				const FBox Box = NewElem.Init(It.Key, Ssc, Str.Score, Str.Age, CurrentTime, Str.BitChannels.Value);
+				if (NewElem.TmpHash != MAX_uint32 && NewElem.StimulusComponent.IsValid())
+				{
+					int32 SharedIdx = INDEX_NONE;
+					for (const TPair<FName, int32>& Shared : SharedElements)
+					{
+						if (Shared.Key != TreeKey)
+						{
+							continue;
+						}
+						const FSensedStimulus& Elem = Batch.Elements[Shared.Value];
+						if (Elem.Score == NewElem.Score && Elem.Age == NewElem.Age && Elem.SensedPoints == NewElem.SensedPoints)
+						{
+							SharedIdx = Shared.Value;
+							break;
+						}
+					}
+					if (SharedIdx != INDEX_NONE)
+					{
+						// the tree mask is the union, the channels of each tag are set after the insert
+						Batch.Elements[SharedIdx].BitChannels |= Str.BitChannels.Value;
+						Batch.SharedResponses.Emplace(SharedIdx, &Str);
+						continue;
+					}
+					if (Batch.ContainerTree->GetTagSlots().Num())
+					{
+						SharedElements.Emplace(TreeKey, Batch.Elements.Num());
+					}
+					Batch.Elements.Add(MoveTemp(NewElem));
+					Batch.Boxes.Add(Box);
+					Batch.Responses.Add(&Str);
+				}
+			}
+		}
+		if (bDone)
+		{
+			OutRegistered.Add(Ssc);
+		}
+	}
+
+	for (auto& It : TagBatches)
+	{
+		FTagBatch& Batch = It.Value;
+		IContainerTree* ContainerTree = Batch.ContainerTree;
+		TArray<IContainerTree::ElementIndexType> ObjIDs;
+		ContainerTree->BulkInsert(MoveTemp(Batch.Elements), Batch.Boxes, ObjIDs);
+
+		check(ObjIDs.Num() == Batch.Responses.Num());
+		for (int32 i = 0; i < ObjIDs.Num(); ++i)
+		{
+			FStimulusTagResponse& Str = *Batch.Responses[i];
+			if (ObjIDs[i] != ContainerTree->MaxIndex())
+			{
+				if (Str.TagSlot.IsShared())
+				{
+					ContainerTree->SetTagChannels_TS(ObjIDs[i], Str.TagSlot, Str.BitChannels.Value);
+				}
+				Str.SetObjID(ObjIDs[i]);
+				Str.ContainerTree = ContainerTree;
+			}
+		}
+		for (const TPair<int32, FStimulusTagResponse*>& Shared : Batch.SharedResponses)
+		{
+			if (ObjIDs[Shared.Key] != ContainerTree->MaxIndex())
+			{
+				ContainerTree->SetTagChannels_TS(ObjIDs[Shared.Key], Shared.Value->TagSlot, Shared.Value->BitChannels.Value);
+				Shared.Value->SetObjID(ObjIDs[Shared.Key]);
+				Shared.Value->ContainerTree = ContainerTree;
+			}
+		}
+	}
+}
+
 bool FRegisteredSensorTags::RemoveSenseStimulus(USenseStimulusBase* Ssc)
 {
 	bool bDone = false;
@@ -165,7 +540,7 @@ const IContainerTree* FRegisteredSensorTags::GetContainerTree(const FName& Tag)
 	if (Tag != NAME_None)
 	{
 		FScopeLock ScopeLock(&CriticalSection);
-		if (const TUniquePtr<IContainerTree>* Ptr = SenseRegChannels.Find(Tag))
+		if (const TUniquePtr<IContainerTree>* Ptr = SenseRegChannels.Find(GetTreeKey(Tag)))
 		{
 			return (*Ptr).Get();
 		}
@@ -178,7 +553,7 @@ IContainerTree* FRegisteredSensorTags::GetContainerTree(const FName& Tag)
 	if (Tag != NAME_None)
 	{
 		FScopeLock ScopeLock(&CriticalSection);
-		if (const TUniquePtr<IContainerTree>* Ptr = SenseRegChannels.Find(Tag))
+		if (const TUniquePtr<IContainerTree>* Ptr = SenseRegChannels.Find(GetTreeKey(Tag)))
 		{
 			return (*Ptr).Get();
 		}
@@ -195,10 +570,12 @@ void FRegisteredSensorTags::Empty()
 void FRegisteredSensorTags::Empty_Internal()
 {
 	SenseRegChannels.Empty();
+	EmptyTreeKeys.Empty();
 }
 void FRegisteredSensorTags::Remove(const FName SensorTag)
 {
-	SenseRegChannels.Remove(SensorTag);
+	SenseRegChannels.Remove(GetTreeKey(SensorTag));
+	EmptyTreeKeys.Remove(GetTreeKey(SensorTag));
 }
 
 
@@ -211,6 +588,12 @@ USenseManager::USenseManager()
 	{
 		WaitTime = Settings->WaitTimeBetweenCyclesUpdate;
 		CounterLimit = Settings->CountPerOneCyclesUpdate;
+		CollapseBudget = Settings->CollapseNodesPerTick;
+		CompactFragmentation = Settings->CompactFragmentation;
+		CompactMinFreeSlots = Settings->CompactMinFreeSlots;
+		AutoTuneInterval = Settings->AutoTuneInterval;
+		AutoTuneMinGain = Settings->AutoTuneMinGain;
+		bAutoTuneTags = HasAutoTuneTag(*Settings);
 	}
 	FCoreDelegates::PostWorldOriginOffset.AddUObject(this, &USenseManager::PostWorldOriginOffsetUpdt);
 	FCoreDelegates::PreWorldOriginOffset.AddUObject(this, &USenseManager::PreWorldOriginOffsetUpdt);
@@ -221,6 +604,12 @@ USenseManager::USenseManager(FVTableHelper& Helper)
 	{
 		WaitTime = Settings->WaitTimeBetweenCyclesUpdate;
 		CounterLimit = Settings->CountPerOneCyclesUpdate;
+		CollapseBudget = Settings->CollapseNodesPerTick;
+		CompactFragmentation = Settings->CompactFragmentation;
+		CompactMinFreeSlots = Settings->CompactMinFreeSlots;
+		AutoTuneInterval = Settings->AutoTuneInterval;
+		AutoTuneMinGain = Settings->AutoTuneMinGain;
+		bAutoTuneTags = HasAutoTuneTag(*Settings);
 	}
 	FCoreDelegates::PostWorldOriginOffset.AddUObject(this, &USenseManager::PostWorldOriginOffsetUpdt);
 	FCoreDelegates::PreWorldOriginOffset.AddUObject(this, &USenseManager::PreWorldOriginOffsetUpdt);
@@ -236,6 +625,7 @@ void USenseManager::Cleanup()
 	Close_SenseThread();
 
 	RegisteredSensorTags.Empty();
+	PendingStimuli.Empty();
 	Receivers.Empty();
 
 	ReportStimulus_Event.Clear();
@@ -255,14 +645,18 @@ void USenseManager::BeginDestroy()
 
 void USenseManager::Add_SenseStimulus(USenseStimulusBase* Ssc, const FName& SensorTag, FStimulusTagResponse& Str)
 {
-	if (Ssc && Ssc->GetWorld() == GetWorld())
+	// a pending stimulus registers all its tags on the flush
+	if (Ssc && Ssc->GetWorld() == GetWorld() && !PendingStimuli.Contains(Ssc))
 	{
 		RegisteredSensorTags.Add_SenseStimulus(Ssc, SensorTag, Str);
 	}
 }
 void USenseManager::Remove_SenseStimulus(USenseStimulusBase* Ssc, const FName& SensorTag, FStimulusTagResponse& Str)
 {
-	RegisteredSensorTags.Remove_SenseStimulus(Ssc, SensorTag, Str);
+	if (!PendingStimuli.Contains(Ssc))
+	{
+		RegisteredSensorTags.Remove_SenseStimulus(Ssc, SensorTag, Str);
+	}
 }
 
 bool USenseManager::IsHaveStimulusTag(const FName Tag) const
@@ -280,7 +674,7 @@ bool USenseManager::HaveReceivers() const
 }
 bool USenseManager::HaveSenseStimulus() const
 {
-	return RegisteredSensorTags.GetMap().Num() > 0;
+	return RegisteredSensorTags.GetMap().Num() > 0 || PendingStimuli.Num() > 0;
 }
 
 bool USenseManager::SenseThread_CreateIfNeed()
@@ -329,6 +723,12 @@ void USenseManager::Initialize(FSubsystemCollectionBase& Collection)
 	{
 		WaitTime = Settings->WaitTimeBetweenCyclesUpdate;
 		CounterLimit = Settings->CountPerOneCyclesUpdate;
+		CollapseBudget = Settings->CollapseNodesPerTick;
+		CompactFragmentation = Settings->CompactFragmentation;
+		CompactMinFreeSlots = Settings->CompactMinFreeSlots;
+		AutoTuneInterval = Settings->AutoTuneInterval;
+		AutoTuneMinGain = Settings->AutoTuneMinGain;
+		bAutoTuneTags = HasAutoTuneTag(*Settings);
 	}
 }
 
@@ -354,8 +754,59 @@ bool USenseManager::RegisterSenseStimulus(USenseStimulusBase* Stimulus)
 	return false;
 }
 
+bool USenseManager::QueueSenseStimulus(USenseStimulusBase* Stimulus)
+{
+	if (IsValid(Stimulus) && Stimulus->GetWorld() == GetWorld())
+	{
+		for (const auto& It : Stimulus->TagResponse)
+		{
+			if (It.Key != NAME_None && It.Value.BitChannels.Value != 0)
+			{
+				PendingStimuli.Add(Stimulus);
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+void USenseManager::FlushPendingStimuli()
+{
+	if (PendingStimuli.Num() == 0)
+	{
+		return;
+	}
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_SenseManager_FlushPendingStimuli);
+
+	TArray<USenseStimulusBase*> Stimuli = PendingStimuli.Array();
+	PendingStimuli.Empty();
+	RegisterSenseStimulusBatch(Stimuli);
+}
+
+int32 USenseManager::RegisterSenseStimulusBatch(const TArray<USenseStimulusBase*>& InStimuli)
+{
+	TArray<USenseStimulusBase*> Registered;
+	RegisteredSensorTags.AddSenseStimulusBatch(InStimuli, Registered);
+	for (USenseStimulusBase* Stimulus : Registered)
+	{
+		StimulusCount++;
+		On_UnregisterReceiver.AddUniqueDynamic(Stimulus, &USenseStimulusBase::OnUnregisterReceiver);
+	}
+	if (Registered.Num())
+	{
+		SenseThread_CreateIfNeed();
+	}
+	return Registered.Num();
+}
+
 bool USenseManager::UnRegisterSenseStimulus(USenseStimulusBase* Stimulus)
 {
+	// not in the trees yet, no sensor has seen it
+	if (Stimulus && PendingStimuli.Remove(Stimulus) != 0)
+	{
+		SenseThread_DeleteIfNeed();
+		return true;
+	}
 	if (Stimulus && StimulusCount > 0)
 	{
 		if (On_UnregisterStimulus.IsBound())
@@ -664,10 +1115,376 @@ FBox USenseManager::GetIntersectTreeBox(const FName SensorTag, const FBox InBox)
 
 void USenseManager::Tick(const float DeltaTime)
 {
-	if (TickingTimer.TickTimer(DeltaTime))
+	UpdateQueryCounting();
+	FlushPendingStimuli();
+	RegisteredSensorTags.FlushStagedUpdates();
+	RegisteredSensorTags.PublishSnapshots();
+	RegisteredSensorTags.CollapseQueuedTrees(CollapseBudget);
+	CompactFragmentedTree();
+	AutoTuneTree();
+	UpdateTreeStats();
+
+	// trees emptied by removes go once no sense thread batch can hold them
+	if (!SenseThread.IsValid() || SenseThread->IsQueueEmpty())
+	{
+		if (RegisteredSensorTags.RemoveEmptyTrees())
+		{
+			SenseThread_DeleteIfNeed();
+		}
+	}
+}
+
+void USenseManager::UpdateQueryCounting() const
+{
+	bool bCount = GSenseSysTreeQueryCounters;
+#if STATS
+	bCount = bCount || FThreadStats::IsCollectingData();
+#endif //STATS
+	for (const auto& It : RegisteredSensorTags.GetMap())
+	{
+		// only the auto tuned trees pay for the counters otherwise
+		const FSensorTagSettings* STagSettings = bCount || !bAutoTuneTags ? nullptr : FRegisteredSensorTags::FindTreeSettings(It.Key);
+		It.Value->SetQueryCounting(bCount || (STagSettings && STagSettings->bAutoTune));
+	}
+}
+
+void USenseManager::UpdateTreeStats()
+{
+#if STATS
+	if (!FThreadStats::IsCollectingData())
+	{
+		return;
+	}
+	FSenseSysTreeStats Total;
+	for (const auto& It : RegisteredSensorTags.GetMap())
+	{
+		FSenseSysTreeStats Stats;
+		It.Value->GetStats(Stats);
+		Total.NumElements += Stats.NumElements;
+		Total.NumNodes += Stats.NumNodes;
+		Total.NumLeaves += Stats.NumLeaves;
+		Total.MaxDepth = FMath::Max(Total.MaxDepth, Stats.MaxDepth);
+		Total.PoolBytes += Stats.PoolBytes + Stats.DataBytes + Stats.ElementPoolBytes;
+		Total.Queries += Stats.Queries;
+		Total.VisitedNodes += Stats.VisitedNodes;
+		Total.VisitedElements += Stats.VisitedElements;
+	}
+	SET_DWORD_STAT(STAT_SenseSys_TreeElements, Total.NumElements);
+	SET_DWORD_STAT(STAT_SenseSys_TreeNodes, Total.NumNodes);
+	SET_DWORD_STAT(STAT_SenseSys_TreeLeaves, Total.NumLeaves);
+	SET_DWORD_STAT(STAT_SenseSys_TreeMaxDepth, Total.MaxDepth);
+	SET_MEMORY_STAT(STAT_SenseSys_TreeMemory, Total.PoolBytes);
+
+	// the counters only grow until a reset, a smaller total starts over
+	if (Total.Queries < StatQueries)
 	{
-		RegisteredSensorTags.CollapseAllTrees();
+		StatQueries = 0;
+		StatVisitedNodes = 0;
+		StatVisitedElements = 0;
 	}
+	SET_DWORD_STAT(STAT_SenseSys_TreeQueries, Total.Queries - StatQueries);
+	SET_DWORD_STAT(STAT_SenseSys_TreeVisitedNodes, Total.VisitedNodes - StatVisitedNodes);
+	SET_DWORD_STAT(STAT_SenseSys_TreeVisitedElements, Total.VisitedElements - StatVisitedElements);
+	StatQueries = Total.Queries;
+	StatVisitedNodes = Total.VisitedNodes;
+	StatVisitedElements = Total.VisitedElements;
+#endif //STATS
+}
+
+bool USenseManager::GetTreeStats(const FName SensorTag, FSenseSysTreeStats& OutStats) const
+{
+	if (const IContainerTree* Tree = GetNamedContainerTree(SensorTag))
+	{
+		Tree->GetStats(OutStats);
+		return true;
+	}
+	return false;
+}
+
+void USenseManager::ResetTreeStats(const FName SensorTag)
+{
+	for (const auto& It : RegisteredSensorTags.GetMap())
+	{
+		if (SensorTag.IsNone() || It.Key == RegisteredSensorTags.GetTreeKey(SensorTag))
+		{
+			It.Value->ResetStats();
+		}
+	}
+}
+
+void USenseManager::LogTreeStats(const FName SensorTag) const
+{
+	for (const auto& It : RegisteredSensorTags.GetMap())
+	{
+		if (!SensorTag.IsNone() && It.Key != RegisteredSensorTags.GetTreeKey(SensorTag))
+		{
+			continue;
+		}
+		FSenseSysTreeStats S;
+		It.Value->GetStats(S);
+
+		FString Histogram;
+		for (int32 i = 0; i < FSenseSysTreeStats::HistogramNum; i++)
+		{
+			Histogram += FString::Printf(TEXT(" %d"), S.LeafHistogram[i]);
+		}
+		UE_LOG(
+			LogSenseSys,
+			Log,
+			TEXT("SenseSys.TreeStats %s: Elements %d, Nodes %d, Leaves %d, MaxDepth %d, AvgDepth %.2f, ElementsPerLeaf [0,1,2-3,..,64+]%s"),
+			*It.Key.ToString(),
+			S.NumElements,
+			S.NumNodes,
+			S.NumLeaves,
+			S.MaxDepth,
+			S.GetAvgDepth(),
+			*Histogram);
+		UE_LOG(
+			LogSenseSys,
+			Log,
+			TEXT("SenseSys.TreeStats %s: Pool %llu B, Data %llu B, ElementPool %llu B, Splits %llu, Collapses %llu, Reinserts %llu"),
+			*It.Key.ToString(),
+			static_cast<uint64>(S.PoolBytes),
+			static_cast<uint64>(S.DataBytes),
+			static_cast<uint64>(S.ElementPoolBytes),
+			S.Splits,
+			S.Collapses,
+			S.Reinserts);
+		UE_LOG(
+			LogSenseSys,
+			Log,
+			TEXT("SenseSys.TreeStats %s: Queries %llu, AvgVisitedNodes %.2f, AvgVisitedElements %.2f"),
+			*It.Key.ToString(),
+			S.Queries,
+			S.GetAvgVisitedNodes(),
+			S.GetAvgVisitedElements());
+		if (S.NodeCantSplit > 0)
+		{
+			UE_LOG(
+				LogSenseSys,
+				Log,
+				TEXT("SenseSys.TreeStats %s: MinimumQuadTreeSize %.1f, NodeCantSplit %d"),
+				*It.Key.ToString(),
+				S.MinimumSize,
+				S.NodeCantSplit);
+		}
+	}
+}
+
+void USenseManager::CompactFragmentedTree()
+{
+	const TMap<FName, TUniquePtr<IContainerTree>>& Map = RegisteredSensorTags.GetMap();
+	if (CompactFragmentation <= 0.f || Map.Num() == 0)
+	{
+		return;
+	}
+	// sensors waiting for the sense thread would only be delayed by the repack
+	if (SenseThread.IsValid() && !SenseThread->IsQueueEmpty())
+	{
+		return;
+	}
+
+	CompactTagIdx = (CompactTagIdx + 1) % Map.Num();
+	auto It = Map.CreateConstIterator();
+	for (int32 i = 0; i < CompactTagIdx; ++i)
+	{
+		++It;
+	}
+	IContainerTree* ContainerTree = It.Value().Get();
+	check(ContainerTree);
+	if (ContainerTree->NumFreeSlots() >= CompactMinFreeSlots && ContainerTree->GetFragmentation() >= CompactFragmentation)
+	{
+		CompactTree(It.Key(), *ContainerTree);
+	}
+}
+
+void USenseManager::AutoTuneTree()
+{
+	// fewer queries since the last check say little about the cost
+	constexpr uint64 MinQueries = 200;
+	// a node visit against one element test, the node box test and the walk to the children
+	constexpr double NodeCost = 4.0;
+	constexpr int32 ElementSamples = 1024;
+
+	if (FinishAutoTuneBuild())
+	{
+		return;
+	}
+	const TMap<FName, TUniquePtr<IContainerTree>>& Map = RegisteredSensorTags.GetMap();
+	if (Map.Num() == 0)
+	{
+		return;
+	}
+	if (SenseThread.IsValid() && !SenseThread->IsQueueEmpty())
+	{
+		return;
+	}
+
+	AutoTuneTagIdx = (AutoTuneTagIdx + 1) % Map.Num();
+	auto It = Map.CreateConstIterator();
+	for (int32 i = 0; i < AutoTuneTagIdx; ++i)
+	{
+		++It;
+	}
+	const FSensorTagSettings* STagSettings = FRegisteredSensorTags::FindTreeSettings(It.Key());
+	if (!STagSettings || !STagSettings->bAutoTune)
+	{
+		return;
+	}
+	IContainerTree* ContainerTree = It.Value().Get();
+	check(ContainerTree);
+
+	const double Now = FPlatformTime::Seconds();
+	FAutoTuneState& State = AutoTuneStates.FindOrAdd(It.Key());
+	if (State.TreeSerial == ContainerTree->GetSerial() && Now - State.Time < AutoTuneInterval)
+	{
+		return;
+	}
+
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_SenseManager_AutoTuneTree);
+
+	FSenseSysTreeStats S;
+	ContainerTree->GetStats(S);
+	const bool bSameTree = State.TreeSerial == ContainerTree->GetSerial() && S.Queries >= State.Queries;
+	const uint64 Queries = S.Queries - State.Queries;
+	const double AvgNodes = Queries ? static_cast<double>(S.VisitedNodes - State.VisitedNodes) / Queries : 0.0;
+	const double AvgElements = Queries ? static_cast<double>(S.VisitedElements - State.VisitedElements) / Queries : 0.0;
+	State.TreeSerial = ContainerTree->GetSerial();
+	State.Time = Now;
+	State.Queries = S.Queries;
+	State.VisitedNodes = S.VisitedNodes;
+	State.VisitedElements = S.VisitedElements;
+	if (!bSameTree || S.NodeCantSplit <= 0 || Queries < MinQueries || AvgNodes <= 0.0 || AvgElements <= 0.0)
+	{
+		return;
+	}
+
+	// visited nodes fall and visited elements grow about linearly with the elements per leaf,
+	// NodeCost * Nodes / Scale + Elements * Scale is lowest at Scale = Sqrt(NodeCost * Nodes / Elements)
+	const double OldCost = NodeCost * AvgNodes + AvgElements;
+	const double BestScale = FMath::Clamp(FMath::Sqrt(NodeCost * AvgNodes / AvgElements), 0.25, 4.0);
+	const int32 NewNodeCantSplit = FMath::Clamp(FMath::RoundToInt(S.NodeCantSplit * BestScale), 4, 128);
+	const double Scale = static_cast<double>(NewNodeCantSplit) / S.NodeCantSplit;
+	const double Gain = 1.0 - (NodeCost * AvgNodes / Scale + AvgElements * Scale) / OldCost;
+
+	// nodes below twice the typical element only hold elements on their edges
+	const float ElementSize = ContainerTree->GetMedianElementSize(ElementSamples);
+	const float NewMinimumSize = ElementSize > 0.f ? FMath::Clamp(ElementSize * 2.f, 10.f, 100000.f) : S.MinimumSize;
+
+	if (Gain < AutoTuneMinGain)
+	{
+		return;
+	}
+	State.Build = ContainerTree->BeginRetune(NewMinimumSize, NewNodeCantSplit);
+	if (!State.Build.IsValid())
+	{
+		return;
+	}
+	State.BuildReport = FString::Printf(
+		TEXT("SenseSys.AutoTune %s: MinimumQuadTreeSize %.1f -> %.1f, NodeCantSplit %d -> %d, predicted gain %.0f%%, AvgVisitedNodes %.2f, AvgVisitedElements %.2f"),
+		*It.Key().ToString(),
+		S.MinimumSize,
+		NewMinimumSize,
+		S.NodeCantSplit,
+		NewNodeCantSplit,
+		Gain * 100.0,
+		AvgNodes,
+		AvgElements);
+	// the build holds its own copy, it outlives the tree and the manager safely
+	State.BuildTask = Async(EAsyncExecution::ThreadPool, [Build = State.Build]() { Build->Build(); });
+}
+
+bool USenseManager::FinishAutoTuneBuild()
+{
+	for (auto& It : AutoTuneStates)
+	{
+		FAutoTuneState& State = It.Value;
+		if (!State.Build.IsValid())
+		{
+			continue;
+		}
+		if (!State.BuildTask.IsReady())
+		{
+			return true;
+		}
+
+		QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_SenseManager_FinishAutoTuneBuild);
+
+		// a tree made again meanwhile has nothing to do with the build
+		const TUniquePtr<IContainerTree>* ContainerTree = RegisteredSensorTags.GetMap().Find(It.Key);
+		if (ContainerTree && (*ContainerTree)->GetSerial() == State.Build->TreeSerial)
+		{
+			if ((*ContainerTree)->FinishRetune(*State.Build))
+			{
+				UE_LOG(LogSenseSys, Log, TEXT("%s"), *State.BuildReport);
+			}
+			else
+			{
+				UE_LOG(LogSenseSys, Verbose, TEXT("SenseSys.AutoTune %s: stimuli changed during the build, retried later"), *It.Key.ToString());
+			}
+		}
+		State.Build.Reset();
+		State.BuildTask = TFuture<void>();
+		State.BuildReport.Empty();
+		return false;
+	}
+	return false;
+}
+
+bool USenseManager::CompactTree(const FName TreeKey, IContainerTree& ContainerTree)
+{
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_SenseManager_CompactTree);
+	check(IsInGameThread());
+
+	// pending IDs of the tag are held here meanwhile, a sensor update finds none instead of stale ones
+	TArray<USensorBase*, TInlineAllocator<16>> TagSensors;
+	TArray<TMap<IContainerTree::ElementIndexType, uint32>, TInlineAllocator<16>> TagPending;
+	for (USenseReceiverComponent* Receiver : Receivers)
+	{
+		for (uint8 i = 1; i < 4; i++)
+		{
+			for (USensorBase* const Sensor : Receiver->GetSensorsByType(static_cast<ESensorType>(i)))
+			{
+				if (IsValid(Sensor) && RegisteredSensorTags.GetTreeKey(Sensor->SensorTag) == TreeKey)
+				{
+					TagSensors.Add(Sensor);
+					TagPending.Add(Sensor->TakePendingUpdate());
+				}
+			}
+		}
+	}
+
+	TArray<IContainerTree::ElementIndexType> Remap;
+	const bool bCompacted = ContainerTree.Compact(Remap);
+	if (bCompacted)
+	{
+		// every tag of a shared tree moves, a stimulus can hold several elements of the tree
+		TSet<USenseStimulusBase*> TreeStimuli;
+		for (const FSensedStimulus& Elem : ContainerTree.GetCompDataPool())
+		{
+			if (USenseStimulusBase* Ssc = Elem.StimulusComponent.Get())
+			{
+				TreeStimuli.Add(Ssc);
+			}
+		}
+		for (USenseStimulusBase* Ssc : TreeStimuli)
+		{
+			for (auto& It : Ssc->TagResponse)
+			{
+				FStimulusTagResponse& Str = It.Value;
+				if (Str.ContainerTree == &ContainerTree && Remap.IsValidIndex(Str.GetObjID()))
+				{
+					Str.SetObjID(Remap[Str.GetObjID()]);
+				}
+			}
+		}
+	}
+
+	for (int32 i = 0; i < TagSensors.Num(); i++)
+	{
+		TagSensors[i]->RestorePendingUpdate(MoveTemp(TagPending[i]), bCompacted ? &Remap : nullptr);
+	}
+	return bCompacted;
 }
 
 
@@ -744,10 +1561,11 @@ void USenseManager::PostWorldOriginOffsetUpdt(UWorld* InWorld, FIntVector Origin
 		}
 	}
 
+	RegisterSenseStimulusBatch(StimulsWorldOrigin.Array());
+
 	for (USenseStimulusBase* It : StimulsWorldOrigin)
 	{
 		It->bRegisteredForSense = true;
-		RegisterSenseStimulus(It);
 
 		if (const auto OwnerActor = It->GetOwner())
 		{
@@ -55,65 +55,51 @@ void FStimulusTagResponse::SetBitChannels(const uint64 NewBit)
 	if (ContainerTree)
 	{
 		check(GetObjID() != TNumericLimits<ElementIndexType>::Max());
-		ContainerTree->SetChannels_TS(GetObjID(), NewBit);
+		ContainerTree->SetTagChannels_TS(GetObjID(), TagSlot, NewBit);
 	}
 }
 
 
-void FStimulusTagResponse::UpdatePosition(const FVector& NewLocation, const TArray<FVector>& Points, const float CurrentTime, const bool bAllPoints) const
+bool FStimulusTagResponse::UpdatePosition(TArray<FVector>&& Points, const uint32 StimulusHash, const float CurrentTime, const bool bAllPoints, const bool bSwept)
 {
-	if (ContainerTree)
+	bool bSweepOpen = false;
+	if (ContainerTree && Points.Num())
 	{
 		check(GetObjID() != TNumericLimits<ElementIndexType>::Max());
 
-		IContainerTree& CTree = *ContainerTree;
-		FSensedStimulus SS = CTree.GetSensedStimulusCopy_Simple_TS(GetObjID());
-		checkSlow(SS.StimulusComponent.IsValid());
-
-		FBox NewBox(NewLocation, NewLocation);
-		auto SP0 = FSensedPoint(NewLocation, SS.Score);
-		bool bNeedUpdt = false;
+		IContainerTree::FUpdateItem Item;
+		Item.ObjID = GetObjID();
+		Item.TmpHash = StimulusHash;
+		Item.Time = CurrentTime;
+		Item.bAllPoints = bAllPoints;
+		Item.Box = FBox(Points[0], Points[0]);
 		if (bAllPoints)
 		{
-			const int32 PNum = Points.Num();
-
-			if (PNum + 1 != SS.SensedPoints.Num())
-			{
-				SS.SensedPoints.SetNum(PNum + 1);
-				bNeedUpdt |= true;
-			}
-
-			if (bNeedUpdt || SS.SensedPoints[0] != SP0)
-			{
-				SS.SensedPoints[0] = MoveTemp(SP0);
-				bNeedUpdt |= true;
-			}
-
-			for (int32 i = 0; i < PNum; i++)
+			for (int32 i = 1; i < Points.Num(); i++)
 			{
-				auto SP = FSensedPoint(Points[i], SS.Score);
-				if (bNeedUpdt || SS.SensedPoints[i + 1] != SP)
-				{
-					SS.SensedPoints[i + 1] = MoveTemp(SP);
-					NewBox += Points[i];
-					bNeedUpdt |= true;
-				}
-			}
-			if (bNeedUpdt)
-			{
-				CTree.SetSensedPoints_TS(GetObjID(), MoveTemp(SS.SensedPoints), CurrentTime);
+				Item.Box += Points[i];
 			}
 		}
-		else if (SS.SensedPoints[0] != SP0)
+		if (bSwept)
 		{
-			CTree.SetSensedPoints_TS(GetObjID(), FSensedPoint(NewLocation, SS.Score), CurrentTime);
-			bNeedUpdt |= true;
+			const FBox CurrentBox = Item.Box;
+			if (SweptFromBox.IsValid)
+			{
+				Item.Box += SweptFromBox;
+				Item.SweepOffset = Points[0] - SweptFromPoint;
+				bSweepOpen = !Item.SweepOffset.IsNearlyZero();
+			}
+			SweptFromBox = CurrentBox;
+			SweptFromPoint = Points[0];
 		}
-		if (bNeedUpdt)
+		else
 		{
-			CTree.Update(GetObjID(), NewBox);
+			SweptFromBox.Init();
 		}
+		Item.Points = MoveTemp(Points);
+		ContainerTree->StageUpdate(MoveTemp(Item));
 	}
+	return bSweepOpen;
 }
 
 bool FStimulusTagResponse::IsReceiveOnSense(const EOnSenseEvent SenseEvent) const
@@ -444,6 +430,30 @@ bool USenseStimulusBase::IsResponseTag(const FName& Tag) const
 	return false;
 }
 
+bool USenseStimulusBase::IsSharedTreeElement(const FStimulusTagResponse& Str) const
+{
+	if (Str.ContainerTree && Str.ContainerTree->GetTagSlots().Num())
+	{
+		for (const auto& It : TagResponse)
+		{
+			if (&It.Value != &Str && It.Value.ContainerTree == Str.ContainerTree && It.Value.GetObjID() == Str.GetObjID())
+			{
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+void USenseStimulusBase::ReRegisterSharedResponse(const FName& Tag, FStimulusTagResponse& Str)
+{
+	if (USenseManager* const Manager = GetSenseManager())
+	{
+		Manager->Remove_SenseStimulus(this, Tag, Str);
+		Manager->Add_SenseStimulus(this, Tag, Str);
+	}
+}
+
 
 bool USenseStimulusBase::RegisterSelfSense()
 {
@@ -461,7 +471,8 @@ bool USenseStimulusBase::RegisterSelfSense()
 				AllChan |= It.Value.BitChannels.Value;
 			}
 
-			bRegisteredForSense = AllChan == 0 ? false : GetSenseManager()->RegisterSenseStimulus(this);
+			// inserted with the other stimuli of the frame by the next SenseManager Tick
+			bRegisteredForSense = AllChan == 0 ? false : GetSenseManager()->QueueSenseStimulus(this);
 
 			if (IsRegisteredForSense())
 			{
@@ -1288,18 +1299,35 @@ void USenseStimulusBase::TickComponent(float DeltaTime, ELevelTick TickType, FAc
 				if (const auto SenseManagerPtr = GetSenseManager())
 				{
 					const float PositionUpdateTime = World->GetTimeSeconds();
+					const uint32 StimulusHash = GetTypeHash(this);
+					// tags sharing a tree element move it once
+					TArray<TPair<const IContainerTree*, ElementIndexType>, TInlineAllocator<4>> Staged;
+					bool bSweepOpen = false;
 					for (auto& It : TagResponse)
 					{
 						if (SenseManagerPtr->IsHaveReceiverTag(It.Key)) //todo Event driven bool
 						{
-							const FVector NewLocation = GetSingleSensePoint(It.Key);
-							const TArray<FVector> Points = GetSensePoints(It.Key);
-							It.Value.UpdatePosition(NewLocation, Points, PositionUpdateTime, true);
+							if (It.Value.ContainerTree && It.Value.ContainerTree->GetTagSlots().Num())
+							{
+								const TPair<const IContainerTree*, ElementIndexType> Element(It.Value.ContainerTree, It.Value.GetObjID());
+								if (Staged.Contains(Element))
+								{
+									continue;
+								}
+								Staged.Add(Element);
+							}
+							const TArray<FVector> SensePoints = GetSensePoints(It.Key);
+							TArray<FVector> Points;
+							Points.Reserve(SensePoints.Num() + 1);
+							Points.Add(GetSingleSensePoint(It.Key));
+							Points.Append(SensePoints);
+							bSweepOpen |= It.Value.UpdatePosition(MoveTemp(Points), StimulusHash, PositionUpdateTime, true, bSweptBox);
 						}
 					}
 					if (Mobility == EStimulusMobility::MovableOwner)
 					{
-						bDirtyTransform = false;
+						// one more update after the last move closes the swept box
+						bDirtyTransform = bSweepOpen;
 					}
 				}
 			}
@@ -19,6 +19,7 @@ FBox FSensedStimulus::Init(
 		Age = InAge;
 		SensedTime = CurrentTime;
 		BitChannels = InBitChannels;
+		bStaticMobility = Component->Mobility == EStimulusMobility::Static;
 
 		const FSensedPoint P0 = FSensedPoint(StimulusComponent->GetSingleSensePoint(SensorTag), Score);
 		FBox NewBox(P0.SensedPoint, P0.SensedPoint);
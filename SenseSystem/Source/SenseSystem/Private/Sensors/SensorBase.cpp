@@ -257,6 +257,21 @@ bool USensorBase::PreUpdateSensor()
 	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_SensorPreUpdate);
 	if (IsValidForTest() /* && IsValid(GetSenseReceiverComponent())*/)
 	{
+		// before PreTest, the location tests follow the sweep
+		SensorSweep = FVector::ZeroVector;
+		if (bSweptQuery)
+		{
+			SweptTo.Location = GetSensorTransform().GetLocation();
+			if (SweptFrom.Box.IsValid)
+			{
+				SensorSweep = SweptTo.Location - SweptFrom.Location;
+			}
+		}
+		else
+		{
+			SweptFrom.Box.Init();
+		}
+
 		for (const auto It : SensorTests)
 		{
 			if (It && It->NeedTest())
@@ -264,6 +279,16 @@ bool USensorBase::PreUpdateSensor()
 				It->PreTest();
 			}
 		}
+
+		if (bSweptQuery)
+		{
+			float Radius;
+			GetSensorTest_BoxAndRadius(SweptTo.Box, Radius, false);
+			if (IsZeroBox(SweptTo.Box))
+			{
+				SweptTo.Box.Init();
+			}
+		}
 		return true;
 	}
 	return false;
@@ -296,17 +321,18 @@ bool USensorBase::UpdateSensor()
 				const auto ContainerTree = GetSenseManager()->GetNamedContainerTree(SensorTag);
 				if (ContainerTree && bIsHavePendingUpdate && SensorTests.Num() != 0)
 				{
-					TArray<ElementIndexType> OutIDs;
+					FSenseSysQueryIDs& OutIDs = QueryIDs;
+					OutIDs.Reset();
+					// marked before the IDs are taken, the tree is not compacted under them
+					ContainerTree->MarkRemoveControl();
 					{
 						FScopeLock Lock_CriticalSection(&SensorCriticalSection);
-						OutIDs = ContainerTree->CheckHash_TS(this->PendingUpdate);
-						this->PendingUpdate.Empty();
+						ContainerTree->CheckHash_TS(this->PendingUpdate, OutIDs);
+						this->PendingUpdate.Reset();
 					}
 					bIsHavePendingUpdate = false;
 
-					ContainerTree->MarkRemoveControl();
-
-					const bool bRes = SensorsTestForSpecifyComponents_V3(ContainerTree, MoveTemp(OutIDs));
+					const bool bRes = SensorsTestForSpecifyComponents_V3(ContainerTree, OutIDs.GetIDs());
 
 					if (ContainerTree) 
 						ContainerTree->ResetRemoveControl();
@@ -337,11 +363,15 @@ bool USensorBase::UpdateSensor()
 		}
 		else
 		{
-			const bool bDone = PreUpdateSensor() && RunSensorTest();
+			const bool bDone = (bBatchPreUpdated || PreUpdateSensor()) && RunSensorTest();
 			if (!bDone)
 			{
 				return false;
 			}
+			if (bSweptQuery)
+			{
+				SweptFrom = SweptTo;
+			}
 		}
 	}
 	//UpdateState = ESensorState::AgeUpdate;
@@ -504,6 +534,7 @@ void USensorBase::InitializeFromReceiver(USenseReceiverComponent* FromReceiver)
 		PrivateSenseReceiver = FromReceiver;
 		checkSlow(GetOuter() == GetSenseReceiverComponent());
 		SensorTransform = FromReceiver->GetSensorTransform(SensorTag);
+		SweptFrom.Box.Init();
 
 		//reset Ignored Arrays on Initialization
 		Ignored_Actors.Empty();
@@ -624,7 +655,7 @@ void USensorBase::Cleanup()
 	}
 }
 
-void USensorBase::GetSensorTest_BoxAndRadius(FBox& OutBox, float& OutRadius) const
+void USensorBase::GetSensorTest_BoxAndRadius(FBox& OutBox, float& OutRadius, const bool bWithSweep) const
 {
 	OutRadius = 0.f;
 	OutBox = FBox(FVector::ZeroVector, FVector::ZeroVector);
@@ -656,6 +687,30 @@ void USensorBase::GetSensorTest_BoxAndRadius(FBox& OutBox, float& OutRadius) con
 		const FVector Ext = FVector(OutRadius * 0.5f);
 		OutBox = FBox::BuildAABB(GetSensorTransform().GetLocation(), Ext);
 	}
+
+	if (bWithSweep && IsSweeping() && !IsZeroBox(OutBox))
+	{
+		// both ends bound the move, a sphere around one location does not
+		OutBox += SweptFrom.Box;
+		OutRadius = 0.f;
+	}
+}
+
+bool USensorBase::GetSensorTest_QueryShape(FSenseSysQueryShape& OutShape) const
+{
+	if (IsSweeping())
+	{
+		return false;
+	}
+	// every test must pass, so the volume of any one of them bounds the result
+	for (const USensorTestBase* St : SensorTests)
+	{
+		if (St && St->NeedTest() && St->GetSensorTestShape(OutShape))
+		{
+			return true;
+		}
+	}
+	return false;
 }
 
 void USensorBase::SetSensorThreadType(const ESensorThreadType NewSensorThreadType)
@@ -987,20 +1042,20 @@ void USensorBase::ReportSenseStimulusEvent(const ElementIndexType InStimulusID)
 				const auto ContainerTree = GetSenseManager()->GetNamedContainerTree(SensorTag);
 				if (ContainerTree && GetSenseManager())
 				{
-					TSet<ElementIndexType> IDs = {InStimulusID};
+					FSenseSysQueryIDs& IDs = QueryIDs;
+					IDs.Reset();
+					IDs.Add(InStimulusID);
 					if (bIsHavePendingUpdate && ContainerTree && IsValidForTest() && bIsHavePendingUpdate)
 					{
-						TArray<ElementIndexType, TMemStackAllocator<>> OutIDs;
 						{
 							FScopeLock Lock_CriticalSection(&SensorCriticalSection);
-							OutIDs = ContainerTree->CheckHashStack_TS(this->PendingUpdate);
-							this->PendingUpdate.Empty();
+							ContainerTree->CheckHash_TS(this->PendingUpdate, IDs);
+							this->PendingUpdate.Reset();
 						}
 						bIsHavePendingUpdate = false;
-						IDs.Append(OutIDs);
 					}
 
-					const bool bDone = SensorsTestForSpecifyComponents_V3(ContainerTree, MoveTemp(IDs));
+					const bool bDone = SensorsTestForSpecifyComponents_V3(ContainerTree, IDs.GetIDs());
 					if (bDone)
 					{
 						//UpdateState = ESensorState::TestUpdated;
@@ -1047,6 +1102,110 @@ void USensorBase::ReportSenseStimulusEvent(const ElementIndexType InStimulusID)
 }
 
 
+bool USensorBase::PrepareBatchQuery(FBox& OutBox, FVector& OutCenter, float& OutRadius, uint64& OutChannels)
+{
+	ResetBatchIDs();
+	//nearest stimuli are not a box query, such sensors run their own
+	if (SensorType != ESensorType::Passive && NearestStimulusCount == 0 && UpdateState.Get() == ESensorState::ReadyToUpdate && //
+		GetSensorUpdateReady() == EUpdateReady::Ready &&										  //
+		(BitChannels.Value & ~IgnoreBitChannels.Value) && SensorTests.Num() != 0 &&				  //
+		PreUpdateSensor())
+	{
+		bBatchPreUpdated = true;
+		//cone and frustum sensors prune the tree with their own volume
+		FSenseSysQueryShape Shape;
+		if (GetSensorTest_QueryShape(Shape))
+		{
+			return false;
+		}
+		GetSensorTest_BoxAndRadius(OutBox, OutRadius);
+		OutCenter = GetSensorTransform().GetLocation();
+		OutChannels = BitChannels.Value;
+		return !IsZeroBox(OutBox);
+	}
+	return false;
+}
+
+void USensorBase::SetBatchIDs(TArray<ElementIndexType>&& InIDs)
+{
+	BatchIDs = MoveTemp(InIDs);
+	bHaveBatchIDs = true;
+}
+
+void USensorBase::ResetBatchIDs()
+{
+	BatchIDs.Reset();
+	bBatchPreUpdated = false;
+	bHaveBatchIDs = false;
+	bBatchTreeMarked = false;
+}
+
+TMap<ElementIndexType, uint32> USensorBase::TakePendingUpdate()
+{
+	FScopeLock Lock_CriticalSection(&SensorCriticalSection);
+	return MoveTemp(PendingUpdate);
+}
+
+void USensorBase::RestorePendingUpdate(TMap<ElementIndexType, uint32>&& InPending, const TArray<ElementIndexType>* Remap)
+{
+	if (InPending.Num() == 0)
+	{
+		return;
+	}
+	{
+		FScopeLock Lock_CriticalSection(&SensorCriticalSection);
+		for (const auto& It : InPending)
+		{
+			const ElementIndexType NewID = Remap ? (Remap->IsValidIndex(It.Key) ? (*Remap)[It.Key] : TNumericLimits<ElementIndexType>::Max()) : It.Key;
+			if (NewID != TNumericLimits<ElementIndexType>::Max())
+			{
+				PendingUpdate.Add(NewID, It.Value);
+			}
+		}
+	}
+	bIsHavePendingUpdate = true;
+}
+
+void USensorBase::QueryBoxCandidates(const IContainerTree& ContainerTree, const FBox& Box, const float Radius, const uint64 TreeChannels, FSenseSysQueryIDs& Out)
+{
+	const FVector Center = Radius == 0.f ? FVector::ZeroVector : GetSensorTransform().GetLocation();
+	FCandidateCache& Cache = CandidateCache;
+	if (Cache.TreeSerial == ContainerTree.GetSerial() && Cache.Box == Box && Cache.Center == Center && Cache.Radius == Radius &&
+		Cache.Channels == TreeChannels && !ContainerTree.IsChangedSince(Box, Cache.Stamp))
+	{
+		Out.Append(Cache.IDs);
+		return;
+	}
+
+	// read before the query, a change between the two reads only costs one more query
+	const uint64 Stamp = ContainerTree.GetModStamp();
+	if (Radius == 0.f)
+	{
+		ContainerTree.GetInBoxIDs(Box, Out, TreeChannels);
+	}
+	else
+	{
+		ContainerTree.GetInBoxRadiusIDs(Box, Center, Radius, Out, TreeChannels);
+	}
+
+	// a tree without stamps reports every region as changed, nothing to keep
+	if (Stamp != 0)
+	{
+		Cache.TreeSerial = ContainerTree.GetSerial();
+		Cache.Box = Box;
+		Cache.Center = Center;
+		Cache.Radius = Radius;
+		Cache.Channels = TreeChannels;
+		Cache.Stamp = Stamp;
+		Cache.IDs.Reset();
+		Cache.IDs.Append(Out.GetIDs());
+	}
+	else
+	{
+		Cache.TreeSerial = 0;
+	}
+}
+
 bool USensorBase::RunSensorTest()
 {
 	if (IsValidForTest_Short())
@@ -1066,11 +1225,50 @@ bool USensorBase::RunSensorTest()
 					const IContainerTree& ContainerTreeRef = *ContainerTree;
 					if (!IsZeroBox(Box))
 					{
-						TSet<ElementIndexType> IDs;
+						// a shared tree keeps the union of its tags channels, the tag is filtered per element
+						const uint64 TreeChannels = BitChannels.Value;
+						FSenseSysQueryIDs& IDs = QueryIDs;
+						IDs.Reset();
+						FSenseSysQueryShape Shape;
 						ContainerTreeRef.MarkRemoveControl();
-						if (Radius == 0.f)
+						if (bHaveBatchIDs)
+						{
+							IDs.Append(BatchIDs);
+						}
+						else if (NearestStimulusCount > 0)
 						{
-							ContainerTreeRef.GetInBoxIDs(Box, IDs, BitChannels.Value);
+							const FVector Location = GetSensorTransform().GetLocation();
+							const float MaxRadius = Radius > 0.f ? Radius : FVector::Max(Location - Box.Min, Box.Max - Location).Size();
+							// ignored stimuli, the owner and other tags of a shared tree do not take the K slots
+							const FSenseSysTagSlot TagSlot = ContainerTreeRef.GetTagSlot(SensorTag);
+							ContainerTreeRef.GetKNearestIDs_Skip(
+								Location,
+								NearestStimulusCount,
+								MaxRadius,
+								NearestIDs,
+								TreeChannels,
+								Ignored_Components.Num(),
+								TagSlot,
+								[this](const FSensedStimulus& It, const uint64 TagChannels)
+								{ return (TagChannels & BitChannels.Value) == 0 || HashSorted::Contains_HashType(Ignored_Components, It.TmpHash); });
+							IDs.Append(NearestIDs);
+						}
+						else if (GetSensorTest_QueryShape(Shape))
+						{
+							if (Shape.Type == ESenseSysQueryShape::Cone)
+							{
+								ContainerTreeRef.GetInConeIDs(Box, Shape.Cone, IDs, TreeChannels);
+							}
+							else if (Shape.Type == ESenseSysQueryShape::Segment)
+							{
+								const FSenseSysSegment& Segment = Shape.Segment;
+								ContainerTreeRef.GetAlongSegmentIDs(Segment.Start, Segment.End, Segment.Radius, NearestIDs, TreeChannels);
+								IDs.Append(NearestIDs);
+							}
+							else
+							{
+								ContainerTreeRef.GetInFrustumIDs(Box, Shape.Frustum, IDs, TreeChannels);
+							}
 						}
 						//else if (Box.GetExtent().SizeSquared() == 0.f)
 						//{
@@ -1078,26 +1276,24 @@ bool USensorBase::RunSensorTest()
 						//}
 						else
 						{
-							ContainerTreeRef.GetInBoxRadiusIDs(Box, GetSensorTransform().GetLocation(), Radius, IDs, BitChannels.Value);
+							QueryBoxCandidates(ContainerTreeRef, Box, Radius, TreeChannels, IDs);
 						}
 
 						if (bIsHavePendingUpdate && ContainerTree && IsValidForTest_Short())
 						{
-							TArray<ElementIndexType, TMemStackAllocator<>> OutIDs;
 							{
 								FScopeLock Lock_CriticalSection(&SensorCriticalSection);
-								OutIDs = ContainerTree->CheckHashStack_TS(this->PendingUpdate);
-								this->PendingUpdate.Empty();
+								ContainerTree->CheckHash_TS(this->PendingUpdate, IDs);
+								this->PendingUpdate.Reset();
 							}
 							bIsHavePendingUpdate = false;
-							IDs.Append(MoveTemp(OutIDs));
 						}
 
 						if (ContainerTree && IsValidForTest_Short())
 						{
 							if (IDs.Num())
 							{
-								const bool bDoneSensorsTest = SensorsTestForSpecifyComponents_V3(ContainerTree, MoveTemp(IDs));
+								const bool bDoneSensorsTest = SensorsTestForSpecifyComponents_V3(ContainerTree, IDs.GetIDs());
 								if (ContainerTree)
 								{
 									ContainerTree->ResetRemoveControl();
@@ -1124,7 +1320,8 @@ bool USensorBase::RunSensorTest()
 								return true;
 							}
 #if WITH_EDITOR
-							check(ContainerTree->IsRemoveControlClear());
+							// the batch keeps its own mark until all of its sensors are updated, also for the ones that run their own query
+							check(bHaveBatchIDs || bBatchTreeMarked || ContainerTree->IsRemoveControlClear());
 #endif
 						}
 					}
@@ -1166,19 +1363,41 @@ float USensorBase::UpdtDetectPoolAndReturnMinScore() const
 	return MinScore;
 }
 
+TSharedPtr<const FSenseSysReadSnapshot, ESPMode::ThreadSafe> USensorBase::PinTreeSnapshot(
+	const IContainerTree* ContainerTree,
+	const TArray<ElementIndexType>& ObjIDs,
+	TArray<uint32>& OutGenerations)
+{
+	if (ContainerTree)
+	{
+		TSharedPtr<const FSenseSysReadSnapshot, ESPMode::ThreadSafe> Snapshot = ContainerTree->PinSnapshot();
+		if (Snapshot.IsValid())
+		{
+			// taken after the pin, an ObjID reused since the copy no longer matches it
+			ContainerTree->GetGenerations_TS(ObjIDs, OutGenerations);
+		}
+		return Snapshot;
+	}
+	return nullptr;
+}
+
 bool USensorBase::UpdtSensorTestForIDInternal(
 	const ElementIndexType Idx,
 	const IContainerTree* ContainerTree,
+	const FSenseSysReadSnapshot* Snapshot,
+	const uint32 Generation,
 	const float CurrentTime,
 	const float MinScore,
-	TArray<ElementIndexType>& ChannelContainsIDs) const
+	FChannelIDs& ChannelContainsIDs) const
 {
 	if (LIKELY(IsValidForTest_Short() && ContainerTree))
 	{
-		FSensedStimulus It = ContainerTree->GetSensedStimulusCopy_TS(Idx);
+		// the copy of a shared tree element gets the channels of this tag
+		const FSenseSysTagSlot TagSlot = ContainerTree->GetTagSlot(SensorTag);
+		FSensedStimulus It = Snapshot ? Snapshot->GetSensedStimulusCopy(Idx, Generation, TagSlot) : ContainerTree->GetSensedStimulusCopy_TS(Idx, TagSlot);
 		if (It.TmpHash != MAX_uint32)
 		{
-			const bool bNotIgnored = !HashSorted::Contains_HashType(Ignored_Components, It.TmpHash);
+			const bool bNotIgnored = (It.BitChannels & BitChannels.Value) != 0 && !HashSorted::Contains_HashType(Ignored_Components, It.TmpHash);
 			if (bNotIgnored)
 			{
 				const ESenseTestResult TotalResult = Sensor_Run_Test(MinScore, CurrentTime, It, ChannelContainsIDs);
@@ -1228,7 +1447,7 @@ bool USensorBase::UpdtSensorTestForIDInternal(
 	return false;
 }
 
-ESenseTestResult USensorBase::Sensor_Run_Test(const float MinScore, const float CurrentTime, FSensedStimulus& Stimulus, TArray<ElementIndexType>& Out) const
+ESenseTestResult USensorBase::Sensor_Run_Test(const float MinScore, const float CurrentTime, FSensedStimulus& Stimulus, FChannelIDs& Out) const
 {
 	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_SensorTests);
 
@@ -1300,7 +1519,7 @@ ESenseTestResult USensorBase::Sensor_Run_Test(const float MinScore, const float
 }
 
 
-void USensorBase::CheckWithCurrent(FSensedStimulus& SS, TArray<ElementIndexType>& Out) const
+void USensorBase::CheckWithCurrent(FSensedStimulus& SS, FChannelIDs& Out) const
 {
 	for (int32 i = 0; i < ChannelSetup.Num(); i++)
 	{
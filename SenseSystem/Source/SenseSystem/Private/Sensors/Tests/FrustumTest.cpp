@@ -165,9 +165,34 @@ bool UFrustumTest::PreTest()
 	AABB_Box += T.TransformPositionNoScale(FVector(FarPlaneDistance, TmpData.Bound.Max.X, TmpData.Bound.Min.Y));
 	AABB_Box += T.TransformPositionNoScale(FVector(FarPlaneDistance, TmpData.Bound.Min.X, TmpData.Bound.Max.Y));
 
+	QueryFrustum.NumPlanes = 0;
+	if (FOVAngle < 180.f)
+	{
+		const FVector2D& Min = TmpData.Bound.Min;
+		const FVector2D& Max = TmpData.Bound.Max;
+		QueryFrustum.AddPlane(-TmpSelfForward, L);
+		QueryFrustum.AddPlane(TmpSelfForward, L + TmpSelfForward * FarPlaneDistance);
+		// side planes through the sensor location and the far rectangle edges, normals in sensor space
+		QueryFrustum.AddPlane(T.TransformVectorNoScale(FVector(-Max.X, FarPlaneDistance, 0.f)), L);
+		QueryFrustum.AddPlane(T.TransformVectorNoScale(FVector(Min.X, -FarPlaneDistance, 0.f)), L);
+		QueryFrustum.AddPlane(T.TransformVectorNoScale(FVector(-Max.Y, 0.f, FarPlaneDistance)), L);
+		QueryFrustum.AddPlane(T.TransformVectorNoScale(FVector(Min.Y, 0.f, -FarPlaneDistance)), L);
+	}
+
 	return true;
 }
 
+bool UFrustumTest::GetSensorTestShape(FSenseSysQueryShape& OutShape) const
+{
+	if (QueryFrustum.NumPlanes > 0)
+	{
+		OutShape.Type = ESenseSysQueryShape::Frustum;
+		OutShape.Frustum = QueryFrustum;
+		return true;
+	}
+	return false;
+}
+
 ESenseTestResult UFrustumTest::RunTest(FSensedStimulus& SensedStimulus) const
 {
 	return Super::RunTest(SensedStimulus);
@@ -102,9 +102,23 @@ bool USensorDistanceAndAngleTest::PreTest()
 		}
 	}
 
+	QueryCone = FSenseSysCone(Loc, TmpSelfForward, MaxDistanceLost, MaxAngleLost, MinDistance);
+
 	return true;
 }
 
+bool USensorDistanceAndAngleTest::GetSensorTestShape(FSenseSysQueryShape& OutShape) const
+{
+	// a full sphere is left to the radius query
+	if (MaxAngleLost < 180.f)
+	{
+		OutShape.Type = ESenseSysQueryShape::Cone;
+		OutShape.Cone = QueryCone;
+		return true;
+	}
+	return false;
+}
+
 ESenseTestResult USensorDistanceAndAngleTest::RunTestForLocation(const FSensedStimulus& SensedStimulus, const FVector& TestLocation, float& ScoreResult) const
 {
 	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_DistanceAndAngleTest);
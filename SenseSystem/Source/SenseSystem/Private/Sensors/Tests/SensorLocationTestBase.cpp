@@ -2,6 +2,7 @@
 
 #include "Sensors/Tests/SensorLocationTestBase.h"
 #include "SensedStimulStruct.h"
+#include "Sensors/SensorBase.h"
 
 
 ESenseTestResult USensorLocationTestBase::RunTest(FSensedStimulus& SensedStimulus) const
@@ -14,11 +15,18 @@ ESenseTestResult USensorLocationTestBase::RunTest(FSensedStimulus& SensedStimulu
 		TArray<FSensedPoint>& Points = SensedStimulus.SensedPoints;
 		const FIntPoint TestBound = GetBoundFotSensePoints(Points);
 		float TotalScore = 0.f;
+		// in the frame of the sensor now, the stimulus was at Point + Sweep on the last update
+		const FVector Sweep = SensorSweep - SensedStimulus.SweepOffset;
+		const bool bSwept = !Sweep.IsNearlyZero();
 
 		for (int32 i = TestBound.X; i < TestBound.Y; i++)
 		{
 			float Score = 1.0f;
 			Points[i].PointTestResult = RunTestForLocation(SensedStimulus, Points[i].SensedPoint, Score);
+			if (bSwept && Points[i].PointTestResult == ESenseTestResult::Lost)
+			{
+				Points[i].PointTestResult = RunSweptTestForLocation(SensedStimulus, Points[i].SensedPoint, Sweep, Score);
+			}
 			if (Points[i].PointTestResult != ESenseTestResult::Lost)
 			{
 				Points[i].PointScore *= Score;
@@ -44,6 +52,32 @@ ESenseTestResult USensorLocationTestBase::RunTestForLocation(const FSensedStimul
 	return ESenseTestResult::Lost;
 }
 
+ESenseTestResult USensorLocationTestBase::RunSweptTestForLocation(
+	const FSensedStimulus& SensedStimulus,
+	const FVector& TestLocation,
+	const FVector& Sweep,
+	float& ScoreResult) const
+{
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_LocationTestBase_RunSweptTest);
+
+	constexpr int32 MaxSweptSteps = 32;
+	const float StepLength = GetSensorOwner() ? GetSensorOwner()->SweptStepLength : 50.f;
+	const int32 Steps = FMath::Clamp(FMath::CeilToInt(Sweep.Size() / FMath::Max(StepLength, 1.f)), 1, MaxSweptSteps);
+
+	// TestLocation itself is already lost
+	for (int32 Step = 1; Step <= Steps; ++Step)
+	{
+		ScoreResult = 1.f;
+		const ESenseTestResult Result = RunTestForLocation(SensedStimulus, TestLocation + Sweep * (static_cast<float>(Step) / Steps), ScoreResult);
+		if (Result != ESenseTestResult::Lost)
+		{
+			return Result;
+		}
+	}
+	ScoreResult = 0.f;
+	return ESenseTestResult::Lost;
+}
+
 FIntPoint USensorLocationTestBase::GetBoundFotSensePoints(TArray<FSensedPoint>& SensedPoints) const
 {
 	if (!bTestBySingleLocation && SensedPoints.Num() > 1)
@@ -0,0 +1,105 @@
+//Copyright 2020 Alexandr Marchenko. All Rights Reserved.
+
+#include "Sensors/Tests/SensorRayTest.h"
+#include "Sensors/SensorBase.h"
+#include "Math/UnrealMathUtility.h"
+
+#if WITH_EDITORONLY_DATA
+	#include "DrawDebugHelpers.h"
+	#include "SceneManagement.h"
+#endif
+
+USensorRayTest::USensorRayTest(const FObjectInitializer& ObjectInitializer) : Super(ObjectInitializer)
+{
+	bTestBySingleLocation = true;
+}
+
+#if WITH_EDITORONLY_DATA
+void USensorRayTest::DrawTest(const FSceneView* View, FPrimitiveDrawInterface* PDI) const
+{
+	if (RayLength > KINDA_SMALL_NUMBER)
+	{
+		const FTransform& T = GetSensorTransform();
+		const FVector Start = T.GetLocation();
+		const FVector End = Start + T.GetRotation().GetForwardVector() * RayLength;
+		PDI->DrawLine(Start, End, FColor::Yellow, SDPG_Foreground);
+		if (RayRadius > KINDA_SMALL_NUMBER)
+		{
+			const FQuat Q = T.GetRotation();
+			// the cylinder axis is Z
+			DrawWireCylinder(PDI, (Start + End) * 0.5f, Q.GetRightVector(), Q.GetUpVector(), Q.GetForwardVector(), FColor::Yellow, RayRadius, RayLength * 0.5f, 16, SDPG_Foreground);
+		}
+	}
+}
+
+void USensorRayTest::DrawDebug(const float Duration) const
+{
+	#if ENABLE_DRAW_DEBUG
+	if (RayLength > KINDA_SMALL_NUMBER && GetSensorOwner())
+	{
+		if (const UWorld* World = GetSensorOwner()->GetWorld())
+		{
+			const FTransform& T = GetSensorTransform();
+			const FVector Start = T.GetLocation();
+			const FVector End = Start + T.GetRotation().GetForwardVector() * RayLength;
+			DrawDebugLine(World, Start, End, FColor::Yellow, false, Duration, SDPG_Foreground, 1.5f);
+			if (RayRadius > KINDA_SMALL_NUMBER)
+			{
+				DrawDebugCylinder(World, Start, End, RayRadius, 16, FColor::Yellow, false, Duration, SDPG_Foreground, 1.5f);
+			}
+		}
+	}
+	#endif
+}
+#endif
+
+
+EUpdateReady USensorRayTest::GetReadyToTest()
+{
+	if (RayLength > KINDA_SMALL_NUMBER)
+	{
+		return Super::GetReadyToTest();
+	}
+	return EUpdateReady::Fail;
+}
+
+bool USensorRayTest::PreTest()
+{
+	Super::PreTest();
+
+	const FTransform& T = GetSensorTransform();
+	TmpSelfForward = T.GetRotation().GetForwardVector();
+
+	const FVector Start = T.GetLocation();
+	QuerySegment = FSenseSysSegment(Start, Start + TmpSelfForward * RayLength, RayRadius);
+	AABB_Box = QuerySegment.GetBounds();
+	return true;
+}
+
+bool USensorRayTest::GetSensorTestShape(FSenseSysQueryShape& OutShape) const
+{
+	OutShape.Type = ESenseSysQueryShape::Segment;
+	OutShape.Segment = QuerySegment;
+	return true;
+}
+
+ESenseTestResult USensorRayTest::RunTestForLocation(const FSensedStimulus& SensedStimulus, const FVector& TestLocation, float& ScoreResult) const
+{
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_SenseSys_RayTest);
+
+	if (AABB_Box.IsInsideOrOn(TestLocation))
+	{
+		const FVector Delta = TestLocation - QuerySegment.Start;
+		const FVector::FReal Along = FVector::DotProduct(Delta, TmpSelfForward);
+		if (Along >= 0.f && Along <= RayLength && (Delta - TmpSelfForward * Along).SizeSquared() <= FMath::Square(RayRadius))
+		{
+			if (bScoreDistance)
+			{
+				ScoreResult *= 1.f - Along / RayLength;
+			}
+			return (MinScore > ScoreResult) ? ESenseTestResult::NotLost : ESenseTestResult::Sensed;
+		}
+	}
+	ScoreResult = 0;
+	return ESenseTestResult::Lost;
+}
@@ -76,6 +76,7 @@ bool USensorTestBase::PreTest()
 	if (const USensorBase* Sensor = GetSensorOwner())
 	{
 		SensorTransform = Sensor->GetSensorTransform();
+		SensorSweep = Sensor->GetSensorSweep();
 	}
 	return true;
 }
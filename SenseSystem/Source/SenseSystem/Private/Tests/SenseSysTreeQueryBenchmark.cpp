@@ -0,0 +1,112 @@
+//Copyright 2020 Alexandr Marchenko. All Rights Reserved.
+
+#include "CoreMinimal.h"
+#include "Misc/AutomationTest.h"
+#include "Math/RandomStream.h"
+#include "HAL/PlatformTime.h"
+
+#include "AbstractTree.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+/**
+ * GetInBoxRadiusIDs leaf test, per element scalar predicate against the four lane ElementBounds test,
+ * dense leaves of NodeCantSplit 16/32/64, the IDs of both have to match
+ */
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(
+	FSenseSysLeafQueryBenchmark,
+	"SenseSystem.Tree.LeafQueryBenchmark",
+	EAutomationTestFlags::EditorContext | EAutomationTestFlags::ClientContext | EAutomationTestFlags::PerfFilter)
+
+namespace SenseSysLeafQueryBenchmark
+{
+	using FTree = TTree_Base<int32, FVector, int32, int32, 3U>;
+	using FElementQuery = FTree::FElementQuery;
+
+	constexpr int32 ElementNum = 20000;
+	constexpr int32 QueryNum = 4000;
+	constexpr int32 Repeats = 5;
+	constexpr float WorldHalfSize = 25000.f;
+	constexpr float QueryRadius = 2500.f;
+	/** half of the elements respond */
+	constexpr uint64 QueryMask = 0x5555555555555555ull;
+} // namespace SenseSysLeafQueryBenchmark
+
+bool FSenseSysLeafQueryBenchmark::RunTest(const FString& Parameters)
+{
+	using namespace SenseSysLeafQueryBenchmark;
+
+	FRandomStream Rand(1234);
+	TArray<FBox> Boxes;
+	Boxes.Reserve(ElementNum);
+	for (int32 i = 0; i < ElementNum; ++i)
+	{
+		const FVector Center(Rand.FRandRange(-WorldHalfSize, WorldHalfSize), Rand.FRandRange(-WorldHalfSize, WorldHalfSize), Rand.FRandRange(-500.f, 500.f));
+		Boxes.Add(FBox::BuildAABB(Center, FVector(Rand.FRandRange(20.f, 100.f))));
+	}
+	TArray<FVector> Centers;
+	Centers.Reserve(QueryNum);
+	for (int32 i = 0; i < QueryNum; ++i)
+	{
+		Centers.Add(FVector(Rand.FRandRange(-WorldHalfSize, WorldHalfSize), Rand.FRandRange(-WorldHalfSize, WorldHalfSize), 0.f));
+	}
+
+	for (const int32 NodeCantSplit : {16, 32, 64})
+	{
+		FTree Tree(500.f, NodeCantSplit, 1024, ElementNum);
+		for (int32 i = 0; i < ElementNum; ++i)
+		{
+			Tree.Insert(i, Boxes[i], 1ull << (i % 64));
+		}
+
+		double ScalarTime = 0.0;
+		double VectorTime = 0.0;
+		int64 ScalarHits = 0;
+		int64 VectorHits = 0;
+		TArray<int32> ScalarOut;
+		TArray<int32> VectorOut;
+		for (int32 r = 0; r < Repeats; ++r)
+		{
+			for (const FVector& Center : Centers)
+			{
+				const FTree::BoxType QueryBox = FTree::BoxType::BuildAABB(Center, FVector(QueryRadius));
+
+				ScalarOut.Reset();
+				double Start = FPlatformTime::Seconds();
+				Tree.GetElementsIDs(
+					QueryBox,
+					[&Tree, &Center](const int32 ObjID)
+					{ return (Tree.GetElementMask(ObjID) & QueryMask) && Tree.GetElementBox(ObjID).SphereAABBIntersection(Center, QueryRadius); },
+					ScalarOut);
+				ScalarTime += FPlatformTime::Seconds() - Start;
+
+				VectorOut.Reset();
+				Start = FPlatformTime::Seconds();
+				Tree.GetElementsIDs(FElementQuery(QueryBox, Center, QueryRadius, QueryMask), VectorOut);
+				VectorTime += FPlatformTime::Seconds() - Start;
+
+				ScalarHits += ScalarOut.Num();
+				VectorHits += VectorOut.Num();
+				if (r == 0 && ScalarOut.Num() == VectorOut.Num())
+				{
+					ScalarOut.Sort();
+					VectorOut.Sort();
+					TestTrue(FString::Printf(TEXT("NodeCantSplit %d same IDs"), NodeCantSplit), ScalarOut == VectorOut);
+				}
+			}
+		}
+		TestEqual(FString::Printf(TEXT("NodeCantSplit %d hit count"), NodeCantSplit), VectorHits, ScalarHits);
+
+		const int32 Queries = QueryNum * Repeats;
+		AddInfo(FString::Printf(
+			TEXT("NodeCantSplit %d: scalar %.2f us/query, vector %.2f us/query, %.2fx, %.1f hits/query"),
+			NodeCantSplit,
+			ScalarTime * 1e6 / Queries,
+			VectorTime * 1e6 / Queries,
+			VectorTime > 0.0 ? ScalarTime / VectorTime : 0.0,
+			static_cast<double>(VectorHits) / Queries));
+	}
+	return true;
+}
+
+#endif //WITH_DEV_AUTOMATION_TESTS
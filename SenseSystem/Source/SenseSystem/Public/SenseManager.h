@@ -6,6 +6,7 @@
 #include "Engine/World.h"
 #include "Containers/Map.h"
 #include "Templates/UniquePtr.h"
+#include "Async/Future.h"
 #include "Stats/Stats2.h"
 #include "Tickable.h"
 #include "UObject/NoExportTypes.h"
@@ -20,9 +21,11 @@
 
 
 struct FStimulusTagResponse;
+struct FSensorTagSettings;
 class USenseStimulusBase;
 class USenseReceiverComponent;
 class IContainerTree;
+struct FSenseSysRetuneBuild;
 class UObject;
 
 
@@ -39,6 +42,9 @@ struct SENSESYSTEM_API FRegisteredSensorTags final : FNoncopyable
 	bool AddSenseStimulus(USenseStimulusBase* Ssc);
 	bool RemoveSenseStimulus(USenseStimulusBase* Ssc);
 
+	/** one BulkInsert per tag, OutRegistered - stimuli with at least one registered tag */
+	void AddSenseStimulusBatch(const TArray<USenseStimulusBase*>& InStimuli, TArray<USenseStimulusBase*>& OutRegistered);
+
 	bool Add_SenseStimulus(USenseStimulusBase* Ssc, const FName& SensorTag, FStimulusTagResponse& Str);
 	bool Remove_SenseStimulus(USenseStimulusBase* Ssc, const FName& SensorTag, FStimulusTagResponse& Str);
 
@@ -48,16 +54,36 @@ struct SENSESYSTEM_API FRegisteredSensorTags final : FNoncopyable
 	void Empty();
 	void Remove(const FName SensorTag);
 	void CollapseAllTrees();
+	/** per tree budget, trees without removes since the last call are skipped */
+	void CollapseQueuedTrees(int32 Budget);
+	/** apply positions staged by stimuli during the frame, one UpdateBatch per tree */
+	void FlushStagedUpdates();
+	/** refresh the sensor read copies of the trees with bSnapshotReads */
+	void PublishSnapshots();
+	/** the tag has a tree with elements */
 	bool IsValidTag(const FName& SensorTag) const;
+	/** delete the trees emptied since the last call, only while the sense thread has no batch, true if any was deleted */
+	bool RemoveEmptyTrees();
+	/** trees by tree key, several tags share one entry through FSensorTagSettings::SharedTree */
 	const TMap<FName, TUniquePtr<IContainerTree>>& GetMap() const { return SenseRegChannels; }
+	/** the SharedTree of the tag or the tag itself */
+	FName GetTreeKey(const FName& Tag) const;
+	/** the SharedTree entry or the first tag by name using the tree, null for a tree of defaults */
+	static const FSensorTagSettings* FindTreeSettings(FName TreeKey);
 
 private:
 	TMap<FName, TUniquePtr<IContainerTree>> SenseRegChannels;
+	/** trees emptied by RemoveSenseStimulus_Internal, kept alive until RemoveEmptyTrees */
+	TSet<FName> EmptyTreeKeys;
+	/** tags with a SharedTree other than their own name, read from the settings once */
+	TMap<FName, FName> SharedTreeKeys;
 
 	bool AddSenseStimulus_Internal(USenseStimulusBase* Ssc, const FName& SensorTag, FStimulusTagResponse& Str);
 	bool RemoveSenseStimulus_Internal(USenseStimulusBase* Ssc, const FName& SensorTag, FStimulusTagResponse& Str);
 
-	static TUniquePtr<IContainerTree> MakeTree(const FName Tag);
+	TUniquePtr<IContainerTree> MakeTree(const FName TreeKey) const;
+	/** registered response of another tag of Ssc on ContainerTree with the same score, age and sense points */
+	static FStimulusTagResponse* FindSharedResponse(USenseStimulusBase* Ssc, const FName& SensorTag, const FStimulusTagResponse& Str, const IContainerTree* ContainerTree);
 
 	//todo you need to make sure that a new element is not added when we take another
 	mutable FCriticalSection CriticalSection;
@@ -99,8 +125,6 @@ public:
 	static USenseManager* GetSenseManager(const UObject* WorldContext);
 
 public:
-	FTickingTimer TickingTimer = FTickingTimer(0.5f);
-
 	virtual UWorld* GetTickableGameObjectWorld() const override { return GetWorld(); }
 	virtual bool IsTickableWhenPaused() const override { return false; }
 	virtual bool IsTickable() const override { return true; /*GetWorld();*/ }
@@ -122,6 +146,13 @@ public:
 	UFUNCTION(BlueprintCallable, Category = "QuadTree")
 	void DrawTree(FName SensorTag, FDrawElementSetup TreeNode, FDrawElementSetup Link, FDrawElementSetup ElemNode, float LifeTime) const;
 
+	/** false if the tag has no tree */
+	bool GetTreeStats(FName SensorTag, FSenseSysTreeStats& OutStats) const;
+	/** NAME_None - all tags */
+	void ResetTreeStats(FName SensorTag = NAME_None);
+	/** NAME_None - all tags, console command SenseSys.TreeStats */
+	void LogTreeStats(FName SensorTag = NAME_None) const;
+
 	/*********************************************/
 
 	/**Delegate for Communication passive sense events "Event channel"*/
@@ -140,6 +171,9 @@ public:
 	TSet<USenseReceiverComponent*> Receivers;
 	UPROPERTY()
 	TSet<USenseStimulusBase*> StimulsWorldOrigin;
+	/** registered by QueueSenseStimulus since the last Tick, level load and streaming insert them in one batch */
+	UPROPERTY()
+	TSet<USenseStimulusBase*> PendingStimuli;
 
 	bool RegisterSenseReceiver(USenseReceiverComponent* Receiver);
 	bool UnRegisterSenseReceiver(USenseReceiverComponent* Receiver);
@@ -151,6 +185,11 @@ public:
 	bool RegisterSenseStimulus(USenseStimulusBase* Stimulus);
 	bool UnRegisterSenseStimulus(USenseStimulusBase* Stimulus);
 
+	/** register many stimuli at once (level streaming, world origin rebase), return registered count */
+	int32 RegisterSenseStimulusBatch(const TArray<USenseStimulusBase*>& InStimuli);
+	/** the stimulus goes in the trees with the others of the frame through RegisterSenseStimulusBatch on the next Tick */
+	bool QueueSenseStimulus(USenseStimulusBase* Stimulus);
+
 	void Add_SenseStimulus(USenseStimulusBase* Ssc, const FName& SensorTag, FStimulusTagResponse& Str);
 	void Remove_SenseStimulus(USenseStimulusBase* Ssc, const FName& SensorTag, FStimulusTagResponse& Str);
 
@@ -189,6 +228,36 @@ protected:
 private:
 	double WaitTime = 0.0001f;
 	int32 CounterLimit = 10;
+	int32 CollapseBudget = 32;
+	float CompactFragmentation = 0.5f;
+	int32 CompactMinFreeSlots = 1024;
+	/** tree checked by the next CompactFragmentedTree */
+	int32 CompactTagIdx = 0;
+	float AutoTuneInterval = 10.f;
+	float AutoTuneMinGain = 0.2f;
+	/** a SensorTag of the settings has bAutoTune, its tree needs the query counters */
+	bool bAutoTuneTags = false;
+	/** tree checked by the next AutoTuneTree */
+	int32 AutoTuneTagIdx = 0;
+	/** query counters of an auto tuned tree at its last check, the cost since then is the difference */
+	struct FAutoTuneState
+	{
+		uint32 TreeSerial = 0;
+		double Time = 0.0;
+		uint64 Queries = 0;
+		uint64 VisitedNodes = 0;
+		uint64 VisitedElements = 0;
+		/** nodes with the new split parameters built on a worker, swapped in by a later AutoTuneTree */
+		TSharedPtr<FSenseSysRetuneBuild, ESPMode::ThreadSafe> Build;
+		TFuture<void> BuildTask;
+		/** log line of the change, written once the nodes are swapped in */
+		FString BuildReport;
+	};
+	TMap<FName, FAutoTuneState> AutoTuneStates;
+	/** counter totals of all trees at the last UpdateTreeStats, the per frame stats are the difference */
+	uint64 StatQueries = 0;
+	uint64 StatVisitedNodes = 0;
+	uint64 StatVisitedElements = 0;
 
 	/**Receivers with ContainsThread counter*/
 	uint32 ContainsThreadCount = 0;
@@ -203,6 +272,24 @@ private:
 	/**Create Sense Thread*/
 	void Create_SenseThread();
 
+	/** BulkInsert of the PendingStimuli, before the staged updates of the frame */
+	void FlushPendingStimuli();
+	/** low load ticks, repacks the next tree once its fragmentation passes the settings threshold */
+	void CompactFragmentedTree();
+	/** ObjIDs of the tree change, moves them in FStimulusTagResponse and the sensor pending updates of the tags using the tree */
+	bool CompactTree(FName TreeKey, IContainerTree& ContainerTree);
+	/**
+	 * low load ticks, fits split parameters of the next bAutoTune tree to its query counters and element sizes,
+	 * its nodes are built on a worker and swapped in by a later tick, one tree at a time
+	 */
+	void AutoTuneTree();
+	/** true while a build runs, swaps in or drops a finished one */
+	bool FinishAutoTuneBuild();
+	/** per tree query counters, all on for SenseSys.TreeQueryCounters or stats collection, else only the bAutoTune trees */
+	void UpdateQueryCounting() const;
+	/** STATGROUP_SenseSys counters summed over the trees, only while stats are collected */
+	void UpdateTreeStats();
+
 #if WITH_EDITORONLY_DATA
 
 public:
@@ -69,6 +69,8 @@ public:
 
 	/** Container Tree Ptr */
 	class IContainerTree* ContainerTree = nullptr;
+	/** channel bits of this tag in ContainerTree */
+	FSenseSysTagSlot TagSlot;
 
 	/** BitChannels*/
 	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "StimulusTagResponse")
@@ -98,12 +100,20 @@ public:
 
 
 	FORCEINLINE ElementIndexType GetObjID() const { return ObjID; }
-	FORCEINLINE void SetObjID(const ElementIndexType Val) { ObjID = Val; }
+	FORCEINLINE void SetObjID(const ElementIndexType Val)
+	{
+		ObjID = Val;
+		SweptFromBox.Init();
+	}
 
 	void SetAge(float AgeValue);
 	void SetScore(float ScoreValue);
 	void SetBitChannels(uint64 NewBit);
-	void UpdatePosition(const FVector& NewLocation, const TArray<FVector>& Points, float CurrentTime, bool bAllPoints = true) const;
+	/**
+	 * stage into ContainerTree, applied by USenseManager in a single UpdateBatch, Points[0] is the single sense point,
+	 * bSwept - the box also covers the previous UpdatePosition, returns true while the staged box is swept
+	 */
+	bool UpdatePosition(TArray<FVector>&& Points, uint32 StimulusHash, float CurrentTime, bool bAllPoints = true, bool bSwept = false);
 
 	float GetAge() const;
 	float GetScore() const;
@@ -138,6 +148,10 @@ public:
 
 
 private:
+	/** box and single point of the last UpdatePosition, the start of the next swept box */
+	FBox SweptFromBox = FBox(ForceInit);
+	FVector SweptFromPoint = FVector::ZeroVector;
+
 	void AddSensed(AActor* Actor, uint8 InChannel);
 	bool RemoveSensed(const AActor* Actor, uint8 InChannel);
 	void AddLost(AActor* Actor, uint8 InChannel);
@@ -235,6 +249,10 @@ public:
 	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "SenseStimulus")
 	EStimulusMobility Mobility = EStimulusMobility::Static;
 
+	/** movable stimulus, the tree box covers its previous and current position, a stimulus with a long TickInterval is not jumped over by the sensors */
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "SenseStimulus")
+	bool bSweptBox = false;
+
 
 	/** Enable/Disable SenseStimulus */
 	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "SenseStimulus")
@@ -325,8 +343,13 @@ public:
 
 	bool IsResponseTag(const FName& Tag) const;
 
+	/** another tag of this stimulus keeps its channels on the same tree element as Str, see FSensorTagSettings::SharedTree */
+	bool IsSharedTreeElement(const FStimulusTagResponse& Str) const;
+
 protected:
 	void SetResponseChannels(const FName& Tag, FStimulusTagResponse& Str, uint64 NewChannelsBit);
+	/** registers Tag again after its score or age changed, a shared element keeps one score and age for all its tags */
+	void ReRegisterSharedResponse(const FName& Tag, FStimulusTagResponse& Str);
 
 public:
 	/************************************/
@@ -459,7 +482,12 @@ FORCEINLINE void USenseStimulusBase::SetAge(const FName SensorTag, const float A
 {
 	if (FStimulusTagResponse* StrPtr = GetStimulusTagResponse(SensorTag))
 	{
-		if (IsRegisteredForSense())
+		if (IsRegisteredForSense() && IsSharedTreeElement(*StrPtr))
+		{
+			StrPtr->Age = AgeValue;
+			ReRegisterSharedResponse(SensorTag, *StrPtr);
+		}
+		else if (IsRegisteredForSense())
 		{
 			StrPtr->SetAge(AgeValue);
 		}
@@ -473,7 +501,12 @@ FORCEINLINE void USenseStimulusBase::SetScore(const FName SensorTag, const float
 {
 	if (FStimulusTagResponse* StrPtr = GetStimulusTagResponse(SensorTag))
 	{
-		if (IsRegisteredForSense())
+		if (IsRegisteredForSense() && IsSharedTreeElement(*StrPtr))
+		{
+			StrPtr->Score = ScoreValue;
+			ReRegisterSharedResponse(SensorTag, *StrPtr);
+		}
+		else if (IsRegisteredForSense())
 		{
 			StrPtr->SetScore(ScoreValue);
 		}
@@ -585,6 +618,9 @@ FORCEINLINE FStimulusTagResponse& FStimulusTagResponse::operator=(const FStimulu
 {
 	ContainerTree = Str.ContainerTree;
 	ObjID = Str.ObjID;
+	TagSlot = Str.TagSlot;
+	SweptFromBox = Str.SweptFromBox;
+	SweptFromPoint = Str.SweptFromPoint;
 
 	//SensorTag = Str.SensorTag;
 	BitChannels = Str.BitChannels;
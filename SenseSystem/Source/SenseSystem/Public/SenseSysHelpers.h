@@ -227,6 +227,232 @@ struct SENSESYSTEM_API FBitFlag64_SenseSys
 };
 
 
+/**
+ *	Cone volume for tree queries, a box is kept if it may touch the cone or the near sphere around the apex.
+ *	Boxes are tested by their bounding sphere, points exactly.
+ */
+struct SENSESYSTEM_API FSenseSysCone
+{
+	FSenseSysCone() {}
+	FSenseSysCone(const FVector& InApex, const FVector& InAxis, const FVector::FReal InLength, const float HalfAngleDegrees, const FVector::FReal InNearRadius = 0.f)
+		: Apex(InApex)
+		, Axis(InAxis.GetSafeNormal(UE_SMALL_NUMBER, FVector::ForwardVector))
+		, Length(InLength)
+		, NearRadius(InNearRadius)
+	{
+		FMath::SinCos(&SinHalfAngle, &CosHalfAngle, FMath::DegreesToRadians(FMath::Clamp(HalfAngleDegrees, 0.f, 180.f)));
+	}
+
+	FVector Apex = FVector::ZeroVector;
+	/** unit */
+	FVector Axis = FVector::ForwardVector;
+	FVector::FReal Length = 0.f;
+	/** kept at any angle within this distance of the apex */
+	FVector::FReal NearRadius = 0.f;
+	float SinHalfAngle = 0.f;
+	float CosHalfAngle = 1.f;
+
+	FORCEINLINE bool IntersectSphere(const FVector& Center, const FVector::FReal Radius) const
+	{
+		const FVector V = Center - Apex;
+		const FVector::FReal DistSquared = V.SizeSquared();
+		if (DistSquared > FMath::Square(Length + Radius))
+		{
+			return false;
+		}
+		if (DistSquared <= FMath::Square(NearRadius + Radius))
+		{
+			return true;
+		}
+		// distance to the side line in the plane of the axis and the center, never more than the distance to the cone
+		const FVector::FReal AxisDist = FVector::DotProduct(V, Axis);
+		const FVector::FReal SideDist = FMath::Sqrt(FMath::Max(DistSquared - AxisDist * AxisDist, 0.));
+		return SideDist * CosHalfAngle - AxisDist * SinHalfAngle <= Radius;
+	}
+	FORCEINLINE bool IntersectBox(const FBox& Box) const { return IntersectSphere(Box.GetCenter(), Box.GetExtent().Size()); }
+};
+
+/**
+ *	Convex volume for tree queries, up to six planes with the normals pointing out,
+ *	a box is kept unless it is fully in front of one plane.
+ */
+struct SENSESYSTEM_API FSenseSysFrustum
+{
+	static constexpr int32 MaxPlanes = 6;
+
+	FPlane Planes[MaxPlanes];
+	int32 NumPlanes = 0;
+
+	FORCEINLINE void AddPlane(const FVector& Normal, const FVector& Point)
+	{
+		check(NumPlanes < MaxPlanes);
+		Planes[NumPlanes++] = FPlane(Point, Normal.GetSafeNormal());
+	}
+
+	FORCEINLINE bool IntersectBox(const FBox& Box) const
+	{
+		const FVector Center = Box.GetCenter();
+		const FVector Extent = Box.GetExtent();
+		for (int32 i = 0; i < NumPlanes; ++i)
+		{
+			const FPlane& P = Planes[i];
+			const FVector::FReal Push = FMath::Abs(P.X * Extent.X) + FMath::Abs(P.Y * Extent.Y) + FMath::Abs(P.Z * Extent.Z);
+			if (P.PlaneDot(Center) > Push)
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+};
+
+/**
+ *	Segment volume for tree queries, Start + T * (End - Start) with T in [0, 1], boxes are grown by Radius on every axis.
+ *	A box is kept if the segment enters it, ClipBox also gives the T of the entry, 0 if Start is inside.
+ */
+struct SENSESYSTEM_API FSenseSysSegment
+{
+	using FReal = FVector::FReal;
+
+	FSenseSysSegment() {}
+	FSenseSysSegment(const FVector& InStart, const FVector& InEnd, const FReal InRadius = 0.f)
+		: Start(InStart)
+		, End(InEnd)
+		, Radius(FMath::Max<FReal>(InRadius, 0.f))
+	{
+		const FVector Dir = End - Start;
+		for (int32 j = 0; j < 3; ++j)
+		{
+			InvDir[j] = FMath::IsNearlyZero(Dir[j]) ? 0.f : 1.f / Dir[j];
+		}
+	}
+
+	FVector Start = FVector::ZeroVector;
+	FVector End = FVector::ZeroVector;
+	FReal Radius = 0.f;
+	/** 0 on the axes the segment does not move along */
+	FReal InvDir[3] = {0.f, 0.f, 0.f};
+
+	FORCEINLINE FBox GetBounds() const { return FBox(Start.ComponentMin(End) - FVector(Radius), Start.ComponentMax(End) + FVector(Radius)); }
+
+	/** narrows [T0, T1] to the part of the segment inside the slab of Axis, false once it is empty */
+	FORCEINLINE bool ClipSlab(const int32 Axis, const FReal Min, const FReal Max, FReal& T0, FReal& T1) const
+	{
+		const FReal Lo = Min - Radius;
+		const FReal Hi = Max + Radius;
+		if (InvDir[Axis] == 0.f)
+		{
+			return Start[Axis] >= Lo && Start[Axis] <= Hi;
+		}
+		FReal A = (Lo - Start[Axis]) * InvDir[Axis];
+		FReal B = (Hi - Start[Axis]) * InvDir[Axis];
+		if (A > B)
+		{
+			Swap(A, B);
+		}
+		T0 = FMath::Max(T0, A);
+		T1 = FMath::Min(T1, B);
+		return T0 <= T1;
+	}
+	/** the first NumAxes of Min and Max, OutEntry - T where the segment enters the box */
+	template<typename MinType, typename MaxType>
+	FORCEINLINE bool ClipBox(const MinType& Min, const MaxType& Max, const int32 NumAxes, FReal& OutEntry) const
+	{
+		FReal T0 = 0.f;
+		FReal T1 = 1.f;
+		for (int32 j = 0; j < NumAxes; ++j)
+		{
+			if (!ClipSlab(j, Min[j], Max[j], T0, T1))
+			{
+				return false;
+			}
+		}
+		OutEntry = T0;
+		return true;
+	}
+	FORCEINLINE bool IntersectBox(const FBox& Box) const
+	{
+		FReal Entry;
+		return ClipBox(Box.Min, Box.Max, 3, Entry);
+	}
+};
+
+enum class ESenseSysQueryShape : uint8
+{
+	None = 0,
+	Cone,
+	Frustum,
+	Segment,
+};
+
+/** query volume of a sensor test, Type selects Cone, Frustum or Segment */
+struct SENSESYSTEM_API FSenseSysQueryShape
+{
+	ESenseSysQueryShape Type = ESenseSysQueryShape::None;
+	FSenseSysCone Cone;
+	FSenseSysFrustum Frustum;
+	FSenseSysSegment Segment;
+
+	FORCEINLINE bool IsSet() const { return Type != ESenseSysQueryShape::None; }
+};
+
+/** shape, memory and counters of a sensor tag tree, filled by IContainerTree::GetStats */
+struct SENSESYSTEM_API FSenseSysTreeStats
+{
+	/** leaves by element count: 0, 1, 2-3, 4-7, 8-15, 16-31, 32-63, 64 and more */
+	static constexpr int32 HistogramNum = 8;
+
+	int32 NumElements = 0;
+	int32 NumNodes = 0;
+	int32 NumLeaves = 0;
+	/** root depth 0 */
+	int32 MaxDepth = 0;
+	int64 LeafDepthSum = 0;
+	int32 LeafHistogram[HistogramNum] = {};
+
+	/** allocated bytes of the node pool with the node element lists, of the per element tree data and of the element pool */
+	SIZE_T PoolBytes = 0;
+	SIZE_T DataBytes = 0;
+	SIZE_T ElementPoolBytes = 0;
+
+	/** split parameters of the quad and octree, 0 for the other trees */
+	float MinimumSize = 0.f;
+	int32 NodeCantSplit = 0;
+
+	/** counted since the tree was created or its last ResetStats, the queries only while SenseSys.TreeQueryCounters, a bAutoTune tag or stats collection is on */
+	uint64 Splits = 0;
+	uint64 Collapses = 0;
+	uint64 Reinserts = 0;
+	uint64 Queries = 0;
+	uint64 VisitedNodes = 0;
+	uint64 VisitedElements = 0;
+
+	FORCEINLINE void AddLeaf(const int32 ElementNum, const int32 Depth)
+	{
+		++NumLeaves;
+		LeafDepthSum += Depth;
+		MaxDepth = FMath::Max(MaxDepth, Depth);
+		++LeafHistogram[ElementNum > 0 ? FMath::Min(static_cast<int32>(FMath::FloorLog2(ElementNum)) + 1, HistogramNum - 1) : 0];
+	}
+
+	FORCEINLINE float GetAvgDepth() const { return NumLeaves ? static_cast<float>(LeafDepthSum) / NumLeaves : 0.f; }
+	FORCEINLINE float GetAvgVisitedNodes() const { return Queries ? static_cast<float>(VisitedNodes) / Queries : 0.f; }
+	FORCEINLINE float GetAvgVisitedElements() const { return Queries ? static_cast<float>(VisitedElements) / Queries : 0.f; }
+};
+
+/**
+ * one sensor tag in a tree shared by several tags (FSensorTagSettings::SharedTree),
+ * the tree keeps the full channels of every tag of an element at Index of its tag channels, BitChannels and the tree mask are their union,
+ * the default slot - a tree of one tag, the channels are FSensedStimulus::BitChannels
+ */
+struct SENSESYSTEM_API FSenseSysTagSlot
+{
+	int32 Index = INDEX_NONE;
+
+	FORCEINLINE bool IsShared() const { return Index != INDEX_NONE; }
+};
+
+
 /** DebugSenseSysHelpers SenseSys */
 namespace EDebugSenseSysHelpers
 {
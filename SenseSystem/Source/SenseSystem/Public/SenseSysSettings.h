@@ -21,11 +21,48 @@ enum class ESenseSys_QtOtSwitch : uint8
 	// QuadTree32 max nodes MAX_uint32 - 1= 4294967294
 	QuadTree   UMETA(DisplayName = "QuadTree"),
 
-	// OcTree16 max nodes MAX_uint16 - 1 = 65534
-	//OcTree16   UMETA(DisplayName = "OcTree16"),
+	// OcTree32 with inflated node bounds (LooseFactor), moving stimuli rarely change the node
+	LooseOcTree   UMETA(DisplayName = "Loose OcTree"),
 
-	// QuadTree16 max nodes MAX_uint16 - 1 = 65534
-	//QuadTree16 UMETA(DisplayName = "QuadTree16")
+	// QuadTree32 with inflated node bounds (LooseFactor), moving stimuli rarely change the node
+	LooseQuadTree UMETA(DisplayName = "Loose QuadTree"),
+
+	// uniform XY grid (HashGridCellSize), O(1) insert update remove for dense evenly spread stimuli
+	HashGrid   UMETA(DisplayName = "Hash Grid"),
+
+	// OcTree with 16 bit node index, max nodes MAX_uint16 - 1 = 65534
+	OcTree16   UMETA(DisplayName = "OcTree16"),
+
+	// QuadTree with 16 bit node index, max nodes MAX_uint16 - 1 = 65534
+	QuadTree16 UMETA(DisplayName = "QuadTree16"),
+
+	// OcTree in Morton sorted arrays, fast queries and rebuilds, moved stimuli wait for the rebuild in a pending list
+	LinearOcTree   UMETA(DisplayName = "Linear OcTree"),
+
+	// QuadTree in Morton sorted arrays, fast queries and rebuilds, moved stimuli wait for the rebuild in a pending list
+	LinearQuadTree UMETA(DisplayName = "Linear QuadTree"),
+
+	// sparse grid of OcTrees (TileSize), float boxes relative to the tile, shallow trees on large maps
+	TiledOcTree   UMETA(DisplayName = "Tiled OcTree"),
+
+	// sparse grid of QuadTrees (TileSize), float boxes relative to the tile, shallow trees on large maps
+	TiledQuadTree UMETA(DisplayName = "Tiled QuadTree"),
+
+	// static stimuli in a BVH packed on registration batches, movable ones in an OcTree, for mostly static levels
+	SplitOcTree   UMETA(DisplayName = "Split OcTree"),
+
+	// static stimuli in a BVH packed on registration batches, movable ones in a QuadTree, for mostly static levels
+	SplitQuadTree UMETA(DisplayName = "Split QuadTree")
+};
+
+UENUM(BlueprintType)
+enum class ESenseSys_IndexWidth : uint8
+{
+	// max stimuli per SensorTag MAX_uint16 - 1 = 65534
+	Bit16 = 0 UMETA(DisplayName = "16 bit"),
+
+	// max stimuli per SensorTag MAX_int32 - 1
+	Bit32 UMETA(DisplayName = "32 bit"),
 };
 
 /**
@@ -46,6 +83,37 @@ struct SENSESYSTEM_API FSensorTagSettings
 	UPROPERTY(Config, EditAnywhere, Category = "SenseSystem")
 	ESenseSys_QtOtSwitch QtOtSwitch = ESenseSys_QtOtSwitch::QuadTree;
 
+	//tags with the same SharedTree keep their stimuli in one tree, the tree settings are taken from the SharedTree entry if there is one,
+	//else from the first of these tags by name. a stimulus with the same score, age and sense points on these tags is one element
+	//moved once per update, each tag keeps all 64 channels, None - own tree
+	UPROPERTY(Config, EditAnywhere, Category = "SenseSystem")
+	FName SharedTree = NAME_None;
+
+	//LooseOcTree, LooseQuadTree, the movable part of SplitOcTree SplitQuadTree - node bounds scale, 2 - node keeps elements up to its own size
+	UPROPERTY(Config, EditAnywhere, Category = "SenseSystem", meta = (ClampMin = "1.0", ClampMax = "4.0", UIMin = "1.0", UIMax = "4.0"))
+	float LooseFactor = 2.f;
+
+	//HashGrid - cell edge on XY, about the typical sensor radius
+	UPROPERTY(Config, EditAnywhere, Category = "SenseSystem", meta = (ClampMin = "10.0", ClampMax = "100000.0", UIMin = "10.0", UIMax = "100000.0"))
+	float HashGridCellSize = 1000.f;
+
+	//TiledOcTree TiledQuadTree - tile edge on XY, float boxes keep about 0.1 cm inside a 20 km tile
+	UPROPERTY(Config, EditAnywhere, Category = "SenseSystem", meta = (ClampMin = "1000.0", ClampMax = "2000000.0", UIMin = "1000.0", UIMax = "2000000.0"))
+	float TileSize = 200000.f;
+
+	//stored stimulus index, 16 bit - smaller trees, 32 bit - more than 65534 stimuli on this SensorTag
+	UPROPERTY(Config, EditAnywhere, Category = "SenseSystem")
+	ESenseSys_IndexWidth ElementIndexWidth = ESenseSys_IndexWidth::Bit16;
+
+	//sensors read a per frame copy of the stimuli without locking the tree, results may lag one frame
+	UPROPERTY(Config, EditAnywhere, Category = "SenseSystem")
+	bool bSnapshotReads = false;
+
+	//OcTree QuadTree and the 16 bit and loose variants - MinimumQuadTreeSize and NodeCantSplit are picked from the query counters and the element sizes at runtime, the chosen values are logged to copy here.
+	//the new nodes are built on a worker thread, moves of the tag stimuli wait for the swap, an insert or remove meanwhile drops the build
+	UPROPERTY(Config, EditAnywhere, Category = "SenseSystem")
+	bool bAutoTune = false;
+
 	UPROPERTY(Config, EditAnywhere, Category = "SenseSystem")
 	FSenseSysDebugDraw SenseSysDebugDraw;
 
@@ -66,9 +134,31 @@ public:
 	UPROPERTY(Config, EditAnywhere, Category = "SenseSystem")
 	TMap<FName, FSensorTagSettings> SensorTagSettings;
 
+	//sensors the sense thread takes from its queue on each wake (about 1 ms), they are updated in that wake and share one walk
+	//per tree, a sensor that fails is retried on the next wake. 1 - one sensor per wake
 	UPROPERTY(Config, EditAnywhere, Category = "SenseSystem")
 	int32 CountPerOneCyclesUpdate = 10;
 
 	UPROPERTY(Config, EditAnywhere, Category = "SenseSystem")
 	float WaitTimeBetweenCyclesUpdate = 0.0001f;
+
+	//tree nodes emptied by removed or moved stimuli, collapsed per tree each tick
+	UPROPERTY(Config, EditAnywhere, Category = "SenseSystem", meta = (ClampMin = "1", ClampMax = "4096", UIMin = "1", UIMax = "4096"))
+	int32 CollapseNodesPerTick = 32;
+
+	//element pools with this share of free slots left by removed stimuli are repacked, one tree per tick while the sense thread queue is empty, 0 - off
+	UPROPERTY(Config, EditAnywhere, Category = "SenseSystem", meta = (ClampMin = "0.0", ClampMax = "1.0", UIMin = "0.0", UIMax = "1.0"))
+	float CompactFragmentation = 0.5f;
+
+	//fewer free slots are not worth a repack
+	UPROPERTY(Config, EditAnywhere, Category = "SenseSystem", meta = (ClampMin = "1", UIMin = "1"))
+	int32 CompactMinFreeSlots = 1024;
+
+	//seconds between two checks of one auto tuned SensorTag, one tag per check while the sense thread queue is empty
+	UPROPERTY(Config, EditAnywhere, Category = "SenseSystem", meta = (ClampMin = "1.0", UIMin = "1.0"))
+	float AutoTuneInterval = 10.f;
+
+	//predicted share of the query cost saved by new split parameters before the tree is rebuilt with them
+	UPROPERTY(Config, EditAnywhere, Category = "SenseSystem", meta = (ClampMin = "0.05", ClampMax = "0.9", UIMin = "0.05", UIMax = "0.9"))
+	float AutoTuneMinGain = 0.2f;
 };
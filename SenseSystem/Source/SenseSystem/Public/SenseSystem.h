@@ -11,7 +11,7 @@ public:
 	virtual void StartupModule() override;
 	virtual void ShutdownModule() override;
 	
-	using ElementIndexType = uint16; //todo options
+	using ElementIndexType = int32; //stimulus handle, trees store 16 or 32 bit per SensorTag (ElementIndexWidth)
 };
 
 DECLARE_LOG_CATEGORY_EXTERN(LogSenseSys, Log, All); //Fatal, Error, Warning, Display, Log, Verbose, VeryVerbose
\ No newline at end of file
@@ -4,6 +4,7 @@
 
 #include "CoreTypes.h"
 #include "Containers/Array.h"
+#include "Containers/BitArray.h"
 #include "UObject/ObjectMacros.h"
 #include "UObject/UObjectBaseUtility.h"
 
@@ -86,6 +87,10 @@ public:
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Transient, Category = "SensedStimulus")
 	float FirstSensedTime = -1.f; // 4  byte
 
+	/** the component was EStimulusMobility::Static on Init, read on the game thread so trees never touch the component */
+	UPROPERTY(Transient)
+	bool bStaticMobility = false; // 1 byte, in the padding before BitChannels
+
 	UPROPERTY()
 	uint64 BitChannels = 0; // 8 byte //todo replace type to  FBitFlag64_SenseSys
 
@@ -96,6 +101,10 @@ public:
 	UPROPERTY(BlueprintReadOnly, SkipSerialization, Transient, Category = "SensedStimulus")
 	TArray<FSensedPoint> SensedPoints; // 16 byte and dynamic memory allocation
 
+	/** move of the single sense point since the previous tree update, zero unless the stimulus stores a swept box */
+	UPROPERTY(Transient)
+	FVector SweepOffset = FVector::ZeroVector; // 24 byte
+
 	FORCEINLINE void InValidate()
 	{
 		StimulusComponent = nullptr;
@@ -104,6 +113,8 @@ public:
 		Age = 0.f;
 		SensedPoints.Empty();
 		BitChannels = 0;
+		bStaticMobility = false;
+		SweepOffset = FVector::ZeroVector;
 	}
 
 	FORCEINLINE friend uint32 GetTypeHash(const FSensedStimulus& In) { return In.TmpHash; }
@@ -129,8 +140,10 @@ public:
 		Age = Other.Age;
 		SensedTime = Other.SensedTime;
 		FirstSensedTime = Other.FirstSensedTime;
+		bStaticMobility = Other.bStaticMobility;
 		BitChannels = Other.BitChannels;
 		SensedPoints = Other.SensedPoints;
+		SweepOffset = Other.SweepOffset;
 		return *this;
 	}
 };
@@ -213,3 +226,56 @@ struct SENSESYSTEM_API FTrackBestSenseScore
 		return Ar;
 	}
 };
+
+
+/**
+ * caller owned query output, an ObjID is added once by its visited bit, no hashing,
+ * Reset clears only the bits of the held IDs and keeps the memory, a reused instance does not allocate once grown
+ */
+struct FSenseSysQueryIDs
+{
+	using ElementIndexType = FSenseSystemModule::ElementIndexType;
+
+	void Reset()
+	{
+		for (const ElementIndexType ID : IDs)
+		{
+			Visited[ID] = false;
+		}
+		IDs.Reset();
+	}
+
+	FORCEINLINE void Add(const ElementIndexType ID)
+	{
+		if (Visited.Num() <= ID)
+		{
+			Visited.Add(false, ID + 1 - Visited.Num());
+		}
+		FBitReference Bit = Visited[ID];
+		if (!Bit)
+		{
+			Bit = true;
+			IDs.Add(ID);
+		}
+	}
+	template<typename ContainerType>
+	void Append(const ContainerType& In)
+	{
+		for (const ElementIndexType ID : In)
+		{
+			Add(ID);
+		}
+	}
+	FORCEINLINE bool Contains(const ElementIndexType ID) const { return Visited.IsValidIndex(ID) && Visited[ID]; }
+
+	/** tree query container interface, capacity only grows */
+	FORCEINLINE void Reserve(const int32 Number) { IDs.Reserve(Number); }
+	FORCEINLINE void Shrink() {}
+
+	FORCEINLINE int32 Num() const { return IDs.Num(); }
+	FORCEINLINE const TArray<ElementIndexType>& GetIDs() const { return IDs; }
+
+private:
+	TArray<ElementIndexType> IDs;
+	TBitArray<> Visited;
+};
@@ -30,8 +30,11 @@
 
 
 class IContainerTree;
+struct FSenseSysReadSnapshot;
 class FSenseDetectPool;
 using ElementIndexType = FSenseSystemModule::ElementIndexType;
+/** per channel slot of the tested stimulus, inline for the usual few channels */
+using FChannelIDs = TArray<ElementIndexType, TInlineAllocator<8>>;
 
 /** CallStimulusFlag */
 UENUM(Meta = (Bitflags, UseEnumValuesAsMaskValuesInEditor = "true"))
@@ -310,7 +313,14 @@ public:
 	UFUNCTION(BlueprintCallable, Category = "SenseSystem|Sensor", meta = (Keywords = "Get Sensor Bound Box"))
 	float GetSensorTestRadius() const;
 
-	void GetSensorTest_BoxAndRadius(FBox& OutBox, float& OutRadius) const;
+	/** bounds of the tests, bWithSweep adds the bounds of the last update while the sensor sweeps, Radius is 0 then */
+	void GetSensorTest_BoxAndRadius(FBox& OutBox, float& OutRadius, bool bWithSweep = true) const;
+	/** shape of the first test that has one, the query is the box narrowed to it, none while the sensor sweeps */
+	bool GetSensorTest_QueryShape(FSenseSysQueryShape& OutShape) const;
+
+	/** sensor move since the last update, zero unless bSweptQuery, valid after PreUpdateSensor */
+	const FVector& GetSensorSweep() const { return SensorSweep; }
+	bool IsSweeping() const { return !SensorSweep.IsNearlyZero(); }
 
 	/** Enable-Disable Sensor */
 	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Sensor")
@@ -340,6 +350,18 @@ public:
 	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Sensor")
 	EOnSenseEvent DetectDepth = EOnSenseEvent::SenseForget;
 
+	/** 0 - test all stimuli in the sensor bounds, >0 - test only this count of stimuli nearest to the sensor location */
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Sensor", meta = (ClampMin = "0", UIMin = "0"))
+	int32 NearestStimulusCount = 0;
+
+	/** the query covers the sensor volume since the last update and the location tests follow the move, a fast sensor keeps a low UpdateTimeRate */
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Sensor")
+	bool bSweptQuery = false;
+
+	/** max distance between the locations tested along a move of the sensor or of a swept stimulus */
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Sensor", meta = (ClampMin = "1.0", UIMin = "1.0"))
+	float SweptStepLength = 50.f;
+
 	/** CallStimulusFlag */
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Sensor", meta = (Bitmask, BitmaskEnum = "/Script/SenseSystem.ECallStimulusFlag"))
 	uint8 CallStimulusFlag =										 //
@@ -655,6 +677,19 @@ public:
 	/** Not Thread Safe Main Sensor work implementation */
 	virtual bool UpdateSensor();
 
+	/** sense thread, PreUpdate and the box query the next RunSensorTest would run, false if the sensor can't join a batched tree query */
+	bool PrepareBatchQuery(FBox& OutBox, FVector& OutCenter, float& OutRadius, uint64& OutChannels);
+	/** sense thread, IDs of a batched tree query, used by the next RunSensorTest instead of its own query */
+	void SetBatchIDs(TArray<ElementIndexType>&& InIDs);
+	/** sense thread, the batch holds the remove control mark of the tree until all of its sensors are updated */
+	void SetBatchTreeMarked() { bBatchTreeMarked = true; }
+	void ResetBatchIDs();
+
+	/** game thread, the pending stimulus IDs are moved out while the tree of SensorTag is compacted */
+	TMap<ElementIndexType, uint32> TakePendingUpdate();
+	/** game thread, puts back the IDs of TakePendingUpdate, Remap - new ObjID by old one, null if the tree was not compacted */
+	void RestorePendingUpdate(TMap<ElementIndexType, uint32>&& InPending, const TArray<ElementIndexType>* Remap);
+
 	/**  */
 	virtual void ReportSenseStimulusEvent(USenseStimulusBase* SenseStimulus);
 	virtual void ReportSenseStimulusEvent(ElementIndexType InStimulusID);
@@ -672,6 +707,9 @@ protected:
 
 	virtual bool RunSensorTest();
 
+	/** box or box-radius query of RunSensorTest, Radius 0 for the box only, TreeChannels packed for the tag slot, appends to Out */
+	void QueryBoxCandidates(const IContainerTree& ContainerTree, const FBox& Box, float Radius, uint64 TreeChannels, FSenseSysQueryIDs& Out);
+
 	/** Detect Age for lost sensed */
 	virtual void DetectionLostAndForgetUpdate();
 
@@ -698,12 +736,19 @@ private:
 	template<typename ConType>
 	bool SensorsTestForSpecifyComponents_V3(const IContainerTree* ContainerTree, ConType&& ObjIDs) const;
 	float UpdtDetectPoolAndReturnMinScore() const;
+	/** null if the tree has no snapshot reads, else OutGenerations[i] is the generation of ObjIDs[i] */
+	static TSharedPtr<const FSenseSysReadSnapshot, ESPMode::ThreadSafe> PinTreeSnapshot(
+		const IContainerTree* ContainerTree,
+		const TArray<ElementIndexType>& ObjIDs,
+		TArray<uint32>& OutGenerations);
 	bool UpdtSensorTestForIDInternal(
 		ElementIndexType Idx,
 		const IContainerTree* ContainerTree,
+		const FSenseSysReadSnapshot* Snapshot,
+		uint32 Generation,
 		const float CurrentTime,
 		const float MinScore,
-		TArray<ElementIndexType>& ChannelContainsIDs) const;
+		FChannelIDs& ChannelContainsIDs) const;
 
 public:
 	/** Check Async Sensor Task IsWorkDone */
@@ -715,8 +760,8 @@ public:
 	void ResetInitialization();
 
 private:
-	ESenseTestResult Sensor_Run_Test(float MinScore, const float CurrentTime, FSensedStimulus& Stimulus, TArray<ElementIndexType>& Out) const;
-	void CheckWithCurrent(FSensedStimulus& SS, TArray<ElementIndexType>& Out) const;
+	ESenseTestResult Sensor_Run_Test(float MinScore, const float CurrentTime, FSensedStimulus& Stimulus, FChannelIDs& Out) const;
+	void CheckWithCurrent(FSensedStimulus& SS, FChannelIDs& Out) const;
 
 
 	// NotUProperty
@@ -758,6 +803,40 @@ protected:
 	/** Sensor Critical Section*/
 	mutable FCriticalSection SensorCriticalSection;
 
+	/** PrepareBatchQuery state, only the sense thread touches it */
+	TArray<ElementIndexType> BatchIDs;
+	bool bBatchPreUpdated = false;
+	bool bHaveBatchIDs = false;
+	bool bBatchTreeMarked = false;
+
+	/** RunSensorTest and ReportSenseStimulusEvent candidates, kept between updates so the steady state does not allocate */
+	FSenseSysQueryIDs QueryIDs;
+	/** ordered results of the nearest and segment queries */
+	TArray<ElementIndexType> NearestIDs;
+
+	/** location and test bounds of an update, From - the last finished one, To - the one in progress */
+	struct FSweptVolume
+	{
+		FVector Location = FVector::ZeroVector;
+		FBox Box = FBox(ForceInit);
+	};
+	FSweptVolume SweptFrom;
+	FSweptVolume SweptTo;
+	FVector SensorSweep = FVector::ZeroVector;
+
+	/** last QueryBoxCandidates result, reused while the query is the same and the tree did not change in its box since Stamp */
+	struct FCandidateCache
+	{
+		uint32 TreeSerial = 0;
+		FBox Box = FBox(ForceInit);
+		FVector Center = FVector::ZeroVector;
+		float Radius = 0.f;
+		uint64 Channels = 0;
+		uint64 Stamp = 0;
+		TArray<ElementIndexType> IDs;
+	};
+	FCandidateCache CandidateCache;
+
 	FSimpleDelegateGraphTask::FDelegate PostUpdateDelegate = FSimpleDelegateGraphTask::FDelegate::CreateUObject(this, &USensorBase::PostUpdateSensor);
 };
 
@@ -776,12 +855,16 @@ bool USensorBase::SensorsTestForSpecifyComponents_V3(const IContainerTree* Conta
 	if (LIKELY(SensorTests.Num() != 0))
 	{
 		const float MinScore = UpdtDetectPoolAndReturnMinScore();
-		TArray<ElementIndexType> ChannelContainsIDs;
+		FChannelIDs ChannelContainsIDs;
 		ChannelContainsIDs.Reserve(ChannelSetup.Num());
 
-		for (const ElementIndexType ItID : ObjIDs)
+		//pinned for the whole pass, stimuli are read from it without the tree lock
+		TArray<uint32> Generations;
+		const TSharedPtr<const FSenseSysReadSnapshot, ESPMode::ThreadSafe> Snapshot = PinTreeSnapshot(ContainerTree, ObjIDs, Generations);
+		for (int32 i = 0; i < ObjIDs.Num(); ++i)
 		{
-			if (UpdtSensorTestForIDInternal(ItID, ContainerTree, CurrentTime, MinScore, ChannelContainsIDs))
+			const uint32 Generation = Snapshot.IsValid() ? Generations[i] : 0;
+			if (UpdtSensorTestForIDInternal(ObjIDs[i], ContainerTree, Snapshot.Get(), Generation, CurrentTime, MinScore, ChannelContainsIDs))
 			{
 				break;
 			}
@@ -83,6 +83,7 @@ public:
 
 	virtual FBox GetSensorTestBoundBox() const override { return AABB_Box; }
 	virtual float GetSensorTestRadius() const override { return TmpData.MaxRadius; }
+	virtual bool GetSensorTestShape(FSenseSysQueryShape& OutShape) const override;
 
 protected:
 	virtual void InitializeCacheTest() override;
@@ -93,6 +94,8 @@ private:
 
 	FFrustumTestData TmpData;
 	FBox AABB_Box;
+	/** no planes for FOVAngle 180 and wider */
+	FSenseSysFrustum QueryFrustum;
 
 	FVector TmpSelfForward = FVector::ForwardVector;
 
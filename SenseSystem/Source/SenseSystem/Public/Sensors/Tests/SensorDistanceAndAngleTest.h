@@ -63,6 +63,7 @@ public:
 
 	virtual FBox GetSensorTestBoundBox() const override { return AABB_Box; }
 	virtual float GetSensorTestRadius() const override { return MaxDistanceLost; }
+	virtual bool GetSensorTestShape(FSenseSysQueryShape& OutShape) const override;
 
 protected:
 	virtual ESenseTestResult RunTestForLocation(const FSensedStimulus& SensedStimulus, const FVector& TestLocation, float& ScoreResult) const override;
@@ -70,6 +71,7 @@ protected:
 	virtual void InitializeCacheTest() override;
 
 	FBox AABB_Box;
+	FSenseSysCone QueryCone;
 	FVector::FReal MinDistanceSquared;
 	FVector::FReal MaxDistanceSquared;
 	FVector::FReal MaxDistanceLostSquared;
@@ -39,5 +39,11 @@ protected:
 	/** test for one sensed point */
 	virtual ESenseTestResult RunTestForLocation(const FSensedStimulus& SensedStimulus, const FVector& TestLocation, float& ScoreResult) const;
 
+	/**
+	 * RunTestForLocation along Sweep from TestLocation, the way of the point relative to the sensor since the last update,
+	 * the first location that is not lost gives the result
+	 */
+	ESenseTestResult RunSweptTestForLocation(const FSensedStimulus& SensedStimulus, const FVector& TestLocation, const FVector& Sweep, float& ScoreResult) const;
+
 	FIntPoint GetBoundFotSensePoints(TArray<struct FSensedPoint>& SensedPoints) const;
 };
@@ -0,0 +1,59 @@
+//Copyright 2020 Alexandr Marchenko. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Sensors/Tests/SensorLocationTestBase.h"
+
+#include "SensorRayTest.generated.h"
+
+/**
+ * RayTest, a beam of RayRadius along the sensor forward axis, the tree is walked along the beam only
+ */
+UCLASS(BlueprintType, EditInlineNew)
+class SENSESYSTEM_API USensorRayTest : public USensorLocationTestBase
+{
+	GENERATED_BODY()
+
+public:
+	USensorRayTest(const FObjectInitializer& ObjectInitializer);
+
+#if WITH_EDITORONLY_DATA
+	virtual void DrawTest(const FSceneView* View, FPrimitiveDrawInterface* PDI) const override;
+	virtual void DrawDebug(float Duration) const override;
+#endif
+
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "SensorTest", meta = (ClampMin = "1.0", UIMin = "1.0"))
+	float RayLength = 5000.f;
+
+	/** distance of the sense points from the ray */
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "SensorTest", meta = (ClampMin = "0.0", UIMin = "0.0"))
+	float RayRadius = 10.f;
+
+	/** score falls from 1 at the sensor to 0 at the end of the ray */
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "SensorTest")
+	bool bScoreDistance = false;
+
+	UFUNCTION(BlueprintCallable, Category = "SenseSystem|SensorTest")
+	void SetRayParam(float InRayLength, float InRayRadius);
+
+	virtual EUpdateReady GetReadyToTest() override;
+	virtual bool PreTest() override;
+
+	virtual FBox GetSensorTestBoundBox() const override { return AABB_Box; }
+	virtual float GetSensorTestRadius() const override { return RayLength + RayRadius; }
+	virtual bool GetSensorTestShape(FSenseSysQueryShape& OutShape) const override;
+
+protected:
+	virtual ESenseTestResult RunTestForLocation(const FSensedStimulus& SensedStimulus, const FVector& TestLocation, float& ScoreResult) const override;
+
+	FBox AABB_Box = FBox(FVector::ZeroVector, FVector::ZeroVector);
+	FSenseSysSegment QuerySegment;
+	FVector TmpSelfForward = FVector::ForwardVector;
+};
+
+FORCEINLINE void USensorRayTest::SetRayParam(const float InRayLength, const float InRayRadius)
+{
+	RayLength = InRayLength;
+	RayRadius = InRayRadius;
+}
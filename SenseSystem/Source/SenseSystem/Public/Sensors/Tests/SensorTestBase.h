@@ -78,6 +78,8 @@ public:
 
 	virtual FBox GetSensorTestBoundBox() const { return FBox(FVector::ZeroVector, FVector::ZeroVector); }
 	virtual float GetSensorTestRadius() const { return 0.f; }
+	/** optional cone, frustum or segment inside GetSensorTestBoundBox, the tree skips nodes outside it, valid after PreTest */
+	virtual bool GetSensorTestShape(FSenseSysQueryShape& OutShape) const { return false; }
 
 	/** GetWorld */
 	virtual class UWorld* GetWorld() const override;
@@ -112,6 +114,8 @@ protected:
 	static bool IsStimulusInterface(const AActor* Actor);
 
 	FTransform SensorTransform = FTransform::Identity;
+	/** USensorBase::GetSensorSweep on PreTest */
+	FVector SensorSweep = FVector::ZeroVector;
 
 	// NotUproperty
 	USensorBase* PrivateSensorOwner = nullptr;